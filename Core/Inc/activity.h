@@ -0,0 +1,43 @@
+/*
+ * activity.h
+ *
+ *  Turns the per-window class scores into the reported activity. Raw argmax
+ *  flips on single noisy windows, and every flip was a report on the uplink.
+ *  ACTIVITY_SMOOTHING picks how the windows are combined:
+ *    ACTIVITY_EMA       exponential average of the scores, with a time
+ *                       constant in ms so a shorter stride doesn't make it
+ *                       faster
+ *    ACTIVITY_MAJORITY  votes of the last ACTIVITY_VOTES argmaxes
+ *  The state moves to the leading class only when its smoothed score (or vote
+ *  share) reaches ACTIVITY_CONFIDENCE and the current state has been held for
+ *  ACTIVITY_MIN_DWELL_MS. Activity_Update says when it moved, main.c only
+ *  reports then. Windows that disagreed with the state but didn't move it are
+ *  counted as held.
+ */
+
+#ifndef INC_ACTIVITY_H_
+#define INC_ACTIVITY_H_
+#include "stm32l4xx.h"
+
+//comment out to report the argmax of every window
+#define ACTIVITY_SMOOTH_EN
+#define ACTIVITY_EMA 0
+#define ACTIVITY_MAJORITY 1
+#ifndef ACTIVITY_SMOOTHING
+#define ACTIVITY_SMOOTHING ACTIVITY_EMA
+#endif
+#define ACTIVITY_CLASSES 3 //AI_NETWORK_OUT_1_SIZE
+#define ACTIVITY_TAU_MS 750 //EMA time constant, ~3 windows at the full stride
+#define ACTIVITY_VOTES 7 //a change needs 5 of them at ACTIVITY_CONFIDENCE 0.6
+#define ACTIVITY_CONFIDENCE 0.6f
+#define ACTIVITY_MIN_DWELL_MS 2000
+
+extern volatile uint32_t activityWindows;
+extern volatile uint32_t activityChanges;
+extern volatile uint32_t activityHeld;
+
+void Activity_Init(void);
+int Activity_Update(const float *scores, uint32_t tick);
+int Activity_State(void);
+float Activity_Confidence(void);
+#endif /* INC_ACTIVITY_H_ */
@@ -0,0 +1,62 @@
+/*
+ * classifier.h
+ *
+ *  Activity classifiers on window features (feature_ext.h) as a cheap
+ *  alternative to the CNN. CLASSIFIER picks what classifies the windows:
+ *    CLASSIFIER_CNN     the X-CUBE-AI network (inference.h), as before
+ *    CLASSIFIER_TREES   a small ensemble of decision trees, nodes compared
+ *                       with <= as in the runtime's TreeEnsembleClassifier
+ *    CLASSIFIER_LINEAR  scores = W.features + b, then softmax, as in its
+ *                       LinearClassifier
+ *  Both run in the sampling task right when a window is complete, in tens of
+ *  microseconds against the CNN's milliseconds over 6 layer releases, and
+ *  take a few hundred bytes of tables against 48K of weights and 1.7K of
+ *  activations (Tools/bench has the host cost of both next to the CNN's
+ *  kernels). With CLASSIFIER_COMPARE the CNN runs on the same windows and
+ *  every class it returns is checked against the feature model's, the
+ *  agreement is in the metrics. CLASSIFIER_LOG_FEATURES prints the features
+ *  of every window on the uart; Tools/classifier_fit.c fits both tables to
+ *  such a log with the classes appended, or to a labelled raw trace.
+ *  No recorded trace is in the tree, so the shipped tables are fitted to
+ *  classifier_eval -g 1..5, synthetic gait the CNN (trained on recordings)
+ *  agrees with: on seeds 11..13, not fitted on, trees 100%, linear 99.8%
+ *  (10 of 1368 stationary windows called walking), CNN 98.2% of 4104
+ *  windows. The synthetic classes separate more cleanly than real ones will,
+ *  so refit on a recorded labelled trace and check it with classifier_eval
+ *  before switching CLASSIFIER away from the CNN.
+ */
+
+#ifndef INC_CLASSIFIER_H_
+#define INC_CLASSIFIER_H_
+#include "feature_ext.h"
+
+#define CLASSIFIER_CNN 0
+#define CLASSIFIER_TREES 1
+#define CLASSIFIER_LINEAR 2
+#ifndef CLASSIFIER
+#define CLASSIFIER CLASSIFIER_CNN
+#endif
+//with a feature model selected, run the CNN too and count where the two agree
+//#define CLASSIFIER_COMPARE
+//#define CLASSIFIER_LOG_FEATURES
+#define CLASSIFIER_CLASSES 3 //AI_NETWORK_OUT_1_SIZE, same order as activities[]
+#define CLASSIFIER_LEAF 0xFF
+
+//a leaf has feature CLASSIFIER_LEAF, its class in yes and its vote in threshold
+typedef struct{
+	uint8_t feature;
+	uint8_t yes; //next node when features[feature] <= threshold
+	uint8_t no;
+	float threshold;
+} Classifier_Node;
+
+extern volatile uint32_t classifierWindows;
+extern volatile uint32_t classifierCompared;
+extern volatile uint32_t classifierAgree;
+extern volatile uint32_t classifierLastUs;
+extern volatile uint32_t classifierMaxUs;
+
+uint32_t Classifier_Run(const float *features, float *scores);
+int Classifier_Window(float sampleHz, float *scores, uint32_t *cls);
+void Classifier_Compare(uint32_t cnnClass);
+#endif /* INC_CLASSIFIER_H_ */
@@ -7,39 +7,119 @@
 
 #ifndef SRC_CYCLIC_H_
 #define SRC_CYCLIC_H_
-#define num_tasks 5
+#define TASKS_MAX 16 //registry size, tasks are registered and removed at runtime
 #define TASK_NAME_LEN 20
 #define CYCLIC_MODE_TRIGGER_PIN BUTTON_EXTI13_Pin
 #define setPos(x) __asm__ __volatile__("mov r2,pc\n\tsub r2,4\n\tmov %0,r2":"=r"(pos)::"r2")
 #define jumpPos(x) __asm__ __volatile__("mov pc,%0\n\tnop\n\tnop"::"r"(pos):"pc")
 #define floor(x)(((float)x-(int)(x))>0.0?((int)(x) + 1):(x))
-#define ceil(x) (((float)x-(int)(x))>0.0?((int)(x) - 1):(x))
+#define ceil(x) (((float)(x)-(int)(x))>0.0?((int)(x) + 1):(int)(x))
 #define abs(x) ((x)<0?(-(x)):(x))
 #define MAX_MINOR_CYCLES 200
-#define SHOW_WINDOW 10
-typedef struct minor_cycle
+#define MAX_IDLE_TASKS 4
+#define MAX_APERIODIC_TASKS 4
+#define SLACK_GUARD_US 500 //kept free before the tick for the loop itself and the timer interrupt
+//table preparation runs in slack only when its worst case fits; these until one is measured
+#define PREPARE_BASIC_BUDGET_US 2000
+#define PREPARE_FAST_BUDGET_US 50000 //harmonizeSearch up to HARMONIZE_NODE_LIMIT nodes
+#define PREPARE_REENCODE_BUDGET_US 5000 //a period request in fast mode, no search
+//what the scheduler does when a minor cycle runs past the next tick
+#define OVERRUN_RUN_LATE 0 //start the next minor cycle late (the old behaviour)
+#define OVERRUN_SKIP 1 //drop the late minor cycle and wait for the next tick
+#define OVERRUN_SHED 2 //run only what still fits in the late minor cycle, by priority
+#define OVERRUN_DEGRADE 3 //after OVERRUN_DEGRADE_THRESHOLD overruns in a major cycle fall back to
+                          //basic mode, re-measure, then rebuild the fast table
+#define OVERRUN_DEGRADE_THRESHOLD 3
+#define OVERRUN_DEGRADE_MEASURE 2 //basic major cycles before going back to fast mode
+#define PERIOD_QUANTUM 5
+#define HARMONIZE_NODE_LIMIT 10000
+#define HARMONIZE_MAX_MAJOR 3600000 //ms, larger hyperperiods are never picked
+#if TASKS_MAX <= 8
+typedef unsigned char Task_Mask;
+#elif TASKS_MAX <= 16
+typedef unsigned short Task_Mask;
+#else
+typedef unsigned int Task_Mask;
+#endif
+#define MAX_RUN_REPEAT 255
+//a run of identical minor cycles; bit i of mask releases the task at order[i] of its table.
+//4 bytes with the 16 bit Task_Mask of TASKS_MAX 16, the repeat count and a byte of padding
+typedef struct frame_run
 {
-	int minor_code;
-	//char task_name[num_tasks][TASK_NAME_LEN];
-	int task_code[num_tasks];
-	void (*taskList[num_tasks])(void) ;
-	int n_tasks;
-}Minor_Cycle;
+	Task_Mask mask;
+	unsigned char repeat;
+}Frame_Run;
+typedef struct schedule_table
+{
+	const Frame_Run *runs;
+	unsigned int n_runs;
+	//fixed priority list: execution order inside every minor cycle
+	unsigned char order[TASKS_MAX];
+	unsigned int major_cycle_len;
+	unsigned int minor_cycle_len;
+	unsigned int number_minor_cycle;
+	int mode;
+	//response time analysis, filled in when the table is prepared (analyzeTable)
+	unsigned int wcrt[TASKS_MAX]; //by task code, us from the ideal release n*period to completion
+	unsigned int worstLoad; //us, busiest minor cycle
+	unsigned short overloadFrames; //minor cycles whose tasks don't fit
+	unsigned short deadlineMisses; //tasks whose wcrt exceeds the period
+	unsigned short skippedReleases; //jobs per major cycle the table doesn't run
+	unsigned short earlyReleases; //jobs started before their period point
+}Schedule_Table;
 typedef struct task
 {
 	char task_name[TASK_NAME_LEN];
 	void (*task)(void) ;
 	int period;
+	//requested period and how far (percent) harmonizePeriods may move it
+	int nominal;
+	int tolerance;
 	int execution;
-	int periodSum;
-	int periodNum;
-	int executionSum;
-	int executionNum;
-	int taskTick;
+	//minor cycle of the basic table
+	int basicMinor;
 }Task;
+//aperiodic job served in slack: runs only when its worst case fits before the next tick
+typedef struct aperiodic_task
+{
+	char task_name[TASK_NAME_LEN];
+	void (*task)(void);
+	unsigned int budgetUs; //declared worst case, used until the first run is measured
+	unsigned int intervalMs; //the server releases it itself this often, 0: releaseAperiodicTask only
+	volatile int pending;
+	unsigned int releaseTick;
+	unsigned int runs;
+	unsigned int cancelled; //pending jobs dropped by cancelAperiodicTask
+	unsigned int maxUs;
+	unsigned int worstResponseMs; //release to completion
+}Aperiodic_Task;
 extern volatile int pos;
+extern volatile unsigned int tickCount;
+extern volatile unsigned int tickCycles;
+//measurements by task code, one array per field: the builder and the
+//analysis walk a single field over all tasks
+typedef struct task_stats
+{
+	//DWT, us
+	unsigned int runs[TASKS_MAX];
+	unsigned int lastUs[TASKS_MAX];
+	unsigned int maxUs[TASKS_MAX];
+	unsigned long long sumUs[TASKS_MAX];
+	//basic mode, ms
+	int executionSum[TASKS_MAX];
+	int executionNum[TASKS_MAX];
+	//data ready interrupts (PERIOD_MEASUREMENT)
+	int periodSum[TASKS_MAX];
+	int periodNum[TASKS_MAX];
+	int taskTick[TASKS_MAX];
+}Task_Stats;
 extern volatile int mode;
-extern volatile Task tasks[num_tasks];
+//mode requested by the button, mode follows at the next major cycle boundary
+extern volatile int nextMode;
+extern volatile Task tasks[TASKS_MAX];
+//registered task codes in registration order
+extern unsigned char taskCodes[TASKS_MAX];
+extern int n_tasks;
 extern unsigned int major_cycle_len;
 extern unsigned int minor_cycle_len;
 extern unsigned int major_cycle;
@@ -48,11 +128,37 @@ extern unsigned int number_minor_cycle;
 extern unsigned int system_time;
 extern volatile int changeModeMark;
 extern volatile int tinyTime;
+extern volatile int pendingPeriod[TASKS_MAX];
+extern Task_Stats taskStats;
+extern unsigned int overrunCount;
+extern unsigned int overrunWorstUs;
+extern unsigned int skippedFrames;
+extern unsigned int shedTasks;
+extern unsigned int degradeCount;
+extern Aperiodic_Task aperiodicTasks[MAX_APERIODIC_TASKS];
+extern int n_aperiodic;
 int gcd(int a, int b);
 int lcm(int a,int b);
-void buildFastMatrix(void);
+void buildFastMatrix(Schedule_Table *t, Frame_Run *runs);
+int reencodeFastMatrix(Schedule_Table *t, Frame_Run *runs);
+void useConstTable(const Schedule_Table *t);
 void registerTask(void (*task)(void),char *name,int minor, int index, int code, int period);
+void unregisterTask(int code);
+int taskRegistered(int code);
 void task_scheduler_tick_reset(void);
+void registerIdleTask(void (*task)(int remaining));
+int registerAperiodicTask(void (*task)(void),char *name,unsigned int budgetUs);
+void releaseAperiodicTask(int id);
+void cancelAperiodicTask(int id);
+void setAperiodicInterval(int id, unsigned int intervalMs);
+void requestTaskPeriod(int code, int period);
+int runningPeriod(int code);
+int requestedPeriod(int code);
+void setPeriodTolerance(int code, int percent);
+void harmonizePeriods(unsigned int minMinor);
+void analyzeTable(Schedule_Table *t);
+const Schedule_Table *activeTable(void);
+void setOverrunPolicy(int policy);
 void task_scheduler(void);
 
 void recoverDelayMark(void);
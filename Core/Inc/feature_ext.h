@@ -0,0 +1,38 @@
+/*
+ * feature_ext.h
+ *
+ *  Window statistics of the accelerometer for the feature classifiers
+ *  (classifier.h). Features_Add takes each raw sample (mg) and slides the
+ *  per-axis sums, sums of squares and zero-crossing counts over the last
+ *  FEATURES_WINDOW samples in integers, so they never drift; zero crossings
+ *  are counted on the signal minus a slow running DC estimate, each sample's
+ *  crossing is decided once when it comes in. Features_Get only divides, and
+ *  runs Goertzel over the FEATURES_PEAK_BINS lowest bins of the window for
+ *  the peak frequency. The window is longer than the network's: gait is 1-3 Hz,
+ *  a bin of the 26 sample window is already 4 Hz.
+ */
+
+#ifndef INC_FEATURE_EXT_H_
+#define INC_FEATURE_EXT_H_
+#include "stm32l4xx.h"
+
+#define FEATURES_WINDOW 128 //samples, ~1.2s at 104Hz, 0.8Hz per bin
+#define FEATURES_PEAK_BINS 8 //bins 1..8 searched for the peak, up to ~7Hz
+#define FEATURES_DC_SHIFT 5 //DC estimate follows the signal with 1/32 per sample
+
+//all in g, g^2, crossings per window and Hz
+enum Feature_Index
+{
+	FEAT_MEAN_X, FEAT_MEAN_Y, FEAT_MEAN_Z,
+	FEAT_VAR_X, FEAT_VAR_Y, FEAT_VAR_Z,
+	FEAT_ZC_X, FEAT_ZC_Y, FEAT_ZC_Z,
+	FEAT_ENERGY, //mean of |a|^2, 1 at rest
+	FEAT_PEAK_HZ, //strongest bin summed over the axes, DC left out
+	FEATURES
+};
+
+void Features_Init(void);
+void Features_Add(const int16_t *xyz);
+int Features_Ready(void);
+void Features_Get(float *out, float sampleHz);
+#endif /* INC_FEATURE_EXT_H_ */
@@ -0,0 +1,65 @@
+/*
+ * gate.h
+ *
+ *  Skips the network while the board lies still. Gate_Add follows every
+ *  accelerometer sample with an exponential mean and variance per axis and
+ *  the range of |a| since the last window, in O(1); Gate_Window decides once
+ *  per window whether the network runs or "stationary" is reported at once.
+ *  The gate closes after GATE_ENTER_WINDOWS windows under the lower
+ *  thresholds and opens on the first window over the higher ones, which
+ *  already goes through the network. Every GATE_AUDIT_EVERY-th gated window
+ *  still runs the network: any other class there is a miss and opens the
+ *  gate, so a slow start of motion costs at most that many windows.
+ *  GATE_HW_INACTIVITY adds the LSM6DSL's inactivity detection: after
+ *  GATE_HW_SLEEP_DUR without motion over GATE_HW_THRESHOLD it counts as quiet
+ *  (the part drops to 12.5Hz meanwhile), its wake-up on INT1 opens the gate.
+ *  Tools/gate_replay.c runs recorded traces through this file on the host and
+ *  reports the duty cycle and the windows the gate got wrong. No recording is
+ *  in the tree; on classifier_eval -g 11..13 (18 min, a third each stationary,
+ *  walking, running in 20 s segments) at stride 26 the gate skips 1250 of
+ *  1440 stationary windows (86.8%, the rest are the GATE_ENTER_WINDOWS after
+ *  each stop and the audits), the network runs on 71.1% of all windows, and
+ *  0 of 2880 moving windows are gated (36 audits, 0 misses); stride 13 gives
+ *  70.5% and 0 of 5760. The duty cycle is about 1 - 0.87 x the stationary
+ *  share, 22% for a board that lies still 90% of the time. Those onsets are
+ *  abrupt (0.8 g and more at once); a slow start on a real trace can stay
+ *  gated for up to GATE_AUDIT_EVERY windows.
+ */
+
+#ifndef INC_GATE_H_
+#define INC_GATE_H_
+#include "stm32l4xx.h"
+
+//comment out to run the network on every window
+#define GATE_EN
+#define GATE_VAR_ENTER 100.0f //mg^2 summed over the axes, ~6mg rms per axis
+#define GATE_VAR_EXIT 400.0f
+#define GATE_RANGE_ENTER 40 //mg, max-min of |a| within a window
+#define GATE_RANGE_EXIT 80
+#define GATE_ENTER_WINDOWS 4
+#define GATE_AUDIT_EVERY 32 //gated windows between network runs, 0 never
+#define GATE_EMA_SHIFT 4 //mean and variance follow with 1/16 per sample
+#define GATE_STATIONARY 0 //class reported for gated windows, activities[0]
+//#define GATE_HW_INACTIVITY
+#define GATE_HW_THRESHOLD 2 //WAKE_UP_THS, FS/64 per LSB: 62mg at +-2g
+#define GATE_HW_SLEEP_DUR 1 //WAKE_UP_DUR, 512/ODR per LSB: ~5s at 104Hz
+
+typedef enum{
+	GATE_RUN = 0, //network
+	GATE_SKIP, //report GATE_STATIONARY
+	GATE_AUDIT //network while gated, hand its class to Gate_Result
+} Gate_DecisionTypeDef;
+
+extern volatile uint32_t gateRun;
+extern volatile uint32_t gateSkipped;
+extern volatile uint32_t gateAudits;
+extern volatile uint32_t gateMisses;
+extern volatile uint32_t gateOpenings;
+
+void Gate_Init(void);
+void Gate_Add(const int16_t *xyz);
+Gate_DecisionTypeDef Gate_Window(void);
+void Gate_Result(uint32_t cls);
+int Gate_Closed(void);
+void Gate_HwEvent(void);
+#endif /* INC_GATE_H_ */
@@ -0,0 +1,44 @@
+/*
+ * imu_stream.h
+ *
+ *  Raw accelerometer samples batched into UDP datagrams. Open the socket with
+ *  hwifi.transportProtocol = WIFI_UDP_PROTOCOL, then push one sample per
+ *  taskAcc run; a datagram goes out when the batch is full or on IMU_Stream_Flush.
+ *
+ *  Datagram layout, all fields big-endian like the WIFI_SendStr length prefix:
+ *    0  'I' 'M'       magic
+ *    2  version       IMU_STREAM_VERSION
+ *    3  channels      int16 values per sample
+ *    4  seq           u32, +1 per datagram, also for the ones that failed to send
+ *    8  t0            u32, HAL tick (ms) of the first sample
+ *    12 span          u16, ms between the first and the last sample
+ *    14 count         u16, number of samples
+ *    16 samples       count*channels int16 (raw mg from BSP_ACCELERO_AccGetXYZ)
+ *
+ *  Tools/udp_receiver.c on the host reports loss, reordering and samples/s.
+ */
+
+#ifndef INC_IMU_STREAM_H_
+#define INC_IMU_STREAM_H_
+#include "wifi.h"
+
+#define IMU_STREAM_VERSION 1
+#define IMU_STREAM_HEADER_SIZE 16
+#define IMU_STREAM_CHANNELS 3
+//largest batch that still fits one S3 payload
+#define IMU_STREAM_MAX_BATCH ((WIFI_MAX_SEND_SIZE-IMU_STREAM_HEADER_SIZE)/(IMU_STREAM_CHANNELS*2))
+#define IMU_STREAM_BATCH IMU_STREAM_MAX_BATCH
+
+typedef struct{
+	uint32_t seq; //next sequence number
+	uint32_t datagrams; //sent without a module error
+	uint32_t sendErrors; //datagrams the module refused, seen as loss on the host
+	uint32_t samples; //samples handed to the module
+} IMU_StreamStatsTypeDef;
+
+void IMU_Stream_Init(WIFI_HandleTypeDef* hwifi);
+WIFI_StatusTypeDef IMU_Stream_Push(const int16_t *xyz, uint32_t tick);
+WIFI_StatusTypeDef IMU_Stream_Flush(void);
+uint16_t IMU_Stream_Pending(void);
+const IMU_StreamStatsTypeDef* IMU_Stream_Stats(void);
+#endif /* INC_IMU_STREAM_H_ */
@@ -0,0 +1,32 @@
+/*
+ * inference.h
+ *
+ *  The network as a scheduler task of its own: a full window is written into
+ *  the network input (Inference_Input, it lives in the activations buffer)
+ *  and queued by Inference_Start, then Inference_Step runs one layer per
+ *  release, walking the node chain of the generated network. The sampling
+ *  task only fills windows, so it keeps its period whatever the model costs;
+ *  a window that comes while the previous one is still in the network is
+ *  dropped and counted. New weights (weights.h) are taken in by
+ *  Inference_Input, between two windows.
+ */
+
+#ifndef INC_INFERENCE_H_
+#define INC_INFERENCE_H_
+#include "stm32l4xx_hal.h"
+#include "network.h"
+
+#define INFERENCE_PERIOD 20 //ms between layers, 6 layers well inside a 26 sample window at 104Hz
+
+//called from Inference_Step once the last layer ran; us is the compute time summed over the layers
+typedef void (*Inference_Callback)(const float *out, uint32_t cls, uint32_t us);
+
+extern volatile uint32_t inferenceDropped;
+void Inference_Init(Inference_Callback done);
+float *Inference_Input(void);
+void Inference_Start(void);
+int Inference_Busy(void);
+void Inference_SetWeights(const void *weights);
+int Inference_SwapPending(void);
+void Inference_Step(void);
+#endif /* INC_INFERENCE_H_ */
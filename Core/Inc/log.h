@@ -0,0 +1,24 @@
+/*
+ * log.h
+ *
+ *  Deferred uart log: Log_Printf only copies the line into a ring buffer,
+ *  Log_Drain (an idle task) sends as much of it as fits in the slack left in
+ *  the minor cycle. Lines that don't fit in the ring are dropped whole and
+ *  counted. Main loop only, not for interrupt handlers.
+ */
+
+#ifndef INC_LOG_H_
+#define INC_LOG_H_
+#include "stm32l4xx_hal.h"
+
+#define LOG_BUFFER_SIZE 2048
+#define LOG_LINE_SIZE 128
+#define LOG_UART_BYTES_PER_MS 11 //115200 8N1
+
+extern volatile uint32_t logDropped;
+int Log_Write(const char *s, int len);
+int Log_Printf(const char *fmt, ...);
+uint16_t Log_Free(void);
+uint16_t Log_Pending(void);
+void Log_Drain(int remaining);
+#endif /* INC_LOG_H_ */
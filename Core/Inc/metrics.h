@@ -0,0 +1,35 @@
+/*
+ * metrics.h
+ *
+ *  Pull based metrics: an HTTP/1.0 server on its own module socket answers
+ *  any GET with a Prometheus style text exposition of the scheduler, link and
+ *  inference counters. Requests are handled one step per run of the periodic
+ *  task METRICS (read the request, then one S3 chunk per run), so the table
+ *  budgets the step like any task and a scrape never delays one. The price is
+ *  latency: a step per period, the request waits up to one period for the
+ *  read, then the response takes ceil(size/WIFI_MAX_SEND_SIZE) more. At the
+ *  default 1000 ms that is up to 8 s for a full METRICS_RESPONSE_SIZE, within
+ *  Prometheus' 10 s default scrape timeout; in basic mode a task runs once per
+ *  1500 ms major cycle, up to 12 s. The last classes are ca3_class{age,label}
+ *  with the class index as value, and ca3_class_tick_ms{age} with its HAL tick.
+ *
+ *    curl http://<node ip>/metrics
+ */
+
+#ifndef INC_METRICS_H_
+#define INC_METRICS_H_
+#include "wifi.h"
+
+#define METRICS_SOCKET 1 //socket 0 is the uplink
+#define METRICS_PORT 80
+#define METRICS_LAST_CLASSES 8
+#define METRICS_POLL_INTERVAL 1000 //ms, the period METRICS is registered with
+#define METRICS_HEADER_ROOM 128
+#define METRICS_RESPONSE_SIZE 8192 //per task, stack and pool series included
+#define METRICS_REQUEST_SIZE 256
+
+extern volatile uint32_t i2cErrors;
+void Metrics_Init(WIFI_HandleTypeDef* hwifi, const char* const* classNames, uint8_t nClasses);
+void Metrics_RecordInference(uint32_t us, uint8_t cls);
+void Metrics_Poll(void);
+#endif /* INC_METRICS_H_ */
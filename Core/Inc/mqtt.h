@@ -0,0 +1,56 @@
+/*
+ * mqtt.h
+ *
+ *  MQTT 3.1.1 publish path on top of the es-wifi socket.
+ *  Broker, topics, client id, keep alive, qos and credentials come from
+ *  hwifi->mqtt (WIFI_MQTTTypeDef). For a bench test point the node at a local
+ *  broker (mosquitto -v) and watch with mosquitto_sub -t '<publishTopic>/#' -v.
+ *  Only MQTT_Connect waits for the broker. A qos 1 publish is sent and kept in
+ *  one of MQTT_INFLIGHT slots. MQTT_PublishSensors starts by taking the
+ *  PUBACKs that came in since the last report (MQTT_Poll, one R0 that doesn't
+ *  wait) and sending what is still unacked again with DUP set (MQTT_Resend),
+ *  up to MQTT_RETRIES times, so a slow broker costs the report task one read
+ *  instead of a wait per message. The acks aren't read in slack: an R0 with
+ *  the NSS delays takes longer than the slack of a fast table. When the
+ *  connect fails the publishes return WIFI_ERROR without touching the socket;
+ *  opening it again blocks on the module's P6 and is left to a reset.
+ */
+
+#ifndef INC_MQTT_H_
+#define INC_MQTT_H_
+#include "wifi.h"
+
+#define MQTT_PACKET_SIZE 512
+#define MQTT_ACK_TIMEOUT 500 //ms, how long the module waits for the CONNACK
+#define MQTT_POLL_TIMEOUT 1 //ms, MQTT_Poll only takes what is already there
+#define MQTT_RETRIES 2 //qos1 re-sends (DUP set) before giving up on a PUBACK
+
+//payload encodings for MQTT_PublishSensors
+#define MQTT_PAYLOAD_JSON 0
+#define MQTT_PAYLOAD_CBOR 1
+#define MQTT_PAYLOAD_FORMAT MQTT_PAYLOAD_JSON
+//uncomment to publish every reading to its own "<publishTopic>/<sensor>" topic
+//instead of one batched document on publishTopic
+//#define MQTT_TOPIC_PER_SENSOR
+#ifdef MQTT_TOPIC_PER_SENSOR
+#define MQTT_PER_REPORT 3
+#else
+#define MQTT_PER_REPORT 1
+#endif
+//unacked qos1 publishes: a report's lives through MQTT_RETRIES more reports;
+//(6+MQTT_INFLIGHT_SIZE) B each, 498 B batched
+#define MQTT_INFLIGHT (MQTT_PER_REPORT*(MQTT_RETRIES+1))
+#define MQTT_INFLIGHT_SIZE 160 //bytes kept per publish for the re-send, the node info fits; longer ones are sent once
+
+//qos1 publishes given up on: no PUBACK after MQTT_RETRIES re-sends, or pushed
+//out of a full in-flight store
+extern volatile uint32_t mqttLost;
+WIFI_StatusTypeDef MQTT_Connect(WIFI_HandleTypeDef* hwifi, char *ip, char *port);
+WIFI_StatusTypeDef MQTT_Publish(WIFI_HandleTypeDef* hwifi, const char *topic, const uint8_t *payload, uint16_t len, uint8_t qos);
+WIFI_StatusTypeDef MQTT_PublishSensors(WIFI_HandleTypeDef* hwifi, const char *state, float temp, float humi);
+WIFI_StatusTypeDef MQTT_Poll(WIFI_HandleTypeDef* hwifi);
+WIFI_StatusTypeDef MQTT_Resend(WIFI_HandleTypeDef* hwifi);
+int MQTT_InFlight(void);
+WIFI_StatusTypeDef MQTT_KeepAlive(WIFI_HandleTypeDef* hwifi);
+WIFI_StatusTypeDef MQTT_Disconnect(WIFI_HandleTypeDef* hwifi);
+#endif /* INC_MQTT_H_ */
@@ -0,0 +1,49 @@
+/*
+ * pipeline.h
+ *
+ *  Assembles the network input from the sensors. Each sensor task hands its
+ *  latest raw sample to Pipeline_Put (accelerometer mg, gyro mdps,
+ *  magnetometer mgauss, as the BSP returns them); the accelerometer clocks
+ *  the window: Pipeline_Frame takes one value per model channel, the other
+ *  sensors' as last put (sample and hold, their age is in the metrics), and
+ *  writes (raw - offset) * scale into a ring of PIPELINE_FRAMES frames,
+ *  channels last. Which sensor axis feeds which channel, and its offset and
+ *  scale, is the model's input metadata in pipeline.c; it has to match what
+ *  the network was trained on and AI_NETWORK_IN_1_CHANNEL. Pipeline_Copy
+ *  puts the window, oldest frame first, straight into the network input
+ *  (Inference_Input), the one copy between the sensors and the network.
+ *  A gyro or magnetometer channel needs its task at the accelerometer's
+ *  period in the task table, otherwise a value is held over several frames.
+ */
+
+#ifndef INC_PIPELINE_H_
+#define INC_PIPELINE_H_
+#include "stm32l4xx.h"
+#include "network.h"
+
+#define PIPELINE_FRAMES AI_NETWORK_IN_1_HEIGHT
+#define PIPELINE_CHANNELS AI_NETWORK_IN_1_CHANNEL
+
+typedef enum{
+	PIPELINE_ACC = 0, //the clock
+	PIPELINE_GYRO,
+	PIPELINE_MAG,
+	PIPELINE_SENSORS
+} Pipeline_SensorTypeDef;
+
+typedef struct{
+	uint8_t sensor; //Pipeline_SensorTypeDef
+	uint8_t axis; //0 x, 1 y, 2 z
+	float offset; //raw units
+	float scale;
+} Pipeline_ChannelTypeDef;
+
+extern volatile uint32_t pipelineFrames;
+//oldest held value a frame used, per sensor, ms
+extern volatile uint32_t pipelineMaxAgeMs[PIPELINE_SENSORS];
+
+void Pipeline_Put(Pipeline_SensorTypeDef sensor, float x, float y, float z, uint32_t tick);
+int Pipeline_Frame(uint32_t tick, uint32_t stride);
+void Pipeline_Copy(float *input);
+int Pipeline_Uses(Pipeline_SensorTypeDef sensor);
+#endif /* INC_PIPELINE_H_ */
@@ -0,0 +1,34 @@
+/*
+ * placement.h
+ *
+ *  Where code and data go besides flash and the main SRAM (RAM, 96K, shared
+ *  with the heap and the thread stack):
+ *    RAM2_BSS   SRAM2 (RAM2, 32K at 0x10000000), zeroed at startup: buffers
+ *               the inference and the interrupt handlers work on
+ *    RAM2_DATA  SRAM2, initialized from flash
+ *    RAM2_FUNC  code copied to SRAM2, fetched over the I-code bus without
+ *               flash wait states or contention with the data in RAM
+ *    RAM_FUNC   code copied to RAM with .data, the HAL's __RAM_FUNC section
+ *  The network's own kernels (conv1d, dense, relu, softmax) are picked out of
+ *  the AI runtime library by name in STM32L475VGTX_FLASH.ld.
+ *  SRAM2 at 0x10000000 is out of the DMA's reach: DMA buffers stay in RAM.
+ */
+
+#ifndef INC_PLACEMENT_H_
+#define INC_PLACEMENT_H_
+
+#ifdef __arm__
+#define RAM2_BSS __attribute__((section(".ram2_bss")))
+#define RAM2_DATA __attribute__((section(".ram2_data")))
+//flash and SRAM2 are further apart than a bl reaches, the linker adds veneers for callers in other files
+#define RAM2_FUNC __attribute__((section(".ram2_func"), long_call, noinline))
+#define RAM_FUNC __attribute__((section(".RamFunc"), long_call, noinline))
+#else
+//host builds (Tools/bench, Tools/emu) link everything the usual way
+#define RAM2_BSS
+#define RAM2_DATA
+#define RAM2_FUNC
+#define RAM_FUNC
+#endif
+
+#endif /* INC_PLACEMENT_H_ */
@@ -0,0 +1,44 @@
+/*
+ * pool.h
+ *
+ *  Scratch blocks for formatting and I/O instead of text buffers on the
+ *  stack. Each pool is a fixed number of same size blocks in .bss, so the RAM
+ *  they take is known at link time; Pool_Get and Pool_Put are O(1) on a free
+ *  bitmap and callable from interrupts. A block remembers who took it, giving
+ *  back a block that isn't taken or belongs to someone else is refused and
+ *  counted. Nobody waits for a block: a full pool returns NULL, the caller
+ *  skips its output and the failure shows up in the metrics.
+ */
+
+#ifndef INC_POOL_H_
+#define INC_POOL_H_
+#include "stm32l4xx.h"
+
+#define POOL_TEXT_SIZE 128 //one uart or log line
+#define POOL_TEXT_BLOCKS 4
+#define POOL_IO_SIZE 1024 //a table dump line, a module answer
+#define POOL_IO_BLOCKS 2
+
+typedef struct pool
+{
+	const char *name;
+	uint8_t *mem;
+	const char **owner; //per block, NULL while free
+	uint16_t blockSize;
+	uint8_t blocks; //at most 32
+	uint32_t freeMask;
+	uint8_t used;
+	uint8_t peak;
+	uint32_t gets;
+	uint32_t failures;
+	uint32_t badPuts;
+}Pool;
+
+extern Pool textPool;
+extern Pool ioPool;
+extern Pool* const pools[];
+extern const int n_pools;
+
+void *Pool_Get(Pool *pool, const char *owner);
+void Pool_Put(Pool *pool, void *block, const char *owner);
+#endif /* INC_POOL_H_ */
@@ -0,0 +1,89 @@
+/*
+ * remote.h
+ *
+ *  Binary command channel on the uplink socket, polled with R0 by the periodic
+ *  task REMOTE every REMOTE_POLL_INTERVAL (tolerance 50%). Being in the table,
+ *  the poll is measured in basic mode and budgeted by the fast table like any
+ *  task: its R0 with the NSS delays sets a floor on the fast minor cycle, and
+ *  analyzeTable's skipped releases show what that costs the short-period tasks.
+ *  The period can be changed with REMOTE_SET_PERIOD like any other. Frames in
+ *  both directions:
+ *    command: 0xA5 cmd seq len payload[len] xor
+ *    ack:     4 byte length (as WIFI_SendStr), 0x5A cmd seq status len payload[len] xor
+ *  xor covers everything from cmd to the last payload byte. Multi-byte fields
+ *  are big-endian. A period change is built into the spare table in slack and
+ *  switched to at the next major cycle boundary, the running table goes on
+ *  meanwhile; in fast mode a period change alone is re-encoded around the
+ *  current harmonized periods without the period search (reencodeFastMatrix).
+ *
+ *    REMOTE_SET_PERIOD  u8 task code, u16 period ms; the ack carries u16 the
+ *                       period running now (0 in basic mode, which doesn't
+ *                       follow periods) and u16 the requested one
+ *    REMOTE_SET_ODR     u8 sensor (ACCELERO/TEMP/HUMI), u16 rate in 0.1Hz;
+ *                       the ack carries the rate actually set
+ *    REMOTE_SET_REPORT  u8 n, send every n-th message task run
+ *    REMOTE_SET_STRIDE  u8 samples the inference window advances by
+ *    REMOTE_GET_CONFIG  ack carries running[TASKS_MAX] and requested[TASKS_MAX]
+ *                       (u16 ms by task code, as runningPeriod/requestedPeriod
+ *                       in cyclic.h), report, stride. A change is applied once
+ *                       the running period follows the requested one (within
+ *                       the task's tolerance, rounded to PERIOD_QUANTUM)
+ *    REMOTE_TRACE       u8 0 dump the scheduler trace over the uart, 1 on this
+ *                       socket (text frames, see trace.h), one frame per poll
+ *                       in place of the read: up to 14 polls for a full ring,
+ *                       commands sent meanwhile are read after it
+ *    REMOTE_WEIGHTS_BEGIN  u32 size, u32 crc, u32 version: start a weights
+ *                       download into the free slot (weights.h); ack u8 slot
+ *    REMOTE_WEIGHTS_DATA   u32 offset, up to REMOTE_WEIGHTS_CHUNK bytes; offset
+ *                       and length multiples of 8
+ *    REMOTE_WEIGHTS_COMMIT check the crc and switch the network over at its next
+ *                       window; ack u8 slot, u32 version
+ *    REMOTE_GET_WEIGHTS ack u8 active slot (0xFF built in), u32 version,
+ *                       u8 1 while a download is open
+ *  A poll takes in at most REMOTE_RX_SIZE, so a download goes at 3 chunks per
+ *  poll, 384 B/s at the default period (about 2 minutes for the 48 KB of the
+ *  network); shorten REMOTE's period for the download if that is too slow.
+ *  Send a chunk after the previous one's ack, or keep a few in flight within
+ *  REMOTE_RX_SIZE.
+ */
+
+#ifndef INC_REMOTE_H_
+#define INC_REMOTE_H_
+#include "wifi.h"
+
+#define REMOTE_SYNC_CMD 0xA5
+#define REMOTE_SYNC_ACK 0x5A
+#define REMOTE_WEIGHTS_CHUNK 128
+#define REMOTE_MAX_PAYLOAD (4+REMOTE_WEIGHTS_CHUNK) //REMOTE_WEIGHTS_DATA
+#define REMOTE_MAX_ACK (4*TASKS_MAX+2) //TASKS_MAX from cyclic.h, for REMOTE_GET_CONFIG
+#define REMOTE_RX_SIZE 512 //3 weights chunks
+#define REMOTE_POLL_INTERVAL 1000 //ms, the period REMOTE is registered with
+
+#define REMOTE_SET_PERIOD 0x01
+#define REMOTE_SET_ODR    0x02
+#define REMOTE_SET_REPORT 0x03
+#define REMOTE_SET_STRIDE 0x04
+#define REMOTE_GET_CONFIG 0x05
+#define REMOTE_TRACE      0x06
+#define REMOTE_WEIGHTS_BEGIN  0x07
+#define REMOTE_WEIGHTS_DATA   0x08
+#define REMOTE_WEIGHTS_COMMIT 0x09
+#define REMOTE_GET_WEIGHTS    0x0A
+
+#define REMOTE_OK          0x00
+#define REMOTE_ERR_CMD     0x01
+#define REMOTE_ERR_ARG     0x02
+#define REMOTE_ERR_CHECK   0x03 //frame checksum, or the weights crc on REMOTE_WEIGHTS_COMMIT
+#define REMOTE_ERR_BUSY    0x04
+#define REMOTE_ERR_FLASH   0x05
+
+typedef struct{
+	uint8_t reportDivider;
+	uint8_t inferenceStride;
+} Remote_ConfigTypeDef;
+
+extern volatile Remote_ConfigTypeDef remoteConfig;
+void Remote_Init(WIFI_HandleTypeDef* hwifi, uint8_t window);
+void Remote_Poll(void);
+uint16_t Remote_Pending(void);
+#endif /* INC_REMOTE_H_ */
@@ -17,6 +17,8 @@ void lps22hb_dready_en(void);
 void lps22hb_dready_dis(void);
 void hts221_dready_en(void);
 void hts221_dready_dis(void);
+int lsm6dsl_acc_odr_set(int odr);
+int hts221_odr_set(int odr);
 int convert(float data,int integer[],int floating[]);
 //enum Sensor_Index
 //{
@@ -34,6 +36,13 @@ enum Sensor_Index
 	TEMP,
 	HUMI,
 	WIFI,
-	TIME
+	TIME,
+	INFER,
+	GYRO,
+	MEGNETO,
+	PIEZO,
+	//not sensors: the wifi pollers, periodic tasks so the fast table budgets them
+	REMOTE,
+	METRICS
 };
 #endif
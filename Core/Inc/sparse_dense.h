@@ -0,0 +1,63 @@
+/*
+ * sparse_dense.h
+ *
+ *  Block-sparse kernel for the network's big dense layer (dense_dense, 176 in
+ *  64 out: 45K of the 48K of weights and about half the MACCs). The weight
+ *  matrix is cut into blocks of SPARSE_BLOCK consecutive outputs by one
+ *  input, Tools/prune_dense.c drops the blocks with the smallest norm down to
+ *  a given sparsity and writes what is left as Core/Src/sparse_dense_table.c:
+ *  per group of SPARSE_BLOCK outputs the input index of every kept block and
+ *  its SPARSE_BLOCK weights, so one input load feeds four accumulators. With
+ *  SPARSE_DENSE_EN, Sparse_Install puts the kernel in place of forward_dense
+ *  on that layer; it reads the same input, bias and output tensors, the rest
+ *  of the network doesn't change. The table carries a hash of the dense
+ *  weights it was pruned from; any other weights (a download, weights.h) keep
+ *  forward_dense.
+ *  The table saves time, not flash: the dense matrix stays in
+ *  s_network_weights_array_u64 for that fallback, so SPARSE_DENSE_EN makes
+ *  the image bigger by the table, +24010 B at 50%, +12042 at 75%, +4868 at
+ *  90% (plus the kernel's code). SPARSE_DENSE_STRIP makes it smaller: the
+ *  tool's -p writes the weights without the 45056 B of that matrix as
+ *  Core/Src/sparse_dense_weights.c, the network is bound to them in place of
+ *  s_network_weights_array_u64 (which then drops out of the link) and the
+ *  image shrinks by 21042, 33010 and 40184 B. With no dense rows to hash the
+ *  stripped weights store the hash they had, the table must carry the same
+ *  one or the network doesn't start; a full weights download still gets
+ *  the hash check and forward_dense when it differs. The tool prints both
+ *  deltas, host latency and the error against the dense layer at 50, 75 and
+ *  90% (-r).
+ */
+
+#ifndef INC_SPARSE_DENSE_H_
+#define INC_SPARSE_DENSE_H_
+#include "network.h"
+#include "core_common.h"
+
+//needs Core/Src/sparse_dense_table.c from Tools/prune_dense.c
+//#define SPARSE_DENSE_EN
+//with SPARSE_DENSE_EN, needs Core/Src/sparse_dense_weights.c from the same run (-p)
+//#define SPARSE_DENSE_STRIP
+#define SPARSE_BLOCK 4
+
+typedef struct{
+	uint16_t rows; //outputs, a multiple of SPARSE_BLOCK
+	uint16_t cols; //inputs, up to 256
+	uint16_t blocks;
+	uint32_t hash; //Sparse_Hash of the dense rows x cols weights
+	const uint16_t *rowStart; //rows/SPARSE_BLOCK+1 offsets into col
+	const uint8_t *col; //input of each block
+	const float *values; //SPARSE_BLOCK per block, output order
+} Sparse_TableTypeDef;
+
+extern const Sparse_TableTypeDef sparseDenseTable;
+extern volatile int sparseDenseActive;
+#ifdef SPARSE_DENSE_STRIP
+//the weights in the image without dense_dense's matrix, and the hash it had
+extern const ai_u64 sparseDenseWeights[];
+extern const uint32_t sparseDenseWeightsHash;
+#endif
+
+void Sparse_Dense(const Sparse_TableTypeDef *table, const float *in, const float *bias, float *out);
+uint32_t Sparse_Hash(const float *weights, uint32_t count);
+int Sparse_Install(ai_node *first, const void *weights);
+#endif /* INC_SPARSE_DENSE_H_ */
@@ -0,0 +1,55 @@
+/*
+ * stackmon.h
+ *
+ *  Stack high-water marks on the board. StackMon_Init moves the handlers to
+ *  their own STACK_ISR_SIZE stack in SRAM2 (MSP) and leaves main and the tasks
+ *  on the stack under _estack (PSP), then paints the free part of both.
+ *  Around every task run and every instrumented handler the part of the
+ *  window below the stack pointer that the last run dirtied is painted again
+ *  and scanned from the bottom afterwards, which gives the bytes that run
+ *  needed. A task's mark includes the exception frames of interrupts taken
+ *  while it ran, a handler's mark includes the handlers nested in it.
+ *  _sbrk keeps the heap STACK_HEAP_GUARD below the deepest point the thread
+ *  stack reached. Tools/stackcheck.c is the static counterpart.
+ */
+
+#ifndef INC_STACKMON_H_
+#define INC_STACKMON_H_
+#include "stm32l4xx.h"
+
+//comment out to compile the hooks away and keep a single stack
+#define STACK_MONITOR_EN
+#define STACK_ISR_SIZE 2048 //bytes, multiple of 8
+#define STACK_TASK_WINDOW 4096 //bytes below runTask painted per task run
+#define STACK_ISR_WINDOW 512 //bytes below the handler entry painted per interrupt
+#define STACK_HEAP_GUARD 256 //bytes _sbrk leaves below the deepest stack seen
+#define STACK_PAINT 0xA5A5A5A5
+#define STACK_IRQS (16+FPU_IRQn+1) //core exceptions, then the L475's irqs
+
+#ifdef STACK_MONITOR_EN
+#define STACK_TASK_START() StackMon_TaskStart()
+#define STACK_TASK_END(code) StackMon_TaskEnd(code)
+#define STACK_ISR_ENTER(irq) StackMon_IsrEnter(irq)
+#define STACK_ISR_EXIT(irq) StackMon_IsrExit(irq)
+#else
+#define STACK_TASK_START()
+#define STACK_TASK_END(code)
+#define STACK_ISR_ENTER(irq)
+#define STACK_ISR_EXIT(irq)
+#endif
+
+//bytes, the deepest run seen
+extern uint16_t stackTaskMax[];
+extern uint16_t stackIsrMax[STACK_IRQS];
+//runs that reached the bottom of their window, their mark is a lower bound
+extern uint32_t stackWindowFull;
+
+void StackMon_Init(void);
+void StackMon_TaskStart(void);
+void StackMon_TaskEnd(int code);
+void StackMon_IsrEnter(IRQn_Type irq);
+void StackMon_IsrExit(IRQn_Type irq);
+uint32_t StackMon_ThreadFree(void);
+uint32_t StackMon_IsrFree(void);
+char *StackMon_Limit(void);
+#endif /* INC_STACKMON_H_ */
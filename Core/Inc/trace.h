@@ -0,0 +1,65 @@
+/*
+ * trace.h
+ *
+ *  Flight recorder for the scheduler: a RAM ring of 8 byte records (DWT
+ *  cycle stamp, event, id, argument), the oldest overwritten first. Trace_Dump
+ *  freezes it and it goes out as text lines: over the deferred uart log from
+ *  Trace_Poll (an idle task), or on the uplink socket one frame per call of
+ *  Trace_SendFrame, which the command poll (remote.c) makes in place of its
+ *  read so the S3 is budgeted in the table and never waits for slack:
+ *    TC <core clock hz>
+ *    TN <code> <task name>        TA <id> <aperiodic job name>
+ *    TR <cycles> <event> <id> <arg>    (hex)
+ *  Tools/trace2json.c turns a capture of either into Chrome trace JSON
+ *  (chrome://tracing, ui.perfetto.dev).
+ */
+
+#ifndef INC_TRACE_H_
+#define INC_TRACE_H_
+#include "wifi.h"
+
+//comment out to compile every TRACE() away
+#define TRACE_EN
+//the first overrun freezes the ring and dumps it over the uart, once
+#define TRACE_DUMP_ON_OVERRUN
+#define TRACE_RECORDS 512 //power of 2, 4KB
+#define TRACE_FRAME_SIZE 1000 //text per uplink frame, 14 frames for a full ring
+
+//id: task code, irq number, layer, idle index; 0 when not listed
+enum Trace_Event
+{
+	TRACE_TICK, //arg: minor cycle counter
+	TRACE_TASK_START,
+	TRACE_TASK_STOP,
+	TRACE_ISR_ENTER,
+	TRACE_ISR_EXIT,
+	TRACE_WIFI_START, //arg: the command's first two characters
+	TRACE_WIFI_END,
+	TRACE_INFER_START,
+	TRACE_INFER_END,
+	TRACE_SLACK_START, //id: idle task index, or TRACE_APERIODIC|job
+	TRACE_SLACK_END,
+	TRACE_OVERRUN //arg: lateness in us, saturated
+};
+#define TRACE_APERIODIC 0x80
+
+typedef struct trace_record
+{
+	uint32_t cycles;
+	uint8_t event;
+	uint8_t id;
+	uint16_t arg;
+}Trace_Record;
+
+#ifdef TRACE_EN
+#define TRACE(event,id,arg) Trace_Event((event),(id),(arg))
+#else
+#define TRACE(event,id,arg)
+#endif
+
+void Trace_Event(uint8_t event, uint8_t id, uint16_t arg);
+void Trace_Dump(WIFI_HandleTypeDef* hwifi);
+int Trace_Dumping(void);
+void Trace_Poll(int remaining);
+int Trace_SendFrame(void);
+#endif /* INC_TRACE_H_ */
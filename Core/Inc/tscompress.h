@@ -0,0 +1,65 @@
+/*
+ * tscompress.h
+ *
+ *  Streaming compressor for one sensor series (timestamp, float value):
+ *  delta-of-delta timestamps and Gorilla style XOR floats, written MSB first
+ *  into a caller owned buffer. An append that could overflow the buffer is
+ *  refused, so the encoder never needs more RAM than the buffer it was given.
+ *  No HAL dependency, the same file builds the decoder on the host
+ *  (Tools/ts_bench.c, Tools/tsc_dump.c).
+ *
+ *  Block layout: u16 sample count (big-endian), then the bit stream.
+ *  First sample: 32 bit timestamp, 32 bit value. Every later sample:
+ *    dod = (t - tPrev) - deltaPrev
+ *      '0'                    dod == 0
+ *      '10'   + 7 bits        -64..63
+ *      '110'  + 9 bits        -256..255
+ *      '1110' + 12 bits       -2048..2047
+ *      '1111' + 32 bits       anything else
+ *    x = bits(v) ^ bits(vPrev)
+ *      '0'                    x == 0
+ *      '10' + meaningful bits x fits the previous leading/trailing window
+ *      '11' + 5 bits leading zeros + 5 bits (length-1) + length bits
+ */
+
+#ifndef INC_TSCOMPRESS_H_
+#define INC_TSCOMPRESS_H_
+#include <stdint.h>
+
+#define TSC_HEADER_SIZE 2
+//worst case bits of one appended sample (4+32 timestamp, 2+5+5+32 value)
+#define TSC_MAX_SAMPLE_BITS 80
+
+typedef struct{
+	uint8_t *buf;
+	uint16_t cap;
+	uint32_t bitPos;
+	uint16_t count;
+	float quantum; //0 keeps values bit exact, otherwise values are rounded to a multiple of it
+	uint32_t tPrev;
+	int32_t deltaPrev;
+	uint32_t vPrev;
+	uint8_t lead;
+	uint8_t trail;
+} TSC_EncoderTypeDef;
+
+typedef struct{
+	const uint8_t *buf;
+	uint16_t len;
+	uint32_t bitPos;
+	uint16_t count;
+	uint16_t index;
+	uint32_t tPrev;
+	int32_t deltaPrev;
+	uint32_t vPrev;
+	uint8_t lead;
+	uint8_t trail;
+} TSC_DecoderTypeDef;
+
+void TSC_EncoderInit(TSC_EncoderTypeDef *enc, uint8_t *buf, uint16_t cap, float quantum);
+int TSC_Append(TSC_EncoderTypeDef *enc, uint32_t t, float v);
+uint16_t TSC_Finish(TSC_EncoderTypeDef *enc);
+void TSC_Reset(TSC_EncoderTypeDef *enc);
+int TSC_DecoderInit(TSC_DecoderTypeDef *dec, const uint8_t *buf, uint16_t len);
+int TSC_Next(TSC_DecoderTypeDef *dec, uint32_t *t, float *v);
+#endif /* INC_TSCOMPRESS_H_ */
@@ -0,0 +1,66 @@
+/*
+ * weights.h
+ *
+ *  Network weights that can be replaced over the uplink without reflashing.
+ *  The last 128K of flash (bank 2, kept out of FLASH in STM32L475VGTX_FLASH.ld)
+ *  hold two slots of WEIGHTS_SLOT_SIZE, each a Weights_HeaderTypeDef followed
+ *  by an s_network_weights_array_u64 for the same network (or the weights
+ *  .bin padded to a multiple of 8). A slot is valid when its magic is set and the CRC of
+ *  its data matches; the valid slot with the highest version is the active
+ *  one, with none valid the network keeps the weights built into the image
+ *  (version 0).
+ *  A download always goes to the other slot: Weights_Begin erases its header,
+ *  Weights_Write programs the chunks as they come, erasing each page the first
+ *  time it's touched, Weights_Commit checks the CRC with the CRC peripheral and
+ *  writes the header, magic last, so a reset at any point leaves either the old
+ *  or the new slot valid. The network switches over between two windows
+ *  (Inference_SetWeights), the sampling schedule never stops.
+ *  Bank 2 is programmed while the code runs from bank 1, an erase stalls reads
+ *  of bank 2 only, and nothing reads the weights while an idle task erases.
+ */
+
+#ifndef INC_WEIGHTS_H_
+#define INC_WEIGHTS_H_
+#include "stm32l4xx_hal.h"
+#include "network_data.h"
+#include "sparse_dense.h"
+
+#define WEIGHTS_SLOT_A 0x080E0000
+#define WEIGHTS_SLOT_B 0x080F0000
+#define WEIGHTS_SLOT_SIZE 0x10000
+#define WEIGHTS_SLOTS 2
+#define WEIGHTS_MAGIC 0x31544757 //"WGT1"
+#define WEIGHTS_SIZE sizeof(s_network_weights_array_u64) //AI_NETWORK_DATA_WEIGHTS_SIZE rounded up to 8
+#define WEIGHTS_BUILTIN (-1) //slot number of the weights in the image
+#ifdef SPARSE_DENSE_STRIP
+#define WEIGHTS_IMAGE ((const void*)sparseDenseWeights) //without dense_dense, see sparse_dense.h
+#else
+#define WEIGHTS_IMAGE ((const void*)s_network_weights_array_u64)
+#endif
+
+//32 bytes at the start of a slot, the data follows
+typedef struct{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t size;
+	uint32_t crc; //CRC-32/MPEG-2 of the data as the CRC peripheral computes it
+	uint32_t reserved[4];
+} Weights_HeaderTypeDef;
+
+typedef enum{
+	WEIGHTS_OK = 0,
+	WEIGHTS_ERR_ARG,
+	WEIGHTS_ERR_BUSY,
+	WEIGHTS_ERR_FLASH,
+	WEIGHTS_ERR_CRC
+} Weights_StatusTypeDef;
+
+void Weights_Init(void);
+const void *Weights_Active(void);
+int Weights_Slot(void);
+uint32_t Weights_Version(void);
+int Weights_Receiving(void);
+Weights_StatusTypeDef Weights_Begin(uint32_t size, uint32_t dataCrc, uint32_t version);
+Weights_StatusTypeDef Weights_Write(uint32_t offset, const uint8_t *data, uint32_t len);
+Weights_StatusTypeDef Weights_Commit(void);
+#endif /* INC_WEIGHTS_H_ */
@@ -11,12 +11,14 @@
 
 /* Defines -------------------------------------------------------------------*/
 #define WIFI_TIMEOUT_TIME 5000
-#define WIFI_TX_BUFFER_SIZE 1024
+#define WIFI_TX_BUFFER_SIZE 1280
 #define WIFI_RX_BUFFER_SIZE 1024
 #define WIFI_MAX_READ_PACKET_SIZE 1200
 #define WIFI_READ_PACKET_SIZE ( WIFI_MAX_READ_PACKET_SIZE > WIFI_RX_BUFFER_SIZE ? WIFI_RX_BUFFER_SIZE : WIFI_MAX_READ_PACKET_SIZE )
 #define WIFI_READ_TIMEOUT 2000
 #define WIFI_POLLING_DELAY 200
+#define WIFI_MAX_SEND_SIZE 1200 // S3 payload limit of the module (ES_WIFI_PAYLOAD_SIZE)
+#define WIFI_MAX_RECV_SIZE (WIFI_RX_BUFFER_SIZE - 16) // R0 payload limit, leaves room for the framing
 
 #define WIFI_TX_PADDING 0x0A
 #define WIFI_RX_PADDING 0x15
@@ -25,6 +27,7 @@
 #define WIFI_MSG_START "\r\n[SOMA]"
 #define WIFI_MSG_END "[EOMA]\r\nOK\r\n>"
 #define WIFI_MSG_EMPTY "\r\n[SOMA][EOMA]\r\nOK\r\n> "
+#define WIFI_MSG_DATA_END "\r\nOK\r\n> "
 
 /* Macros --------------------------------------------------------------------*/
 #define WIFI_RESET_MODULE()                 HAL_GPIO_WritePin(WIFI_RESET_GPIO_Port, WIFI_RESET_Pin, GPIO_PIN_RESET );\
@@ -98,6 +101,7 @@ typedef struct{
 	char password[32];
 	char clientId[24];
 	uint16_t keepAlive;
+	uint8_t qos;
 } WIFI_MQTTTypeDef;
 
 typedef struct
@@ -129,6 +133,13 @@ WIFI_StatusTypeDef WIFI_ConnectServer(WIFI_HandleTypeDef* hwifi,char *ip,char *p
 WIFI_StatusTypeDef WIFI_SendData(WIFI_HandleTypeDef* hwifi,float data);
 WIFI_StatusTypeDef WIFI_SendStr(WIFI_HandleTypeDef* hwifi,char *data);
 WIFI_StatusTypeDef WIFI_DisconnectServer(WIFI_HandleTypeDef* hwifi);
+WIFI_StatusTypeDef WIFI_SelectSocket(WIFI_HandleTypeDef* hwifi, uint8_t socket);
+WIFI_StatusTypeDef WIFI_StartServer(WIFI_HandleTypeDef* hwifi, uint8_t socket, uint16_t port);
+WIFI_StatusTypeDef WIFI_CloseClient(WIFI_HandleTypeDef* hwifi);
+WIFI_StatusTypeDef WIFI_SendRaw(WIFI_HandleTypeDef* hwifi, const uint8_t* data, uint16_t len);
+WIFI_StatusTypeDef WIFI_ReceiveRaw(WIFI_HandleTypeDef* hwifi, uint8_t* data, uint16_t size, uint16_t* len, uint32_t timeout);
 void trimstr(char* str, uint32_t strSize, char c);
 extern UART_HandleTypeDef huart1;
+extern volatile uint32_t wifiSpiErrors;
+extern volatile uint32_t wifiSendErrors;
 #endif /* INC_WIFI_H_ */
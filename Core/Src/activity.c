@@ -0,0 +1,86 @@
+#include "activity.h"
+#include <math.h>
+
+volatile uint32_t activityWindows = 0;
+volatile uint32_t activityChanges = 0;
+volatile uint32_t activityHeld = 0;
+static int state = -1;
+static float confidence = 0;
+static uint32_t since = 0; //tick of the last change
+#if ACTIVITY_SMOOTHING == ACTIVITY_EMA
+static float smooth[ACTIVITY_CLASSES];
+static uint32_t lastTick;
+#else
+static uint8_t votes[ACTIVITY_VOTES];
+static uint8_t filled = 0;
+static uint8_t next = 0;
+#endif
+
+void Activity_Init(void)
+{
+	state = -1;
+	confidence = 0;
+	activityWindows = 0;
+#if ACTIVITY_SMOOTHING == ACTIVITY_MAJORITY
+	filled = next = 0;
+#endif
+}
+/**
+  * @brief  Takes the scores of one window.
+  * @param  scores: ACTIVITY_CLASSES probabilities
+  * @param  tick: HAL tick of the window
+  * @retval 1 when the state changed, Activity_State has the new one
+  */
+int Activity_Update(const float *scores, uint32_t tick)
+{
+	uint32_t best = 0, raw = 0;
+	for(int c=1;c<ACTIVITY_CLASSES;c++) if(scores[c] > scores[raw]) raw = c;
+#if ACTIVITY_SMOOTHING == ACTIVITY_EMA
+	//the first window is taken as it is
+	float alpha = activityWindows ? 1.0f - expf(-(float)(tick - lastTick)/ACTIVITY_TAU_MS) : 1.0f;
+	lastTick = tick;
+	for(int c=0;c<ACTIVITY_CLASSES;c++)
+	{
+		smooth[c] += alpha*(scores[c] - smooth[c]);
+		if(smooth[c] > smooth[best]) best = c;
+	}
+	float lead = smooth[best];
+#else
+	uint8_t count[ACTIVITY_CLASSES] = {0};
+	votes[next] = raw;
+	next = (next+1) % ACTIVITY_VOTES;
+	if(filled < ACTIVITY_VOTES) filled++;
+	for(int i=0;i<filled;i++) count[votes[i]]++;
+	//a tie keeps the state
+	for(int c=0;c<ACTIVITY_CLASSES;c++)
+	{
+		if(count[c] > count[best] || (count[c] == count[best] && (int)c == state)) best = c;
+	}
+	float lead = (float)count[best]/filled;
+#endif
+	activityWindows++;
+	if((int)best == state || lead < ACTIVITY_CONFIDENCE || (state >= 0 && tick - since < ACTIVITY_MIN_DWELL_MS))
+	{
+		if((int)best == state) confidence = lead;
+		//a window that alone would have changed the report
+		if(state >= 0 && (int)raw != state) activityHeld++;
+		return 0;
+	}
+	state = best;
+	confidence = lead;
+	since = tick;
+	activityChanges++;
+	return 1;
+}
+/**
+  * @brief  Reported class.
+  * @retval Class index, -1 until a window was confident enough
+  */
+int Activity_State(void)
+{
+	return state;
+}
+float Activity_Confidence(void)
+{
+	return confidence;
+}
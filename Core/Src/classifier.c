@@ -0,0 +1,140 @@
+#include "classifier.h"
+#include "log.h"
+#include <math.h>
+
+enum {STATIONARY, WALKING, RUNNING};
+
+volatile uint32_t classifierWindows = 0;
+volatile uint32_t classifierCompared = 0;
+volatile uint32_t classifierAgree = 0;
+volatile uint32_t classifierLastUs = 0;
+volatile uint32_t classifierMaxUs = 0;
+#ifdef CLASSIFIER_COMPARE
+//the feature model's class for the window the CNN is working on
+static uint32_t pendingClass;
+static int pending = 0;
+#endif
+
+#if CLASSIFIER == CLASSIFIER_TREES
+//fitted by Tools/classifier_fit.c, see classifier.h
+#define LEAF(cls,vote) {CLASSIFIER_LEAF, cls, 0, vote}
+static const Classifier_Node nodes[] = {
+	//0: tree 0
+	{FEAT_VAR_X, 1, 2, 0.000278099f},
+	LEAF(STATIONARY, 1.000f),
+	{FEAT_VAR_Z, 3, 4, 0.0145861f},
+	LEAF(WALKING, 1.000f),
+	LEAF(RUNNING, 1.000f),
+	//5: tree 1
+	{FEAT_VAR_X, 6, 7, 0.000278087f},
+	LEAF(STATIONARY, 1.000f),
+	{FEAT_ENERGY, 8, 9, 2.4825f},
+	LEAF(WALKING, 1.000f),
+	LEAF(RUNNING, 1.000f),
+	//10: tree 2
+	{FEAT_VAR_Z, 11, 14, 0.0148065f},
+	{FEAT_VAR_X, 12, 13, 0.000278791f},
+	LEAF(STATIONARY, 1.000f),
+	LEAF(WALKING, 1.000f),
+	LEAF(RUNNING, 1.000f),
+};
+static const uint8_t roots[] = {0, 5, 10};
+
+uint32_t Classifier_Run(const float *features, float *scores)
+{
+	float votes = 0;
+	for(int c=0;c<CLASSIFIER_CLASSES;c++) scores[c] = 0;
+	for(uint32_t t=0;t<sizeof(roots);t++)
+	{
+		const Classifier_Node *node = &nodes[roots[t]];
+		while(node->feature != CLASSIFIER_LEAF)
+		{
+			node = &nodes[features[node->feature] <= node->threshold ? node->yes : node->no];
+		}
+		scores[node->yes] += node->threshold;
+		votes += node->threshold;
+	}
+	uint32_t best = 0;
+	for(int c=0;c<CLASSIFIER_CLASSES;c++)
+	{
+		scores[c] /= votes;
+		if(scores[c] > scores[best]) best = c;
+	}
+	return best;
+}
+#else
+//CLASSIFIER_LINEAR, also what the bench measures with CLASSIFIER_CNN; fitted by Tools/classifier_fit.c
+static const float weights[CLASSIFIER_CLASSES][FEATURES] = {
+	[STATIONARY] = {-1.82048f, 0.0131424f, 5.46901f, -0.686096f, -0.501291f, -57.0672f, 0.0106979f, 0.019101f, 0.0833884f, -0.565662f, 0.35931f},
+	[WALKING] = {1.69146f, -1.36927f, -3.9409f, -0.393438f, -0.523936f, -45.2193f, -0.0110464f, -0.0164686f, -0.077475f, -0.450719f, -0.79219f},
+	[RUNNING] = {0.129011f, 1.35613f, -1.5281f, 1.07953f, 1.02522f, 102.286f, 0.00034854f, -0.00263234f, -0.00591368f, 1.01638f, 0.43288f},
+};
+static const float bias[CLASSIFIER_CLASSES] = {-6.63809f, 10.8228f, -4.1847f};
+
+uint32_t Classifier_Run(const float *features, float *scores)
+{
+	uint32_t best = 0;
+	for(int c=0;c<CLASSIFIER_CLASSES;c++)
+	{
+		scores[c] = bias[c];
+		for(int f=0;f<FEATURES;f++) scores[c] += weights[c][f]*features[f];
+		if(scores[c] > scores[best]) best = c;
+	}
+	float total = 0;
+	for(int c=0;c<CLASSIFIER_CLASSES;c++)
+	{
+		scores[c] = expf(scores[c] - scores[best]);
+		total += scores[c];
+	}
+	for(int c=0;c<CLASSIFIER_CLASSES;c++) scores[c] /= total;
+	return best;
+}
+#endif
+
+/**
+  * @brief  Classifies the window that just completed. Called by the
+  * 		sampling task in place of the network, or next to it with
+  * 		CLASSIFIER_COMPARE.
+  * @param  sampleHz: Accelerometer task rate
+  * @param  scores: CLASSIFIER_CLASSES floats, summing to 1
+  * @param  cls: The class
+  * @retval 0 until FEATURES_WINDOW samples came in, scores and cls untouched
+  */
+int Classifier_Window(float sampleHz, float *scores, uint32_t *cls)
+{
+	float features[FEATURES];
+	if(!Features_Ready()) return 0;
+	uint32_t c1 = DWT->CYCCNT;
+	Features_Get(features, sampleHz);
+	*cls = Classifier_Run(features, scores);
+	classifierLastUs = (DWT->CYCCNT - c1)/(SystemCoreClock/1000000);
+	if(classifierLastUs > classifierMaxUs) classifierMaxUs = classifierLastUs;
+	classifierWindows++;
+#ifdef CLASSIFIER_LOG_FEATURES
+	Log_Printf("F %.4f %.4f %.4f %.5f %.5f %.5f %d %d %d %.4f %.2f\r\n",
+			features[0], features[1], features[2], features[3], features[4], features[5],
+			(int)features[6], (int)features[7], (int)features[8], features[9], features[10]);
+#endif
+#ifdef CLASSIFIER_COMPARE
+	pendingClass = *cls;
+	pending = 1;
+#endif
+	return 1;
+}
+/**
+  * @brief  Counts whether the CNN agreed with the feature model on the window
+  * 		both were given. Called from the inference callback.
+  * @param  cnnClass: The CNN's class
+  * @retval None
+  */
+void Classifier_Compare(uint32_t cnnClass)
+{
+#ifdef CLASSIFIER_COMPARE
+	if(!pending) return;
+	pending = 0;
+	classifierCompared++;
+	if(cnnClass == pendingClass) classifierAgree++;
+#else
+	(void)cnnClass;
+#endif
+}
@@ -1,8 +1,18 @@
+//before cyclic.h, which redefines abs
+#include "stdlib.h"
 #include "cyclic.h"
 #include "hal_config.h"
 #include "string.h"
 #include "stdio.h"
 #include "stm32l4xx.h"
+#include "log.h"
+#include "trace.h"
+#include "stackmon.h"
+#include "pool.h"
+#include "placement.h"
+#if 60+(TASK_NAME_LEN+8)*TASKS_MAX > POOL_IO_SIZE
+#error "a scheduling table row is formatted in an io pool block"
+#endif
 #define MAJOR_CYCLE_LEN 1500
 #define MINOR_CYCLE_LEN 300
 #define NUMBER_MINOR_CYCLE 5
@@ -13,15 +23,84 @@ unsigned int minor_cycle;
 unsigned int number_minor_cycle = NUMBER_MINOR_CYCLE;
 //sys_time is for delay recovery
 unsigned int system_time;
-volatile Task tasks[num_tasks];
+volatile Task tasks[TASKS_MAX];
+unsigned char taskCodes[TASKS_MAX];
+int n_tasks = 0;
 volatile int jpos = 0;
 volatile int mode = 0;
 volatile int pos;
+//TIM1 ticks so far and the cycle counter at the last one, set by the tick interrupt
+volatile unsigned int tickCount = 0;
+volatile unsigned int tickCycles = 0;
 volatile int changeModeMark = 0;
 volatile int tinyTime = 0;
-Minor_Cycle basic_matrix[num_tasks];
-//Minor_Cycle *fast_matrix;
-Minor_Cycle fast_matrix[MAX_MINOR_CYCLES+1];
+volatile int nextMode = 0;
+//two tables: the scheduler runs from one while the other is rebuilt in slack,
+//basic (one run per minor cycle, tasks in registration order) or fast;
+//2 x 201 runs of sizeof(Frame_Run) = 4 (16 bit mask, repeat, 1 byte padding) = 1608 B
+Frame_Run fast_runs[2][MAX_MINOR_CYCLES+1] RAM2_BSS;
+static Schedule_Table active;
+//dispatch cursor: the run minor_cycle is in and the minor cycles left in it
+static unsigned int runIndex = 0;
+static unsigned int runLeft = 0;
+static unsigned int runMinor = 0;
+//offline table from Tools/schedgen.c, replaces buildFastMatrix when set
+static const Schedule_Table *constTable = NULL;
+//the table waiting for the next major cycle boundary
+static Schedule_Table shadow;
+static volatile int swapMark = 0;
+static int dumpRow = -1;
+static void dumpStep(void);
+//runtime reconfiguration, applied at the next major cycle boundary
+volatile int pendingPeriod[TASKS_MAX];
+volatile int rebuildMark = 0;
+//a task was registered or removed since the last table was built
+static int registryMark = 0;
+//the periods need harmonizePeriods again: a task or a tolerance changed since the last
+//search, a requested period alone is re-encoded (reencodeFastMatrix)
+static int searchMark = 1;
+//periods by task code of the table waiting for the boundary and of the running one,
+//0 when a table doesn't follow periods (basic, const) or doesn't have the task
+static int shadowPeriod[TASKS_MAX];
+static int tablePeriod[TASKS_MAX];
+//called once per minor cycle, in order, in the time left before the next tick
+static void (*idleTasks[MAX_IDLE_TASKS])(int remaining);
+static int n_idle = 0;
+//slack server: queued aperiodic jobs, served in registration order
+Aperiodic_Task aperiodicTasks[MAX_APERIODIC_TASKS];
+int n_aperiodic = 0;
+//per task execution time in us, measured with the DWT cycle counter in both modes
+Task_Stats taskStats;
+unsigned int overrunCount = 0;
+//overrun monitor: worst lateness past the tick, and what the policy dropped
+unsigned int overrunWorstUs = 0;
+unsigned int skippedFrames = 0;
+unsigned int shedTasks = 0;
+unsigned int degradeCount = 0;
+static int overrunPolicy = OVERRUN_RUN_LATE;
+//how late the current minor cycle started, after an overrun of the previous one
+static unsigned int startLateUs = 0;
+static unsigned int majorOverruns = 0;
+static int degradeMajors = -1;
+//longest prepareTable seen: basic, fast with the period search, fast re-encode
+#define PREPARE_BASIC 0
+#define PREPARE_FAST 1
+#define PREPARE_REENCODE 2
+static unsigned int prepareMaxUs[3] = {0,0,0};
+static void runTask(void (*task)(void), int code)
+{
+	TRACE(TRACE_TASK_START,code,0);
+	STACK_TASK_START();
+	uint32_t c1 = DWT->CYCCNT;
+	task();
+	uint32_t us = (DWT->CYCCNT - c1)/(SystemCoreClock/1000000);
+	STACK_TASK_END(code);
+	TRACE(TRACE_TASK_STOP,code,0);
+	taskStats.runs[code]++;
+	taskStats.lastUs[code] = us;
+	taskStats.sumUs[code] += us;
+	if(us > taskStats.maxUs[code]) taskStats.maxUs[code] = us;
+}
 int gcd(int a, int b)
 {
     int _max, _min;
@@ -46,134 +125,664 @@ int gcd(int a, int b)
 //		b++;
 //	}
 //}
+int taskRegistered(int code)
+{
+	for(int k=0;k<n_tasks;k++)
+	{
+		if(taskCodes[k]==code)
+		{
+			return 1;
+		}
+	}
+	return 0;
+}
+//both take effect with the next table, at a major cycle boundary; a removed task
+//keeps running from the current table until then
 void registerTask(void (*task)(void),char *name,int minor, int index, int code,int period)
 {
-	basic_matrix[minor].minor_code = minor;
-	//strcpy(basic_matrix[minor].task_name[index],name);
-	basic_matrix[minor].task_code[index] = code;
-	basic_matrix[minor].taskList[index] = task;
-	basic_matrix[minor].n_tasks++;
+	if(code<0 || code>=TASKS_MAX || period<=0 || taskRegistered(code))
+	{
+		return;
+	}
 	tasks[code].task = task;
-	strcpy(tasks[code].task_name,name);
+	strncpy((char*)tasks[code].task_name,name,TASK_NAME_LEN-1);
 	tasks[code].period = period;
+	tasks[code].nominal = period;
+	tasks[code].basicMinor = minor%NUMBER_MINOR_CYCLE;
+	taskStats.runs[code] = 0;
+	taskStats.maxUs[code] = 0;
+	taskStats.sumUs[code] = 0;
+	taskStats.executionSum[code] = 0;
+	taskStats.executionNum[code] = 0;
+	taskCodes[n_tasks++] = code;
+	registryMark = 1;
+	searchMark = 1;
+	rebuildMark = 1;
+}
+void unregisterTask(int code)
+{
+	for(int k=0;k<n_tasks;k++)
+	{
+		if(taskCodes[k]==code)
+		{
+			memmove(taskCodes+k,taskCodes+k+1,n_tasks-k-1);
+			n_tasks--;
+			registryMark = 1;
+			searchMark = 1;
+			rebuildMark = 1;
+			return;
+		}
+	}
+}
+void setOverrunPolicy(int policy)
+{
+	overrunPolicy = policy;
+}
+const Schedule_Table *activeTable(void)
+{
+	return &active;
+}
+void useConstTable(const Schedule_Table *t)
+{
+	constTable = t;
+}
+int registerAperiodicTask(void (*task)(void),char *name,unsigned int budgetUs)
+{
+	if(n_aperiodic == MAX_APERIODIC_TASKS)
+	{
+		return -1;
+	}
+	Aperiodic_Task *a = &aperiodicTasks[n_aperiodic];
+	a->task = task;
+	strncpy(a->task_name,name,TASK_NAME_LEN-1);
+	a->budgetUs = budgetUs;
+	return n_aperiodic++;
+}
+//interrupt safe; a job released again before it ran runs once
+void releaseAperiodicTask(int id)
+{
+	if(id<0 || id>=n_aperiodic || aperiodicTasks[id].pending)
+	{
+		return;
+	}
+	aperiodicTasks[id].releaseTick = HAL_GetTick();
+	aperiodicTasks[id].pending = 1;
+}
+void cancelAperiodicTask(int id)
+{
+	if(id>=0 && id<n_aperiodic && aperiodicTasks[id].pending)
+	{
+		aperiodicTasks[id].pending = 0;
+		aperiodicTasks[id].cancelled++;
+	}
+}
+//for pollers: released again intervalMs after the last release, a job that wants the next slack releases itself
+void setAperiodicInterval(int id, unsigned int intervalMs)
+{
+	if(id>=0 && id<n_aperiodic)
+	{
+		aperiodicTasks[id].intervalMs = intervalMs;
+	}
+}
+//runs the pending jobs whose worst case fits in slackUs, returns the time they took
+static unsigned int serveAperiodic(unsigned int slackUs)
+{
+	unsigned int used = 0;
+	for(int i=0;i<n_aperiodic;i++)
+	{
+		Aperiodic_Task *a = &aperiodicTasks[i];
+		if(!a->pending && a->intervalMs>0 && HAL_GetTick()-a->releaseTick>=a->intervalMs)
+		{
+			releaseAperiodicTask(i);
+		}
+		//the declared budget is a guess, once the job ran its measured worst case is what has to fit
+		unsigned int wcet = a->runs>0 ? a->maxUs : a->budgetUs;
+		if(!a->pending || used+wcet>slackUs)
+		{
+			continue;
+		}
+		a->pending = 0;
+		TRACE(TRACE_SLACK_START,TRACE_APERIODIC|i,0);
+		uint32_t c1 = DWT->CYCCNT;
+		a->task();
+		unsigned int us = (DWT->CYCCNT - c1)/(SystemCoreClock/1000000);
+		TRACE(TRACE_SLACK_END,TRACE_APERIODIC|i,0);
+		used += us;
+		a->runs++;
+		if(us>a->maxUs)
+		{
+			a->maxUs = us;
+		}
+		unsigned int response = HAL_GetTick()-a->releaseTick;
+		if(response>a->worstResponseMs)
+		{
+			a->worstResponseMs = response;
+		}
+	}
+	return used;
+}
+void registerIdleTask(void (*task)(int remaining))
+{
+	if(n_idle < MAX_IDLE_TASKS)
+	{
+		idleTasks[n_idle++] = task;
+	}
+}
+void setPeriodTolerance(int code, int percent)
+{
+	if(code<0 || code>=TASKS_MAX || percent<0 || percent>=100) return;
+	tasks[code].tolerance = percent;
+	searchMark = 1;
+	rebuildMark = 1;
+}
+void requestTaskPeriod(int code, int period)
+{
+	if(code<0 || code>=TASKS_MAX || period<=0) return;
+	pendingPeriod[code] = period;
+	rebuildMark = 1;
+}
+//the period the running table releases the task at, 0 in basic mode, with a const
+//table or when the task isn't in it yet
+int runningPeriod(int code)
+{
+	return code>=0 && code<TASKS_MAX ? tablePeriod[code] : 0;
+}
+//the period last asked for, by registerTask or requestTaskPeriod; it runs at that
+//(or within its tolerance) once runningPeriod follows
+int requestedPeriod(int code)
+{
+	if(code<0 || code>=TASKS_MAX || !taskRegistered(code)) return 0;
+	return pendingPeriod[code]>0 ? pendingPeriod[code] : tasks[code].nominal;
+}
+static void applyPendingPeriods(void)
+{
+	rebuildMark = 0;
+	for(int i=0;i<TASKS_MAX;i++)
+	{
+		if(pendingPeriod[i]>0)
+		{
+			tasks[i].period = pendingPeriod[i];
+			tasks[i].nominal = pendingPeriod[i];
+			pendingPeriod[i] = 0;
+		}
+	}
+}
+static void basicTable(Schedule_Table *t, Frame_Run *runs)
+{
+	for(int i=0;i<NUMBER_MINOR_CYCLE;i++)
+	{
+		runs[i].mask = 0;
+		runs[i].repeat = 1;
+	}
+	for(int k=0;k<n_tasks;k++)
+	{
+		t->order[k] = taskCodes[k];
+		runs[tasks[taskCodes[k]].basicMinor].mask |= 1<<k;
+	}
+	t->runs = runs;
+	t->n_runs = NUMBER_MINOR_CYCLE;
+	t->major_cycle_len = MAJOR_CYCLE_LEN;
+	t->minor_cycle_len = MINOR_CYCLE_LEN;
+	t->number_minor_cycle = NUMBER_MINOR_CYCLE;
+	t->mode = 0;
+}
+//puts the dispatch cursor on minor_cycle, walking the runs from the start
+static void seekRun(void)
+{
+	unsigned int m = minor_cycle;
+	runIndex = 0;
+	while(runIndex<active.n_runs-1 && m>=active.runs[runIndex].repeat)
+	{
+		m -= active.runs[runIndex].repeat;
+		runIndex++;
+	}
+	runLeft = active.runs[runIndex].repeat - m;
+	runMinor = minor_cycle;
+}
+static unsigned int tickPeriod(unsigned int len)
+{
+	return SystemCoreClock/(TIM1_Handler.Init.Prescaler+1)/1000*len;
 }
 void task_scheduler_tick_reset(void)
 {
 	major_cycle = 0;
 	minor_cycle = 0;
 	HAL_TIM_Base_Stop_IT(&TIM1_Handler);
-	TIM1_Handler.Init.Period=SystemCoreClock/(TIM1_Handler.Init.Prescaler+1)/1000*minor_cycle_len;//100ms
+	TIM1_Handler.Init.Period=tickPeriod(minor_cycle_len);//100ms
 	HAL_TIM_Base_Init(&TIM1_Handler);
 	HAL_TIM_Base_Start_IT(&TIM1_Handler);
 }
-static void changeMode(int showWindowMs)
+//worst case execution time in us: the longest run seen, or the mean from basic mode before any
+static unsigned int wcetUs(int code)
+{
+	return taskStats.runs[code]>0 ? taskStats.maxUs[code] : tasks[code].execution*1000;
+}
+//response time analysis of a table: walks one major cycle, a task placed in a minor cycle
+//serves its latest release and completes at the cycle start plus everything before it;
+//releases passed over in between are skipped, a placement before the next release is early.
+//Basic mode doesn't follow periods, there a task is released with its minor cycle
+void analyzeTable(Schedule_Table *t)
+{
+	unsigned int minorUs = t->minor_cycle_len*1000;
+	unsigned int next[TASKS_MAX];
+	unsigned int frame = 0;
+	Task_Mask present = 0;
+	memset(next,0,sizeof(next));
+	memset(t->wcrt,0,sizeof(t->wcrt));
+	t->worstLoad = 0;
+	t->overloadFrames = 0;
+	t->deadlineMisses = 0;
+	t->skippedReleases = 0;
+	t->earlyReleases = 0;
+	for(unsigned int r=0;r<t->n_runs;r++)
+	{
+		for(int k=0;k<t->runs[r].repeat;k++,frame++)
+		{
+			unsigned int busy = 0;
+			unsigned int start = frame*minorUs;
+			Task_Mask release = t->runs[r].mask;
+			present |= release;
+			while(release)
+			{
+				int code = t->order[__builtin_ctz(release)];
+				release &= release-1;
+				busy += wcetUs(code);
+				unsigned int job = start/(tasks[code].period*1000);
+				if(t->mode==0)
+				{
+					job = next[code];
+				}
+				else if(job<next[code])
+				{
+					t->earlyReleases++;
+					job = next[code];
+				}
+				t->skippedReleases += job-next[code];
+				next[code] = job+1;
+				unsigned int releaseAt = t->mode==0 ? start : job*tasks[code].period*1000;
+				if(start+busy>releaseAt && start+busy-releaseAt>t->wcrt[code])
+				{
+					t->wcrt[code] = start+busy-releaseAt;
+				}
+			}
+			if(busy>t->worstLoad)
+			{
+				t->worstLoad = busy;
+			}
+			if(busy>minorUs)
+			{
+				t->overloadFrames++;
+			}
+		}
+	}
+	for(Task_Mask m=present;m && t->mode==1;m&=m-1)
+	{
+		int i = t->order[__builtin_ctz(m)];
+		unsigned int expected = (t->major_cycle_len+tasks[i].period-1)/tasks[i].period;
+		if(next[i]<expected)
+		{
+			t->skippedReleases += expected-next[i];
+		}
+		if(t->wcrt[i]>tasks[i].period*1000)
+		{
+			t->deadlineMisses++;
+		}
+	}
+}
+static void logAnalysis(const Schedule_Table *t)
+{
+	for(int k=0;k<n_tasks;k++)
+	{
+		int i = taskCodes[k];
+		Log_Printf("rta: task %s wcrt %u us (period %d ms, wcet %u us)\r\n",tasks[i].task_name,t->wcrt[i],tasks[i].period,wcetUs(i));
+	}
+	Log_Printf("rta: worst minor cycle %u/%u us, %u overloaded, %u deadline misses, %u skipped and %u early releases\r\n",
+			t->worstLoad,t->minor_cycle_len*1000,t->overloadFrames,t->deadlineMisses,t->skippedReleases,t->earlyReleases);
+}
+//which prepareTable the next table takes: a period change alone in fast mode skips the search
+static int prepareKind(void)
+{
+	if(nextMode==0)
+	{
+		return PREPARE_BASIC;
+	}
+	return mode==1 && !searchMark && !constTable ? PREPARE_REENCODE : PREPARE_FAST;
+}
+//runs in slack: builds the table for the requested mode into the spare buffer,
+//the switch itself waits for the major cycle boundary
+static void prepareTable(int kind)
 {
-	//change mode
+	changeModeMark = 0;
+	int target = nextMode;
+	if(rebuildMark)
+	{
+		applyPendingPeriods();
+	}
+	Frame_Run *spare = (active.runs == fast_runs[0]) ? fast_runs[1] : fast_runs[0];
 #ifdef  FAST_EN
-	char *message = (mode == 0?"----------------------------now in mode basic------------------------------\r\n":"---------------------now in mode fast--------------------\r\n");
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-	if(mode == 0)
+	if(target == 0)
 	{
-		for(int i=0;i<num_tasks;i++)
+		//the basic table doesn't depend on periods, it picks them up on the next switch to fast mode
+		if(mode == 0 && !registryMark)
 		{
-			tasks[i].periodSum = 0;
-			tasks[i].periodNum = 0;
-			tasks[i].taskTick = 0;
-			tasks[i].executionSum = 0;
-			tasks[i].executionNum = 0;
+			return;
 		}
+		basicTable(&shadow,spare);
+	}
+	else if(constTable)
+	{
+		shadow = *constTable;
+		Log_Printf("const table: major_cycle=%d,minor_cycle=%d,number_of_minor=%d\r\n",shadow.major_cycle_len,shadow.minor_cycle_len,shadow.number_minor_cycle);
+		showFastMatrix();
+	}
+	else
+	{
+		if(kind==PREPARE_FAST)
+		{
+			buildFastMatrix(&shadow,spare);
+			searchMark = 0;
+		}
+		else if(!reencodeFastMatrix(&shadow,spare))
+		{
+			//the new periods don't nest within HARMONIZE_MAX_MAJOR: search, in a slack with room for it
+			searchMark = 1;
+			rebuildMark = 1;
+			return;
+		}
+		//check the matrix
+		Log_Printf("major_cycle=%d,minor_cycle=%d,number_of_minor=%d\r\n",shadow.major_cycle_len,shadow.minor_cycle_len,shadow.number_minor_cycle);
+		for(int k=0;k<n_tasks;k++)
+		{
+			int i = taskCodes[k];
+			Log_Printf("task %s:(period,execution):(%d,%d)\r\n",tasks[i].task_name,tasks[i].period,tasks[i].execution);
+		}
+		showFastMatrix();
+	}
+	registryMark = 0;
+	shadow.mode = target;
+	for(int i=0;i<TASKS_MAX;i++)
+	{
+		shadowPeriod[i] = target==1 && !constTable && taskRegistered(i) ? tasks[i].period : 0;
+	}
+	analyzeTable(&shadow);
+	if(target==1)
+	{
+		logAnalysis(&shadow);
+	}
+	swapMark = 1;
+#else
+	for(int k=0;k<n_tasks;k++)
+	{
+		int i = taskCodes[k];
+#ifdef PERIOD_MEASUREMENT
+		tasks[i].period = floor(taskStats.periodSum[i]/taskStats.periodNum[i]);
+#endif
+		tasks[i].execution = floor(taskStats.executionSum[i]/taskStats.executionNum[i]);
+		Log_Printf("task %s:(period,execution):(%d,%d)\r\n",tasks[i].task_name,tasks[i].period,tasks[i].execution);
+	}
+#endif
+}
+//called right after the last minor cycle of a major cycle ran, the tick ending it is still pending
+static void swapTable(void)
+{
+	swapMark = 0;
+	//back from fast mode: measure again (a basic table rebuilt for the registry keeps measuring)
+	if(shadow.mode == 0 && mode != 0)
+	{
+		memset(taskStats.periodSum,0,sizeof(taskStats.periodSum));
+		memset(taskStats.periodNum,0,sizeof(taskStats.periodNum));
+		memset(taskStats.taskTick,0,sizeof(taskStats.taskTick));
+		memset(taskStats.executionSum,0,sizeof(taskStats.executionSum));
+		memset(taskStats.executionNum,0,sizeof(taskStats.executionNum));
 #ifdef PERIOD_MEASUREMENT
 		lsm6dsl_dready_en();
 		lis3mdl_dready_en();
 		lps22hb_dready_en();
 		hts221_dready_en();
 #endif
-		major_cycle_len = MAJOR_CYCLE_LEN;
-		minor_cycle_len = MINOR_CYCLE_LEN;
-		number_minor_cycle = NUMBER_MINOR_CYCLE;
-		major_cycle = 0;
-		minor_cycle = 0;
 	}
-
-	else
-	{
 #ifdef PERIOD_MEASUREMENT
+	else if(mode == 0)
+	{
 		lsm6dsl_dready_dis();
 		lis3mdl_dready_dis();
 		lps22hb_dready_dis();
 		hts221_dready_dis();
+	}
 #endif
-		buildFastMatrix();
-		showFastMatrix();
-		//check the matrix
-		char message[200];
-		sprintf(message,"major_cycle=%d,minor_cycle=%d,number_of_minor=%d\r\n",major_cycle_len,minor_cycle_len,number_minor_cycle);
-		HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-		for(int i=0;i<num_tasks;i++)
-		{
-			sprintf(message,"task %s:(period,execution):(%d,%d)\r\n",tasks[i].task_name,tasks[i].period,tasks[i].execution);
-			HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-		}
-		HAL_Delay(showWindowMs*1000);
-
+	active = shadow;
+	memcpy(tablePeriod,shadowPeriod,sizeof(tablePeriod));
+	major_cycle_len = shadow.major_cycle_len;
+	minor_cycle_len = shadow.minor_cycle_len;
+	number_minor_cycle = shadow.number_minor_cycle;
+	mode = shadow.mode;
+	major_cycle = 0;
+	seekRun();
+	//ARR is preloaded, so the running minor cycle keeps its length and the
+	//new one starts on the very next tick: no release is lost or moved
+	__HAL_TIM_SET_AUTORELOAD(&TIM1_Handler,tickPeriod(minor_cycle_len));
+	Log_Printf(mode == 0?"----------------------------now in mode basic------------------------------\r\n":"---------------------now in mode fast--------------------\r\n");
+}
+static void nextMinor(void)
+{
+	minor_cycle++;
+	if(--runLeft==0 && runIndex<active.n_runs-1)
+	{
+		runIndex++;
+		runLeft = active.runs[runIndex].repeat;
 	}
-	task_scheduler_tick_reset();
-#else
-	for(int i=0;i<num_tasks;i++)
+	if(minor_cycle==number_minor_cycle)
 	{
-#ifdef PERIOD_MEASUREMENT
-		tasks[i].period = floor(tasks[i].periodSum/tasks[i].periodNum);
-#endif
-		tasks[i].execution = floor(tasks[i].executionSum/tasks[i].executionNum);
-		char message[200];
-		sprintf(message,"task %s:(period,execution):(%d,%d)\r\n",tasks[i].task_name,tasks[i].period,tasks[i].execution);
-		HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+		minor_cycle = 0;
+		major_cycle++;
+		runIndex = 0;
+		runLeft = active.runs[0].repeat;
+		majorOverruns = 0;
+		if(degradeMajors>=0 && mode==0 && ++degradeMajors>=OVERRUN_DEGRADE_MEASURE && !changeModeMark)
+		{
+			degradeMajors = -1;
+			nextMode = 1;
+			changeModeMark = 1;
+		}
+		//never run a major cycle half on the old table and half on the new one
+		if(swapMark)
+		{
+			swapTable();
+		}
 	}
-	HAL_Delay(showWindowMs*1000);
-#endif
+	runMinor = minor_cycle;
 }
 void task_scheduler(void)
 {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	basicTable(&active,fast_runs[0]);
+	registryMark = 0;
 	task_scheduler_tick_reset();
+	seekRun();
+	//the tick the current minor cycle started on, and whether the loop was still busy when the next one came
+	unsigned int ticksSeen = tickCount;
+	int overran = 0;
 	while(1)
 	{
 		//setPos();
-		system_time = HAL_GetTick();
-		if(changeModeMark)
+		unsigned int now;
+		uint32_t frameStart;
+		do
+		{
+			now = tickCount;
+			frameStart = tickCycles;
+		}while(now!=tickCount);
+		//more than one tick since the last minor cycle started: the ones in between
+		//went by in its periodic tasks or in the slack work after them
+		unsigned int ticks = now-ticksSeen;
+		ticksSeen = now;
+		if(ticks==0)
+		{
+			frameStart = DWT->CYCCNT;
+		}
+		unsigned int minorUs = minor_cycle_len*1000;
+		unsigned int sinceTick = (DWT->CYCCNT - frameStart)/(SystemCoreClock/1000000);
+		//time of the tick, the idle tasks count their slack from it
+		system_time = HAL_GetTick() - sinceTick/1000;
+		//recoverDelayMark may have moved minor_cycle
+		if(minor_cycle!=runMinor)
 		{
-			changeModeMark = 0;
-			changeMode(SHOW_WINDOW);
+			seekRun();
+		}
+		int skip = 0;
+		startLateUs = 0;
+		if(overran)
+		{
+			overran = 0;
+			unsigned int late = (ticks-1)*minorUs + sinceTick;
+			overrunCount++;
+			majorOverruns++;
+			if(late>overrunWorstUs)
+			{
+				overrunWorstUs = late;
+			}
+			TRACE(TRACE_OVERRUN,0,late>0xffff?0xffff:late);
+#if defined(TRACE_EN) && defined(TRACE_DUMP_ON_OVERRUN)
+			//keep what led up to the first one
+			if(overrunCount==1)
+			{
+				Trace_Dump(NULL);
+			}
+#endif
+			//whole minor cycles that went by during the overrun, their ticks are lost
+			unsigned int missed = late/minorUs;
+			if(overrunPolicy==OVERRUN_SKIP)
+			{
+				for(unsigned int i=0;i<=missed;i++)
+				{
+					nextMinor();
+					skippedFrames++;
+				}
+				//realign on the next tick, the slack of the dropped cycle goes to the idle tasks
+				skip = 1;
+			}
+			else if(overrunPolicy==OVERRUN_SHED)
+			{
+				for(unsigned int i=0;i<missed;i++)
+				{
+					nextMinor();
+					skippedFrames++;
+				}
+				startLateUs = late%minorUs;
+			}
+			else
+			{
+				startLateUs = late<minorUs ? late : minorUs;
+				if(overrunPolicy==OVERRUN_DEGRADE && mode==1 && majorOverruns>=OVERRUN_DEGRADE_THRESHOLD && !changeModeMark)
+				{
+					//the execution times the table was built on are stale: measure them again
+					degradeCount++;
+					degradeMajors = 0;
+					nextMode = 0;
+					changeModeMark = 1;
+					Log_Printf("overrun: %u in this major cycle, back to basic mode to re-measure\r\n",majorOverruns);
+				}
+			}
 		}
-		pos=0;
-		if(mode==0)
+		//shedding: what's left of a minor cycle that started late, by worst case
+		unsigned int budget = (overrunPolicy==OVERRUN_SHED && startLateUs>0) ? minorUs-startLateUs : 0;
+		unsigned int used = 0;
+		//slack stealing: whatever the worst case of this minor cycle leaves goes to
+		//the aperiodic jobs first, the periodic tasks still finish before the tick
+		if(n_aperiodic>0 && startLateUs==0 && !skip)
 		{
-			for(int i=0;i<basic_matrix[minor_cycle].n_tasks;i++)
+			unsigned int load = SLACK_GUARD_US;
+			for(Task_Mask m=active.runs[runIndex].mask;m;m&=m-1)
+			{
+				int code = active.order[__builtin_ctz(m)];
+				//nothing measured yet, no worst case to steal against
+				load += taskStats.runs[code]>0 ? wcetUs(code) : minorUs;
+			}
+			if(load<minorUs)
+			{
+				serveAperiodic(minorUs-load);
+			}
+		}
+		//set bits in priority order, lowest first
+		Task_Mask release = skip ? 0 : active.runs[runIndex].mask;
+		while(release)
+		{
+			int code = active.order[__builtin_ctz(release)];
+			release &= release-1;
+			if(budget>0)
+			{
+				if(used+wcetUs(code)>budget)
+				{
+					shedTasks++;
+					continue;
+				}
+				used += wcetUs(code);
+			}
+			if(mode==0)
 			{
 				int t1 = HAL_GetTick();
-				basic_matrix[minor_cycle].taskList[i]();
+				runTask(tasks[code].task,code);
 				int t2 = HAL_GetTick();
-				int code = basic_matrix[minor_cycle].task_code[i];
-				tasks[code].executionSum+=(t2-t1);
-				tasks[code].executionNum++;
+				taskStats.executionSum[code]+=(t2-t1);
+				taskStats.executionNum[code]++;
+			}
+			else
+			{
+				runTask(tasks[code].task,code);
 			}
 		}
-		else
+		if(!skip)
+		{
+			nextMinor();
+		}
+		//a second request while a table waits for its boundary is picked up after the swap;
+		//one that doesn't fit in this slack waits for a minor cycle that has room
+		if((changeModeMark || rebuildMark) && !swapMark && tickCount==ticksSeen)
 		{
-			for(int i=0;i<fast_matrix[minor_cycle].n_tasks;i++)
+			static const unsigned int prepareBudgetUs[3] = {PREPARE_BASIC_BUDGET_US,PREPARE_FAST_BUDGET_US,PREPARE_REENCODE_BUDGET_US};
+			int kind = prepareKind();
+			unsigned int need = prepareMaxUs[kind]>0 ? prepareMaxUs[kind] : prepareBudgetUs[kind];
+			uint32_t c1 = DWT->CYCCNT;
+			unsigned int elapsed = (c1 - frameStart)/(SystemCoreClock/1000000);
+			if(elapsed+need+SLACK_GUARD_US<minorUs)
 			{
-				char message[200];
-//				sprintf(message,"(%d tasks)(%d,%d)execution addr:%x\r\n",fast_matrix[minor_cycle].n_tasks,minor_cycle,i,fast_matrix[minor_cycle].taskList[i]);
-//				HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-				fast_matrix[minor_cycle].taskList[i]();
+				prepareTable(kind);
+				unsigned int us = (DWT->CYCCNT - c1)/(SystemCoreClock/1000000);
+				if(us>prepareMaxUs[kind])
+				{
+					prepareMaxUs[kind] = us;
+				}
 			}
 		}
-		minor_cycle++;
-		if(minor_cycle==number_minor_cycle)
+		if(dumpRow>=0)
+		{
+			dumpStep();
+		}
+		//then the slack the periodic tasks actually left, measured rather than assumed
+		if(n_aperiodic>0 && tickCount==ticksSeen)
 		{
-			minor_cycle = 0;
-			major_cycle++;
+			unsigned int elapsed = (DWT->CYCCNT - frameStart)/(SystemCoreClock/1000000);
+			if(elapsed+SLACK_GUARD_US<minorUs)
+			{
+				serveAperiodic(minorUs-elapsed-SLACK_GUARD_US);
+			}
 		}
-		while(pos==0);
+		for(int i=0;i<n_idle && tickCount==ticksSeen;i++)
+		{
+			int remaining = (int)(system_time + minor_cycle_len - HAL_GetTick());
+			if(remaining<=0)
+			{
+				break;
+			}
+			TRACE(TRACE_SLACK_START,i,remaining);
+			idleTasks[i](remaining);
+			TRACE(TRACE_SLACK_END,i,0);
+		}
+		//the tick is already in: whatever ran since this minor cycle started made the next one late
+		overran = tickCount!=ticksSeen;
+		while(tickCount==ticksSeen);
 	}
 }
 int lcm(int a,int b)
@@ -183,108 +792,235 @@ int lcm(int a,int b)
 	int b1 = b/m;
 	return a1*b1*m;
 }
-//surprisingly, high robustness~!
-void buildFastMatrix(void)
+//sort key by task code for sortedCodes
+static int sortKeys[TASKS_MAX];
+static int keyCompare(const void *a, const void *b)
+{
+	int ca = *(const unsigned char*)a;
+	int cb = *(const unsigned char*)b;
+	if(sortKeys[ca]!=sortKeys[cb])
+	{
+		return sortKeys[ca]<sortKeys[cb] ? -1 : 1;
+	}
+	return ca-cb;
+}
+//the registered codes ordered by sortKeys, ties by code
+static void sortedCodes(unsigned char *codes)
+{
+	memcpy(codes,taskCodes,n_tasks);
+	qsort(codes,n_tasks,1,keyCompare);
+}
+//period search state, sorted by nominal period so the hyperperiod grows from the short tasks up
+static unsigned char hp_task[TASKS_MAX];
+static int hp_pick[TASKS_MAX];
+static int hp_best[TASKS_MAX];
+static unsigned int hp_bestMajor;
+static unsigned int hp_bestFrames;
+static unsigned int hp_bestErr;
+static unsigned int hp_minor;
+static int hp_nodes;
+static unsigned long long gcd64(unsigned long long a, unsigned long long b)
+{
+	while(b)
+	{
+		unsigned long long r = a%b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+static unsigned int framesOf(unsigned long long major, unsigned long long g)
+{
+	unsigned long long minor = g>hp_minor ? g : hp_minor;
+	return (major+minor-1)/minor;
+}
+static unsigned int gcd32(unsigned int a, unsigned int b)
+{
+	while(b)
+	{
+		unsigned int r = a%b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+//rate error in 0.1%
+static unsigned int rateError(int code, int period)
 {
-	for(int i=0;i<num_tasks;i++)
+	return abs(period-tasks[code].nominal)*1000/tasks[code].nominal;
+}
+static int better(unsigned int frames, unsigned int major, unsigned int err)
+{
+	if(frames!=hp_bestFrames) return frames<hp_bestFrames;
+	if(major!=hp_bestMajor) return major<hp_bestMajor;
+	return err<hp_bestErr;
+}
+//frames and hyperperiod only grow as tasks are added, so a partial set that
+//is already worse than the best full set is cut
+//32 bit on purpose, the M4 divides those in hardware
+static void harmonizeSearch(int depth, unsigned int major, unsigned int g, unsigned int err)
+{
+	if(++hp_nodes>HARMONIZE_NODE_LIMIT || !better(depth ? framesOf(major,g) : 0, major, err))
+	{
+		return;
+	}
+	if(depth==n_tasks)
+	{
+		hp_bestFrames = framesOf(major,g);
+		hp_bestMajor = major;
+		hp_bestErr = err;
+		memcpy(hp_best,hp_pick,sizeof(hp_best));
+		return;
+	}
+	int code = hp_task[depth];
+	int q = PERIOD_QUANTUM;
+	int nominal = (tasks[code].nominal+q-1)/q*q;
+	int lo = ((tasks[code].nominal*(100-tasks[code].tolerance)+99)/100+q-1)/q*q;
+	int hi = tasks[code].nominal*(100+tasks[code].tolerance)/100/q*q;
+	if(lo<q) lo = q;
+	if(hi<nominal) hi = nominal;
+	if(lo>nominal) lo = nominal;
+	//harmonic candidates (multiples or divisors of the hyperperiod so far) first,
+	//each pass from the nominal period outwards
+	for(int pass=0;pass<2;pass++)
+	{
+		for(int d=0;nominal-d>=lo || nominal+d<=hi;d+=q)
+		{
+			for(int side=0;side<2;side++)
+			{
+				int p = side ? nominal+d : nominal-d;
+				if((side && d==0) || p<lo || p>hi) continue;
+				int harmonic = depth==0 || p%major==0 || major%p==0;
+				if(harmonic!=(pass==0)) continue;
+				unsigned int m = depth ? major/gcd32(major,p) : 1;
+				if(m>HARMONIZE_MAX_MAJOR/p) continue;
+				hp_pick[code] = p;
+				harmonizeSearch(depth+1, m*p, depth ? gcd32(g,p) : p, err+rateError(code,p));
+			}
+		}
+	}
+}
+//picks every task's period inside its tolerance band, on the PERIOD_QUANTUM grid,
+//so the table has as few minor cycles as possible (then the shortest major cycle,
+//then the least rate error). Tolerance 0 is the old behaviour: nominal rounded up to 5.
+void harmonizePeriods(unsigned int minMinor)
+{
+	hp_minor = (minMinor+PERIOD_QUANTUM-1)/PERIOD_QUANTUM*PERIOD_QUANTUM;
+	for(int k=0;k<n_tasks;k++)
+	{
+		sortKeys[taskCodes[k]] = tasks[taskCodes[k]].nominal;
+	}
+	sortedCodes(hp_task);
+	//reference: the periods as they would be without any tolerance
+	unsigned long long major = 0, g = 0;
+	for(int k=0;k<n_tasks;k++)
+	{
+		int i = taskCodes[k];
+		int p = (tasks[i].nominal+PERIOD_QUANTUM-1)/PERIOD_QUANTUM*PERIOD_QUANTUM;
+		hp_best[i] = p;
+		major = k ? major/gcd64(major,p)*p : p;
+		g = k ? gcd64(g,p) : p;
+	}
+	unsigned int framesBefore = framesOf(major,g);
+	unsigned long long majorBefore = major;
+	//a reference beyond 32 bits loses against anything the search finds
+	hp_bestFrames = framesBefore;
+	hp_bestMajor = major>HARMONIZE_MAX_MAJOR ? HARMONIZE_MAX_MAJOR : major;
+	hp_bestErr = 0;
+	for(int k=0;k<n_tasks;k++)
 	{
+		hp_bestErr += rateError(taskCodes[k],hp_best[taskCodes[k]]);
+	}
+	hp_nodes = 0;
+	harmonizeSearch(0,0,0,0);
+	for(int k=0;k<n_tasks;k++)
+	{
+		int i = taskCodes[k];
+		tasks[i].period = hp_best[i];
+		if(tasks[i].period!=tasks[i].nominal)
+		{
+			Log_Printf("task %s: period %d -> %d ms, rate error %d.%d%%\r\n",tasks[i].task_name,tasks[i].nominal,tasks[i].period,rateError(i,tasks[i].period)/10,rateError(i,tasks[i].period)%10);
+		}
+	}
+	//newlib nano has no %llu
+	Log_Printf("harmonized: major %lu -> %u ms, %u -> %u minor cycles (%u B fewer runs at most)%s\r\n",(unsigned long)(majorBefore>0xFFFFFFFF ? 0xFFFFFFFF : majorBefore),hp_bestMajor,framesBefore,hp_bestFrames,
+			(framesBefore-hp_bestFrames)*(unsigned int)sizeof(Frame_Run),hp_nodes>HARMONIZE_NODE_LIMIT?", search cut short":"");
+}
+//execution times from the basic mode measurements, returns the longest:
+//the minor cycle can't be shorter than that, see encodeFastMatrix
+static unsigned int measureExecution(void)
+{
+	int n = n_tasks;
+	for(int k=0;k<n;k++)
+	{
+		int i = taskCodes[k];
 #ifdef PERIOD_MEASUREMENT
-		tasks[i].period = floor(tasks[i].periodSum/tasks[i].periodNum);
+		tasks[i].nominal = floor(taskStats.periodSum[i]/taskStats.periodNum[i]);
 #endif
-		if( tasks[i].executionNum==0)
+		if( taskStats.executionNum[i]==0)
 		{
-			tasks[i].execution = tasks[i].period;
+			tasks[i].execution = tasks[i].nominal;
 			continue;
 		}
-		tasks[i].execution = floor(tasks[i].executionSum/ tasks[i].executionNum);
-		//align period to 5
-		int r = tasks[i].period%5;
-		if(r>0)
-		tasks[i].period = tasks[i].period+5-r;
+		tasks[i].execution = floor(taskStats.executionSum[i]/ taskStats.executionNum[i]);
  	}
-	if(num_tasks>1)
+	unsigned int minMinor = 0;
+	for(int k=0;k<n;k++)
 	{
-		int gcd_matrix[num_tasks-1],lcm_matrix[num_tasks-1];
-		gcd_matrix[0] = gcd(tasks[0].period,tasks[1].period);
-		lcm_matrix[0] = lcm(tasks[0].period,tasks[1].period);
-		for(int i=0;i<=num_tasks-3;i++)
+		if(tasks[taskCodes[k]].execution>minMinor)
 		{
-			gcd_matrix[i+1] = gcd(gcd_matrix[i],tasks[i+2].period);
-			lcm_matrix[i+1] = lcm(lcm_matrix[i],tasks[i+2].period);
+			minMinor = tasks[taskCodes[k]].execution;
 		}
-
-		minor_cycle_len = gcd_matrix[num_tasks-2];
-		major_cycle_len = lcm_matrix[num_tasks-2];
-	}
-	else
-	{
-		minor_cycle_len = tasks[0].execution;
-		major_cycle_len = tasks[0].period;
 	}
+	return minMinor;
+}
+//surprisingly, high robustness~!
+static void encodeFastMatrix(Schedule_Table *t, Frame_Run *runs)
+{
+	int n = n_tasks;
 	//n-lcm is hard to compute, so here we don't use lcm, we don't have much chance to
 	//use lcm where gcd > max(E) anyway
-	int ready_queen[num_tasks+1];
-	int rest_time_tasks[num_tasks];
-	struct task_bond
+	t->minor_cycle_len = tasks[taskCodes[0]].period;
+	t->major_cycle_len = tasks[taskCodes[0]].period;
+	for(int k=1;k<n;k++)
 	{
-		int exe;
-		int code;
-	};
-	//we need this code Map for minor_cycle modification
-	struct task_bond taskOrder[num_tasks];
-	for(int i=0;i<num_tasks;i++)
+		t->minor_cycle_len = gcd(t->minor_cycle_len,tasks[taskCodes[k]].period);
+		t->major_cycle_len = lcm(t->major_cycle_len,tasks[taskCodes[k]].period);
+	}
+	if(n==1)
 	{
-		taskOrder[i].code = i;
-		taskOrder[i].exe = tasks[i].execution;
+		t->minor_cycle_len = tasks[taskCodes[0]].execution;
 	}
-	for(int i=num_tasks;i>1;i--)
+	//queue and marks by task code, the queue holds every task at most once
+	int ready_queen[TASKS_MAX+1];
+	int rest_time_tasks[TASKS_MAX];
+	//we need this code Map for minor_cycle modification: shortest execution first
+	unsigned char taskOrder[TASKS_MAX];
+	for(int k=0;k<n;k++)
 	{
-		int pos = 0;
-		for(int j=0;j<i;j++)
-		{
-			if(taskOrder[j].exe>taskOrder[pos].exe)
-			{
-				pos = j;
-			}
-		}
-		struct task_bond tmp = taskOrder[i-1];
-		taskOrder[i-1] = taskOrder[pos];
-		taskOrder[pos] = tmp;
+		sortKeys[taskCodes[k]] = tasks[taskCodes[k]].execution;
 	}
-	if(taskOrder[num_tasks-1].exe>minor_cycle_len)
+	sortedCodes(taskOrder);
+	if(tasks[taskOrder[n-1]].execution>t->minor_cycle_len)
 	{
-		minor_cycle_len = taskOrder[num_tasks-1].exe;
-		int r = minor_cycle_len % 5;
+		t->minor_cycle_len = tasks[taskOrder[n-1]].execution;
+		int r = t->minor_cycle_len % 5;
 		if(r>0)
 		{
-			minor_cycle_len+=(5-r);
+			t->minor_cycle_len+=(5-r);
 		}
 	}
 	//Get largestT as major cycle
 	//We also need this cause I want a period oriented sjf like scheduler in each minor cycle
-	struct task_bond taskT[num_tasks];
-	for(int i=0;i<num_tasks;i++)
-	{
-		taskT[i].code = i;
-		taskT[i].exe = tasks[i].period;
-	}
-	for(int i=num_tasks;i>1;i--)
+	unsigned char taskT[TASKS_MAX];
+	for(int k=0;k<n;k++)
 	{
-		int pos = 0;
-		for(int j=0;j<i;j++)
-		{
-			if(taskT[j].exe>taskT[pos].exe)
-			{
-				pos = j;
-			}
-		}
-		struct task_bond tmp = taskT[i-1];
-		taskT[i-1] = taskT[pos];
-		taskT[pos] = tmp;
+		sortKeys[taskCodes[k]] = tasks[taskCodes[k]].period;
 	}
-	number_minor_cycle = floor(major_cycle_len/minor_cycle_len);
+	sortedCodes(taskT);
+	t->number_minor_cycle = floor(t->major_cycle_len/t->minor_cycle_len);
 	int tail_idle = 0;
-	if(number_minor_cycle> MAX_MINOR_CYCLES)
+	if(t->number_minor_cycle> MAX_MINOR_CYCLES)
 	{
 		//for table scheduler, we may miss scheduling between each task's periodic points, but generally
 		//in each major cycle, the states of each tasks should be ok, in another word, each major_cycle should
@@ -295,45 +1031,50 @@ void buildFastMatrix(void)
 		//not tolerable in some cases.
 		//What's more, for our accelerometer, execution time may even be longer than period,
 		//a good proof of missing scheduling is ok...(rare, but happened actually)
-		number_minor_cycle =  MAX_MINOR_CYCLES;
+		t->number_minor_cycle =  MAX_MINOR_CYCLES;
 		//this one is to guarantee period behavior doesn't go wrong
 		//when new cycle begins, all the tasks should be ready(at pos_t 0)
 		//though not necessary for our tasks, but for general purpose
 		//We should change length of minor cycles instead of length of major cycles, for period task principle
-		minor_cycle_len = major_cycle_len/number_minor_cycle;
-		if(minor_cycle_len*number_minor_cycle!=major_cycle_len)
+		t->minor_cycle_len = t->major_cycle_len/t->number_minor_cycle;
+		if(t->minor_cycle_len*t->number_minor_cycle!=t->major_cycle_len)
 		{
-			number_minor_cycle+=1;
+			t->number_minor_cycle+=1;
 			//shouldn't do any tasks in idle minor cycle,
 			//or there's possibility we don't get all tasks ready in new major cycle
 			tail_idle = 1;
 		}
-		char message[200];
-		sprintf(message,"warning:number of minor cycles(%d) overlapping boundary(%d)",number_minor_cycle,MAX_MINOR_CYCLES);
-		HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+		Log_Printf("warning:number of minor cycles(%d) overlapping boundary(%d)\r\n",t->number_minor_cycle,MAX_MINOR_CYCLES);
 	}
 	//rdy queue doesn't allow 2 same task
-	int queen_mark[num_tasks];
+	int queen_mark[TASKS_MAX];
 	//first enqueue use execution order, and the rest time use
-	for(int i=0;i<num_tasks;i++)
+	for(int i=0;i<n;i++)
 	{
-		ready_queen[i] = taskOrder[i].code;
-		rest_time_tasks[i] = 0;
-		queen_mark[i] = 1;
+		ready_queen[i] = taskOrder[i];
+		rest_time_tasks[taskOrder[i]] = 0;
+		queen_mark[taskOrder[i]] = 1;
 	}
 //	extern int _eheap;
 //	fast_matrix = (Minor_Cycle*)&_eheap;
 	//fast_matrix = (Minor_Cycle*)(HEAP_BASE - sizeof(Minor_Cycle)*number_minor_cycle);
-	int head = 0,tail = num_tasks;
+	int head = 0,tail = n;
+	//inside a minor cycle tasks run shortest period first
+	int prio[TASKS_MAX];
+	for(int j=0;j<n;j++)
+	{
+		t->order[j] = taskT[j];
+		prio[taskT[j]] = j;
+	}
+	t->n_runs = 0;
 	//core of the scheduler
-	for(int i=0;i<number_minor_cycle;i++)
+	for(int i=0;i<t->number_minor_cycle;i++)
 	{
-		int rest_time = minor_cycle_len;
-		int numer = 0;
-		fast_matrix[i].minor_code = i;
+		int rest_time = t->minor_cycle_len;
+		Task_Mask mask = 0;
 		while(1)
 		{
-			//queen is the same size as num_tasks, thus never gets full
+			//queen holds one more than the tasks, thus never gets full
 			if(head==tail)
 			{
 				//there maybe hole minor cycle, however handles it would be impossible in our algorithm which
@@ -342,7 +1083,7 @@ void buildFastMatrix(void)
 			}
 			else
 			{
-				int taskCode = ready_queen[(head)%(num_tasks+1)];
+				int taskCode = ready_queen[(head)%(n+1)];
 
 				rest_time-=tasks[taskCode].execution;
 				if(rest_time<0)
@@ -353,42 +1094,92 @@ void buildFastMatrix(void)
 				head++;
 				rest_time_tasks[taskCode] = tasks[taskCode].period;
 				queen_mark[taskCode] = 0;
-				fast_matrix[i].task_code[numer] = taskCode;
-				//strcpy(fast_matrix[i].task_name[numer],tasks[taskCode].task_name);
-				fast_matrix[i].taskList[numer] = tasks[taskCode].task;
-				numer++;
+				mask |= 1<<prio[taskCode];
 			}
 		}
-		for(int j=0;j<num_tasks;j++)
+		for(int j=0;j<n;j++)
 		{
 			//already in queue: skip
-			if(queen_mark[taskT[j].code]==1)
+			if(queen_mark[taskT[j]]==1)
 			{
 				continue;
 			}
-			rest_time_tasks[taskT[j].code]-=minor_cycle_len;
-			if(rest_time_tasks[taskT[j].code]<=0)
+			rest_time_tasks[taskT[j]]-=t->minor_cycle_len;
+			if(rest_time_tasks[taskT[j]]<=0)
 			{
-				ready_queen[tail%(num_tasks+1)] = taskT[j].code;
+				ready_queen[tail%(n+1)] = taskT[j];
 				tail++;
-				queen_mark[taskT[j].code] = 1;
+				queen_mark[taskT[j]] = 1;
 			}
 		}
-		fast_matrix[i].n_tasks = numer;
+		if(tail_idle==1 && i==t->number_minor_cycle-1)
+		{
+			mask = 0;
+		}
+		//identical neighbours share one run
+		if(t->n_runs>0 && runs[t->n_runs-1].mask==mask && runs[t->n_runs-1].repeat<MAX_RUN_REPEAT)
+		{
+			runs[t->n_runs-1].repeat++;
+		}
+		else
+		{
+			runs[t->n_runs].mask = mask;
+			runs[t->n_runs].repeat = 1;
+			t->n_runs++;
+		}
 	}
-	if(tail_idle==1)
+	t->runs = runs;
+}
+void buildFastMatrix(Schedule_Table *t, Frame_Run *runs)
+{
+	if(n_tasks==0)
 	{
-		fast_matrix[number_minor_cycle-1].n_tasks = 0;
+		basicTable(t,runs);
+		return;
 	}
+	harmonizePeriods(measureExecution());
+	encodeFastMatrix(t,runs);
+}
+//a fast table for new requested periods without the period search: the tasks keep
+//the harmonized periods they have, a changed one runs at its request rounded up to
+//PERIOD_QUANTUM. Returns 0 without touching the table when that hyperperiod is past
+//HARMONIZE_MAX_MAJOR, the periods then need buildFastMatrix
+int reencodeFastMatrix(Schedule_Table *t, Frame_Run *runs)
+{
+	unsigned long long major = 1;
+	int q = PERIOD_QUANTUM;
+	if(n_tasks==0)
+	{
+		basicTable(t,runs);
+		return 1;
+	}
+	for(int k=0;k<n_tasks;k++)
+	{
+		int p = (tasks[taskCodes[k]].period+q-1)/q*q;
+		major = major/gcd64(major,p)*p;
+		if(major>HARMONIZE_MAX_MAJOR)
+		{
+			return 0;
+		}
+	}
+	for(int k=0;k<n_tasks;k++)
+	{
+		int i = taskCodes[k];
+		tasks[i].period = (tasks[i].period+q-1)/q*q;
+	}
+	measureExecution();
+	encodeFastMatrix(t,runs);
+	return 1;
 }
 //these to eliminate higher priority interrupt's bad consequence(higher than timer1 tick which is scheduling tick)
 void recoverDelayMark(void)
 {
 	unsigned int major_pass,minor_pass;
 	unsigned int delay = HAL_GetTick();
-	major_pass = ceil(abs(delay-system_time)/major_cycle_len);
-	unsigned int tmp = abs(delay-system_time)%major_cycle_len;
-    minor_pass = ceil(tmp/minor_cycle);
+	unsigned int elapsed = delay-system_time;
+	major_pass = elapsed/major_cycle_len;
+	unsigned int tmp = elapsed%major_cycle_len;
+    minor_pass = tmp/minor_cycle_len;
     major_cycle += major_pass;
     minor_cycle += minor_pass;
     unsigned int rd = minor_cycle / (number_minor_cycle);
@@ -402,45 +1193,74 @@ void recoverDelayMark(void)
 //    HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
     //if time chunk between minor cycle, we must wait until the end of that cycle to guarantee predictability
     //though may lose some time, but delay is unpredictable, and if we want to make it predictable we need to pay a price
-    if(tmp%minor_cycle>0)
+    if(tmp%minor_cycle_len>0)
     {
     	//error range: 1 minor cycle
     	//solve this needs execesive system consumption and much complex software implementation
     	//E(error) = 0.5 minor cycle
-    	tinyTime = tmp%minor_cycle;
+    	tinyTime = tmp%minor_cycle_len;
     }
 
 }
 //save stack code is needed! uart many times is time trade stack, it's after careful consideration!!!!!!!!!!
+//the dump goes through the log one row at a time, a 200 row table doesn't fit in the ring at once
 void showFastMatrix(void)
 {
-	char tableInfo[60+(TASK_NAME_LEN+8)*num_tasks];
-	sprintf(tableInfo,"[[-------------------showing scheduling table for %d seconds-------------------]]\r\n",SHOW_WINDOW);
-	HAL_UART_Transmit(&huart1, (uint8_t*)tableInfo, strlen(tableInfo),0xFFFF);
-	char tmp2[200];
-	for(int i=0;i<number_minor_cycle;i++)
+	dumpRow = 0;
+}
+//one line per run of identical minor cycles
+static void dumpStep(void)
+{
+	static unsigned int dumpMinor;
+	//a row: the run header and every task name, 60+(TASK_NAME_LEN+8)*TASKS_MAX at most
+	const int rowSize = 60+(TASK_NAME_LEN+8)*TASKS_MAX;
+	char *tableInfo = NULL;
+	while(dumpRow>=0 && Log_Free()>=rowSize)
 	{
-		sprintf(tableInfo,"| Minor cycle %d |  %dtasks  ",i,fast_matrix[i].n_tasks);
-		if(fast_matrix[i].n_tasks==0)
+		if(tableInfo==NULL && (tableInfo = Pool_Get(&ioPool,__func__))==NULL) return;
+		if(dumpRow==0)
+		{
+			Log_Printf("[[-------------------scheduling table, %d minor cycles in %d runs-------------------]]\r\n",shadow.number_minor_cycle,shadow.n_runs);
+			dumpMinor = 0;
+		}
+		if(dumpRow>=shadow.n_runs)
+		{
+			Log_Printf("\r\n\r\n");
+			dumpRow = -1;
+			break;
+		}
+		const Frame_Run *run = &shadow.runs[dumpRow++];
+		int n_tasks = __builtin_popcount(run->mask);
+		if(run->repeat>1)
+		{
+			sprintf(tableInfo,"| Minor cycle %d-%d |  %dtasks  ",dumpMinor,dumpMinor+run->repeat-1,n_tasks);
+		}
+		else
+		{
+			sprintf(tableInfo,"| Minor cycle %d |  %dtasks  ",dumpMinor,n_tasks);
+		}
+		dumpMinor += run->repeat;
+		if(n_tasks==0)
 		{
 			strcat(tableInfo,"[no tasks]\r\n");
 		}
-		for(int j=0;j<fast_matrix[i].n_tasks;j++)
+		Task_Mask release = run->mask;
+		int len = strlen(tableInfo);
+		for(int j=0;j<n_tasks;j++)
 		{
-			char *ins = ( (j==fast_matrix[i].n_tasks-1) ?"%s]\r\n":"%s,\t");
+			char *ins = ( (j==n_tasks-1) ?"%s]\r\n":"%s,\t");
 			if(j==0)
 			{
 				ins = "[%s,";
-				if(j==fast_matrix[i].n_tasks-1)
+				if(j==n_tasks-1)
 				{
 					ins = "[%s]\r\n";
 				}
 			}
-			sprintf(tmp2,ins,tasks[fast_matrix[i].task_code[j]].task_name);
-			strcat(tableInfo,tmp2);
+			len += sprintf(tableInfo+len,ins,tasks[shadow.order[__builtin_ctz(release)]].task_name);
+			release &= release-1;
 		}
-		HAL_UART_Transmit(&huart1, (uint8_t*)tableInfo, strlen(tableInfo),0xFFFF);
+		Log_Write(tableInfo,len);
 	}
-	sprintf(tableInfo,"\r\n\r\n");
-	HAL_UART_Transmit(&huart1, (uint8_t*)tableInfo, strlen(tableInfo),0xFFFF);
+	Pool_Put(&ioPool,tableInfo,__func__);
 }
@@ -0,0 +1,110 @@
+#include "feature_ext.h"
+#include <math.h>
+#include <string.h>
+
+static int16_t window[FEATURES_WINDOW][3];
+//bit per axis, set when the sample crossed the DC estimate
+static uint8_t crossed[FEATURES_WINDOW];
+static uint16_t head = 0;
+static uint16_t filled = 0;
+static int32_t sum[3];
+static int64_t sumSq[3];
+static uint16_t crossings[3];
+static int32_t dc[3]; //Q8
+static uint8_t above = 0; //bit per axis, side of the DC estimate of the last sample
+//2cos(2 pi k/N) of bins 1..FEATURES_PEAK_BINS
+static float coeff[FEATURES_PEAK_BINS];
+
+void Features_Init(void)
+{
+	memset(window, 0, sizeof(window));
+	memset(crossed, 0, sizeof(crossed));
+	memset(sum, 0, sizeof(sum));
+	memset(sumSq, 0, sizeof(sumSq));
+	memset(crossings, 0, sizeof(crossings));
+	memset(dc, 0, sizeof(dc));
+	head = filled = 0;
+	above = 0;
+	for(int k=0;k<FEATURES_PEAK_BINS;k++) coeff[k] = 2*cosf(2*(float)M_PI*(k+1)/FEATURES_WINDOW);
+}
+/**
+  * @brief  Slides the window by one sample.
+  * @param  xyz: Raw accelerometer sample, mg
+  * @retval None
+  */
+void Features_Add(const int16_t *xyz)
+{
+	uint8_t cross = 0;
+	for(int a=0;a<3;a++)
+	{
+		int32_t x = xyz[a], old = window[head][a];
+		sum[a] += x - old;
+		sumSq[a] += (int64_t)(x*x) - old*old;
+		//the first sample sets the DC estimate instead of crossing it
+		if(filled == 0) dc[a] = x<<8;
+		dc[a] += ((x<<8) - dc[a]) >> FEATURES_DC_SHIFT;
+		uint8_t side = (x<<8) > dc[a];
+		if(filled && side != ((above>>a)&1)) cross |= 1<<a;
+		above = (above & ~(1<<a)) | side<<a;
+		crossings[a] += ((cross>>a)&1) - ((crossed[head]>>a)&1);
+		window[head][a] = x;
+	}
+	crossed[head] = cross;
+	head = (head+1) % FEATURES_WINDOW;
+	if(filled < FEATURES_WINDOW) filled++;
+}
+int Features_Ready(void)
+{
+	return filled == FEATURES_WINDOW;
+}
+/**
+  * @brief  Features of the last FEATURES_WINDOW samples.
+  * @param  out: FEATURES floats, in enum Feature_Index order
+  * @param  sampleHz: Accelerometer task rate, for FEAT_PEAK_HZ
+  * @retval None
+  */
+void Features_Get(float *out, float sampleHz)
+{
+	const float n = FEATURES_WINDOW;
+	float energy = 0, mean[3];
+	for(int a=0;a<3;a++)
+	{
+		//mg to g
+		mean[a] = sum[a]/n/1000.0f;
+		float meanSq = sumSq[a]/n/1e6f;
+		out[FEAT_MEAN_X+a] = mean[a];
+		out[FEAT_VAR_X+a] = meanSq - mean[a]*mean[a];
+		out[FEAT_ZC_X+a] = crossings[a];
+		energy += meanSq;
+	}
+	out[FEAT_ENERGY] = energy;
+	//Goertzel for every bin and axis in one pass over the window, the chains are
+	//independent; over a whole window the mean only lands in bin 0
+	float s1[FEATURES_PEAK_BINS][3] = {{0}}, s2[FEATURES_PEAK_BINS][3] = {{0}};
+	for(int n=0,i=head;n<FEATURES_WINDOW;n++,i=(i+1)%FEATURES_WINDOW)
+	{
+		float x[3] = {window[i][0], window[i][1], window[i][2]};
+		for(int k=0;k<FEATURES_PEAK_BINS;k++)
+		{
+			for(int a=0;a<3;a++)
+			{
+				float s0 = (x[a] - s2[k][a]) + coeff[k]*s1[k][a];
+				s2[k][a] = s1[k][a];
+				s1[k][a] = s0;
+			}
+		}
+	}
+	float best = 0;
+	int peak = 1;
+	for(int k=0;k<FEATURES_PEAK_BINS;k++)
+	{
+		float power = 0;
+		for(int a=0;a<3;a++) power += s1[k][a]*s1[k][a] + s2[k][a]*s2[k][a] - coeff[k]*s1[k][a]*s2[k][a];
+		if(power > best)
+		{
+			best = power;
+			peak = k+1;
+		}
+	}
+	out[FEAT_PEAK_HZ] = peak*sampleHz/FEATURES_WINDOW;
+}
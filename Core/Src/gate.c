@@ -0,0 +1,167 @@
+#include "gate.h"
+#include <math.h>
+#ifdef GATE_HW_INACTIVITY
+#include "sensor_config.h"
+#endif
+
+volatile uint32_t gateRun = 0;
+volatile uint32_t gateSkipped = 0;
+volatile uint32_t gateAudits = 0;
+volatile uint32_t gateMisses = 0;
+volatile uint32_t gateOpenings = 0;
+static int32_t mean[3]; //Q8 mg
+static int32_t var[3]; //mg^2
+static float magMin, magMax, magLast;
+static int started = 0;
+static int closed = 0;
+static uint16_t quiet = 0;
+static uint16_t sinceAudit = 0;
+static int auditPending = 0;
+#ifdef GATE_HW_INACTIVITY
+static volatile int hwEvent = 0;
+static int hwSleeping = 0;
+
+//inactivity on the accelerometer only, the state change routed to INT1
+static void hwInit(void)
+{
+	uint8_t tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_TAP_CFG);
+	//INTERRUPTS_ENABLE, INACT_EN 01: accelerometer at 12.5Hz while asleep, gyro as it is
+	SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_TAP_CFG, (tmp & ~0x60) | 0x20 | 0x80);
+	tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_WAKE_UP_THS);
+	SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_WAKE_UP_THS, (tmp & ~0x3F) | GATE_HW_THRESHOLD);
+	tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_WAKE_UP_DUR);
+	SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_WAKE_UP_DUR, (tmp & ~0x0F) | GATE_HW_SLEEP_DUR);
+	tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_MD1_CFG);
+	SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_MD1_CFG, tmp | 0x80);
+	hwEvent = 1;
+}
+#endif
+
+void Gate_Init(void)
+{
+	started = closed = 0;
+	quiet = sinceAudit = 0;
+	auditPending = 0;
+#ifdef GATE_HW_INACTIVITY
+	hwInit();
+#endif
+}
+/**
+  * @brief  Follows one sample. Called by the sampling task.
+  * @param  xyz: Raw accelerometer sample, mg
+  * @retval None
+  */
+void Gate_Add(const int16_t *xyz)
+{
+	float mag = sqrtf((float)xyz[0]*xyz[0] + (float)xyz[1]*xyz[1] + (float)xyz[2]*xyz[2]);
+	if(!started)
+	{
+		for(int a=0;a<3;a++)
+		{
+			mean[a] = xyz[a]*256;
+			var[a] = 0;
+		}
+		magMin = magMax = magLast = mag;
+		started = 1;
+		return;
+	}
+	for(int a=0;a<3;a++)
+	{
+		int32_t d = (xyz[a]*256 - mean[a]) / 256;
+		mean[a] += (xyz[a]*256 - mean[a]) >> GATE_EMA_SHIFT;
+		var[a] += (d*d - var[a]) >> GATE_EMA_SHIFT;
+	}
+	if(mag < magMin) magMin = mag;
+	if(mag > magMax) magMax = mag;
+	magLast = mag;
+}
+/**
+  * @brief  Decides for the window that just completed and starts the range
+  * 		of the next one.
+  * @retval GATE_SKIP when the network can be left out
+  */
+Gate_DecisionTypeDef Gate_Window(void)
+{
+	float v = (float)var[0] + var[1] + var[2];
+	float range = magMax - magMin;
+	magMin = magMax = magLast;
+	int still = v < GATE_VAR_ENTER && range < GATE_RANGE_ENTER;
+	int moving = v > GATE_VAR_EXIT || range > GATE_RANGE_EXIT;
+#ifdef GATE_HW_INACTIVITY
+	if(hwEvent)
+	{
+		hwEvent = 0;
+		uint8_t src = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_WAKE_UP_SRC);
+		//SLEEP_STATE_IA
+		int sleeping = (src & 0x10) != 0;
+		if(hwSleeping && !sleeping) moving = 1;
+		hwSleeping = sleeping;
+	}
+	still |= hwSleeping;
+#endif
+	if(closed)
+	{
+		if(moving)
+		{
+			closed = 0;
+			quiet = 0;
+			gateOpenings++;
+			gateRun++;
+			return GATE_RUN;
+		}
+		if(GATE_AUDIT_EVERY && ++sinceAudit >= GATE_AUDIT_EVERY)
+		{
+			sinceAudit = 0;
+			auditPending = 1;
+			gateAudits++;
+			gateRun++;
+			return GATE_AUDIT;
+		}
+		gateSkipped++;
+		return GATE_SKIP;
+	}
+	quiet = still ? quiet+1 : 0;
+	if(quiet >= GATE_ENTER_WINDOWS)
+	{
+		closed = 1;
+		sinceAudit = 0;
+		gateSkipped++;
+		return GATE_SKIP;
+	}
+	gateRun++;
+	return GATE_RUN;
+}
+/**
+  * @brief  Takes the network's class for a window. After a GATE_AUDIT window
+  * 		anything but GATE_STATIONARY is a miss and opens the gate. A
+  * 		window the network had no room for leaves the audit to the next.
+  * @param  cls: Class index
+  * @retval None
+  */
+void Gate_Result(uint32_t cls)
+{
+	if(!auditPending) return;
+	auditPending = 0;
+	if(cls != GATE_STATIONARY && closed)
+	{
+		gateMisses++;
+		closed = 0;
+		quiet = 0;
+		gateOpenings++;
+	}
+}
+int Gate_Closed(void)
+{
+	return closed;
+}
+/**
+  * @brief  LSM6DSL INT1 hook, the sleep state changed. The state is read
+  * 		from the part at the next Gate_Window, not in the interrupt.
+  * @retval None
+  */
+void Gate_HwEvent(void)
+{
+#ifdef GATE_HW_INACTIVITY
+	hwEvent = 1;
+#endif
+}
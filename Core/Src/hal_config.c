@@ -2,6 +2,9 @@
 #include "stdio.h"
 #include "string.h"
 #include "wifi.h"
+#include "trace.h"
+#include "stackmon.h"
+#include "gate.h"
 //set clock to 80hz
 __IO FlagStatus cmdDataReady = 0;
 SPI_HandleTypeDef hspi3;
@@ -29,8 +32,8 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 	//button interrupt:change mode and send a message;
 	if(GPIO_Pin == CYCLIC_MODE_TRIGGER_PIN)
 	{
+		nextMode = (nextMode+1)%2;
 		changeModeMark = 1;
-		mode = (mode+1)%2;
 	}
 	//note: the lsm6dsl didn't say the drdy and function interrupt can't work together,
 	//so here can't measure lsm6dsl period.
@@ -39,6 +42,9 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 	{
 //		char *message = "in exti 11!\r\n";
 //	    HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+#ifdef GATE_HW_INACTIVITY
+		Gate_HwEvent();
+#endif
 		uint8_t res = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, 0x53);
 		res = (res&(1<<5))&&1;
 		//All interruption uses "or"
@@ -60,18 +66,18 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 		if(BSP_ACCELERO_Ready())
 		{
 			int tickNow = HAL_GetTick();
-			int tickAcc = abs(tickNow - tasks[ACCELERO].taskTick);
-			tasks[ACCELERO].taskTick = tickNow;
-			tasks[ACCELERO].periodNum =  tasks[ACCELERO].periodNum+1;
-			tasks[ACCELERO].periodSum = tasks[ACCELERO].periodSum+tickAcc;
+			int tickAcc = abs(tickNow - taskStats.taskTick[ACCELERO]);
+			taskStats.taskTick[ACCELERO] = tickNow;
+			taskStats.periodNum[ACCELERO] =  taskStats.periodNum[ACCELERO]+1;
+			taskStats.periodSum[ACCELERO] = taskStats.periodSum[ACCELERO]+tickAcc;
 		}
 		if(BSP_GYRO_Ready())
 		{
 			int tickNow = HAL_GetTick();
-			int tickAcc = abs(tickNow - tasks[GYRO].taskTick);
-			tasks[GYRO].taskTick = tickNow;
-			tasks[GYRO].periodNum =  tasks[GYRO].periodNum+1;
-			tasks[GYRO].periodSum = tasks[GYRO].periodSum+tickAcc;
+			int tickAcc = abs(tickNow - taskStats.taskTick[GYRO]);
+			taskStats.taskTick[GYRO] = tickNow;
+			taskStats.periodNum[GYRO] =  taskStats.periodNum[GYRO]+1;
+			taskStats.periodSum[GYRO] = taskStats.periodSum[GYRO]+tickAcc;
 		}
 #endif
 	}
@@ -82,37 +88,37 @@ void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 	else if(GPIO_Pin == GPIO_PIN_10)
 	{
 		int tickNow = HAL_GetTick();
-		int tickAcc = abs(tickNow - tasks[PIEZO].taskTick);
-		tasks[PIEZO].taskTick = tickNow;
-		tasks[PIEZO].periodNum =  tasks[PIEZO].periodNum+1;
-		tasks[PIEZO].periodSum = tasks[PIEZO].periodSum+tickAcc;
+		int tickAcc = abs(tickNow - taskStats.taskTick[PIEZO]);
+		taskStats.taskTick[PIEZO] = tickNow;
+		taskStats.periodNum[PIEZO] =  taskStats.periodNum[PIEZO]+1;
+		taskStats.periodSum[PIEZO] = taskStats.periodSum[PIEZO]+tickAcc;
 	}
 	else if(GPIO_Pin == GPIO_PIN_15)
 	{
 		if(BSP_HSENSOR_Ready())
 		{
 			int tickNow = HAL_GetTick();
-			int tickAcc = abs(tickNow - tasks[HUMI].taskTick);
-			tasks[HUMI].taskTick = tickNow;
-			tasks[HUMI].periodNum =  tasks[HUMI].periodNum+1;
-			tasks[HUMI].periodSum = tasks[HUMI].periodSum+tickAcc;
+			int tickAcc = abs(tickNow - taskStats.taskTick[HUMI]);
+			taskStats.taskTick[HUMI] = tickNow;
+			taskStats.periodNum[HUMI] =  taskStats.periodNum[HUMI]+1;
+			taskStats.periodSum[HUMI] = taskStats.periodSum[HUMI]+tickAcc;
 		}
 		if(BSP_TSENSOR_Ready())
 		{
 			int tickNow = HAL_GetTick();
-			int tickAcc = abs(tickNow - tasks[TEMP].taskTick);
-			tasks[TEMP].taskTick = tickNow;
-			tasks[TEMP].periodNum =  tasks[TEMP].periodNum+1;
-			tasks[TEMP].periodSum = tasks[TEMP].periodSum+tickAcc;
+			int tickAcc = abs(tickNow - taskStats.taskTick[TEMP]);
+			taskStats.taskTick[TEMP] = tickNow;
+			taskStats.periodNum[TEMP] =  taskStats.periodNum[TEMP]+1;
+			taskStats.periodSum[TEMP] = taskStats.periodSum[TEMP]+tickAcc;
 		}
 	}
 	else if(GPIO_Pin == GPIO_PIN_8)
 	{
 		int tickNow = HAL_GetTick();
-		int tickAcc = abs(tickNow - tasks[MEGNETO].taskTick);
-		tasks[MEGNETO].taskTick = tickNow;
-		tasks[MEGNETO].periodNum =  tasks[MEGNETO].periodNum+1;
-		tasks[MEGNETO].periodSum = tasks[MEGNETO].periodSum+tickAcc;
+		int tickAcc = abs(tickNow - taskStats.taskTick[MEGNETO]);
+		taskStats.taskTick[MEGNETO] = tickNow;
+		taskStats.periodNum[MEGNETO] =  taskStats.periodNum[MEGNETO]+1;
+		taskStats.periodSum[MEGNETO] = taskStats.periodSum[MEGNETO]+tickAcc;
 	}
 #endif
 }
@@ -386,6 +392,10 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 	{
 		//jumpPos();
 			pos=1;
+		//the scheduler counts these, a tick that comes while it's still busy isn't lost
+		tickCycles = DWT->CYCCNT;
+		tickCount++;
+		TRACE(TRACE_TICK,0,minor_cycle);
 	}
 	//timer2 responsible for triangle blinking
 	else if(htim->Instance == TIM2)
@@ -398,11 +408,19 @@ void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 
 void TIM1_UP_TIM16_IRQHandler(void)
 {
+	TRACE(TRACE_ISR_ENTER,TIM1_UP_TIM16_IRQn,0);
+	STACK_ISR_ENTER(TIM1_UP_TIM16_IRQn);
 	HAL_TIM_IRQHandler(&TIM1_Handler);
+	STACK_ISR_EXIT(TIM1_UP_TIM16_IRQn);
+	TRACE(TRACE_ISR_EXIT,TIM1_UP_TIM16_IRQn,0);
 }
 void TIM2_IRQHandler(void)
 {
+	TRACE(TRACE_ISR_ENTER,TIM2_IRQn,0);
+	STACK_ISR_ENTER(TIM2_IRQn);
 	HAL_TIM_IRQHandler(&TIM2_Handler);
+	STACK_ISR_EXIT(TIM2_IRQn);
+	TRACE(TRACE_ISR_EXIT,TIM2_IRQn,0);
 }
 
 
@@ -0,0 +1,96 @@
+#include "imu_stream.h"
+
+#if IMU_STREAM_BATCH > IMU_STREAM_MAX_BATCH
+#error "IMU_STREAM_BATCH does not fit in one datagram"
+#endif
+
+static WIFI_HandleTypeDef *streamWifi;
+static uint8_t datagram[IMU_STREAM_HEADER_SIZE + IMU_STREAM_BATCH*IMU_STREAM_CHANNELS*2];
+static uint16_t count = 0;
+static uint32_t t0 = 0;
+static uint32_t tLast = 0;
+static IMU_StreamStatsTypeDef stats;
+
+static void putU16(uint8_t *p, uint16_t v)
+{
+	p[0] = v>>8;
+	p[1] = v&0xff;
+}
+static void putU32(uint8_t *p, uint32_t v)
+{
+	p[0] = v>>24;
+	p[1] = v>>16;
+	p[2] = v>>8;
+	p[3] = v&0xff;
+}
+/**
+  * @brief  Binds the stream to an open UDP socket and clears the counters.
+  * @param  hwifi: Wifi handle, connected with WIFI_UDP_PROTOCOL
+  * @retval None
+  */
+void IMU_Stream_Init(WIFI_HandleTypeDef* hwifi)
+{
+	streamWifi = hwifi;
+	count = 0;
+	memset(&stats,0,sizeof(stats));
+}
+/**
+  * @brief  Appends one sample to the current batch and sends the batch once
+  * 		IMU_STREAM_BATCH samples are queued.
+  * @param  xyz: IMU_STREAM_CHANNELS raw values
+  * @param  tick: HAL tick of the reading
+  * @retval WIFI_StatusTypeDef of the send, WIFI_OK if nothing was sent
+  */
+WIFI_StatusTypeDef IMU_Stream_Push(const int16_t *xyz, uint32_t tick)
+{
+	if(count == 0) t0 = tick;
+	tLast = tick;
+	uint8_t *p = datagram + IMU_STREAM_HEADER_SIZE + count*IMU_STREAM_CHANNELS*2;
+	for(int i=0;i<IMU_STREAM_CHANNELS;i++)
+	{
+		putU16(p+2*i, (uint16_t)xyz[i]);
+	}
+	count++;
+	if(count < IMU_STREAM_BATCH) return WIFI_OK;
+	return IMU_Stream_Flush();
+}
+/**
+  * @brief  Sends whatever is queued as one datagram. A failed send is not
+  * 		retried, the batch is dropped and its sequence number is used up
+  * 		so the receiver accounts for it as loss.
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef IMU_Stream_Flush(void)
+{
+	if(count == 0 || streamWifi == NULL) return WIFI_OK;
+	datagram[0] = 'I';
+	datagram[1] = 'M';
+	datagram[2] = IMU_STREAM_VERSION;
+	datagram[3] = IMU_STREAM_CHANNELS;
+	putU32(datagram+4, stats.seq);
+	putU32(datagram+8, t0);
+	putU16(datagram+12, (uint16_t)(tLast-t0));
+	putU16(datagram+14, count);
+	uint16_t len = IMU_STREAM_HEADER_SIZE + count*IMU_STREAM_CHANNELS*2;
+	WIFI_StatusTypeDef status = WIFI_SendRaw(streamWifi, datagram, len);
+	stats.seq++;
+	if(status == WIFI_OK)
+	{
+		stats.datagrams++;
+		stats.samples += count;
+	}
+	else
+	{
+		stats.sendErrors++;
+	}
+	count = 0;
+	return status;
+}
+uint16_t IMU_Stream_Pending(void)
+{
+	return count;
+}
+const IMU_StreamStatsTypeDef* IMU_Stream_Stats(void)
+{
+	return &stats;
+}
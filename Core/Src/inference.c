@@ -0,0 +1,184 @@
+#include "inference.h"
+#include "main.h"
+#include "network_data.h"
+#include "core_common.h"
+#include "trace.h"
+#include "placement.h"
+#include "weights.h"
+#include "sparse_dense.h"
+#include "log.h"
+#include <stdio.h>
+#include <string.h>
+
+extern UART_HandleTypeDef huart1;
+
+volatile uint32_t inferenceDropped = 0;
+static ai_handle network;
+//the runtime's scratch, inputs and outputs included; every layer reads and writes it
+static ai_u8 activations[AI_NETWORK_DATA_ACTIVATIONS_SIZE] RAM2_BSS __attribute__((aligned(4)));
+static ai_buffer *ai_input;
+static ai_buffer *ai_output;
+static float result[AI_NETWORK_OUT_1_SIZE];
+static Inference_Callback onDone;
+//next layer to run, NULL while no window is in the network
+static ai_node *layer = NULL;
+static uint32_t cycles;
+static uint8_t layerIndex;
+//weights to switch to before the next window, NULL when there is no switch
+static const void *pendingWeights = NULL;
+
+#ifdef SPARSE_DENSE_STRIP
+//ai_network_data_params_get would link the full weights back in through
+//g_network_data_map_weights; the same maps with no address in them
+static ai_buffer mapActivations[AI_NETWORK_DATA_ACTIVATIONS_COUNT] = {
+	AI_BUFFER_INIT(AI_FLAG_NONE, AI_BUFFER_FORMAT_U8,
+		AI_BUFFER_SHAPE_INIT(AI_SHAPE_BCWH, 4, 1, AI_NETWORK_DATA_ACTIVATIONS_SIZE, 1, 1),
+		AI_NETWORK_DATA_ACTIVATIONS_SIZE, NULL, NULL)};
+static ai_buffer mapWeights[AI_NETWORK_DATA_WEIGHTS_COUNT] = {
+	AI_BUFFER_INIT(AI_FLAG_NONE, AI_BUFFER_FORMAT_U8,
+		AI_BUFFER_SHAPE_INIT(AI_SHAPE_BCWH, 4, 1, AI_NETWORK_DATA_WEIGHTS_SIZE, 1, 1),
+		AI_NETWORK_DATA_WEIGHTS_SIZE, NULL, NULL)};
+static ai_bool paramsGet(ai_network_params *params)
+{
+	const ai_buffer_array activationsMap = AI_BUFFER_ARRAY_OBJ_INIT(AI_FLAG_NONE, AI_NETWORK_DATA_ACTIVATIONS_COUNT, mapActivations);
+	const ai_buffer_array weightsMap = AI_BUFFER_ARRAY_OBJ_INIT(AI_FLAG_NONE, AI_NETWORK_DATA_WEIGHTS_COUNT, mapWeights);
+	return ai_platform_bind_network_params(params, &weightsMap, &activationsMap);
+}
+#else
+#define paramsGet ai_network_data_params_get
+#endif
+//binds the activations and the weights, ai_network_init only sets up pointers
+static ai_bool bindWeights(const void *weights)
+{
+	ai_network_params params;
+	if(!paramsGet(&params)) return false;
+	AI_BUFFER_ARRAY_ITEM_SET_ADDRESS(&params.map_activations, 0, activations);
+	AI_BUFFER_ARRAY_ITEM_SET_ADDRESS(&params.map_weights, 0, (ai_handle)weights);
+	if(!ai_network_init(network, &params)) return false;
+	//inputs and outputs are allocated in the activations, data already points there
+	ai_input = ai_network_inputs_get(network, NULL);
+	ai_output = ai_network_outputs_get(network, NULL);
+	//the sparse table only holds for the weights it was pruned from
+	return Sparse_Install(AI_NETWORK_ACQUIRE_CTX(network)->input_node, weights);
+}
+void Inference_Init(Inference_Callback done)
+{
+	ai_error err;
+	__HAL_RCC_CRC_CLK_ENABLE();
+	onDone = done;
+	err = ai_network_create(&network, AI_NETWORK_DATA_CONFIG);
+	if(err.type == AI_ERROR_NONE && !bindWeights(Weights_Active()))
+	{
+		err = ai_network_get_error(network);
+		//the runtime took the weights, the sparse table doesn't go with them
+		if(err.type == AI_ERROR_NONE) err = (ai_error){AI_ERROR_INIT_FAILED, AI_ERROR_CODE_NETWORK_WEIGHTS};
+	}
+	if(err.type != AI_ERROR_NONE)
+	{
+		char message[100];
+		sprintf(message,"AI ai_network_create error - type=%d code=%d\r\n", err.type, err.code);
+		HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+		Error_Handler();
+	}
+}
+int Inference_Busy(void)
+{
+	return layer != NULL;
+}
+/**
+  * @brief  Switches the network to other weights from the next window on,
+  * 		the window in the network finishes with the ones it started with.
+  * @param  weights: AI_NETWORK_DATA_WEIGHTS_SIZE bytes, 4 byte aligned
+  * @retval None
+  */
+void Inference_SetWeights(const void *weights)
+{
+	pendingWeights = weights;
+}
+int Inference_SwapPending(void)
+{
+	return pendingWeights != NULL;
+}
+static void swapWeights(void)
+{
+	if(!bindWeights(pendingWeights))
+	{
+		ai_error err = ai_network_get_error(network);
+		Log_Printf("AI weights switch error - type=%d code=%d\r\n", err.type, err.code);
+		//back to the weights in the image, they passed Inference_Init
+		bindWeights(WEIGHTS_IMAGE);
+	}
+	pendingWeights = NULL;
+}
+/**
+  * @brief  The network input, to be filled before Inference_Start. It lives
+  * 		in the activations, so only between two windows.
+  * @retval AI_NETWORK_IN_1_SIZE floats, NULL when the previous window is
+  * 		still running
+  */
+float *Inference_Input(void)
+{
+	if(layer != NULL)
+	{
+		inferenceDropped++;
+		return NULL;
+	}
+	//the input may move with the weights
+	if(pendingWeights != NULL) swapWeights();
+	return (float*)ai_input[0].data;
+}
+/**
+  * @brief  Starts an inference on the window written to Inference_Input.
+  * @retval None
+  */
+void Inference_Start(void)
+{
+	cycles = 0;
+	layerIndex = 0;
+	layer = AI_NETWORK_ACQUIRE_CTX(network)->input_node;
+}
+static uint32_t argmax(const float * values, uint32_t len)
+{
+	float max_value = values[0];
+	uint32_t max_index = 0;
+	for(uint32_t i = 1; i < len; i++)
+	{
+		if(values[i] > max_value)
+		{
+			max_value = values[i];
+			max_index = i;
+		}
+	}
+	return max_index;
+}
+/**
+  * @brief  Scheduler task: runs the next layer of the submitted window.
+  * 		The last node of the chain links to itself.
+  * @retval None
+  */
+void Inference_Step(void)
+{
+	if(layer == NULL)
+	{
+		return;
+	}
+	TRACE(TRACE_INFER_START,layerIndex,0);
+	uint32_t c1 = DWT->CYCCNT;
+	layer->forward(layer);
+	cycles += DWT->CYCCNT - c1;
+	TRACE(TRACE_INFER_END,layerIndex,0);
+	layerIndex++;
+	if(layer->next != layer)
+	{
+		layer = layer->next;
+		return;
+	}
+	layer = NULL;
+	//the output shares the activations with the next input, take it out now
+	memcpy(result, ai_output[0].data, sizeof(result));
+	uint32_t cls = argmax(result, AI_NETWORK_OUT_1_SIZE);
+	if(onDone)
+	{
+		onDone(result, cls, cycles/(SystemCoreClock/1000000));
+	}
+}
@@ -0,0 +1,81 @@
+#include "log.h"
+#include "pool.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+extern UART_HandleTypeDef huart1;
+volatile uint32_t logDropped = 0;
+static char ring[LOG_BUFFER_SIZE];
+//head is written by Log_Write, tail by Log_Drain; one slot stays empty
+static uint16_t head = 0;
+static uint16_t tail = 0;
+#if LOG_LINE_SIZE > POOL_TEXT_SIZE
+#error "a log line is formatted in a text pool block"
+#endif
+
+uint16_t Log_Pending(void)
+{
+	return (head + LOG_BUFFER_SIZE - tail) % LOG_BUFFER_SIZE;
+}
+uint16_t Log_Free(void)
+{
+	return LOG_BUFFER_SIZE - 1 - Log_Pending();
+}
+/**
+  * @brief  Queues len bytes for the uart.
+  * @param  s: Text, not necessarily terminated
+  * @param  len: Number of bytes
+  * @retval len, or 0 when the ring is full and the text was dropped
+  */
+int Log_Write(const char *s, int len)
+{
+	if(len <= 0) return 0;
+	if(len > Log_Free())
+	{
+		logDropped++;
+		return 0;
+	}
+	int first = LOG_BUFFER_SIZE - head;
+	if(first > len) first = len;
+	memcpy(ring+head, s, first);
+	memcpy(ring, s+first, len-first);
+	head = (head + len) % LOG_BUFFER_SIZE;
+	return len;
+}
+int Log_Printf(const char *fmt, ...)
+{
+	char *line = Pool_Get(&textPool, __func__);
+	if(line == NULL)
+	{
+		logDropped++;
+		return 0;
+	}
+	va_list args;
+	va_start(args, fmt);
+	int n = vsnprintf(line, LOG_LINE_SIZE, fmt, args);
+	va_end(args);
+	if(n >= LOG_LINE_SIZE) n = LOG_LINE_SIZE-1;
+	n = Log_Write(line, n);
+	Pool_Put(&textPool, line, __func__);
+	return n;
+}
+/**
+  * @brief  Idle task: sends queued text, never more than the uart can
+  * 		shift out in the time left (1ms kept as margin).
+  * @param  remaining: ms until the next scheduler tick
+  * @retval None
+  */
+void Log_Drain(int remaining)
+{
+	int budget = (remaining-1)*LOG_UART_BYTES_PER_MS;
+	while(budget > 0 && head != tail)
+	{
+		//contiguous part only, the wrapped part goes in the next round
+		int n = (head > tail ? head : LOG_BUFFER_SIZE) - tail;
+		if(n > budget) n = budget;
+		HAL_UART_Transmit(&huart1, (uint8_t*)ring+tail, n, remaining);
+		tail = (tail + n) % LOG_BUFFER_SIZE;
+		budget -= n;
+	}
+}
@@ -17,72 +17,108 @@
 #include "network.h"
 #include "network_data.h"
 #include "wifi.h"
-ai_handle network;
-float aiInData[AI_NETWORK_IN_1_SIZE];
-float aiOutData[AI_NETWORK_OUT_1_SIZE];
-ai_u8 activations[AI_NETWORK_DATA_ACTIVATIONS_SIZE];
+#include "mqtt.h"
+#include "imu_stream.h"
+#include "tscompress.h"
+#include "remote.h"
+#include "metrics.h"
+#include "log.h"
+#include "inference.h"
+#include "weights.h"
+#include "classifier.h"
+#include "gate.h"
+#include "activity.h"
+#include "pipeline.h"
+#include "trace.h"
+#include "stackmon.h"
+#include "pool.h"
+//uplink: MQTT publishes instead of the raw length-prefixed strings over TCP
+//#define UPLINK_MQTT
+//uplink: raw accelerometer batches as UDP datagrams (see imu_stream.h)
+//#define UPLINK_UDP
+//TCP uplink: compressed series blocks instead of one ASCII reading per second
+//(frame = 4 byte length, "TS", series id, block; decode with Tools/tsc_dump.c)
+//#define UPLINK_TSC
+#if defined(UPLINK_TSC) && (defined(UPLINK_MQTT) || defined(UPLINK_UDP))
+//the blocks are framed for the raw TCP stream, tscInit only runs on that path
+#error "UPLINK_TSC is a TCP uplink, it can't go with UPLINK_MQTT or UPLINK_UDP"
+#endif
+#ifndef UPLINK_MQTT
+//binary commands from the server on the uplink socket (see remote.h),
+//the MQTT stream belongs to the broker so it's only for the raw socket paths
+#define REMOTE_CMD_EN
+#endif
+//scrapeable counters on http port 80 of the module (see metrics.h)
+#define METRICS_EN
+//fast mode runs the const table generated by Tools/schedgen.c (Core/Src/schedule_table.c)
+//instead of building one at runtime
+//#define CONST_SCHEDULE
+#ifdef CONST_SCHEDULE
+extern const Schedule_Table schedule_table;
+#endif
+#define UPLINK_HOST "47.108.170.207"
+#ifdef UPLINK_MQTT
+#define UPLINK_PORT "1883"
+#elif defined(UPLINK_UDP)
+#define UPLINK_PORT "6667"
+#else
+#define UPLINK_PORT "6666"
+#endif
 const char* activities[AI_NETWORK_OUT_1_SIZE] = {
   "stationary", "walking", "running"
 };
-ai_buffer * ai_input;
-ai_buffer * ai_output;
-static void AI_Init(void);
-static void AI_Run(float *pIn, float *pOut);
-static uint32_t argmax(const float * values, uint32_t len);
-uint32_t write_index = 0;
+#ifdef GATE_EN
+static const float stationaryScores[AI_NETWORK_OUT_1_SIZE] = {[GATE_STATIONARY] = 1.0f};
+#endif
 
 
-static void AI_Init(void)
+char ssid[] = "HUAWEI-1CR2PZ";
+char passphrase[] = "86443860";
+WIFI_HandleTypeDef hwifi;
+float temp,humi;
+const char *state="idle";
+#ifdef UPLINK_TSC
+enum {TSC_TEMP, TSC_HUMI, TSC_ACC_X, TSC_ACC_Y, TSC_ACC_Z, TSC_SERIES};
+//accel gets ~110 samples/s per axis, temperature and humidity 12.5/s
+static uint8_t tscBuf[TSC_SERIES][384];
+static const uint16_t tscCap[TSC_SERIES] = {128, 128, 384, 384, 384};
+static TSC_EncoderTypeDef tscEnc[TSC_SERIES];
+static void tscInit(void)
 {
-  ai_error err;
-  __HAL_RCC_CRC_CLK_ENABLE();
-  /* Create a local array with the addresses of the activations buffers */
-  const ai_handle act_addr[] = { activations };
-  char message[100];
-  /* Create an instance of the model */
-  err = ai_network_create_and_init(&network, act_addr, NULL);
-  if (err.type != AI_ERROR_NONE) {
-	sprintf(message,"AI ai_network_run error - type=%d code=%d\r\n", err.type, err.code);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-    Error_Handler();
-  }
-  ai_input = ai_network_inputs_get(network, NULL);
-  ai_output = ai_network_outputs_get(network, NULL);
+	for(int i=0;i<TSC_SERIES;i++)
+	{
+		//temperature and humidity are reported with 0.01 resolution anyway
+		TSC_EncoderInit(&tscEnc[i],tscBuf[i],tscCap[i],i <= TSC_HUMI ? 0.01f : 0);
+	}
 }
-static void AI_Run(float *pIn, float *pOut)
+static void tscSend(int id)
 {
-  ai_i32 batch;
-  ai_error err;
-
-  /* Update IO handlers with the data payload */
-  ai_input[0].data = AI_HANDLE_PTR(pIn);
-  ai_output[0].data = AI_HANDLE_PTR(pOut);
-  char message[100];
-  batch = ai_network_run(network, ai_input, ai_output);
-  if (batch != 1) {
-    err = ai_network_get_error(network);
-    sprintf(message,"AI ai_network_run error - type=%d code=%d\r\n", err.type, err.code);
-    HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-    Error_Handler();
-  }
+	//length prefix as in WIFI_SendStr, then the series tag and the block
+	static uint8_t frame[4+3+384];
+	uint16_t len = TSC_Finish(&tscEnc[id]);
+	if(len == 0) return;
+	uint32_t size = len + 3;
+	frame[0] = size>>24;
+	frame[1] = size>>16;
+	frame[2] = size>>8;
+	frame[3] = size;
+	frame[4] = 'T';
+	frame[5] = 'S';
+	frame[6] = id;
+	memcpy(frame+7,tscBuf[id],len);
+	WIFI_SendRaw(&hwifi,frame,len+7);
+	TSC_Reset(&tscEnc[id]);
 }
-static uint32_t argmax(const float * values, uint32_t len)
+static void tscPush(int id, float v)
 {
-  float max_value = values[0];
-  uint32_t max_index = 0;
-  for (uint32_t i = 1; i < len; i++) {
-    if (values[i] > max_value) {
-      max_value = values[i];
-      max_index = i;
-    }
-  }
-  return max_index;
+	uint32_t t = HAL_GetTick();
+	if(TSC_Append(&tscEnc[id],t,v) != 0)
+	{
+		tscSend(id);
+		TSC_Append(&tscEnc[id],t,v);
+	}
 }
-char ssid[] = "HUAWEI-1CR2PZ";
-char passphrase[] = "86443860";
-WIFI_HandleTypeDef hwifi;
-float temp,humi;
-const char *state="idle";
+#endif
 static void WIFI_Init_main(){
 
 	hwifi.handle = &hspi3;
@@ -93,103 +129,227 @@ static void WIFI_Init_main(){
 	hwifi.ipStatus = IP_V4;
 	hwifi.transportProtocol = WIFI_TCP_PROTOCOL;
 	hwifi.port = 8080;
+#ifdef UPLINK_MQTT
+	hwifi.transportProtocol = WIFI_MQTT_PROTOCOL;
+	strcpy(hwifi.mqtt.publishTopic,"ca3/node0");
+	strcpy(hwifi.mqtt.subscribeTopic,"ca3/node0/cmd");
+	strcpy(hwifi.mqtt.clientId,"ca3-node0");
+	hwifi.mqtt.securityMode = WIFI_MQTT_SECURITY_NONE;
+	hwifi.mqtt.keepAlive = 60;
+	hwifi.mqtt.qos = 1;
+#elif defined(UPLINK_UDP)
+	hwifi.transportProtocol = WIFI_UDP_PROTOCOL;
+#endif
 
 	WIFI_Init(&hwifi);
 }
+#if !defined(UPLINK_UDP) && !defined(UPLINK_TSC)
+//a new activity goes up in the next slack big enough for a send instead of waiting for the report period
+#define REPORT_ON_CHANGE
+#define REPORT_SEND_BUDGET 40000 //us, three S3 sends until the first run is measured
+static int reportJob = -1;
+#endif
+#if CLASSIFIER != CLASSIFIER_CNN
+static void classifyWindow(void);
+#elif defined(GATE_EN)
+static void inferenceDone(const float *out, uint32_t class, uint32_t us);
+#endif
+#if CLASSIFIER == CLASSIFIER_CNN || defined(CLASSIFIER_COMPARE)
+//the window goes from the pipeline's ring straight into the network input
+static int submitWindow(void)
+{
+	float *input = Inference_Input();
+	if(input == NULL) return 0;
+	Pipeline_Copy(input);
+	Inference_Start();
+	return 1;
+}
+#endif
 void taskAcc(void)
 {
 	float accXYZ[3];
 	int16_t accXYZ_in[3];
 	BSP_ACCELERO_AccGetXYZ(accXYZ_in);
+#ifdef UPLINK_UDP
+	IMU_Stream_Push(accXYZ_in,HAL_GetTick());
+#endif
+#ifdef UPLINK_TSC
+	tscPush(TSC_ACC_X,accXYZ_in[0]);
+	tscPush(TSC_ACC_Y,accXYZ_in[1]);
+	tscPush(TSC_ACC_Z,accXYZ_in[2]);
+#endif
 	accXYZ[0] = accXYZ_in[0]/100;
 	accXYZ[1] = accXYZ_in[1]/100;
 	accXYZ[2] = accXYZ_in[2]/100;
-	char message[100];
-	sprintf(message,"Major Cycle %d |Minor Cycle %d| Accel X:%8.4f; Accel Y:%8.4f; Accel Z:%8.4f (m/s2)\r\n",major_cycle,minor_cycle,accXYZ[0],accXYZ[1],accXYZ[2]);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-	aiInData[write_index + 0] = (float)accXYZ_in[0]/4000.0f;
-    aiInData[write_index + 1] = (float)accXYZ_in[1]/4000.0f;
-	aiInData[write_index + 2] = (float)accXYZ_in[2]/4000.0f;
-	write_index += 3;
-	if (write_index == AI_NETWORK_IN_1_SIZE) {
-	        write_index = 0;
-
-	        sprintf(message,"Running inference\r\n");
-	        HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-	        AI_Run(aiInData, aiOutData);
-
-	        /* Output results */
-	        for (uint32_t i = 0; i < AI_NETWORK_OUT_1_SIZE; i++) {
-	          sprintf(message,"%8.6f ", aiOutData[i]);
-	          HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
-	        }
-	        uint32_t class = argmax(aiOutData, AI_NETWORK_OUT_1_SIZE);
-	        sprintf(message,": %d - %s\r\n", (int) class, activities[class]);
-	        state = activities[class];
-	        HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+#if CLASSIFIER != CLASSIFIER_CNN
+	Features_Add(accXYZ_in);
+#elif defined(GATE_EN)
+	Gate_Add(accXYZ_in);
+#endif
+	Log_Printf("Major Cycle %d |Minor Cycle %d| Accel X:%8.4f; Accel Y:%8.4f; Accel Z:%8.4f (m/s2)\r\n",major_cycle,minor_cycle,accXYZ[0],accXYZ[1],accXYZ[2]);
+	uint32_t tick = HAL_GetTick();
+	Pipeline_Put(PIPELINE_ACC,accXYZ_in[0],accXYZ_in[1],accXYZ_in[2],tick);
+	//the accelerometer clocks the frames, the window slides by the stride and the newest frames stay
+	if(Pipeline_Frame(tick, remoteConfig.inferenceStride ? remoteConfig.inferenceStride : PIPELINE_FRAMES)) {
+#if CLASSIFIER == CLASSIFIER_CNN
+#ifdef GATE_EN
+	        //a board lying still is reported stationary without the network
+	        if(Gate_Window() == GATE_SKIP) inferenceDone(stationaryScores, GATE_STATIONARY, 0);
+	        else
+#endif
+	        //the network runs layer by layer in its own task, a window that comes while it's busy is dropped
+	        submitWindow();
+#else
+	        classifyWindow();
+#endif
   }
 }
+static void inferenceDone(const float *out, uint32_t class, uint32_t us)
+{
+	Log_Printf("%8.6f %8.6f %8.6f : %d - %s (%u us)\r\n", out[0], out[1], out[2], (int) class, activities[class], (unsigned)us);
+#ifdef METRICS_EN
+	Metrics_RecordInference(us, class);
+#endif
+#ifdef ACTIVITY_SMOOTH_EN
+	//the reported state only moves on a smoothed, confident class once the old one was held long enough
+	if(!Activity_Update(out, HAL_GetTick())) return;
+	class = Activity_State();
+	Log_Printf("Activity: %s (%.2f)\r\n", activities[class], Activity_Confidence());
+#endif
+#ifdef REPORT_ON_CHANGE
+	//one report per change: the job sends it, or the periodic report does and cancels the job
+	//(activity changes = runs + cancelled of "Report on change" in the metrics)
+	if(state != activities[class])
+	{
+		releaseAperiodicTask(reportJob);
+	}
+#endif
+	state = activities[class];
+}
+#if CLASSIFIER == CLASSIFIER_CNN && defined(GATE_EN)
+//network results, the gate's audits among them; gated windows go to inferenceDone directly
+static void networkDone(const float *out, uint32_t class, uint32_t us)
+{
+	Gate_Result(class);
+	inferenceDone(out, class, us);
+}
+#endif
+#if CLASSIFIER != CLASSIFIER_CNN
+#ifdef CLASSIFIER_COMPARE
+//the CNN only runs to check the feature model against
+static void cnnDone(const float *out, uint32_t class, uint32_t us)
+{
+	(void)out;
+	Classifier_Compare(class);
+	Log_Printf("CNN: %d - %s (%u us)\r\n", (int) class, activities[class], (unsigned)us);
+}
+#endif
+//features and the model take microseconds, they run right here in the sampling task
+static void classifyWindow(void)
+{
+	float scores[CLASSIFIER_CLASSES];
+	uint32_t class;
+#ifdef CLASSIFIER_COMPARE
+	//both look at the same windows, one the CNN has no room for isn't classified either
+	if(!submitWindow()) return;
+#endif
+	if(Classifier_Window(1000.0f/tasks[ACCELERO].period, scores, &class))
+	{
+		inferenceDone(scores, class, classifierLastUs);
+	}
+}
+#endif
 void taskTemp(void)
 {
 	temp = BSP_TSENSOR_ReadTemp();
-	char message[100];
-	sprintf(message,"Major Cycle %d |Minor Cycle %d| Temperature : %8.4f(Celsius)\r\n",major_cycle,minor_cycle,temp);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+#ifdef UPLINK_TSC
+	tscPush(TSC_TEMP,temp);
+#endif
+	char *message = Pool_Get(&textPool, __func__);
+	if(message == NULL) return;
+	int n = snprintf(message,POOL_TEXT_SIZE,"Major Cycle %d |Minor Cycle %d| Temperature : %8.4f(Celsius)\r\n",major_cycle,minor_cycle,temp);
+	HAL_UART_Transmit(&huart1, (uint8_t*)message, n < POOL_TEXT_SIZE ? n : POOL_TEXT_SIZE-1,0xFFFF);
+	Pool_Put(&textPool, message, __func__);
 }
 void taskMegneto(void)
 {
 	float megXYZ[3];
 	int16_t megXYZ_in[3];
 	BSP_MAGNETO_GetXYZ(megXYZ_in);
+	Pipeline_Put(PIPELINE_MAG,megXYZ_in[0],megXYZ_in[1],megXYZ_in[2],HAL_GetTick());
 	megXYZ[0] = megXYZ_in[0]/1000;
 	megXYZ[1] = megXYZ_in[1]/1000;
 	megXYZ[2] = megXYZ_in[2]/1000;
-	char message[100];
-	sprintf(message,"Major Cycle %d |Minor Cycle %d| Megneto X:%8.4f; Megneto Y:%8.4f; Megneto Z:%8.4f (Gauss) \r\n",major_cycle,minor_cycle,megXYZ[0],megXYZ[1],megXYZ[2]);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+	Log_Printf("Major Cycle %d |Minor Cycle %d| Megneto X:%8.4f; Megneto Y:%8.4f; Megneto Z:%8.4f (Gauss) \r\n",major_cycle,minor_cycle,megXYZ[0],megXYZ[1],megXYZ[2]);
 }
 void taskHumi(void)
 {
 	humi = BSP_HSENSOR_ReadHumidity();
-	char message[100];
-	sprintf(message,"Major Cycle %d |Minor Cycle %d| Humidity : %8.4f(rH%%)\r\n",major_cycle,minor_cycle,humi);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+#ifdef UPLINK_TSC
+	tscPush(TSC_HUMI,humi);
+#endif
+	char *message = Pool_Get(&textPool, __func__);
+	if(message == NULL) return;
+	int n = snprintf(message,POOL_TEXT_SIZE,"Major Cycle %d |Minor Cycle %d| Humidity : %8.4f(rH%%)\r\n",major_cycle,minor_cycle,humi);
+	HAL_UART_Transmit(&huart1, (uint8_t*)message, n < POOL_TEXT_SIZE ? n : POOL_TEXT_SIZE-1,0xFFFF);
+	Pool_Put(&textPool, message, __func__);
 }
 void taskGyro(void)
 {
 	float gyroXYZ[3];
 	float gyroXYZ_in[3];
 	BSP_GYRO_GetXYZ(gyroXYZ_in);
+	Pipeline_Put(PIPELINE_GYRO,gyroXYZ_in[0],gyroXYZ_in[1],gyroXYZ_in[2],HAL_GetTick());
 	gyroXYZ[0] = gyroXYZ_in[0]/1000;
 	gyroXYZ[1] = gyroXYZ_in[1]/1000;
 	gyroXYZ[2] = gyroXYZ_in[2]/1000;
-	char message[100];
-	sprintf(message,"Major Cycle %d |Minor Cycle %d| Gyro X:%8.4f; Gyro Y:%8.4f; Gyro Z:%8.4f (dps)\r\n",major_cycle,minor_cycle,gyroXYZ[0],gyroXYZ[1],gyroXYZ[2]);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+	Log_Printf("Major Cycle %d |Minor Cycle %d| Gyro X:%8.4f; Gyro Y:%8.4f; Gyro Z:%8.4f (dps)\r\n",major_cycle,minor_cycle,gyroXYZ[0],gyroXYZ[1],gyroXYZ[2]);
 }
 void taskPiezo(void)
 {
 	float pressure = BSP_PSENSOR_ReadPressure();
-	char message[100];
-	sprintf(message,"Major Cycle %d |Minor Cycle %d| Pressure : %8.4f(hPa)\r\n",major_cycle,minor_cycle,pressure);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+	Log_Printf("Major Cycle %d |Minor Cycle %d| Pressure : %8.4f(hPa)\r\n",major_cycle,minor_cycle,pressure);
 }
-void taskSendMessage(void)
+static void sendReport(void)
 {
+#ifdef UPLINK_MQTT
+	MQTT_PublishSensors(&hwifi,state,temp,humi);
+	MQTT_KeepAlive(&hwifi);
+#elif defined(UPLINK_UDP)
+	//at most one second of samples waits in the batch
+	IMU_Stream_Flush();
+#elif defined(UPLINK_TSC)
+	WIFI_SendStr(&hwifi,state);
+	for(int i=0;i<TSC_SERIES;i++) tscSend(i);
+#else
 	//__set_PRIMASK(1);
 	WIFI_SendStr(&hwifi,state);
-	char temp_in[11],humi_in[11];
-	memset(temp_in,0,11);
-	memset(humi_in,0,11);
-	sprintf(temp_in,"%010.4f",temp);
-	sprintf(humi_in,"%010.4f",humi);
+	//both values in one scratch block, sprintf terminates them
+	char *temp_in = Pool_Get(&textPool, __func__);
+	if(temp_in == NULL) return;
+	char *humi_in = temp_in + POOL_TEXT_SIZE/2;
+	snprintf(temp_in,POOL_TEXT_SIZE/2,"%010.4f",temp);
+	snprintf(humi_in,POOL_TEXT_SIZE/2,"%010.4f",humi);
     WIFI_SendStr(&hwifi,temp_in);
     WIFI_SendStr(&hwifi,humi_in);
+    Pool_Put(&textPool, temp_in, __func__);
     //__set_PRIMASK(0);
+#endif
+}
+void taskSendMessage(void)
+{
+	static int skipped = 0;
+	if(++skipped < remoteConfig.reportDivider) return;
+	skipped = 0;
+	sendReport();
+#ifdef REPORT_ON_CHANGE
+	cancelAperiodicTask(reportJob);
+#endif
 }
 void taskShowTime(void)
 {
-	char message_box[100];
+	char *message_box = Pool_Get(&textPool, __func__);
+	if(message_box == NULL) return;
 	RTC_DateTypeDef GetData;  //获取日期结构体
     RTC_TimeTypeDef GetTime;   //获取时间结构体
     HAL_RTC_GetTime(&hrtc, &GetTime, RTC_FORMAT_BIN);
@@ -200,6 +360,7 @@ void taskShowTime(void)
     HAL_UART_Transmit(&huart1, (uint8_t*)message_box, strlen(message_box),0xFFFF);
     sprintf(message_box,"%02d:%02d:%02d\r\n",GetTime.Hours, GetTime.Minutes, GetTime.Seconds);
     HAL_UART_Transmit(&huart1, (uint8_t*)message_box, strlen(message_box),0xFFFF);
+    Pool_Put(&textPool, message_box, __func__);
 }
 void SystemClock_Config(void)
 {
@@ -293,13 +454,39 @@ int main(void)
 	WIFI_JoinNetwork(&hwifi);
 	//WIFI_ConnectServer(&hwifi,"192.168.3.3","12345");
 	//WIFI_ConnectServer(&hwifi,"192.168.3.5","6666");
-	WIFI_ConnectServer(&hwifi,"47.108.170.207","6666");
+#ifndef UPLINK_UDP
+	//the node info, only the MQTT and TCP uplinks send it
 	const char *name = "CA3 IOT NODE(main node)";
 	const char *position = "westcove 16";
 	const char *type = "B-L475E-IOT01A";
+#endif
+#ifdef UPLINK_MQTT
+	//without the broker the node still samples and classifies, the publishes fail until a reset
+	if(MQTT_Connect(&hwifi,UPLINK_HOST,UPLINK_PORT) != WIFI_OK)
+	{
+		Log_Printf("MQTT: no broker at %s:%s, the uplink is off\r\n",UPLINK_HOST,UPLINK_PORT);
+	}
+	else
+	{
+		char info[128];
+		int infoLen = sprintf(info,"{\"name\":\"%s\",\"type\":\"%s\",\"position\":\"%s\"}",name,type,position);
+		char infoTopic[sizeof(hwifi.mqtt.publishTopic)+8];
+		sprintf(infoTopic,"%s/info",hwifi.mqtt.publishTopic);
+		MQTT_Publish(&hwifi,infoTopic,(uint8_t*)info,infoLen,1);
+	}
+#elif defined(UPLINK_UDP)
+	//datagrams only carry samples, the node info stays on the uart
+	if(WIFI_ConnectServer(&hwifi,UPLINK_HOST,UPLINK_PORT) != WIFI_OK) Log_Printf("uplink: %s:%s didn't open\r\n",UPLINK_HOST,UPLINK_PORT);
+	IMU_Stream_Init(&hwifi);
+#else
+	if(WIFI_ConnectServer(&hwifi,UPLINK_HOST,UPLINK_PORT) != WIFI_OK) Log_Printf("uplink: %s:%s didn't open\r\n",UPLINK_HOST,UPLINK_PORT);
 	WIFI_SendStr(&hwifi,name);
 	WIFI_SendStr(&hwifi,type);
 	WIFI_SendStr(&hwifi,position);
+#ifdef UPLINK_TSC
+	tscInit();
+#endif
+#endif
 	//odr(accelerometor ) = 104
 	registerTask(taskAcc,"Accelero reading",0,0,ACCELERO,floor(1000/104));
 	//odr(temperature)  = 12.5
@@ -309,8 +496,61 @@ int main(void)
 	//odr(humidity) = 12.5
 	registerTask(taskHumi,"Humidity reading",2,0,HUMI,floor(1000/12.5));
 	registerTask(taskShowTime,"show current time",4,0,TIME,3000);
+	//motion and pressure at display rates, the inference only needs the accelerometer
+	registerTask(taskGyro,"Gyro reading",1,0,GYRO,100);
+	registerTask(taskMegneto,"Magneto reading",2,0,MEGNETO,100);
+	registerTask(taskPiezo,"Pressure reading",3,0,PIEZO,200);
+	//basic mode shares the accelerometer's minor cycle, so a new window starts at once
+#if CLASSIFIER == CLASSIFIER_CNN || defined(CLASSIFIER_COMPARE)
+	registerTask(Inference_Step,"Inference layer",0,0,INFER,INFERENCE_PERIOD);
+#endif
+#ifdef REPORT_ON_CHANGE
+	reportJob = registerAperiodicTask(sendReport,"Report on change",REPORT_SEND_BUDGET);
+#endif
+	//sensor periods follow their ODR, the rest may move so the periods nest and the table stays short
+	setPeriodTolerance(WIFI,20);
+	setPeriodTolerance(TIME,50);
+	//an overrunning cycle drops the tasks that no longer fit instead of pushing the whole table late
+	setOverrunPolicy(OVERRUN_SHED);
+#ifdef CONST_SCHEDULE
+	useConstTable(&schedule_table);
+#endif
+	//the log gets the slack the periodic tasks and the slack server jobs leave
+	registerIdleTask(Log_Drain);
+#ifdef TRACE_EN
+	registerIdleTask(Trace_Poll);
+#endif
+#ifdef REMOTE_CMD_EN
+	//the poll is the periodic task REMOTE, registered by Remote_Init
+	Remote_Init(&hwifi,PIPELINE_FRAMES);
+#endif
+#ifdef METRICS_EN
+	//the request handling is the periodic task METRICS, registered by Metrics_Init
+	Metrics_Init(&hwifi,activities,AI_NETWORK_OUT_1_SIZE);
+#endif
 	HAL_NVIC_EnableIRQ(EXTI15_10_IRQn);
-	AI_Init();
+#ifdef ACTIVITY_SMOOTH_EN
+	Activity_Init();
+#endif
+#if CLASSIFIER == CLASSIFIER_CNN
+	Weights_Init();
+#ifdef GATE_EN
+	Gate_Init();
+	Inference_Init(networkDone);
+#else
+	Inference_Init(inferenceDone);
+#endif
+#else
+	Features_Init();
+#ifdef CLASSIFIER_COMPARE
+	Weights_Init();
+	Inference_Init(cnnDone);
+#endif
+#endif
+#ifdef STACK_MONITOR_EN
+	//last, everything main set up stays on the thread stack
+	StackMon_Init();
+#endif
 	task_scheduler();
 
 	while(1);
@@ -0,0 +1,229 @@
+#include "metrics.h"
+#include "cyclic.h"
+#include "sensor_config.h"
+#include "remote.h"
+#include "imu_stream.h"
+#include "log.h"
+#include "inference.h"
+#include "stackmon.h"
+#include "pool.h"
+#include "weights.h"
+#include "classifier.h"
+#include "gate.h"
+#include "activity.h"
+#include "sparse_dense.h"
+#include "pipeline.h"
+
+volatile uint32_t i2cErrors = 0;
+static WIFI_HandleTypeDef *metricsWifi;
+static const char* const* classes;
+static uint8_t numClasses;
+static uint32_t inferences = 0;
+static uint32_t inferenceLastUs = 0;
+static uint32_t inferenceMaxUs = 0;
+static uint8_t lastClasses[METRICS_LAST_CLASSES];
+static uint32_t lastClassTicks[METRICS_LAST_CLASSES];
+
+static enum {METRICS_IDLE, METRICS_SEND} state = METRICS_IDLE;
+static char request[METRICS_REQUEST_SIZE];
+static uint16_t requestLen = 0;
+static char response[METRICS_RESPONSE_SIZE];
+static char *responseStart;
+static uint16_t responseLen = 0;
+static uint16_t sendPos = 0;
+
+/**
+  * @brief  Starts the metrics server on METRICS_SOCKET and registers its
+  * 		request handling as the periodic task METRICS.
+  * @param  hwifi: Wifi handle, joined to the network
+  * @param  classNames: Labels of the classifier outputs
+  * @param  nClasses: Number of labels
+  * @retval None
+  */
+void Metrics_Init(WIFI_HandleTypeDef* hwifi, const char* const* classNames, uint8_t nClasses)
+{
+	classes = classNames;
+	numClasses = nClasses;
+	if(WIFI_StartServer(hwifi, METRICS_SOCKET, METRICS_PORT) != WIFI_OK) return;
+	metricsWifi = hwifi;
+	//a basic minor cycle with only the short I2C reads in it, a step is up to 3 AT commands
+	registerTask(Metrics_Poll, "Metrics server", 1, 0, METRICS, METRICS_POLL_INTERVAL);
+	setPeriodTolerance(METRICS, 50);
+}
+void Metrics_RecordInference(uint32_t us, uint8_t cls)
+{
+	uint32_t slot = inferences % METRICS_LAST_CLASSES;
+	lastClasses[slot] = cls;
+	lastClassTicks[slot] = HAL_GetTick();
+	inferences++;
+	inferenceLastUs = us;
+	if(us > inferenceMaxUs) inferenceMaxUs = us;
+}
+static int buildBody(char *p, int size)
+{
+	int n = 0;
+#define PUT(...) do{ if(n < size) n += snprintf(p+n, size-n, __VA_ARGS__); }while(0)
+	PUT("ca3_uptime_ms %u\n", (unsigned)HAL_GetTick());
+	PUT("ca3_mode %d\n", mode);
+	PUT("ca3_cycle_ms{cycle=\"minor\"} %u\nca3_cycle_ms{cycle=\"major\"} %u\n", minor_cycle_len, major_cycle_len);
+	PUT("ca3_overruns_total %u\n", overrunCount);
+	PUT("ca3_overrun_worst_us %u\n", overrunWorstUs);
+	PUT("ca3_frames_skipped_total %u\n", skippedFrames);
+	PUT("ca3_tasks_shed_total %u\n", shedTasks);
+	PUT("ca3_degrades_total %u\n", degradeCount);
+	const Schedule_Table *t = activeTable();
+	PUT("ca3_rta_worst_load_us %u\n", t->worstLoad);
+	PUT("ca3_rta_frames{stat=\"overloaded\"} %u\n", t->overloadFrames);
+	PUT("ca3_rta_jobs{stat=\"deadline_miss\"} %u\nca3_rta_jobs{stat=\"skipped\"} %u\nca3_rta_jobs{stat=\"early\"} %u\n", t->deadlineMisses, t->skippedReleases, t->earlyReleases);
+	for(int k=0;k<n_tasks;k++)
+	{
+		int i = taskCodes[k];
+		const char *name = (const char*)tasks[i].task_name;
+		unsigned avg = taskStats.runs[i] ? (unsigned)(taskStats.sumUs[i]/taskStats.runs[i]) : 0;
+		PUT("ca3_task_period_ms{task=\"%s\"} %d\n", name, tasks[i].period);
+		PUT("ca3_task_runs_total{task=\"%s\"} %u\n", name, taskStats.runs[i]);
+		PUT("ca3_task_exec_us{task=\"%s\",stat=\"last\"} %u\n", name, taskStats.lastUs[i]);
+		PUT("ca3_task_exec_us{task=\"%s\",stat=\"avg\"} %u\n", name, avg);
+		PUT("ca3_task_exec_us{task=\"%s\",stat=\"max\"} %u\n", name, taskStats.maxUs[i]);
+		PUT("ca3_rta_wcrt_us{task=\"%s\"} %u\n", name, t->wcrt[i]);
+#ifdef STACK_MONITOR_EN
+		PUT("ca3_stack_bytes{task=\"%s\"} %u\n", name, stackTaskMax[i]);
+#endif
+	}
+	for(int i=0;i<n_aperiodic;i++)
+	{
+		const char *name = aperiodicTasks[i].task_name;
+		PUT("ca3_aperiodic_runs_total{job=\"%s\"} %u\n", name, aperiodicTasks[i].runs);
+		PUT("ca3_aperiodic_cancelled_total{job=\"%s\"} %u\n", name, aperiodicTasks[i].cancelled);
+		PUT("ca3_aperiodic_pending{job=\"%s\"} %d\n", name, aperiodicTasks[i].pending);
+		PUT("ca3_aperiodic_exec_us{job=\"%s\",stat=\"max\"} %u\n", name, aperiodicTasks[i].maxUs);
+		PUT("ca3_aperiodic_response_ms{job=\"%s\",stat=\"max\"} %u\n", name, aperiodicTasks[i].worstResponseMs);
+	}
+#ifdef STACK_MONITOR_EN
+	for(int i=0;i<STACK_IRQS;i++)
+		if(stackIsrMax[i] > 0) PUT("ca3_stack_bytes{irq=\"%d\"} %u\n", i-16, stackIsrMax[i]);
+	PUT("ca3_stack_free_bytes{stack=\"thread\"} %u\nca3_stack_free_bytes{stack=\"handler\"} %u\n", (unsigned)StackMon_ThreadFree(), (unsigned)StackMon_IsrFree());
+	PUT("ca3_stack_window_full_total %u\n", (unsigned)stackWindowFull);
+#endif
+	for(int i=0;i<n_pools;i++)
+	{
+		const Pool *pool = pools[i];
+		const char *name = pool->name;
+		PUT("ca3_pool_blocks{pool=\"%s\",stat=\"total\"} %u\nca3_pool_blocks{pool=\"%s\",stat=\"used\"} %u\nca3_pool_blocks{pool=\"%s\",stat=\"peak\"} %u\n",
+				name, pool->blocks, name, pool->used, name, pool->peak);
+		PUT("ca3_pool_block_bytes{pool=\"%s\"} %u\n", name, pool->blockSize);
+		PUT("ca3_pool_gets_total{pool=\"%s\"} %u\n", name, (unsigned)pool->gets);
+		PUT("ca3_pool_failures_total{pool=\"%s\"} %u\n", name, (unsigned)pool->failures);
+		PUT("ca3_pool_bad_puts_total{pool=\"%s\"} %u\n", name, (unsigned)pool->badPuts);
+	}
+	PUT("ca3_queue_depth{queue=\"remote_rx\"} %u\n", Remote_Pending());
+	PUT("ca3_queue_depth{queue=\"imu_batch\"} %u\n", IMU_Stream_Pending());
+	PUT("ca3_queue_depth{queue=\"log\"} %u\n", Log_Pending());
+	PUT("ca3_log_dropped_total %u\n", (unsigned)logDropped);
+	PUT("ca3_errors_total{bus=\"i2c\"} %u\n", (unsigned)i2cErrors);
+	PUT("ca3_errors_total{bus=\"spi\"} %u\n", (unsigned)wifiSpiErrors);
+	PUT("ca3_errors_total{bus=\"wifi_send\"} %u\n", (unsigned)wifiSendErrors);
+	PUT("ca3_pipeline_frames_total %u\n", (unsigned)pipelineFrames);
+	//how stale a held gyro or magnetometer value got in a frame, only for sensors the model reads
+	static const char *const sensorNames[PIPELINE_SENSORS] = {"acc", "gyro", "mag"};
+	for(int s=0;s<PIPELINE_SENSORS;s++)
+	{
+		if(Pipeline_Uses(s)) PUT("ca3_pipeline_hold_ms_max{sensor=\"%s\"} %u\n", sensorNames[s], (unsigned)pipelineMaxAgeMs[s]);
+	}
+	PUT("ca3_inferences_total %u\n", (unsigned)inferences);
+	PUT("ca3_inference_windows_dropped_total %u\n", (unsigned)inferenceDropped);
+#if CLASSIFIER == CLASSIFIER_CNN && defined(GATE_EN)
+	//audits are network runs while gated, a miss is an audit that didn't come back stationary
+	PUT("ca3_gate_windows_total{path=\"network\"} %u\nca3_gate_windows_total{path=\"gated\"} %u\n", (unsigned)gateRun, (unsigned)gateSkipped);
+	PUT("ca3_gate_audits_total %u\nca3_gate_misses_total %u\n", (unsigned)gateAudits, (unsigned)gateMisses);
+	PUT("ca3_gate_openings_total %u\nca3_gate_closed %d\n", (unsigned)gateOpenings, Gate_Closed());
+	PUT("ca3_inference_duty_ratio %.3f\n", gateRun+gateSkipped ? (double)gateRun/(gateRun+gateSkipped) : 1.0);
+#endif
+#if CLASSIFIER != CLASSIFIER_CNN
+	//the feature model feeds ca3_inference_us too; agree counts the windows the CNN put in the same class
+	PUT("ca3_classifier_windows_total %u\n", (unsigned)classifierWindows);
+	PUT("ca3_classifier_us{stat=\"last\"} %u\nca3_classifier_us{stat=\"max\"} %u\n", (unsigned)classifierLastUs, (unsigned)classifierMaxUs);
+	PUT("ca3_classifier_compared_total %u\nca3_classifier_agree_total %u\n", (unsigned)classifierCompared, (unsigned)classifierAgree);
+#endif
+#ifdef ACTIVITY_SMOOTH_EN
+	//held counts windows whose own class differed from the reported one, the flaps smoothing kept off the uplink
+	PUT("ca3_activity_state %d\nca3_activity_confidence %.3f\n", Activity_State(), (double)Activity_Confidence());
+	PUT("ca3_activity_changes_total %u\nca3_activity_held_total %u\n", (unsigned)activityChanges, (unsigned)activityHeld);
+#endif
+	//slot -1 is the built in array
+	PUT("ca3_weights_version %u\nca3_weights_slot %d\nca3_weights_receiving %d\n", (unsigned)Weights_Version(), Weights_Slot(), Weights_Receiving());
+#ifdef SPARSE_DENSE_EN
+	//0 when the weights in use aren't the ones the table was pruned from
+	PUT("ca3_sparse_dense_active %d\n", sparseDenseActive);
+#endif
+	PUT("ca3_inference_us{stat=\"last\"} %u\nca3_inference_us{stat=\"max\"} %u\n", (unsigned)inferenceLastUs, (unsigned)inferenceMaxUs);
+	//newest first, age 0 is the latest result
+	for(uint32_t age=0;age<METRICS_LAST_CLASSES && age<inferences;age++)
+	{
+		uint32_t slot = (inferences-1-age) % METRICS_LAST_CLASSES;
+		uint8_t c = lastClasses[slot];
+		PUT("ca3_class{age=\"%u\",label=\"%s\"} %u\n", (unsigned)age, c < numClasses ? classes[c] : "?", c);
+		PUT("ca3_class_tick_ms{age=\"%u\"} %u\n", (unsigned)age, (unsigned)lastClassTicks[slot]);
+	}
+#undef PUT
+	return n < size ? n : size;
+}
+//the body goes after METRICS_HEADER_ROOM, the header is put right in front of it
+static void buildResponse(void)
+{
+	char header[METRICS_HEADER_ROOM];
+	char *body = response + METRICS_HEADER_ROOM;
+	int bodyLen = 0;
+	const char *status = "404 Not Found";
+	if(strncmp(request, "GET / ", 6) == 0 || strncmp(request, "GET /metrics", 12) == 0)
+	{
+		status = "200 OK";
+		bodyLen = buildBody(body, METRICS_RESPONSE_SIZE - METRICS_HEADER_ROOM);
+	}
+	int headerLen = snprintf(header, sizeof(header),
+		"HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n",
+		status, bodyLen);
+	responseStart = body - headerLen;
+	memcpy(responseStart, header, headerLen);
+	responseLen = headerLen + bodyLen;
+	sendPos = 0;
+}
+/**
+  * @brief  Periodic task: one step of request handling, reading the request
+  * 		or sending the next WIFI_MAX_SEND_SIZE of the response.
+  * @retval None
+  */
+void Metrics_Poll(void)
+{
+	if(metricsWifi == NULL) return;
+	if(WIFI_SelectSocket(metricsWifi, METRICS_SOCKET) != WIFI_OK) return;
+	if(state == METRICS_IDLE)
+	{
+		uint16_t len = 0;
+		if(WIFI_ReceiveRaw(metricsWifi, (uint8_t*)request+requestLen, sizeof(request)-1-requestLen, &len, 1) == WIFI_OK && len > 0)
+		{
+			requestLen += len;
+			request[requestLen] = '\0';
+			//only the request line matters, a request that fills the buffer is answered as is
+			if(strstr(request, "\r\n\r\n") != NULL || requestLen == sizeof(request)-1)
+			{
+				buildResponse();
+				state = METRICS_SEND;
+			}
+		}
+	}
+	else
+	{
+		uint16_t n = responseLen - sendPos;
+		if(n > WIFI_MAX_SEND_SIZE) n = WIFI_MAX_SEND_SIZE;
+		WIFI_StatusTypeDef status = WIFI_SendRaw(metricsWifi, (uint8_t*)responseStart+sendPos, n);
+		sendPos += n;
+		if(status != WIFI_OK || sendPos >= responseLen)
+		{
+			WIFI_CloseClient(metricsWifi);
+			state = METRICS_IDLE;
+			requestLen = 0;
+		}
+	}
+	WIFI_SelectSocket(metricsWifi, 0);
+}
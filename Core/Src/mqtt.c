@@ -0,0 +1,326 @@
+#include "mqtt.h"
+
+//control packet types (first byte, high nibble)
+#define MQTT_CONNECT     0x10
+#define MQTT_CONNACK     0x20
+#define MQTT_PUBLISH     0x30
+#define MQTT_PUBACK      0x40
+#define MQTT_PINGREQ     0xC0
+#define MQTT_DISCONNECT  0xE0
+#define MQTT_FLAG_DUP    0x08
+
+static uint8_t mqttPacket[MQTT_PACKET_SIZE];
+//a PUBACK per slot and per re-send plus a PINGRESP
+static uint8_t mqttAck[32];
+static uint16_t packetId = 0;
+static uint32_t lastSend = 0;
+static uint8_t connected = 0;
+volatile uint32_t mqttLost = 0;
+//unacked qos1 publishes, used in turn so the slot taken next is the oldest; id 0 is free
+static struct{
+	uint16_t id;
+	uint8_t resent;
+	uint16_t len; //0: too long to keep, dropped at the next MQTT_Resend
+	uint8_t packet[MQTT_INFLIGHT_SIZE];
+} inFlight[MQTT_INFLIGHT];
+static uint8_t nextSlot = 0;
+
+static int putU16(uint8_t *p, uint16_t v)
+{
+	p[0] = v>>8;
+	p[1] = v&0xff;
+	return 2;
+}
+static int putStr(uint8_t *p, const char *s)
+{
+	uint16_t len = strlen(s);
+	putU16(p,len);
+	memcpy(p+2,s,len);
+	return len+2;
+}
+//remaining length is a base-128 varint of at most 4 bytes
+static int putRemaining(uint8_t *p, uint32_t len)
+{
+	int n = 0;
+	do
+	{
+		uint8_t b = len%128;
+		len /= 128;
+		if(len>0) b |= 0x80;
+		p[n++] = b;
+	}while(len>0);
+	return n;
+}
+//the fixed header goes in front of a body built at mqttPacket+5
+static uint8_t *framePacket(uint8_t type, uint16_t bodyLen, uint16_t *len)
+{
+	uint8_t header[5];
+	header[0] = type;
+	int n = 1 + putRemaining(header+1, bodyLen);
+	uint8_t *start = mqttPacket + 5 - n;
+	memcpy(start,header,n);
+	*len = n + bodyLen;
+	return start;
+}
+static WIFI_StatusTypeDef sendPacket(WIFI_HandleTypeDef* hwifi, uint8_t type, uint16_t bodyLen)
+{
+	uint16_t len;
+	uint8_t *start = framePacket(type, bodyLen, &len);
+	lastSend = HAL_GetTick();
+	return WIFI_SendRaw(hwifi, start, len);
+}
+static void keep(uint16_t id, const uint8_t *packet, uint16_t len)
+{
+	if(inFlight[nextSlot].id != 0) mqttLost++;
+	inFlight[nextSlot].id = id;
+	inFlight[nextSlot].resent = 0;
+	inFlight[nextSlot].len = len <= MQTT_INFLIGHT_SIZE ? len : 0;
+	memcpy(inFlight[nextSlot].packet, packet, inFlight[nextSlot].len);
+	nextSlot = (nextSlot+1) % MQTT_INFLIGHT;
+}
+//acks are short, so every packet read here has a one byte remaining length;
+//anything that isn't the wanted type (e.g. a late PINGRESP) is skipped
+static WIFI_StatusTypeDef waitAck(WIFI_HandleTypeDef* hwifi, uint8_t type, uint8_t *ack, uint16_t ackLen)
+{
+	uint16_t len = 0;
+	if(WIFI_ReceiveRaw(hwifi, mqttAck, sizeof(mqttAck), &len, MQTT_ACK_TIMEOUT) != WIFI_OK) return WIFI_ERROR;
+	if(len == 0) return WIFI_TIMEOUT;
+	for(int i=0;i+1<len;i+=2+mqttAck[i+1])
+	{
+		if((mqttAck[i]&0xF0) == type && mqttAck[i+1] >= ackLen && i+2+ackLen <= len)
+		{
+			memcpy(ack, mqttAck+i+2, ackLen);
+			return WIFI_OK;
+		}
+	}
+	return WIFI_ERROR;
+}
+/**
+  * @brief  Opens the socket to the broker and runs the CONNECT/CONNACK
+  * 		handshake with the settings in hwifi->mqtt.
+  * @param  hwifi: Wifi handle, transportProtocol should be WIFI_MQTT_PROTOCOL
+  * @param  ip: Broker address
+  * @param  port: Broker port, normally "1883" (or "8883" for cert mode)
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef MQTT_Connect(WIFI_HandleTypeDef* hwifi, char *ip, char *port)
+{
+	WIFI_MQTTTypeDef *cfg = &hwifi->mqtt;
+	//clean session: nothing from an earlier one is re-sent
+	connected = 0;
+	memset(inFlight, 0, sizeof(inFlight));
+	//no CONNECT on a socket that didn't open
+	WIFI_StatusTypeDef opened = WIFI_ConnectServer(hwifi, ip, port);
+	if(opened != WIFI_OK) return opened;
+
+	uint8_t *p = mqttPacket + 5;
+	int n = 0;
+	n += putStr(p+n, "MQTT");
+	p[n++] = 4; //protocol level 3.1.1
+	uint8_t flags = 0x02; //clean session
+	if(cfg->securityMode == WIFI_MQTT_SECURITY_USER_PW)
+	{
+		flags |= 0xC0;
+	}
+	p[n++] = flags;
+	n += putU16(p+n, cfg->keepAlive);
+	n += putStr(p+n, cfg->clientId);
+	if(cfg->securityMode == WIFI_MQTT_SECURITY_USER_PW)
+	{
+		n += putStr(p+n, cfg->userName);
+		n += putStr(p+n, cfg->password);
+	}
+	if(sendPacket(hwifi, MQTT_CONNECT, n) != WIFI_OK) return WIFI_ERROR;
+
+	uint8_t ack[2];
+	if(waitAck(hwifi, MQTT_CONNACK, ack, 2) != WIFI_OK) return WIFI_ERROR;
+	//ack[1] is the return code, 0 = accepted
+	connected = ack[1] == 0;
+	return connected ? WIFI_OK : WIFI_ERROR;
+}
+/**
+  * @brief  Publishes one message. A qos 1 message is kept until MQTT_Poll
+  * 		finds its PUBACK, the call doesn't wait for it.
+  * @param  hwifi: Wifi handle
+  * @param  topic: Topic name
+  * @param  payload: Message body
+  * @param  len: Message body length
+  * @param  qos: 0 or 1
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef MQTT_Publish(WIFI_HandleTypeDef* hwifi, const char *topic, const uint8_t *payload, uint16_t len, uint8_t qos)
+{
+	if(!connected) return WIFI_ERROR;
+	uint8_t *p = mqttPacket + 5;
+	int n = putStr(p, topic);
+	uint16_t id = 0;
+	if(qos > 0)
+	{
+		qos = 1;
+		packetId++;
+		if(packetId == 0) packetId = 1;
+		id = packetId;
+		n += putU16(p+n, id);
+	}
+	if(n + len > MQTT_PACKET_SIZE - 5) return WIFI_ERROR;
+	memcpy(p+n, payload, len);
+	n += len;
+
+	uint16_t packetLen;
+	uint8_t *packet = framePacket(MQTT_PUBLISH | (qos<<1), n, &packetLen);
+	if(qos) keep(id, packet, packetLen);
+	lastSend = HAL_GetTick();
+	return WIFI_SendRaw(hwifi, packet, packetLen);
+}
+int MQTT_InFlight(void)
+{
+	int n = 0;
+	for(int i=0;i<MQTT_INFLIGHT;i++) if(inFlight[i].id != 0) n++;
+	return n;
+}
+/**
+  * @brief  Takes the acks the broker sent since the last call and frees the
+  * 		publishes they acknowledge. Reads nothing while none is in flight.
+  * @param  hwifi: Wifi handle
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef MQTT_Poll(WIFI_HandleTypeDef* hwifi)
+{
+	uint16_t len = 0;
+	if(MQTT_InFlight() == 0) return WIFI_OK;
+	if(WIFI_ReceiveRaw(hwifi, mqttAck, sizeof(mqttAck), &len, MQTT_POLL_TIMEOUT) != WIFI_OK) return WIFI_ERROR;
+	//short packets only, as in waitAck; a late PINGRESP is skipped
+	for(int i=0;i+1<len;i+=2+mqttAck[i+1])
+	{
+		if((mqttAck[i]&0xF0) != MQTT_PUBACK || mqttAck[i+1] != 2 || i+4 > len) continue;
+		uint16_t id = (mqttAck[i+2]<<8) | mqttAck[i+3];
+		for(int k=0;k<MQTT_INFLIGHT;k++) if(inFlight[k].id == id) inFlight[k].id = 0;
+	}
+	return WIFI_OK;
+}
+/**
+  * @brief  Sends every unacked qos 1 publish again with DUP set, one that
+  * 		was re-sent MQTT_RETRIES times already is given up (mqttLost).
+  * @param  hwifi: Wifi handle
+  * @retval WIFI_StatusTypeDef: the first failed send
+  */
+WIFI_StatusTypeDef MQTT_Resend(WIFI_HandleTypeDef* hwifi)
+{
+	WIFI_StatusTypeDef status = WIFI_OK;
+	for(int k=0;k<MQTT_INFLIGHT && connected;k++)
+	{
+		if(inFlight[k].id == 0) continue;
+		if(inFlight[k].resent >= MQTT_RETRIES || inFlight[k].len == 0)
+		{
+			inFlight[k].id = 0;
+			mqttLost++;
+			continue;
+		}
+		inFlight[k].resent++;
+		inFlight[k].packet[0] |= MQTT_FLAG_DUP;
+		lastSend = HAL_GetTick();
+		if(WIFI_SendRaw(hwifi, inFlight[k].packet, inFlight[k].len) != WIFI_OK && status == WIFI_OK) status = WIFI_ERROR;
+	}
+	return status;
+}
+#if MQTT_PAYLOAD_FORMAT == MQTT_PAYLOAD_CBOR
+static int cborStr(uint8_t *p, const char *s)
+{
+	int len = strlen(s);
+	int n = 0;
+	//major type 3 (text string), lengths below 24 fit in the initial byte
+	if(len < 24)
+	{
+		p[n++] = 0x60 | len;
+	}
+	else
+	{
+		p[n++] = 0x78;
+		p[n++] = len;
+	}
+	memcpy(p+n,s,len);
+	return n+len;
+}
+static int cborFloat(uint8_t *p, float f)
+{
+	uint32_t bits;
+	memcpy(&bits,&f,4);
+	p[0] = 0xFA; //major type 7, single precision
+	p[1] = bits>>24;
+	p[2] = bits>>16;
+	p[3] = bits>>8;
+	p[4] = bits;
+	return 5;
+}
+#endif
+/**
+  * @brief  Publishes the node's current readings, either as one batched
+  * 		document (JSON or CBOR) or one topic per sensor. The acks of the
+  * 		earlier reports are taken first and what they left unacked goes
+  * 		out again.
+  * @param  hwifi: Wifi handle
+  * @param  state: Activity label
+  * @param  temp: Temperature in Celsius
+  * @param  humi: Relative humidity
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef MQTT_PublishSensors(WIFI_HandleTypeDef* hwifi, const char *state, float temp, float humi)
+{
+	WIFI_MQTTTypeDef *cfg = &hwifi->mqtt;
+	MQTT_Poll(hwifi);
+	WIFI_StatusTypeDef status = MQTT_Resend(hwifi);
+#ifdef MQTT_TOPIC_PER_SENSOR
+	char topic[sizeof(cfg->publishTopic)+16];
+	char value[16];
+	WIFI_StatusTypeDef sent;
+	//all three go out, the first failure is what's returned
+	sprintf(topic,"%s/state",cfg->publishTopic);
+	sent = MQTT_Publish(hwifi, topic, (const uint8_t*)state, strlen(state), cfg->qos);
+	if(status == WIFI_OK) status = sent;
+	sprintf(topic,"%s/temperature",cfg->publishTopic);
+	sprintf(value,"%.4f",temp);
+	sent = MQTT_Publish(hwifi, topic, (const uint8_t*)value, strlen(value), cfg->qos);
+	if(status == WIFI_OK) status = sent;
+	sprintf(topic,"%s/humidity",cfg->publishTopic);
+	sprintf(value,"%.4f",humi);
+	sent = MQTT_Publish(hwifi, topic, (const uint8_t*)value, strlen(value), cfg->qos);
+	if(status == WIFI_OK) status = sent;
+#elif MQTT_PAYLOAD_FORMAT == MQTT_PAYLOAD_CBOR
+	uint8_t doc[64];
+	int n = 0;
+	doc[n++] = 0xA3; //map of 3 pairs
+	n += cborStr(doc+n,"state");
+	n += cborStr(doc+n,state);
+	n += cborStr(doc+n,"temp");
+	n += cborFloat(doc+n,temp);
+	n += cborStr(doc+n,"humi");
+	n += cborFloat(doc+n,humi);
+	WIFI_StatusTypeDef sent = MQTT_Publish(hwifi, cfg->publishTopic, doc, n, cfg->qos);
+	if(status == WIFI_OK) status = sent;
+#else
+	char doc[96];
+	int n = sprintf(doc,"{\"state\":\"%s\",\"temp\":%.4f,\"humi\":%.4f}",state,temp,humi);
+	WIFI_StatusTypeDef sent = MQTT_Publish(hwifi, cfg->publishTopic, (const uint8_t*)doc, n, cfg->qos);
+	if(status == WIFI_OK) status = sent;
+#endif
+	return status == WIFI_OK ? WIFI_OK : WIFI_ERROR;
+}
+/**
+  * @brief  Sends PINGREQ when nothing was sent for half the keep alive
+  * 		interval, call it from a periodic task.
+  * @param  hwifi: Wifi handle
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef MQTT_KeepAlive(WIFI_HandleTypeDef* hwifi)
+{
+	uint32_t interval = hwifi->mqtt.keepAlive*1000/2;
+	if(!connected || interval == 0 || HAL_GetTick()-lastSend < interval) return WIFI_OK;
+	//the PINGRESP is left in the module and dropped with the next ack read
+	return sendPacket(hwifi, MQTT_PINGREQ, 0);
+}
+WIFI_StatusTypeDef MQTT_Disconnect(WIFI_HandleTypeDef* hwifi)
+{
+	sendPacket(hwifi, MQTT_DISCONNECT, 0);
+	connected = 0;
+	return WIFI_DisconnectServer(hwifi);
+}
@@ -0,0 +1,77 @@
+#include "pipeline.h"
+#include "placement.h"
+#include <string.h>
+
+//input metadata of the network in X-CUBE-AI/App: channel order and normalization used in training
+static const Pipeline_ChannelTypeDef channels[PIPELINE_CHANNELS] = {
+	{PIPELINE_ACC, 0, 0.0f, 1/4000.0f},
+	{PIPELINE_ACC, 1, 0.0f, 1/4000.0f},
+	{PIPELINE_ACC, 2, 0.0f, 1/4000.0f},
+};
+
+volatile uint32_t pipelineFrames = 0;
+volatile uint32_t pipelineMaxAgeMs[PIPELINE_SENSORS];
+static float latest[PIPELINE_SENSORS][3];
+static uint32_t latestTick[PIPELINE_SENSORS];
+static float ring[PIPELINE_FRAMES][PIPELINE_CHANNELS] RAM2_BSS;
+static uint16_t head = 0; //next frame to write, the oldest once the ring is full
+static uint16_t filled = 0;
+static uint16_t sinceWindow = 0;
+
+/**
+  * @brief  Takes a sensor's newest sample. Called by the sensor tasks.
+  * @param  sensor: Which one
+  * @param  x: Raw value, BSP units
+  * @param  y: Raw value
+  * @param  z: Raw value
+  * @param  tick: HAL tick of the read
+  * @retval None
+  */
+void Pipeline_Put(Pipeline_SensorTypeDef sensor, float x, float y, float z, uint32_t tick)
+{
+	latest[sensor][0] = x;
+	latest[sensor][1] = y;
+	latest[sensor][2] = z;
+	latestTick[sensor] = tick;
+}
+/**
+  * @brief  Appends a frame from the latest samples. Called by the
+  * 		accelerometer task after its Pipeline_Put.
+  * @param  tick: HAL tick of the frame
+  * @param  stride: Frames between two windows, PIPELINE_FRAMES for no overlap
+  * @retval 1 when a window is due, Pipeline_Copy has it
+  */
+int Pipeline_Frame(uint32_t tick, uint32_t stride)
+{
+	float *frame = ring[head];
+	for(int c=0;c<PIPELINE_CHANNELS;c++)
+	{
+		const Pipeline_ChannelTypeDef *ch = &channels[c];
+		frame[c] = (latest[ch->sensor][ch->axis] - ch->offset)*ch->scale;
+		uint32_t age = tick - latestTick[ch->sensor];
+		if(age > pipelineMaxAgeMs[ch->sensor]) pipelineMaxAgeMs[ch->sensor] = age;
+	}
+	head = (head+1) % PIPELINE_FRAMES;
+	if(filled < PIPELINE_FRAMES) filled++;
+	sinceWindow++;
+	pipelineFrames++;
+	if(filled < PIPELINE_FRAMES || sinceWindow < stride) return 0;
+	sinceWindow = 0;
+	return 1;
+}
+/**
+  * @brief  Copies the window into the network input, oldest frame first.
+  * @param  input: PIPELINE_FRAMES*PIPELINE_CHANNELS floats
+  * @retval None
+  */
+void Pipeline_Copy(float *input)
+{
+	uint32_t older = (PIPELINE_FRAMES - head)*PIPELINE_CHANNELS;
+	memcpy(input, ring[head], older*sizeof(float));
+	memcpy(input + older, ring[0], head*PIPELINE_CHANNELS*sizeof(float));
+}
+int Pipeline_Uses(Pipeline_SensorTypeDef sensor)
+{
+	for(int c=0;c<PIPELINE_CHANNELS;c++) if(channels[c].sensor == sensor) return 1;
+	return 0;
+}
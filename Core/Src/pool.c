@@ -0,0 +1,77 @@
+#include "pool.h"
+#include <stddef.h>
+
+#define POOL_MASK(blocks) ((blocks) >= 32 ? 0xFFFFFFFFu : (1u<<(blocks))-1)
+#define POOL(var,label,size,count) \
+	static uint8_t var##Mem[(count)*(size)] __attribute__((aligned(4))); \
+	static const char *var##Owner[count]; \
+	Pool var = {label, var##Mem, var##Owner, size, count, POOL_MASK(count), 0, 0, 0, 0, 0}
+
+#ifdef __arm__
+#define POOL_LOCK() uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define POOL_UNLOCK() __set_PRIMASK(primask)
+#else
+//the host benchmark links this file, single threaded
+#define POOL_LOCK()
+#define POOL_UNLOCK()
+#endif
+
+POOL(textPool,"text",POOL_TEXT_SIZE,POOL_TEXT_BLOCKS);
+POOL(ioPool,"io",POOL_IO_SIZE,POOL_IO_BLOCKS);
+Pool* const pools[] = {&textPool, &ioPool};
+const int n_pools = sizeof(pools)/sizeof(pools[0]);
+
+/**
+  * @brief  Takes a free block.
+  * @param  pool: textPool or ioPool
+  * @param  owner: Tag of the taker (__func__), Pool_Put has to give the same one
+  * @retval The block, NULL when all are taken
+  */
+void *Pool_Get(Pool *pool, const char *owner)
+{
+	void *block = NULL;
+	POOL_LOCK();
+	if(pool->freeMask == 0)
+	{
+		pool->failures++;
+	}
+	else
+	{
+		int i = __builtin_ctz(pool->freeMask);
+		pool->freeMask &= ~(1u<<i);
+		pool->owner[i] = owner;
+		if(++pool->used > pool->peak) pool->peak = pool->used;
+		pool->gets++;
+		block = pool->mem + i*pool->blockSize;
+	}
+	POOL_UNLOCK();
+	return block;
+}
+/**
+  * @brief  Gives a block back. A pointer that isn't the start of a block
+  * 		of this pool, a free block or another owner's block is ignored
+  * 		and counted in badPuts.
+  * @param  pool: The pool it came from
+  * @param  block: Pool_Get's result, NULL is ignored
+  * @param  owner: The tag it was taken with
+  * @retval None
+  */
+void Pool_Put(Pool *pool, void *block, const char *owner)
+{
+	if(block == NULL) return;
+	uint32_t offset = (uint8_t*)block - pool->mem;
+	int i = offset/pool->blockSize;
+	POOL_LOCK();
+	if((uint8_t*)block < pool->mem || i >= pool->blocks || offset % pool->blockSize != 0 ||
+			(pool->freeMask & (1u<<i)) || pool->owner[i] != owner)
+	{
+		pool->badPuts++;
+	}
+	else
+	{
+		pool->owner[i] = NULL;
+		pool->freeMask |= 1u<<i;
+		pool->used--;
+	}
+	POOL_UNLOCK();
+}
@@ -0,0 +1,202 @@
+#include "remote.h"
+#include "cyclic.h"
+#include "sensor_config.h"
+#include "trace.h"
+#include "weights.h"
+
+//stride 0 keeps the whole-window inference until Remote_Init
+volatile Remote_ConfigTypeDef remoteConfig = {1, 0};
+static WIFI_HandleTypeDef *remoteWifi;
+static uint8_t rx[REMOTE_RX_SIZE];
+static uint16_t rxLen = 0;
+static uint8_t maxStride = 1;
+static const uint8_t weightsStatus[] = {REMOTE_OK, REMOTE_ERR_ARG, REMOTE_ERR_BUSY, REMOTE_ERR_FLASH, REMOTE_ERR_CHECK};
+
+static void sendAck(uint8_t cmd, uint8_t seq, uint8_t status, const uint8_t *payload, uint8_t len)
+{
+	uint8_t frame[4+5+REMOTE_MAX_ACK+1];
+	uint32_t size = 5 + len + 1;
+	frame[0] = size>>24;
+	frame[1] = size>>16;
+	frame[2] = size>>8;
+	frame[3] = size;
+	frame[4] = REMOTE_SYNC_ACK;
+	frame[5] = cmd;
+	frame[6] = seq;
+	frame[7] = status;
+	frame[8] = len;
+	memcpy(frame+9, payload, len);
+	uint8_t check = 0;
+	for(int i=5;i<9+len;i++) check ^= frame[i];
+	frame[9+len] = check;
+	WIFI_SendRaw(remoteWifi, frame, 4+size);
+}
+static uint32_t u32(const uint8_t *p)
+{
+	return (uint32_t)p[0]<<24 | (uint32_t)p[1]<<16 | (uint32_t)p[2]<<8 | p[3];
+}
+static uint8_t putPeriod(uint8_t *ack, int period)
+{
+	ack[0] = period>>8;
+	ack[1] = period&0xff;
+	return 2;
+}
+static uint8_t putWeights(uint8_t *ack)
+{
+	uint32_t version = Weights_Version();
+	ack[0] = Weights_Slot() == WEIGHTS_BUILTIN ? 0xFF : Weights_Slot();
+	ack[1] = version>>24;
+	ack[2] = version>>16;
+	ack[3] = version>>8;
+	ack[4] = version;
+	return 5;
+}
+static void handle(uint8_t cmd, uint8_t seq, const uint8_t *p, uint8_t len)
+{
+	uint8_t ack[REMOTE_MAX_ACK];
+	uint8_t ackLen = 0;
+	uint8_t status = REMOTE_OK;
+	switch(cmd)
+	{
+	case REMOTE_SET_PERIOD:
+		if(len != 3 || !taskRegistered(p[0]) || ((p[1]<<8) | p[2]) == 0) status = REMOTE_ERR_ARG;
+		else
+		{
+			requestTaskPeriod(p[0], (p[1]<<8) | p[2]);
+			//still the old period (or 0 in basic mode) until the new table is in
+			ackLen += putPeriod(ack+ackLen, runningPeriod(p[0]));
+			ackLen += putPeriod(ack+ackLen, requestedPeriod(p[0]));
+		}
+		break;
+	case REMOTE_SET_ODR:
+	{
+		int odr = len == 3 ? (p[1]<<8) | p[2] : 0;
+		if(odr == 0) status = REMOTE_ERR_ARG;
+		else if(p[0] == ACCELERO) odr = lsm6dsl_acc_odr_set(odr);
+		else if(p[0] == TEMP || p[0] == HUMI) odr = hts221_odr_set(odr);
+		else status = REMOTE_ERR_ARG;
+		if(status == REMOTE_OK)
+		{
+			ack[ackLen++] = odr>>8;
+			ack[ackLen++] = odr&0xff;
+		}
+		break;
+	}
+	case REMOTE_SET_REPORT:
+		if(len != 1 || p[0] == 0) status = REMOTE_ERR_ARG;
+		else remoteConfig.reportDivider = p[0];
+		break;
+	case REMOTE_SET_STRIDE:
+		if(len != 1 || p[0] == 0 || p[0] > maxStride) status = REMOTE_ERR_ARG;
+		else remoteConfig.inferenceStride = p[0];
+		break;
+	case REMOTE_GET_CONFIG:
+		//what the running table does and what was asked for, they differ until a change is in
+		for(int i=0;i<TASKS_MAX;i++) ackLen += putPeriod(ack+ackLen, runningPeriod(i));
+		for(int i=0;i<TASKS_MAX;i++) ackLen += putPeriod(ack+ackLen, requestedPeriod(i));
+		ack[ackLen++] = remoteConfig.reportDivider;
+		ack[ackLen++] = remoteConfig.inferenceStride;
+		break;
+#ifdef TRACE_EN
+	case REMOTE_TRACE:
+		//the ack goes out before the first trace frame, a dump already running is an error
+		if(len != 1 || p[0] > 1 || Trace_Dumping()) status = REMOTE_ERR_ARG;
+		else Trace_Dump(p[0] ? remoteWifi : NULL);
+		break;
+#endif
+	case REMOTE_WEIGHTS_BEGIN:
+		if(len != 12) status = REMOTE_ERR_ARG;
+		else status = weightsStatus[Weights_Begin(u32(p), u32(p+4), u32(p+8))];
+		if(status == REMOTE_OK) ack[ackLen++] = Weights_Slot() == 0 ? 1 : 0;
+		break;
+	case REMOTE_WEIGHTS_DATA:
+		if(len <= 4) status = REMOTE_ERR_ARG;
+		else status = weightsStatus[Weights_Write(u32(p), p+4, len-4)];
+		break;
+	case REMOTE_WEIGHTS_COMMIT:
+		status = weightsStatus[Weights_Commit()];
+		if(status == REMOTE_OK) ackLen = putWeights(ack);
+		break;
+	case REMOTE_GET_WEIGHTS:
+		ackLen = putWeights(ack);
+		ack[ackLen++] = Weights_Receiving();
+		break;
+	default:
+		status = REMOTE_ERR_CMD;
+		break;
+	}
+	sendAck(cmd, seq, status, ack, ackLen);
+}
+//consumes every complete frame in rx, a partial one stays for the next poll
+static void parse(void)
+{
+	uint16_t i = 0;
+	while(i < rxLen)
+	{
+		if(rx[i] != REMOTE_SYNC_CMD)
+		{
+			i++;
+			continue;
+		}
+		if(rxLen - i < 4) break;
+		uint8_t len = rx[i+3];
+		if(len > REMOTE_MAX_PAYLOAD)
+		{
+			//not a frame start, resync on the next sync byte
+			i++;
+			continue;
+		}
+		if(rxLen - i < 4 + len + 1) break;
+		uint8_t check = 0;
+		for(int j=1;j<4+len;j++) check ^= rx[i+j];
+		if(check != rx[i+4+len]) sendAck(rx[i+1], rx[i+2], REMOTE_ERR_CHECK, NULL, 0);
+		else handle(rx[i+1], rx[i+2], &rx[i+4], len);
+		i += 4 + len + 1;
+	}
+	memmove(rx, rx+i, rxLen-i);
+	rxLen -= i;
+}
+/**
+  * @brief  Binds the command channel to the uplink socket and registers its
+  * 		poll as the periodic task REMOTE.
+  * @param  hwifi: Wifi handle with an open TCP or UDP socket
+  * @param  window: Inference window in samples, the largest stride allowed
+  * @retval None
+  */
+void Remote_Init(WIFI_HandleTypeDef* hwifi, uint8_t window)
+{
+	remoteWifi = hwifi;
+	maxStride = window;
+	remoteConfig.reportDivider = 1;
+	remoteConfig.inferenceStride = window;
+	rxLen = 0;
+	//the minor cycle of the basic table the clock display has to itself
+	registerTask(Remote_Poll,"Remote commands",4,0,REMOTE,REMOTE_POLL_INTERVAL);
+	//a poll a bit later or sooner is fine, let it nest with the other periods
+	setPeriodTolerance(REMOTE,50);
+}
+uint16_t Remote_Pending(void)
+{
+	return rxLen;
+}
+/**
+  * @brief  Periodic task: reads whatever the server sent, up to REMOTE_RX_SIZE,
+  * 		and runs the commands in it.
+  * @retval None
+  */
+void Remote_Poll(void)
+{
+	uint16_t len = 0;
+	if(remoteWifi == NULL) return;
+#ifdef TRACE_EN
+	//a dump on this socket goes out a frame per run instead of the read,
+	//so a run stays one AT exchange; commands wait for the dump to end
+	if(Trace_SendFrame()) return;
+#endif
+	if(rxLen == REMOTE_RX_SIZE) rxLen = 0; //garbage only, start over
+	if(WIFI_ReceiveRaw(remoteWifi, rx+rxLen, REMOTE_RX_SIZE-rxLen, &len, 1) == WIFI_OK && len > 0)
+	{
+		rxLen += len;
+		parse();
+	}
+}
@@ -49,6 +49,28 @@ void hts221_dready_dis(void)
 {
 	SENSOR_IO_Write(HTS221_I2C_ADDRESS,HTS221_CTRL_REG3,0b0);
 }
+//odr in 0.1Hz, rounded up to the next rate the part has; returns the rate set (0.1Hz)
+int lsm6dsl_acc_odr_set(int odr)
+{
+	static const int rates[] = {125,260,520,1040,2080,4160,8330,16600};
+	int i = 0;
+	while(i<7 && rates[i]<odr) i++;
+	uint8_t tmp = SENSOR_IO_Read(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL1_XL);
+	tmp = (tmp & ~LSM6DSL_ODR_BITPOSITION) | ((i+1)<<4);
+	SENSOR_IO_Write(LSM6DSL_ACC_GYRO_I2C_ADDRESS_LOW, LSM6DSL_ACC_GYRO_CTRL1_XL, tmp);
+	return rates[i];
+}
+//temperature and humidity both come from the hts221, so they share the rate
+int hts221_odr_set(int odr)
+{
+	static const int rates[] = {10,70,125};
+	int i = 0;
+	while(i<2 && rates[i]<odr) i++;
+	uint8_t tmp = SENSOR_IO_Read(HTS221_I2C_ADDRESS, HTS221_CTRL_REG1);
+	tmp = (tmp & ~HTS221_ODR_MASK) | (i+1);
+	SENSOR_IO_Write(HTS221_I2C_ADDRESS, HTS221_CTRL_REG1, tmp);
+	return rates[i];
+}
 //script of lps22hb error: drdy enable for default
 void sensor_config(void)
 {
@@ -0,0 +1,130 @@
+#include "sparse_dense.h"
+#include "layers.h"
+#include "core_private.h"
+#include "log.h"
+#include <string.h>
+
+volatile int sparseDenseActive = 0;
+
+/**
+  * @brief  out = W.in + bias with W in blocks of SPARSE_BLOCK outputs.
+  * @param  table: The kept blocks
+  * @param  in: table->cols floats
+  * @param  bias: table->rows floats
+  * @param  out: table->rows floats
+  * @retval None
+  */
+void Sparse_Dense(const Sparse_TableTypeDef *table, const float *in, const float *bias, float *out)
+{
+	const float *v = table->values;
+	for(uint32_t r=0;r<table->rows/SPARSE_BLOCK;r++)
+	{
+		float a0 = bias[0], a1 = bias[1], a2 = bias[2], a3 = bias[3];
+		for(uint32_t b=table->rowStart[r];b<table->rowStart[r+1];b++)
+		{
+			float x = in[table->col[b]];
+			a0 += v[0]*x;
+			a1 += v[1]*x;
+			a2 += v[2]*x;
+			a3 += v[3]*x;
+			v += SPARSE_BLOCK;
+		}
+		out[0] = a0;
+		out[1] = a1;
+		out[2] = a2;
+		out[3] = a3;
+		out += SPARSE_BLOCK;
+		bias += SPARSE_BLOCK;
+	}
+}
+//over the bit patterns, so the tool on the host and the target agree exactly
+uint32_t Sparse_Hash(const float *weights, uint32_t count)
+{
+	uint32_t h = 2166136261u;
+	for(uint32_t i=0;i<count;i++)
+	{
+		uint32_t bits;
+		memcpy(&bits, &weights[i], sizeof(bits));
+		h = (h ^ bits) * 16777619u;
+	}
+	return h;
+}
+#ifdef SPARSE_DENSE_EN
+//same interface as forward_dense: input 0, output 0, weights 0 and bias 1 of the chain
+static void forwardSparse(ai_layer *layer)
+{
+	const ai_tensor_chain *chain = AI_LAYER_OBJ(layer)->tensors;
+	ai_tensor *in = GET_TENSOR_IN(chain, 0);
+	ai_tensor *out = GET_TENSOR_OUT(chain, 0);
+	ai_tensor *bias = GET_TENSOR_WEIGHTS(chain, 1);
+	Sparse_Dense(&sparseDenseTable, AI_ARRAY_OBJ_DATA(in->data, float),
+			AI_ARRAY_OBJ_DATA(bias->data, float), AI_ARRAY_OBJ_DATA(out->data, float));
+}
+#endif
+#ifdef SPARSE_DENSE_STRIP
+//network_configure_weights placed every tensor as in the full weights, the
+//ones after the dense matrix sit that much lower in the stripped image
+static void rebase(ai_node *first, const uint8_t *end, uint32_t cut)
+{
+	for(ai_node *node = first;node != NULL;node = node->next)
+	{
+		ai_tensor_list *list = GET_TENSOR_LIST_WEIGTHS(node->tensors);
+		for(uint32_t i=0;i<GET_TENSOR_LIST_SIZE(list);i++)
+		{
+			ai_array *array = GET_TENSOR_LIST_ITEM(list, i)->data;
+			if(array->data >= end)
+			{
+				array->data -= cut;
+				array->data_start -= cut;
+			}
+		}
+		if(node->next == node) break;
+	}
+}
+#endif
+/**
+  * @brief  Picks the kernel of the table's layer for the weights the network
+  * 		is bound to now. Called after every (re)init of the network.
+  * @param  first: Input node of the network
+  * @param  weights: The weights it was bound to
+  * @retval 0 when the weights can't run: the stripped image and a table from
+  * 		other weights
+  */
+int Sparse_Install(ai_node *first, const void *weights)
+{
+#ifdef SPARSE_DENSE_EN
+	const uint32_t count = (uint32_t)sparseDenseTable.rows*sparseDenseTable.cols;
+	for(ai_node *node = first;node != NULL;node = node->next)
+	{
+		if(node->forward == AI_NODE_FUNC(forward_dense) || node->forward == AI_NODE_FUNC(forwardSparse))
+		{
+			ai_tensor *dense = GET_TENSOR_WEIGHTS(node->tensors, 0);
+			if(AI_ARRAY_OBJ_SIZE(dense->data) == count)
+			{
+#ifdef SPARSE_DENSE_STRIP
+				//no dense rows to hash or fall back to, the image says what they were
+				if(weights == (const void*)sparseDenseWeights)
+				{
+					sparseDenseActive = sparseDenseWeightsHash == sparseDenseTable.hash;
+					rebase(first, AI_ARRAY_OBJ_DATA(dense->data, uint8_t) + count*sizeof(float), count*sizeof(float));
+					node->forward = AI_NODE_FUNC(forwardSparse);
+					Log_Printf("dense %ux%u: %s\r\n", sparseDenseTable.cols, sparseDenseTable.rows,
+							sparseDenseActive ? "block sparse, dense rows stripped" : "stripped weights are from other weights than the sparse table");
+					return sparseDenseActive;
+				}
+#endif
+				sparseDenseActive = Sparse_Hash(AI_ARRAY_OBJ_DATA(dense->data, float), count) == sparseDenseTable.hash;
+				node->forward = sparseDenseActive ? AI_NODE_FUNC(forwardSparse) : AI_NODE_FUNC(forward_dense);
+				Log_Printf("dense %ux%u: %s\r\n", sparseDenseTable.cols, sparseDenseTable.rows,
+						sparseDenseActive ? "block sparse" : "dense, weights differ from the sparse table");
+				return 1;
+			}
+		}
+		//the last node links to itself
+		if(node->next == node) break;
+	}
+#endif
+	(void)first;
+	(void)weights;
+	return 1;
+}
@@ -0,0 +1,153 @@
+#include "stackmon.h"
+#include "cyclic.h"
+#include "placement.h"
+#include <sys/types.h>
+
+#ifdef STACK_MONITOR_EN
+//room for the frames of the helpers below, never painted while they run
+#define STACK_MARGIN 64
+#define WORDS(bytes) ((bytes)/sizeof(uint32_t))
+
+caddr_t _sbrk(int incr);
+uint16_t stackTaskMax[TASKS_MAX];
+uint16_t stackIsrMax[STACK_IRQS];
+uint32_t stackWindowFull = 0;
+static uint32_t isrStack[WORDS(STACK_ISR_SIZE)] RAM2_BSS __attribute__((aligned(8)));
+static uint32_t *isrEntry[STACK_IRQS];
+static uint32_t *taskEntry;
+//lowest thread stack word seen written, _sbrk stays below it
+static uint32_t *threadLow;
+static int ready = 0;
+
+static uint32_t *heapTop(void)
+{
+	uintptr_t p = (uintptr_t)_sbrk(0) + STACK_HEAP_GUARD;
+	return (uint32_t*)((p + 3) & ~3u);
+}
+static uint32_t *lowest(uint32_t *bottom, uint32_t *top)
+{
+	while(bottom < top && *bottom == STACK_PAINT) bottom++;
+	return bottom;
+}
+static void paint(uint32_t *from, uint32_t *to)
+{
+	while(from < to) *from++ = STACK_PAINT;
+}
+//[bottom, top) of the window below sp, bottom clamped to limit
+static uint32_t *windowBottom(uint32_t *sp, uint32_t bytes, uint32_t *limit)
+{
+	return sp - WORDS(bytes) > limit ? sp - WORDS(bytes) : limit;
+}
+
+/**
+  * @brief  Splits the stacks and paints them. Call from main before
+  * 		task_scheduler, with nothing left to return to on the handler side.
+  * @retval None
+  */
+void StackMon_Init(void)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	paint(isrStack, isrStack + WORDS(STACK_ISR_SIZE));
+	//thread mode keeps the stack it's on, from now on through PSP
+	__set_PSP(__get_MSP());
+	__set_CONTROL(__get_CONTROL() | CONTROL_SPSEL_Msk);
+	__ISB();
+	__set_MSP((uint32_t)(isrStack + WORDS(STACK_ISR_SIZE)));
+	uint32_t *sp = (uint32_t*)__get_PSP() - WORDS(STACK_MARGIN);
+	paint(heapTop(), sp);
+	threadLow = sp;
+	ready = 1;
+	__set_PRIMASK(primask);
+}
+/**
+  * @brief  Repaints what the code since the last task run dirtied in the
+  * 		window below the caller. Called by runTask.
+  * @retval None
+  */
+void StackMon_TaskStart(void)
+{
+	if(!ready) return;
+	taskEntry = (uint32_t*)__get_PSP();
+	uint32_t *top = taskEntry - WORDS(STACK_MARGIN);
+	uint32_t *p = lowest(windowBottom(taskEntry, STACK_TASK_WINDOW, heapTop()), top);
+	//idle tasks and the scheduler itself leave their marks here too
+	if(p < threadLow) threadLow = p;
+	paint(p, top);
+}
+/**
+  * @brief  Records the stack the task just needed.
+  * @param  code: Task code
+  * @retval None
+  */
+void StackMon_TaskEnd(int code)
+{
+	if(!ready) return;
+	uint32_t *bottom = windowBottom(taskEntry, STACK_TASK_WINDOW, heapTop());
+	uint32_t *p = lowest(bottom, taskEntry - WORDS(STACK_MARGIN));
+	if(p == bottom) stackWindowFull++;
+	if(p < threadLow) threadLow = p;
+	uint32_t used = (taskEntry - p)*sizeof(uint32_t);
+	if(used > stackTaskMax[code]) stackTaskMax[code] = used;
+}
+/**
+  * @brief  Handler entry hook, repaints the window below the handler.
+  * @param  irq: The handler's IRQn
+  * @retval None
+  */
+void StackMon_IsrEnter(IRQn_Type irq)
+{
+	if(!ready) return;
+	uint32_t *sp = (uint32_t*)__get_MSP();
+	uint32_t *top = sp - WORDS(STACK_MARGIN);
+	uint32_t *p = lowest(windowBottom(sp, STACK_ISR_WINDOW, isrStack), top);
+	paint(p, top);
+	isrEntry[irq+16] = sp;
+}
+/**
+  * @brief  Handler exit hook, records the stack the handler needed.
+  * @param  irq: The handler's IRQn
+  * @retval None
+  */
+void StackMon_IsrExit(IRQn_Type irq)
+{
+	uint32_t *sp = isrEntry[irq+16];
+	if(!ready || sp == NULL) return;
+	uint32_t *bottom = windowBottom(sp, STACK_ISR_WINDOW, isrStack);
+	uint32_t *p = lowest(bottom, sp - WORDS(STACK_MARGIN));
+	if(p == bottom) stackWindowFull++;
+	uint32_t used = (sp - p)*sizeof(uint32_t);
+	if(used > stackIsrMax[irq+16]) stackIsrMax[irq+16] = used;
+}
+/**
+  * @brief  Bytes between the heap guard and the deepest point the thread
+  * 		stack ever reached. Scans all of it, for the idle tasks.
+  * @retval Bytes
+  */
+uint32_t StackMon_ThreadFree(void)
+{
+	if(!ready) return 0;
+	uint32_t *bottom = heapTop();
+	uint32_t *p = lowest(bottom, threadLow);
+	if(p < threadLow) threadLow = p;
+	return (p - bottom)*sizeof(uint32_t);
+}
+/**
+  * @brief  Bytes of the handler stack never used.
+  * @retval Bytes
+  */
+uint32_t StackMon_IsrFree(void)
+{
+	if(!ready) return 0;
+	return (lowest(isrStack, isrStack + WORDS(STACK_ISR_SIZE)) - isrStack)*sizeof(uint32_t);
+}
+/**
+  * @brief  The highest address the heap may grow to. Used by _sbrk.
+  * @retval NULL before StackMon_Init
+  */
+char *StackMon_Limit(void)
+{
+	if(!ready) return NULL;
+	return (char*)threadLow - STACK_HEAP_GUARD;
+}
+#endif
@@ -22,6 +22,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
 /* USER CODE BEGIN Includes */
+#include "metrics.h"
 
 /* USER CODE END Includes */
 
@@ -191,6 +192,8 @@ void HAL_I2C_MspDeInit(I2C_HandleTypeDef* hi2c)
   if(hi2c->Instance==I2C2)
   {
   /* USER CODE BEGIN I2C2_MspDeInit 0 */
+  /* the sensor bsp only de-inits the bus to recover from an error */
+  i2cErrors++;
 
   /* USER CODE END I2C2_MspDeInit 0 */
     /* Peripheral clock disable */
@@ -23,6 +23,8 @@
 #include "stm32l4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "trace.h"
+#include "stackmon.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -203,14 +205,16 @@ void SysTick_Handler(void)
 void EXTI9_5_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI9_5_IRQn 0 */
-
+  TRACE(TRACE_ISR_ENTER, EXTI9_5_IRQn, 0);
+  STACK_ISR_ENTER(EXTI9_5_IRQn);
   /* USER CODE END EXTI9_5_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_5);
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_6);
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_7);
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_8);
   /* USER CODE BEGIN EXTI9_5_IRQn 1 */
-
+  STACK_ISR_EXIT(EXTI9_5_IRQn);
+  TRACE(TRACE_ISR_EXIT, EXTI9_5_IRQn, 0);
   /* USER CODE END EXTI9_5_IRQn 1 */
 }
 
@@ -220,7 +224,8 @@ void EXTI9_5_IRQHandler(void)
 void EXTI15_10_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI15_10_IRQn 0 */
-
+  TRACE(TRACE_ISR_ENTER, EXTI15_10_IRQn, 0);
+  STACK_ISR_ENTER(EXTI15_10_IRQn);
   /* USER CODE END EXTI15_10_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_10);
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_11);
@@ -228,17 +233,20 @@ void EXTI15_10_IRQHandler(void)
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_14);
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_15);
   /* USER CODE BEGIN EXTI15_10_IRQn 1 */
-
+  STACK_ISR_EXIT(EXTI15_10_IRQn);
+  TRACE(TRACE_ISR_EXIT, EXTI15_10_IRQn, 0);
   /* USER CODE END EXTI15_10_IRQn 1 */
 }
 void EXTI1_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI1_IRQn 0 */
-
+  TRACE(TRACE_ISR_ENTER, EXTI1_IRQn, 0);
+  STACK_ISR_ENTER(EXTI1_IRQn);
   /* USER CODE END EXTI1_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_1);
   /* USER CODE BEGIN EXTI1_IRQn 1 */
-
+  STACK_ISR_EXIT(EXTI1_IRQn);
+  TRACE(TRACE_ISR_EXIT, EXTI1_IRQn, 0);
   /* USER CODE END EXTI1_IRQn 1 */
 }
 /* USER CODE BEGIN 1 */
@@ -49,6 +49,7 @@
 /* Includes */
 #include <errno.h>
 #include <stdio.h>
+#include "stackmon.h"
 
 /* Variables */
 extern int errno;
@@ -70,7 +71,14 @@ caddr_t _sbrk(int incr)
 		heap_end = &end;
 
 	prev_heap_end = heap_end;
-	if (heap_end + incr > stack_ptr)
+	char *limit = stack_ptr;
+#ifdef STACK_MONITOR_EN
+	//the live SP is only where the stack is now, keep off where it has been
+	char *deepest = StackMon_Limit();
+	if (deepest != NULL && deepest < limit)
+		limit = deepest;
+#endif
+	if (heap_end + incr > limit)
 	{
 		errno = ENOMEM;
 		return (caddr_t) -1;
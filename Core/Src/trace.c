@@ -0,0 +1,137 @@
+#include "trace.h"
+#include "cyclic.h"
+#include "log.h"
+#include "placement.h"
+#include <stdio.h>
+#include <string.h>
+
+//written from every handler, kept off the bus the tasks' data is on
+static Trace_Record ring[TRACE_RECORDS] RAM2_BSS;
+static uint16_t head = 0;
+static uint16_t count = 0;
+//set while a dump runs, Trace_Event leaves the ring alone
+static volatile uint8_t frozen = 0;
+static WIFI_HandleTypeDef *dumpWifi;
+//header lines first (clock, task names, aperiodic names), then the records oldest first
+static int dumpLine;
+static char frame[4+TRACE_FRAME_SIZE];
+
+/**
+  * @brief  Records one event, callable from interrupts.
+  * @param  event: enum Trace_Event
+  * @param  id: Task code, irq number, layer... see trace.h
+  * @param  arg: Event specific
+  * @retval None
+  */
+RAM2_FUNC void Trace_Event(uint8_t event, uint8_t id, uint16_t arg)
+{
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	if(!frozen)
+	{
+		Trace_Record *r = &ring[head];
+		r->cycles = DWT->CYCCNT;
+		r->event = event;
+		r->id = id;
+		r->arg = arg;
+		head = (head+1) & (TRACE_RECORDS-1);
+		if(count < TRACE_RECORDS) count++;
+	}
+	__set_PRIMASK(primask);
+}
+/**
+  * @brief  Freezes the ring and starts writing it out, from Trace_Poll to the
+  * 		uart or from Trace_SendFrame to the socket. Recording resumes once
+  * 		the last record went out.
+  * @param  hwifi: Uplink handle, NULL for the uart log
+  * @retval None
+  */
+void Trace_Dump(WIFI_HandleTypeDef* hwifi)
+{
+	if(frozen) return;
+	frozen = 1;
+	dumpWifi = hwifi;
+	dumpLine = 0;
+}
+int Trace_Dumping(void)
+{
+	return frozen;
+}
+//formats line n of the dump, 0 once past the last one; unused codes give an empty line
+static int formatLine(int n, char *out, int size)
+{
+	if(n == 0) return snprintf(out, size, "TC %lu\r\n", SystemCoreClock);
+	n--;
+	if(n < TASKS_MAX)
+	{
+		return taskRegistered(n) ? snprintf(out, size, "TN %d %s\r\n", n, tasks[n].task_name) : -1;
+	}
+	n -= TASKS_MAX;
+	if(n < n_aperiodic)
+	{
+		return snprintf(out, size, "TA %d %s\r\n", n, aperiodicTasks[n].task_name);
+	}
+	n -= n_aperiodic;
+	if(n < count)
+	{
+		Trace_Record *r = &ring[(head + TRACE_RECORDS - count + n) & (TRACE_RECORDS-1)];
+		return snprintf(out, size, "TR %08lx %02x %02x %04x\r\n", r->cycles, r->event, r->id, r->arg);
+	}
+	return 0;
+}
+/**
+  * @brief  Idle task: writes a frozen ring dumped to the uart out a few lines
+  * 		at a time, keeping half of the log ring for everyone else.
+  * @param  remaining: ms left before the next minor cycle
+  * @retval None
+  */
+void Trace_Poll(int remaining)
+{
+	char line[LOG_LINE_SIZE];
+	int n = 1;
+	(void)remaining;
+	if(!frozen || dumpWifi != NULL) return;
+	while(Log_Free() > LOG_BUFFER_SIZE/2 && (n = formatLine(dumpLine, line, sizeof(line))) != 0)
+	{
+		dumpLine++;
+		Log_Write(line, n);
+	}
+	if(n == 0)
+	{
+		count = 0;
+		frozen = 0;
+	}
+}
+/**
+  * @brief  Sends the next frame of a dump to the uplink socket.
+  * @retval 1 when a socket dump is open and this call sent its next frame,
+  * 		0 when there is none
+  */
+int Trace_SendFrame(void)
+{
+	uint32_t len = 0;
+	int n;
+	if(!frozen || dumpWifi == NULL) return 0;
+	//whole lines only, the one that doesn't fit starts the next frame
+	while((n = formatLine(dumpLine, frame+4+len, TRACE_FRAME_SIZE-len)) != 0 && n < (int)(TRACE_FRAME_SIZE-len))
+	{
+		dumpLine++;
+		if(n > 0) len += n;
+	}
+	//length prefix as WIFI_SendStr, the server splits the stream on it
+	frame[0] = len>>24;
+	frame[1] = len>>16;
+	frame[2] = len>>8;
+	frame[3] = len;
+	if(len > 0 && WIFI_SendRaw(dumpWifi, (uint8_t*)frame, 4+len) != WIFI_OK)
+	{
+		//the link is gone, don't keep the recorder frozen for it
+		n = 0;
+	}
+	if(n == 0)
+	{
+		count = 0;
+		frozen = 0;
+	}
+	return 1;
+}
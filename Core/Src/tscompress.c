@@ -0,0 +1,240 @@
+#include "tscompress.h"
+#include <string.h>
+
+static void putBits(TSC_EncoderTypeDef *enc, uint32_t value, uint8_t n)
+{
+	while(n > 0)
+	{
+		uint32_t byte = enc->bitPos >> 3;
+		uint8_t room = 8 - (enc->bitPos & 7);
+		uint8_t take = n < room ? n : room;
+		uint8_t bits = (value >> (n - take)) & ((1u << take) - 1);
+		if(room == 8) enc->buf[byte] = 0;
+		enc->buf[byte] |= bits << (room - take);
+		enc->bitPos += take;
+		n -= take;
+	}
+}
+static int getBits(TSC_DecoderTypeDef *dec, uint8_t n, uint32_t *value)
+{
+	uint32_t v = 0;
+	if(dec->bitPos + n > (uint32_t)dec->len*8) return -1;
+	while(n > 0)
+	{
+		uint8_t byte = dec->buf[dec->bitPos >> 3];
+		uint8_t left = 8 - (dec->bitPos & 7);
+		uint8_t take = n < left ? n : left;
+		v = (v << take) | ((byte >> (left - take)) & ((1u << take) - 1));
+		dec->bitPos += take;
+		n -= take;
+	}
+	*value = v;
+	return 0;
+}
+static uint32_t floatBits(float f)
+{
+	uint32_t b;
+	memcpy(&b,&f,4);
+	return b;
+}
+static float bitsFloat(uint32_t b)
+{
+	float f;
+	memcpy(&f,&b,4);
+	return f;
+}
+/**
+  * @brief  Starts an empty block in buf.
+  * @param  enc: Encoder state
+  * @param  buf: Output buffer, the block never grows beyond it
+  * @param  cap: Buffer size in bytes
+  * @param  quantum: Value resolution, 0 for lossless
+  * @retval None
+  */
+void TSC_EncoderInit(TSC_EncoderTypeDef *enc, uint8_t *buf, uint16_t cap, float quantum)
+{
+	enc->buf = buf;
+	enc->cap = cap;
+	enc->quantum = quantum;
+	TSC_Reset(enc);
+}
+void TSC_Reset(TSC_EncoderTypeDef *enc)
+{
+	enc->bitPos = TSC_HEADER_SIZE*8;
+	enc->count = 0;
+	enc->deltaPrev = 0;
+	enc->lead = 0xff;
+	enc->trail = 0;
+}
+/**
+  * @brief  Appends one sample.
+  * @param  enc: Encoder state
+  * @param  t: Timestamp, e.g. HAL tick in ms
+  * @param  v: Value
+  * @retval 0 on success, -1 if the block is full (nothing was written)
+  */
+int TSC_Append(TSC_EncoderTypeDef *enc, uint32_t t, float v)
+{
+	if(enc->count == 0xffff || enc->bitPos + TSC_MAX_SAMPLE_BITS > (uint32_t)enc->cap*8) return -1;
+	if(enc->quantum > 0)
+	{
+		float q = v/enc->quantum;
+		v = (float)(int32_t)(q < 0 ? q-0.5f : q+0.5f) * enc->quantum;
+	}
+	uint32_t bits = floatBits(v);
+	if(enc->count == 0)
+	{
+		putBits(enc, t, 32);
+		putBits(enc, bits, 32);
+	}
+	else
+	{
+		int32_t delta = (int32_t)(t - enc->tPrev);
+		int32_t dod = delta - enc->deltaPrev;
+		enc->deltaPrev = delta;
+		if(dod == 0)
+		{
+			putBits(enc, 0, 1);
+		}
+		else if(dod >= -64 && dod <= 63)
+		{
+			putBits(enc, 0x2, 2);
+			putBits(enc, (uint32_t)dod, 7);
+		}
+		else if(dod >= -256 && dod <= 255)
+		{
+			putBits(enc, 0x6, 3);
+			putBits(enc, (uint32_t)dod, 9);
+		}
+		else if(dod >= -2048 && dod <= 2047)
+		{
+			putBits(enc, 0xE, 4);
+			putBits(enc, (uint32_t)dod, 12);
+		}
+		else
+		{
+			putBits(enc, 0xF, 4);
+			putBits(enc, (uint32_t)dod, 32);
+		}
+
+		uint32_t x = bits ^ enc->vPrev;
+		if(x == 0)
+		{
+			putBits(enc, 0, 1);
+		}
+		else
+		{
+			uint8_t lead = __builtin_clz(x);
+			uint8_t trail = __builtin_ctz(x);
+			if(enc->lead != 0xff && lead >= enc->lead && trail >= enc->trail)
+			{
+				//reuse the previous window
+				putBits(enc, 0x2, 2);
+				putBits(enc, x >> enc->trail, 32 - enc->lead - enc->trail);
+			}
+			else
+			{
+				uint8_t len = 32 - lead - trail;
+				putBits(enc, 0x3, 2);
+				putBits(enc, lead, 5);
+				putBits(enc, len - 1, 5);
+				putBits(enc, x >> trail, len);
+				enc->lead = lead;
+				enc->trail = trail;
+			}
+		}
+	}
+	enc->tPrev = t;
+	enc->vPrev = bits;
+	enc->count++;
+	return 0;
+}
+/**
+  * @brief  Writes the sample count into the block header.
+  * @param  enc: Encoder state
+  * @retval Block size in bytes, 0 if the block is empty
+  */
+uint16_t TSC_Finish(TSC_EncoderTypeDef *enc)
+{
+	if(enc->count == 0) return 0;
+	enc->buf[0] = enc->count >> 8;
+	enc->buf[1] = enc->count & 0xff;
+	return (enc->bitPos + 7) >> 3;
+}
+/**
+  * @brief  Opens a block produced by TSC_Finish.
+  * @retval Number of samples in the block, -1 if the block is malformed
+  */
+int TSC_DecoderInit(TSC_DecoderTypeDef *dec, const uint8_t *buf, uint16_t len)
+{
+	if(len < TSC_HEADER_SIZE) return -1;
+	dec->buf = buf;
+	dec->len = len;
+	dec->bitPos = TSC_HEADER_SIZE*8;
+	dec->count = (buf[0] << 8) | buf[1];
+	dec->index = 0;
+	dec->deltaPrev = 0;
+	dec->lead = 0;
+	dec->trail = 0;
+	return dec->count;
+}
+static int32_t signExtend(uint32_t v, uint8_t n)
+{
+	uint32_t m = 1u << (n - 1);
+	return (int32_t)((v ^ m) - m);
+}
+/**
+  * @brief  Decodes the next sample.
+  * @retval 1 if a sample was returned, 0 at the end of the block, -1 on a truncated block
+  */
+int TSC_Next(TSC_DecoderTypeDef *dec, uint32_t *t, float *v)
+{
+	uint32_t b, x;
+	if(dec->index >= dec->count) return 0;
+	if(dec->index == 0)
+	{
+		if(getBits(dec, 32, &dec->tPrev) || getBits(dec, 32, &dec->vPrev)) return -1;
+	}
+	else
+	{
+		//timestamp: count the leading ones of the prefix, at most 4
+		uint8_t ones = 0;
+		while(ones < 4)
+		{
+			if(getBits(dec, 1, &b)) return -1;
+			if(b == 0) break;
+			ones++;
+		}
+		static const uint8_t width[5] = {0, 7, 9, 12, 32};
+		int32_t dod = 0;
+		if(ones > 0)
+		{
+			if(getBits(dec, width[ones], &b)) return -1;
+			dod = width[ones] == 32 ? (int32_t)b : signExtend(b, width[ones]);
+		}
+		dec->deltaPrev += dod;
+		dec->tPrev += dec->deltaPrev;
+
+		if(getBits(dec, 1, &b)) return -1;
+		if(b)
+		{
+			if(getBits(dec, 1, &b)) return -1;
+			if(b)
+			{
+				uint32_t lead, len;
+				if(getBits(dec, 5, &lead) || getBits(dec, 5, &len)) return -1;
+				len += 1;
+				if(lead + len > 32) return -1;
+				dec->lead = lead;
+				dec->trail = 32 - lead - len;
+			}
+			uint8_t len = 32 - dec->lead - dec->trail;
+			if(getBits(dec, len, &x)) return -1;
+			dec->vPrev ^= x << dec->trail;
+		}
+	}
+	*t = dec->tPrev;
+	*v = bitsFloat(dec->vPrev);
+	dec->index++;
+	return 1;
+}
@@ -0,0 +1,177 @@
+#include "weights.h"
+#include "inference.h"
+#include "log.h"
+#include <string.h>
+
+#define WEIGHTS_DATA(slot) ((const uint8_t*)slotBase[slot] + sizeof(Weights_HeaderTypeDef))
+
+static const uint32_t slotBase[WEIGHTS_SLOTS] = {WEIGHTS_SLOT_A, WEIGHTS_SLOT_B};
+static int active = WEIGHTS_BUILTIN;
+static uint32_t activeVersion = 0;
+//the download in progress, target is WEIGHTS_BUILTIN when there is none
+static int target = WEIGHTS_BUILTIN;
+static uint32_t targetCrc;
+static uint32_t targetVersion;
+static uint32_t erased; //bit per page of the target slot
+
+static const Weights_HeaderTypeDef *header(int slot)
+{
+	return (const Weights_HeaderTypeDef*)slotBase[slot];
+}
+//CRC peripheral in its reset configuration: poly 0x04C11DB7, init all ones, no reflection
+static uint32_t crc(const uint8_t *data, uint32_t len)
+{
+	CRC->POL = 0x04C11DB7;
+	CRC->INIT = 0xFFFFFFFF;
+	CRC->CR = CRC_CR_RESET;
+	uint32_t i = 0;
+	for(;i+4<=len;i+=4) CRC->DR = *(const uint32_t*)(data+i);
+	for(;i<len;i++) *(__IO uint8_t*)&CRC->DR = data[i];
+	return CRC->DR;
+}
+static int valid(int slot)
+{
+	const Weights_HeaderTypeDef *h = header(slot);
+	return h->magic == WEIGHTS_MAGIC && h->size == WEIGHTS_SIZE && crc(WEIGHTS_DATA(slot), h->size) == h->crc;
+}
+static int erasePage(uint32_t addr)
+{
+	FLASH_EraseInitTypeDef erase = {0};
+	uint32_t pageError;
+	erase.TypeErase = FLASH_TYPEERASE_PAGES;
+	erase.Banks = FLASH_BANK_2;
+	erase.Page = (addr - FLASH_BASE - FLASH_BANK_SIZE)/FLASH_PAGE_SIZE;
+	erase.NbPages = 1;
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase, &pageError);
+	HAL_FLASH_Lock();
+	return status == HAL_OK;
+}
+//addr and len multiples of 8; a doubleword that already holds the value is left alone, so a resent chunk is harmless
+static int program(uint32_t addr, const uint8_t *data, uint32_t len)
+{
+	HAL_StatusTypeDef status = HAL_OK;
+	HAL_FLASH_Unlock();
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+	for(uint32_t i=0;i<len && status == HAL_OK;i+=8)
+	{
+		uint64_t word;
+		memcpy(&word, data+i, 8);
+		if(*(const uint64_t*)(addr+i) != word) status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD, addr+i, word);
+	}
+	HAL_FLASH_Lock();
+	return status == HAL_OK;
+}
+
+/**
+  * @brief  Picks the active slot. Call before Inference_Init.
+  * @retval None
+  */
+void Weights_Init(void)
+{
+	__HAL_RCC_CRC_CLK_ENABLE();
+	active = WEIGHTS_BUILTIN;
+	activeVersion = 0;
+	for(int slot=0;slot<WEIGHTS_SLOTS;slot++)
+	{
+		if(header(slot)->version > activeVersion && valid(slot))
+		{
+			active = slot;
+			activeVersion = header(slot)->version;
+		}
+	}
+	Log_Printf("weights: %s, version %lu\r\n", active == WEIGHTS_BUILTIN ? "built in" : active ? "slot B" : "slot A", activeVersion);
+}
+/**
+  * @brief  The weights the network runs (or will run from the next window) with.
+  * @retval WEIGHTS_SIZE bytes
+  */
+const void *Weights_Active(void)
+{
+	return active == WEIGHTS_BUILTIN ? WEIGHTS_IMAGE : WEIGHTS_DATA(active);
+}
+int Weights_Slot(void)
+{
+	return active;
+}
+uint32_t Weights_Version(void)
+{
+	return activeVersion;
+}
+int Weights_Receiving(void)
+{
+	return target != WEIGHTS_BUILTIN;
+}
+/**
+  * @brief  Starts a download into the slot not in use, a download already
+  * 		running is dropped. Erases the target's header page.
+  * @param  size: Bytes of weights, WEIGHTS_SIZE
+  * @param  dataCrc: CRC of the weights, checked by Weights_Commit
+  * @param  version: Above the active version, the highest valid one wins at boot
+  * @retval WEIGHTS_ERR_BUSY while the network hasn't switched to the last commit yet
+  */
+Weights_StatusTypeDef Weights_Begin(uint32_t size, uint32_t dataCrc, uint32_t version)
+{
+	if(size != WEIGHTS_SIZE || version <= activeVersion) return WEIGHTS_ERR_ARG;
+	//the slot that's about to be erased may still be in the network
+	if(Inference_SwapPending()) return WEIGHTS_ERR_BUSY;
+	target = active == 0 ? 1 : 0;
+	targetCrc = dataCrc;
+	targetVersion = version;
+	erased = 0;
+	if(!erasePage(slotBase[target]))
+	{
+		target = WEIGHTS_BUILTIN;
+		return WEIGHTS_ERR_FLASH;
+	}
+	erased = 1;
+	return WEIGHTS_OK;
+}
+/**
+  * @brief  Programs a chunk of the download.
+  * @param  offset: Into the weights, a multiple of 8
+  * @param  data: The chunk
+  * @param  len: A multiple of 8
+  * @retval WEIGHTS_ERR_ARG without a download or for a bad offset or length
+  */
+Weights_StatusTypeDef Weights_Write(uint32_t offset, const uint8_t *data, uint32_t len)
+{
+	if(target == WEIGHTS_BUILTIN) return WEIGHTS_ERR_ARG;
+	if(offset % 8 || len % 8 || len == 0 || offset + len > WEIGHTS_SIZE) return WEIGHTS_ERR_ARG;
+	uint32_t addr = (uint32_t)WEIGHTS_DATA(target) + offset;
+	uint32_t first = (addr - slotBase[target])/FLASH_PAGE_SIZE;
+	uint32_t last = (addr + len - 1 - slotBase[target])/FLASH_PAGE_SIZE;
+	for(uint32_t page=first;page<=last;page++)
+	{
+		if(erased & (1u<<page)) continue;
+		if(!erasePage(slotBase[target] + page*FLASH_PAGE_SIZE)) return WEIGHTS_ERR_FLASH;
+		erased |= 1u<<page;
+	}
+	return program(addr, data, len) ? WEIGHTS_OK : WEIGHTS_ERR_FLASH;
+}
+/**
+  * @brief  Checks the download and makes it the active slot; the network
+  * 		switches at its next window.
+  * @retval WEIGHTS_ERR_CRC when the data doesn't match the CRC from Weights_Begin,
+  * 		the download stays open for the missing chunks
+  */
+Weights_StatusTypeDef Weights_Commit(void)
+{
+	if(target == WEIGHTS_BUILTIN) return WEIGHTS_ERR_ARG;
+	//a page never written may hold anything, the CRC below would only catch it by chance
+	if(erased != (1u<<((sizeof(Weights_HeaderTypeDef)+WEIGHTS_SIZE-1)/FLASH_PAGE_SIZE+1))-1) return WEIGHTS_ERR_CRC;
+	if(crc(WEIGHTS_DATA(target), WEIGHTS_SIZE) != targetCrc) return WEIGHTS_ERR_CRC;
+	Weights_HeaderTypeDef h = {WEIGHTS_MAGIC, targetVersion, WEIGHTS_SIZE, targetCrc, {0}};
+	//size and crc first, a slot without its magic is never looked at
+	if(!program(slotBase[target] + 8, (const uint8_t*)&h + 8, 8) || !program(slotBase[target], (const uint8_t*)&h, 8))
+	{
+		return WEIGHTS_ERR_FLASH;
+	}
+	active = target;
+	activeVersion = targetVersion;
+	target = WEIGHTS_BUILTIN;
+	Inference_SetWeights(Weights_Active());
+	Log_Printf("weights: slot %s, version %lu committed\r\n", active ? "B" : "A", activeVersion);
+	return WEIGHTS_OK;
+}
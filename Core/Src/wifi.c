@@ -1,5 +1,7 @@
 /* Includes ------------------------------------------------------------------*/
 #include "wifi.h"
+#include "trace.h"
+#include "placement.h"
 
 
 
@@ -11,16 +13,21 @@
   * @param  size: Buffer size
   * @retval WIFI_StatusTypeDef
   */
-char wifiTxBuffer[WIFI_TX_BUFFER_SIZE];
-char wifiRxBuffer[WIFI_RX_BUFFER_SIZE];
+//polled SPI, no DMA, so they can live in SRAM2
+char wifiTxBuffer[WIFI_TX_BUFFER_SIZE] RAM2_BSS;
+char wifiRxBuffer[WIFI_RX_BUFFER_SIZE] RAM2_BSS;
+volatile uint32_t wifiSpiErrors = 0;
+volatile uint32_t wifiSendErrors = 0;
 void WIFI_DEBUG(char *cmd,char *resp)
 {
-	char message[WIFI_RX_BUFFER_SIZE*2];
-	char cmd_box[WIFI_RX_BUFFER_SIZE];
-	sprintf(cmd_box,cmd);
-	trimstr(cmd_box,strlen(cmd_box)+1,'\r');
-	sprintf(message,"[%s]%s",cmd_box,resp);
-	HAL_UART_Transmit(&huart1, (uint8_t*)message, strlen(message),0xFFFF);
+	//"[cmd]resp" with the command's '\r' trimmed, sent from where it is instead of a 3KB copy
+	char *end = cmd + strlen(cmd);
+	while(*cmd == '\r') cmd++;
+	while(end > cmd && end[-1] == '\r') end--;
+	HAL_UART_Transmit(&huart1, (uint8_t*)"[", 1, 0xFFFF);
+	HAL_UART_Transmit(&huart1, (uint8_t*)cmd, end-cmd, 0xFFFF);
+	HAL_UART_Transmit(&huart1, (uint8_t*)"]", 1, 0xFFFF);
+	HAL_UART_Transmit(&huart1, (uint8_t*)resp, strlen(resp), 0xFFFF);
 }
 uint32_t htonl(uint32_t data)
 {
@@ -60,12 +67,15 @@ WIFI_StatusTypeDef WIFI_SPI_Receive(WIFI_HandleTypeDef* hwifi, char* buffer, uin
 
 WIFI_StatusTypeDef WIFI_SPI_Transmit(WIFI_HandleTypeDef* hwifi, char* buffer, uint16_t size){
 
-	char bTx[(size/2)*2 + 1]; // Make a buffer that has an even amount of bytes (even is meant for the chars excluding \0)
-	snprintf( bTx, size, buffer ); // Copy buffer in bTx
+	// An odd amount of chars (excluding \0) gets a filler char after them, put in place for the transfer
+	uint16_t len = strnlen(buffer, size - 1);
+	char saved = buffer[len];
 	//size % 2 ==0 : mLen is odd
-	if ( !(size % 2) ) strcat(bTx, (char) WIFI_TX_PADDING); // If buffer had an odd amount of bytes, append a filler char to bTx
+	if ( !(size % 2) ) buffer[len] = WIFI_TX_PADDING;
 
-	if (HAL_SPI_Transmit(hwifi->handle, (uint8_t*)bTx, size/2, WIFI_TIMEOUT) != HAL_OK) // size must be halved since 16bits are sent via SPI
+	HAL_StatusTypeDef status = HAL_SPI_Transmit(hwifi->handle, (uint8_t*)buffer, size/2, WIFI_TIMEOUT); // size must be halved since 16bits are sent via SPI
+	buffer[len] = saved;
+	if (status != HAL_OK)
 	  {
 		Error_Handler();
 	  }
@@ -120,6 +130,7 @@ WIFI_StatusTypeDef WIFI_Init(WIFI_HandleTypeDef* hwifi){
 
 WIFI_StatusTypeDef WIFI_SendATCommand(WIFI_HandleTypeDef* hwifi, char* bCmd, uint16_t sizeCmd, char* bRx, uint16_t sizeRx){
 
+	TRACE(TRACE_WIFI_START,0,(bCmd[0]<<8) | bCmd[1]);
 	while(!WIFI_IS_CMDDATA_READY());
 
 	WIFI_ENABLE_NSS();
@@ -138,10 +149,12 @@ WIFI_StatusTypeDef WIFI_SendATCommand(WIFI_HandleTypeDef* hwifi, char* bCmd, uin
 
 	WIFI_DISABLE_NSS();
 
+	TRACE(TRACE_WIFI_END,0,(bCmd[0]<<8) | bCmd[1]);
 	return WIFI_OK;
 }
 WIFI_StatusTypeDef WIFI_SendATData(WIFI_HandleTypeDef* hwifi, char* bCmd, uint16_t sizeCmd, char* bRx, uint16_t sizeRx){
 
+	TRACE(TRACE_WIFI_START,0,(bCmd[0]<<8) | bCmd[1]);
 	while(!WIFI_IS_CMDDATA_READY());
 
 	WIFI_ENABLE_NSS();
@@ -163,6 +176,7 @@ WIFI_StatusTypeDef WIFI_SendATData(WIFI_HandleTypeDef* hwifi, char* bCmd, uint16
 
 	WIFI_DISABLE_NSS();
 
+	TRACE(TRACE_WIFI_END,0,(bCmd[0]<<8) | bCmd[1]);
 	return WIFI_OK;
 }
 
@@ -227,10 +241,10 @@ WIFI_StatusTypeDef WIFI_JoinNetwork(WIFI_HandleTypeDef* hwifi){
 	if(hwifi->DHCP == SET){
 		// The IP address is between the first and second comma
 		char* startPos = strstr(wifiRxBuffer, ",");
+		// Check whether the commas have been found, the second is only looked for after the first
+		if(startPos == NULL) Error_Handler();
 		char* endPos = strstr(startPos+1, ",");
-
-		// Check whether the commas have been found
-		if(startPos == NULL || endPos == NULL) Error_Handler();
+		if(endPos == NULL) Error_Handler();
 
 		// Copy the IP address from the response buffer into the Wifi handle
 		// For n set IP_length+1, because the ending char \0 must be considered
@@ -248,7 +262,13 @@ WIFI_StatusTypeDef WIFI_JoinNetwork(WIFI_HandleTypeDef* hwifi){
 WIFI_StatusTypeDef WIFI_ConnectServer(WIFI_HandleTypeDef* hwifi,char *ip,char *port)
 {
 	int msgLength = 0;
-	msgLength = sprintf(wifiTxBuffer,"P1=0\r");
+	int protocol = hwifi->transportProtocol;
+	// MQTT is framed on our side (see mqtt.c), the module only carries the byte stream
+	if(protocol == WIFI_MQTT_PROTOCOL)
+	{
+		protocol = (hwifi->mqtt.securityMode == WIFI_MQTT_SECURITY_CERT) ? WIFI_TCP_SSL_PROTOCOL : WIFI_TCP_PROTOCOL;
+	}
+	msgLength = sprintf(wifiTxBuffer,"P1=%d\r",protocol);
 	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
 	WIFI_DEBUG(wifiTxBuffer,wifiRxBuffer);
 	msgLength = sprintf(wifiTxBuffer,"P3=%s\r",ip);
@@ -260,6 +280,64 @@ WIFI_StatusTypeDef WIFI_ConnectServer(WIFI_HandleTypeDef* hwifi,char *ip,char *p
 	msgLength = sprintf(wifiTxBuffer,"P6=1\r");
 	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
 	WIFI_DEBUG(wifiTxBuffer,wifiRxBuffer);
+	// The module answers ERROR when the server refused or didn't answer
+	if(strstr(wifiRxBuffer, "ERROR") != NULL || strstr(wifiRxBuffer, "OK") == NULL) return WIFI_ERROR;
+	return WIFI_OK;
+}
+/**
+  * @brief  Selects the socket the following P/S/R commands apply to.
+  * 		Everything else in this file works on socket 0.
+  * @param  hwifi: Wifi handle, which decides which Wifi instance is used.
+  * @param  socket: 0..3
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef WIFI_SelectSocket(WIFI_HandleTypeDef* hwifi, uint8_t socket)
+{
+	int msgLength = sprintf(wifiTxBuffer,"P0=%d\r",socket);
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	if(strstr(wifiRxBuffer, "ERROR") != NULL) return WIFI_ERROR;
+	return WIFI_OK;
+}
+/**
+  * @brief  Starts a TCP server on a socket, the same sequence as
+  * 		ES_WIFI_StartServerMultiConn but without blocking for a client.
+  * 		Socket 0 is selected again afterwards.
+  * @param  hwifi: Wifi handle, which decides which Wifi instance is used.
+  * @param  socket: Server socket, must not be the uplink socket 0
+  * @param  port: Local port
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef WIFI_StartServer(WIFI_HandleTypeDef* hwifi, uint8_t socket, uint16_t port)
+{
+	int msgLength = 0;
+	WIFI_StatusTypeDef status = WIFI_OK;
+	if(WIFI_SelectSocket(hwifi, socket) != WIFI_OK) return WIFI_ERROR;
+	msgLength = sprintf(wifiTxBuffer,"P1=%d\r",WIFI_TCP_PROTOCOL);
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	msgLength = sprintf(wifiTxBuffer,"P2=%d\r",port);
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	// backlog of waiting clients
+	msgLength = sprintf(wifiTxBuffer,"P8=6\r");
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	msgLength = sprintf(wifiTxBuffer,"P5=1\r");
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	WIFI_DEBUG(wifiTxBuffer,wifiRxBuffer);
+	if(strstr(wifiRxBuffer, "ERROR") != NULL) status = WIFI_ERROR;
+	WIFI_SelectSocket(hwifi, 0);
+	return status;
+}
+/**
+  * @brief  Closes the client connection of the selected server socket and
+  * 		lets the module take the next client from the backlog.
+  * @param  hwifi: Wifi handle, which decides which Wifi instance is used.
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef WIFI_CloseClient(WIFI_HandleTypeDef* hwifi)
+{
+	int msgLength = sprintf(wifiTxBuffer,"P7=2\r");
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	msgLength = sprintf(wifiTxBuffer,"P7=3\r");
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
 	return WIFI_OK;
 }
 WIFI_StatusTypeDef WIFI_DisconnectServer(WIFI_HandleTypeDef* hwifi)
@@ -305,6 +383,99 @@ WIFI_StatusTypeDef WIFI_SendStr(WIFI_HandleTypeDef* hwifi,char *data)
 	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
 	WIFI_DEBUG(wifiTxBuffer,wifiRxBuffer);
 }
+/**
+  * @brief  Receives a response without treating it as a c string, so
+  * 		payload bytes like 0x00 or 0x15 survive.
+  * @param  hwifi: Wifi handle, which decides which Wifi instance is used.
+  * @param  buffer: Buffer, where the received bytes will be saved in.
+  * @param  size: Buffer size
+  * @param  count: Number of bytes clocked in (padding included)
+  * @retval WIFI_StatusTypeDef
+  */
+static WIFI_StatusTypeDef WIFI_SPI_ReceiveRaw(WIFI_HandleTypeDef* hwifi, uint8_t* buffer, uint16_t size, uint16_t* count){
+
+	uint16_t cnt = 0;
+
+	while (WIFI_IS_CMDDATA_READY())
+	{
+		if ( (cnt > (size - 2)) || (HAL_SPI_Receive(hwifi->handle , buffer + cnt, 1, WIFI_TIMEOUT) != HAL_OK) )
+		{
+			wifiSpiErrors++;
+			return WIFI_ERROR;
+		}
+		cnt+=2;
+	}
+	*count = cnt;
+	return WIFI_OK;
+}
+/**
+  * @brief  Sends a binary payload on the open socket with the S3 command.
+  * 		Unlike WIFI_SendStr nothing is copied through sprintf, so the
+  * 		payload may contain any byte value.
+  * @param  hwifi: Wifi handle, which decides which Wifi instance is used.
+  * @param  data: Payload
+  * @param  len: Payload length, at most WIFI_MAX_SEND_SIZE
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef WIFI_SendRaw(WIFI_HandleTypeDef* hwifi, const uint8_t* data, uint16_t len)
+{
+	if(len > WIFI_MAX_SEND_SIZE) return WIFI_ERROR;
+	int msgLength = sprintf(wifiTxBuffer,"S3=%04d\r",len);
+	memcpy(wifiTxBuffer+msgLength, data, len);
+	msgLength += len;
+	// 16 bit SPI frames: pad odd lengths with the filler char
+	if(msgLength % 2) wifiTxBuffer[msgLength++] = WIFI_TX_PADDING;
+	WIFI_SendATData(hwifi, wifiTxBuffer, msgLength, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	if(strstr(wifiRxBuffer, "ERROR") != NULL || strstr(wifiRxBuffer, "-1") != NULL)
+	{
+		wifiSendErrors++;
+		return WIFI_ERROR;
+	}
+	return WIFI_OK;
+}
+/**
+  * @brief  Reads pending bytes from the open socket with the R0 command.
+  * @param  hwifi: Wifi handle, which decides which Wifi instance is used.
+  * @param  data: Buffer, where the payload will be saved in.
+  * @param  size: Buffer size, at most WIFI_MAX_RECV_SIZE
+  * @param  len: Number of payload bytes received, 0 if nothing arrived
+  * @param  timeout: Module side read timeout in ms
+  * @retval WIFI_StatusTypeDef
+  */
+WIFI_StatusTypeDef WIFI_ReceiveRaw(WIFI_HandleTypeDef* hwifi, uint8_t* data, uint16_t size, uint16_t* len, uint32_t timeout)
+{
+	int msgLength = 0;
+	uint16_t cnt = 0;
+	*len = 0;
+	if(size > WIFI_MAX_RECV_SIZE) size = WIFI_MAX_RECV_SIZE;
+	msgLength = sprintf(wifiTxBuffer,"R1=%d\r",size);
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	msgLength = sprintf(wifiTxBuffer,"R2=%lu\r",timeout);
+	WIFI_SendATCommand(hwifi, wifiTxBuffer, msgLength+1, wifiRxBuffer, WIFI_RX_BUFFER_SIZE);
+	msgLength = sprintf(wifiTxBuffer,"R0\r");
+
+	TRACE(TRACE_WIFI_START,0,('R'<<8) | '0');
+	while(!WIFI_IS_CMDDATA_READY());
+	WIFI_ENABLE_NSS();
+	if(WIFI_SPI_Transmit(hwifi, wifiTxBuffer, msgLength+1) != WIFI_OK) Error_Handler();
+	WIFI_DISABLE_NSS();
+	while(!WIFI_IS_CMDDATA_READY());
+	WIFI_ENABLE_NSS();
+	WIFI_StatusTypeDef status = WIFI_SPI_ReceiveRaw(hwifi, (uint8_t*)wifiRxBuffer, WIFI_RX_BUFFER_SIZE, &cnt);
+	WIFI_DISABLE_NSS();
+	TRACE(TRACE_WIFI_END,0,('R'<<8) | '0');
+	if(status != WIFI_OK) return status;
+
+	// Layout: "\r\n" payload "\r\nOK\r\n> " followed by 0x15 padding
+	while(cnt > 0 && wifiRxBuffer[cnt-1] == WIFI_RX_PADDING) cnt--;
+	uint16_t tail = sizeof(WIFI_MSG_DATA_END) - 1;
+	if(cnt < tail + 2 || memcmp(&wifiRxBuffer[cnt-tail], WIFI_MSG_DATA_END, tail) != 0) return WIFI_ERROR;
+	uint16_t n = cnt - tail - 2;
+	if(n > size) n = size;
+	memcpy(data, &wifiRxBuffer[2], n);
+	*len = n;
+	return WIFI_OK;
+}
 /**
   * @brief  Trims a given character from beginning and end of a c string.
   * @param  str: C string
@@ -344,8 +515,8 @@ void trimstr(char* str, uint32_t strSize, char c){
 			trimPos = i + 1;
 		}else break;
 	}
-	// Trim leading c
-	char message[strSize];
-	snprintf( message, endPos + 1 - trimPos, &str[trimPos] );
-	strcpy(str,message);
+	// Trim leading c, in place
+	uint32_t len = endPos > trimPos ? endPos - trimPos : 0;
+	memmove(str, &str[trimPos], len);
+	str[len] = '\0';
 }
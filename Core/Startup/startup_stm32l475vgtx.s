@@ -90,6 +90,35 @@ LoopFillZerobss:
 	cmp	r2, r3
 	bcc	FillZerobss
 
+/* Same for SRAM2: code and data copied from flash, then its bss zeroed
+   (which also sets the SRAM2 parity before the first read) */
+  movs	r1, #0
+  b	LoopCopyRam2Init
+
+CopyRam2Init:
+	ldr	r3, =_siram2
+	ldr	r3, [r3, r1]
+	str	r3, [r0, r1]
+	adds	r1, r1, #4
+
+LoopCopyRam2Init:
+	ldr	r0, =_sram2
+	ldr	r3, =_eram2
+	adds	r2, r0, r1
+	cmp	r2, r3
+	bcc	CopyRam2Init
+	ldr	r2, =_sram2_bss
+	b	LoopFillZeroRam2
+
+FillZeroRam2:
+	movs	r3, #0
+	str	r3, [r2], #4
+
+LoopFillZeroRam2:
+	ldr	r3, =_eram2_bss
+	cmp	r2, r3
+	bcc	FillZeroRam2
+
 /* Call the clock system intitialization function.*/
     bl  SystemInit
 /* Call static constructors */
@@ -0,0 +1,248 @@
+/*
+ * bench.c
+ *
+ *  Host benchmark for the firmware code that doesn't need the board: the
+ *  table builder, the period arithmetic, argmax and reference kernels for
+ *  the network's layers next to the feature classifier (classifier.h, the
+ *  linear one; -DCLASSIFIER=1 for the trees), trimstr, WIFI_SendStr on the
+ *  ISM43362 emulator,
+ *  and the float formatting of the tasks. Per case it reports ns/op (best
+ *  of 5 batches, the indirect call included), heap allocations per op made
+ *  by the firmware sources, and the stack one op needs (painted thread
+ *  stack, thread start-up subtracted).
+ *
+ *  -o writes the results as CSV, -c compares against such a file and exits
+ *  with 1 when a case got slower than the tolerance or allocates or uses
+ *  more stack than before; keep a baseline from the same machine.
+ *
+ *  build (from the repository root):
+ *    cc -O2 -std=gnu11 -DUSE_HAL_DRIVER -DSTM32L475xx \
+ *       -IDrivers/CMSIS/Include -IDrivers/CMSIS/Device/ST/STM32L4xx/Include \
+ *       -IDrivers/STM32L4xx_HAL_Driver/Inc -IDrivers/BSP/B-L475E-IOT01 \
+ *       -IDrivers/BSP/Components/lsm6dsl -ICore/Inc -IX-CUBE-AI/App \
+ *       -IMiddlewares/ST/AI/Inc -ITools/emu \
+ *       -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free \
+ *       -o host_bench Tools/bench/bench.c Tools/bench/bench_infer.c \
+ *       Tools/bench/bench_sched.c Tools/bench/bench_text.c \
+ *       Tools/emu/ism43362_emu.c Core/Src/wifi.c Core/Src/log.c \
+ *       Core/Src/pool.c -lpthread -lm
+ *
+ *  run:  ./host_bench [-t seconds per case] [-o out.csv] [-c baseline.csv]
+ *                     [-p tolerance %] [name filter]
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+#include "hal_config.h"
+
+#define BATCHES 5
+#define STACK_SIZE (256*1024)
+#define STACK_PAINT 0xA5
+#define MAX_RESULTS 64
+
+typedef struct{
+	char name[48];
+	double ns;
+	double allocs;
+	long stack;
+} Result;
+
+//what cyclic.c and inference.c reach that the emulator doesn't provide
+uint32_t SystemCoreClock = 80000000;
+TIM_HandleTypeDef TIM1_Handler;
+HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *htim) { (void)htim; return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Start_IT(TIM_HandleTypeDef *htim) { (void)htim; return HAL_OK; }
+HAL_StatusTypeDef HAL_TIM_Base_Stop_IT(TIM_HandleTypeDef *htim) { (void)htim; return HAL_OK; }
+void Trace_Dump(void *hwifi) { (void)hwifi; }
+void StackMon_TaskStart(void) { }
+void StackMon_TaskEnd(int code) { (void)code; }
+
+//heap use of everything linked in, libc's own calls aren't wrapped
+static volatile unsigned long allocCount = 0;
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t size);
+void __real_free(void *p);
+void *__wrap_malloc(size_t size) { allocCount++; return __real_malloc(size); }
+void *__wrap_calloc(size_t n, size_t size) { allocCount++; return __real_calloc(n, size); }
+void *__wrap_realloc(void *p, size_t size) { allocCount++; return __real_realloc(p, size); }
+void __wrap_free(void *p) { __real_free(p); }
+
+static unsigned rng = 1;
+void benchSeed(unsigned seed)
+{
+	rng = seed*2654435761u + 1;
+}
+unsigned benchRand(void)
+{
+	rng = rng*1664525u + 1013904223u;
+	return rng >> 8;
+}
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+static double timeBatch(void (*op)(void), long n)
+{
+	double t0 = now();
+	for(long i=0;i<n;i++) op();
+	return now() - t0;
+}
+static int compareDouble(const void *a, const void *b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+static void *stackRun(void *op)
+{
+	((void (*)(void))op)();
+	return NULL;
+}
+static void nop(void)
+{
+}
+//bytes of a painted thread stack touched while running op once
+static long stackUse(void (*op)(void))
+{
+	uint8_t *stack = mmap(NULL, STACK_SIZE, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(stack == MAP_FAILED) return -1;
+	memset(stack, STACK_PAINT, STACK_SIZE);
+	pthread_attr_t attr;
+	pthread_t thread;
+	pthread_attr_init(&attr);
+	pthread_attr_setstack(&attr, stack, STACK_SIZE);
+	long used = -1;
+	if(pthread_create(&thread, &attr, stackRun, (void*)op) == 0)
+	{
+		pthread_join(thread, NULL);
+		//grows down: the lowest byte that isn't paint any more
+		long i = 0;
+		while(i < STACK_SIZE && stack[i] == STACK_PAINT) i++;
+		used = STACK_SIZE - i;
+	}
+	pthread_attr_destroy(&attr);
+	munmap(stack, STACK_SIZE);
+	return used;
+}
+static void run(const Bench_Case *c, double seconds, long stackBase, Result *r)
+{
+	if(c->setup) c->setup(c->arg);
+	c->op();
+	//batch size: at least 10ms per batch
+	long n = 1;
+	double t;
+	while((t = timeBatch(c->op, n)) < 0.01 && n < (1L<<40)) n *= 2;
+	long per = (long)(n*(seconds/BATCHES)/t);
+	if(per < 1) per = 1;
+	double ns[BATCHES];
+	unsigned long allocs = allocCount;
+	for(int b=0;b<BATCHES;b++) ns[b] = timeBatch(c->op, per)*1e9/per;
+	allocs = allocCount - allocs;
+	qsort(ns, BATCHES, sizeof(double), compareDouble);
+	snprintf(r->name, sizeof(r->name), "%s", c->name);
+	//the fastest batch is the one least disturbed by the rest of the machine
+	r->ns = ns[0];
+	r->allocs = (double)allocs/(per*BATCHES);
+	r->stack = stackUse(c->op) - stackBase;
+}
+static int readCsv(const char *path, Result *results)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+	{
+		perror(path);
+		exit(2);
+	}
+	char line[160];
+	int n = 0;
+	while(fgets(line, sizeof(line), f) && n < MAX_RESULTS)
+	{
+		Result *r = &results[n];
+		if(sscanf(line, "%47[^,],%lf,%lf,%ld", r->name, &r->ns, &r->allocs, &r->stack) == 4) n++;
+	}
+	fclose(f);
+	return n;
+}
+int main(int argc, char **argv)
+{
+	double seconds = 1.0;
+	double tolerance = 10;
+	const char *out = NULL, *baseline = NULL, *filter = NULL;
+	int opt;
+	while((opt = getopt(argc, argv, "t:o:c:p:")) != -1)
+	{
+		switch(opt)
+		{
+		case 't': seconds = atof(optarg); break;
+		case 'o': out = optarg; break;
+		case 'c': baseline = optarg; break;
+		case 'p': tolerance = atof(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-t seconds] [-o out.csv] [-c baseline.csv] [-p tolerance %%] [filter]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(optind < argc) filter = argv[optind];
+
+	const Bench_Case *lists[] = {schedBench, inferBench, textBench};
+	static Result results[MAX_RESULTS];
+	int n = 0;
+	long stackBase = stackUse(nop);
+	printf("%-24s %12s %10s %10s\n", "case", "ns/op", "allocs/op", "stack B");
+	for(unsigned l=0;l<sizeof(lists)/sizeof(lists[0]);l++)
+	{
+		for(const Bench_Case *c=lists[l];c->name!=NULL && n<MAX_RESULTS;c++)
+		{
+			if(filter != NULL && strstr(c->name, filter) == NULL) continue;
+			Result *r = &results[n++];
+			run(c, seconds, stackBase, r);
+			printf("%-24s %12.1f %10.2f %10ld\n", r->name, r->ns, r->allocs, r->stack);
+			fflush(stdout);
+		}
+	}
+	if(out != NULL)
+	{
+		FILE *f = fopen(out, "w");
+		if(f == NULL)
+		{
+			perror(out);
+			return 2;
+		}
+		fprintf(f, "name,ns_per_op,allocs_per_op,stack_bytes\n");
+		for(int i=0;i<n;i++) fprintf(f, "%s,%.1f,%.4f,%ld\n", results[i].name, results[i].ns, results[i].allocs, results[i].stack);
+		fclose(f);
+	}
+	if(baseline == NULL) return 0;
+
+	static Result base[MAX_RESULTS];
+	int nb = readCsv(baseline, base);
+	int regressions = 0;
+	printf("\nagainst %s, %.0f%% tolerance:\n", baseline, tolerance);
+	for(int i=0;i<n;i++)
+	{
+		Result *r = &results[i], *b = NULL;
+		for(int j=0;j<nb && b==NULL;j++) if(strcmp(base[j].name, r->name) == 0) b = &base[j];
+		if(b == NULL)
+		{
+			printf("%-24s new\n", r->name);
+			continue;
+		}
+		int slower = r->ns > b->ns*(1+tolerance/100);
+		int heap = r->allocs > b->allocs;
+		int stack = r->stack > b->stack;
+		printf("%-24s %+7.1f%% time %s%s%s\n", r->name, (r->ns/b->ns-1)*100,
+				slower ? " SLOWER" : "", heap ? " MORE ALLOCS" : "", stack ? " MORE STACK" : "");
+		regressions += slower || heap || stack;
+	}
+	printf("%d regression(s)\n", regressions);
+	return regressions > 0;
+}
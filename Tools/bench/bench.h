@@ -0,0 +1,26 @@
+/*
+ * bench.h
+ *
+ *  Cases for the host benchmark (Tools/bench/bench.c). setup runs untimed
+ *  before the case with arg, op is what gets measured. Each file ends its
+ *  list with a case whose name is NULL.
+ */
+
+#ifndef TOOLS_BENCH_BENCH_H_
+#define TOOLS_BENCH_BENCH_H_
+
+typedef struct{
+	const char *name;
+	void (*setup)(int arg);
+	void (*op)(void);
+	int arg;
+} Bench_Case;
+
+//seeded per case so every run measures the same inputs
+void benchSeed(unsigned seed);
+unsigned benchRand(void);
+
+extern const Bench_Case schedBench[];
+extern const Bench_Case textBench[];
+extern const Bench_Case inferBench[];
+#endif /* TOOLS_BENCH_BENCH_H_ */
@@ -0,0 +1,263 @@
+/*
+ * bench_infer.c
+ *
+ *  Inference cases: argmax from inference.c, and plain C reference kernels
+ *  for the layers of the network (X-CUBE-AI/App/network_generate_report.txt):
+ *  conv1d 26x3 -> 24x16, conv1d -> 22x8, dense 176 -> 64, dense 64 -> 3, with
+ *  relu/softmax. The runtime's own kernels only exist as a Cortex-M4 library,
+ *  these are the scalar baseline the same shapes cost on the host; weights
+ *  are random, the cost doesn't depend on them. feature/ and classifier/
+ *  are the feature path that replaces all of ref/forward, per sample and
+ *  per window. sparse/dense_0 is ref/dense_0 on the block-sparse kernel
+ *  (sparse_dense.h) with 50, 75 and 90% of the blocks dropped.
+ */
+
+#include <math.h>
+#include "../../Core/Src/inference.c"
+#include "../../Core/Src/feature_ext.c"
+#include "../../Core/Src/classifier.c"
+#include "../../Core/Src/sparse_dense.c"
+#include "bench.h"
+
+#define IN_LEN 26
+#define IN_CH 3
+#define K 3
+#define C0 16
+#define L0 (IN_LEN-K+1)
+#define C1 8
+#define L1 (L0-K+1)
+#define D0 64
+#define D1 3
+
+static float in[IN_LEN*IN_CH];
+static float w0[C0*K*IN_CH], b0[C0], a0[L0*C0];
+static float w1[C1*K*C0], b1[C1], a1[L1*C1];
+static float w2[D0*L1*C1], b2[D0], a2[D0];
+static float w3[D1*D0], b3[D1], a3[D1];
+static float scores[64];
+static uint16_t sparseRows[D0/SPARSE_BLOCK+1];
+static uint8_t sparseCols[D0/SPARSE_BLOCK*L1*C1];
+static float sparseValues[D0*L1*C1];
+static Sparse_TableTypeDef sparseTable = {D0, L1*C1, 0, 0, sparseRows, sparseCols, sparseValues};
+static int16_t samples[FEATURES_WINDOW][3];
+static float featureVec[FEATURES];
+static volatile uint32_t sink;
+
+//the AI runtime isn't linked, Inference_Init/Submit are never called here
+ai_error ai_network_create(ai_handle* net, const ai_buffer* config)
+{
+	(void)net; (void)config;
+	return (ai_error){AI_ERROR_NONE, AI_ERROR_CODE_NONE};
+}
+ai_buffer* ai_network_inputs_get(ai_handle net, ai_u16 *n_buffer)
+{
+	(void)net; (void)n_buffer;
+	return NULL;
+}
+ai_buffer* ai_network_outputs_get(ai_handle net, ai_u16 *n_buffer)
+{
+	(void)net; (void)n_buffer;
+	return NULL;
+}
+ai_context* ai_platform_context_acquire(const ai_handle handle)
+{
+	(void)handle;
+	return NULL;
+}
+ai_bool ai_network_init(ai_handle net, const ai_network_params* params)
+{
+	(void)net; (void)params;
+	return true;
+}
+ai_error ai_network_get_error(ai_handle net)
+{
+	(void)net;
+	return (ai_error){AI_ERROR_NONE, AI_ERROR_CODE_NONE};
+}
+ai_bool ai_network_data_params_get(ai_network_params* params)
+{
+	(void)params;
+	return false;
+}
+ai_bool ai_buffer_array_item_set_address(ai_buffer_array* barray, const ai_u32 pos, ai_handle address)
+{
+	(void)barray; (void)pos; (void)address;
+	return false;
+}
+const ai_u64 s_network_weights_array_u64[6038];
+const void *Weights_Active(void)
+{
+	return s_network_weights_array_u64;
+}
+
+//channels last, weights [out channel][tap][in channel], valid padding
+static void conv1d(const float *x, int len, int cin, const float *w, const float *b, int cout, float *y)
+{
+	for(int t=0;t<len-K+1;t++)
+	{
+		for(int o=0;o<cout;o++)
+		{
+			const float *wo = w + o*K*cin;
+			float acc = b[o];
+			for(int k=0;k<K;k++)
+				for(int c=0;c<cin;c++)
+					acc += x[(t+k)*cin+c]*wo[k*cin+c];
+			y[t*cout+o] = acc;
+		}
+	}
+}
+//weights [out][in]
+static void dense(const float *x, int nin, const float *w, const float *b, int nout, float *y)
+{
+	for(int o=0;o<nout;o++)
+	{
+		const float *wo = w + o*nin;
+		float acc = b[o];
+		for(int i=0;i<nin;i++) acc += x[i]*wo[i];
+		y[o] = acc;
+	}
+}
+static void relu(float *x, int n)
+{
+	for(int i=0;i<n;i++) if(x[i] < 0) x[i] = 0;
+}
+static void softmax(float *x, int n)
+{
+	float max = x[0], sum = 0;
+	for(int i=1;i<n;i++) if(x[i] > max) max = x[i];
+	for(int i=0;i<n;i++) sum += x[i] = expf(x[i]-max);
+	for(int i=0;i<n;i++) x[i] /= sum;
+}
+static void fill(float *x, int n, float scale)
+{
+	for(int i=0;i<n;i++) x[i] = ((int)(benchRand() % 2001) - 1000)*scale/1000.0f;
+}
+static void modelSet(int arg)
+{
+	(void)arg;
+	benchSeed(11);
+	fill(in, sizeof(in)/sizeof(float), 1000.0f);
+	fill(w0, sizeof(w0)/sizeof(float), 0.01f);
+	fill(b0, C0, 0.1f);
+	fill(w1, sizeof(w1)/sizeof(float), 0.1f);
+	fill(b1, C1, 0.1f);
+	fill(w2, sizeof(w2)/sizeof(float), 0.05f);
+	fill(b2, D0, 0.1f);
+	fill(w3, sizeof(w3)/sizeof(float), 0.1f);
+	fill(b3, D1, 0.1f);
+	fill(scores, 64, 1.0f);
+}
+//a walk: gravity on z, 2Hz steps on all axes, sensor noise
+static void walkSet(int arg)
+{
+	(void)arg;
+	benchSeed(13);
+	Features_Init();
+	for(int i=0;i<FEATURES_WINDOW;i++)
+	{
+		float step = sinf(2*(float)M_PI*2.0f*i/104.0f);
+		for(int a=0;a<3;a++) samples[i][a] = (a == 2 ? 1000 : 0) + 300*step + (int)(benchRand() % 41) - 20;
+		Features_Add(samples[i]);
+	}
+	Features_Get(featureVec, 104.0f);
+}
+static void featureAddOp(void)
+{
+	static int i = 0;
+	Features_Add(samples[i]);
+	i = (i+1) % FEATURES_WINDOW;
+}
+static void featureGetOp(void)
+{
+	Features_Get(featureVec, 104.0f);
+}
+static void classifierOp(void)
+{
+	sink = Classifier_Run(featureVec, scores);
+}
+static void featureWindowOp(void)
+{
+	//one CNN window's worth of samples, then a classification
+	for(int i=0;i<IN_LEN;i++) featureAddOp();
+	featureGetOp();
+	classifierOp();
+}
+static void conv0Op(void)
+{
+	conv1d(in, IN_LEN, IN_CH, w0, b0, C0, a0);
+	relu(a0, L0*C0);
+}
+static void conv1Op(void)
+{
+	conv1d(a0, L0, C0, w1, b1, C1, a1);
+	relu(a1, L1*C1);
+}
+static void dense0Op(void)
+{
+	//flatten is a no-op on the channels last layout
+	dense(a1, L1*C1, w2, b2, D0, a2);
+	relu(a2, D0);
+}
+//arg percent of the blocks dropped at random, which ones doesn't change the cost
+static void sparseSet(int arg)
+{
+	modelSet(0);
+	conv0Op();
+	conv1Op();
+	sparseTable.blocks = 0;
+	for(int g=0;g<D0/SPARSE_BLOCK;g++)
+	{
+		sparseRows[g] = sparseTable.blocks;
+		for(int i=0;i<L1*C1;i++)
+		{
+			if((int)(benchRand() % 100) < arg) continue;
+			for(int r=0;r<SPARSE_BLOCK;r++) sparseValues[sparseTable.blocks*SPARSE_BLOCK+r] = w2[(g*SPARSE_BLOCK+r)*L1*C1+i];
+			sparseCols[sparseTable.blocks++] = i;
+		}
+	}
+	sparseRows[D0/SPARSE_BLOCK] = sparseTable.blocks;
+}
+static void sparseDense0Op(void)
+{
+	Sparse_Dense(&sparseTable, a1, b2, a2);
+	relu(a2, D0);
+}
+static void dense1Op(void)
+{
+	dense(a2, D0, w3, b3, D1, a3);
+	softmax(a3, D1);
+}
+static void forwardOp(void)
+{
+	conv0Op();
+	conv1Op();
+	dense0Op();
+	dense1Op();
+	sink = argmax(a3, D1);
+}
+static void argmax3Op(void)
+{
+	sink = argmax(a3, D1);
+}
+static void argmax64Op(void)
+{
+	sink = argmax(scores, 64);
+}
+
+const Bench_Case inferBench[] = {
+	{"argmax/3", modelSet, argmax3Op, 0},
+	{"argmax/64", modelSet, argmax64Op, 0},
+	{"ref/conv1d_0", modelSet, conv0Op, 0},
+	{"ref/conv1d_1", modelSet, conv1Op, 0},
+	{"ref/dense_0", modelSet, dense0Op, 0},
+	{"ref/dense_1", modelSet, dense1Op, 0},
+	{"ref/forward", modelSet, forwardOp, 0},
+	{"sparse/dense_0/50", sparseSet, sparseDense0Op, 50},
+	{"sparse/dense_0/75", sparseSet, sparseDense0Op, 75},
+	{"sparse/dense_0/90", sparseSet, sparseDense0Op, 90},
+	{"feature/add", walkSet, featureAddOp, 0},
+	{"feature/get", walkSet, featureGetOp, 0},
+	{"classifier/run", walkSet, classifierOp, 0},
+	{"classifier/window", walkSet, featureWindowOp, 0},
+	{NULL, NULL, NULL, 0}
+};
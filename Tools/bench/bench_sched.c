@@ -0,0 +1,88 @@
+/*
+ * bench_sched.c
+ *
+ *  Scheduler cases: table construction over random task sets and the
+ *  period arithmetic. cyclic.c is included whole, the builder works on
+ *  its static shadow table.
+ */
+
+#include "../../Core/Src/cyclic.c"
+#include "bench.h"
+
+//periods the node's tasks actually use or could, in ms
+static const int periods[] = {10, 20, 25, 40, 50, 80, 100, 125, 200, 250, 500, 1000, 3000};
+static int pairs[64][2];
+static volatile int sink;
+
+static void nop(void)
+{
+}
+static void taskSet(int n)
+{
+	char *names[TASKS_MAX] = {"t0","t1","t2","t3","t4","t5","t6","t7","t8","t9","t10","t11","t12","t13","t14","t15"};
+	benchSeed(n);
+	while(n_tasks > 0) unregisterTask(taskCodes[0]);
+	for(int i=0;i<n && i<TASKS_MAX;i++)
+	{
+		int period = periods[benchRand() % (sizeof(periods)/sizeof(periods[0]))];
+		registerTask(nop,names[i],0,0,i,period);
+		setPeriodTolerance(i,benchRand() % 25);
+		//keep the set well below full load, the builder should find a table
+		int wcet = period/(4*n);
+		taskStats.executionSum[i] = 1 + (wcet > 1 ? benchRand() % wcet : 0);
+		taskStats.executionNum[i] = 1;
+	}
+}
+static void build(void)
+{
+	buildFastMatrix(&shadow,fast_runs[1]);
+	//the builder logs its harmonization, drain like the idle task does
+	Log_Drain(1000);
+}
+//a period request on top of a harmonized set: one task moves, the rest keep theirs
+static void reencodeSet(int n)
+{
+	taskSet(n);
+	buildFastMatrix(&shadow,fast_runs[1]);
+	Log_Drain(1000);
+	tasks[taskCodes[0]].period = tasks[taskCodes[0]].nominal*2;
+}
+static void reencode(void)
+{
+	sink = reencodeFastMatrix(&shadow,fast_runs[1]);
+	Log_Drain(1000);
+}
+static void pairSet(int arg)
+{
+	(void)arg;
+	benchSeed(7);
+	for(int i=0;i<64;i++)
+	{
+		pairs[i][0] = periods[benchRand() % (sizeof(periods)/sizeof(periods[0]))];
+		pairs[i][1] = periods[benchRand() % (sizeof(periods)/sizeof(periods[0]))];
+	}
+}
+static void gcdOp(void)
+{
+	static int i = 0;
+	sink = gcd(pairs[i][0],pairs[i][1]);
+	i = (i+1) & 63;
+}
+static void lcmOp(void)
+{
+	static int i = 0;
+	sink = lcm(pairs[i][0],pairs[i][1]);
+	i = (i+1) & 63;
+}
+
+const Bench_Case schedBench[] = {
+	{"buildFastMatrix/2", taskSet, build, 2},
+	{"buildFastMatrix/4", taskSet, build, 4},
+	{"buildFastMatrix/8", taskSet, build, 8},
+	{"buildFastMatrix/12", taskSet, build, 12},
+	{"buildFastMatrix/16", taskSet, build, 16},
+	{"reencodeFastMatrix/16", reencodeSet, reencode, 16},
+	{"gcd", pairSet, gcdOp, 0},
+	{"lcm", pairSet, lcmOp, 0},
+	{NULL, NULL, NULL, 0}
+};
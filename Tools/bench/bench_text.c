@@ -0,0 +1,88 @@
+/*
+ * bench_text.c
+ *
+ *  String and protocol cases: trimstr on module responses, WIFI_SendStr
+ *  against the ISM43362 emulator (no latency, so what's left is the frame
+ *  building and the SPI loop), and the float formatting the tasks do for
+ *  the uart and the uplink.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "bench.h"
+#include "log.h"
+#include "wifi.h"
+#include "ism43362_emu.h"
+
+extern SPI_HandleTypeDef hspi3;
+static WIFI_HandleTypeDef hwifi;
+static char response[WIFI_RX_BUFFER_SIZE];
+static char buffer[WIFI_RX_BUFFER_SIZE];
+static float values[64];
+static char message[128];
+
+static void responseSet(int len)
+{
+	//a module answer: payload, OK, prompt, then the 0x15 padding trimstr takes off
+	memset(response, 0, sizeof(response));
+	int n = snprintf(response, sizeof(response), "\r\n%.*s\r\nOK\r\n> ", len, "0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz0123456789abcdefghijklmnopqrstuvwxyz");
+	memset(response+n, WIFI_RX_PADDING, 32);
+}
+static void trimOp(void)
+{
+	memcpy(buffer, response, sizeof(buffer));
+	trimstr(buffer, sizeof(buffer), (char)WIFI_RX_PADDING);
+}
+static void emuSet(int arg)
+{
+	(void)arg;
+	EMU_ConfigTypeDef cfg = {0};
+	cfg.spiKHz = 5000;
+	cfg.seed = 1;
+	EMU_Init(&cfg);
+	hwifi.handle = &hspi3;
+	//no socket behind it, the module answers the sends with ERROR
+	WIFI_Init(&hwifi);
+}
+static void sendStrOp(void)
+{
+	//taskSendMessage's payload
+	WIFI_SendStr(&hwifi, "T0024.3125H0055.1250");
+}
+static void valueSet(int arg)
+{
+	(void)arg;
+	benchSeed(3);
+	for(int i=0;i<64;i++) values[i] = (benchRand() % 1000000)/10000.0f - 20.0f;
+}
+static void uplinkOp(void)
+{
+	static int i = 0;
+	//taskSendMessage
+	sprintf(message, "%010.4f", values[i]);
+	i = (i+1) & 63;
+}
+static void uartOp(void)
+{
+	static int i = 0;
+	//taskTemp and taskHumi
+	sprintf(message, "Major Cycle %d |Minor Cycle %d| Temperature : %8.4f(Celsius)\r\n", i, i, values[i]);
+	i = (i+1) & 63;
+}
+static void logOp(void)
+{
+	static int i = 0;
+	Log_Printf("Major Cycle %d |Minor Cycle %d| Humidity : %8.4f(rH%%)\r\n", i, i, values[i]);
+	if(Log_Free() < LOG_LINE_SIZE) Log_Drain(1000);
+	i = (i+1) & 63;
+}
+
+const Bench_Case textBench[] = {
+	{"trimstr/16", responseSet, trimOp, 16},
+	{"trimstr/128", responseSet, trimOp, 128},
+	{"WIFI_SendStr", emuSet, sendStrOp, 0},
+	{"sprintf/%010.4f", valueSet, uplinkOp, 0},
+	{"sprintf/message", valueSet, uartOp, 0},
+	{"Log_Printf", valueSet, logOp, 0},
+	{NULL, NULL, NULL, 0}
+};
@@ -0,0 +1,303 @@
+/*
+ * classifier_eval.c
+ *
+ *  Per-class accuracy of the feature model in Core/Src/classifier.c and of the
+ *  CNN on a labelled accelerometer trace. The trace is gate_replay's: one
+ *  sample per line, "x y z" in mg followed by the true class as a number or a
+ *  name from activities[] in main.c, # starts a comment. The samples go
+ *  through Features_Add as in taskAcc; every stride samples a window is
+ *  classified by Classifier_Run on the features of the last FEATURES_WINDOW
+ *  samples and by the host golden model of the network (as in prune_dense.c,
+ *  built-in weights or a raw weights file) on the last 26. A window counts
+ *  when all FEATURES_WINDOW samples under it carry the same class, windows
+ *  across a change of activity are only counted as mixed. Without a trace
+ *  it runs on synthetic segments: stationary with a random tilt, walking
+ *  (1.6-2.2 Hz, 0.8-1.3 g) and running (2.5-3.2 Hz, 2-3 g) in the board's x-y
+ *  plane; -g seed writes them out as a trace instead, the input for
+ *  Tools/classifier_fit.c (fit on some seeds, evaluate on others).
+ *
+ *  The feature model is the one CLASSIFIER selects, build once per model:
+ *  build: cc -O2 -DUSE_HAL_DRIVER -DSTM32L475xx -DCLASSIFIER=CLASSIFIER_TREES \
+ *            -IDrivers/CMSIS/Include -IDrivers/CMSIS/Device/ST/STM32L4xx/Include \
+ *            -IDrivers/STM32L4xx_HAL_Driver/Inc -ICore/Inc \
+ *            -IMiddlewares/ST/AI/Inc -IX-CUBE-AI/App -o classifier_eval \
+ *            Tools/classifier_eval.c Core/Src/classifier.c Core/Src/feature_ext.c \
+ *            X-CUBE-AI/App/network_data_params.c -lm
+ *         (-DCLASSIFIER=CLASSIFIER_LINEAR for the linear model)
+ *  run:   ./classifier_eval [-s stride] [-r rate Hz] [-w weights.bin] [trace.txt]
+ *         ./classifier_eval -g seed > trace.txt
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "classifier.h"
+#include "network_data.h"
+
+//byte offsets in the weights, from network_configure_weights in network.c
+#define OFF_CONV0_W 12
+#define OFF_CONV0_B 588
+#define OFF_CONV1_W 652
+#define OFF_CONV1_B 2188
+#define OFF_DENSE0_W 2220
+#define OFF_DENSE0_B 47276
+#define OFF_DENSE1_W 47532
+#define OFF_DENSE1_B 0
+#define IN_LEN 26 //AI_NETWORK_IN_1_SIZE/3
+#define IN_CH 3
+#define K 3
+#define C0 16
+#define L0 (IN_LEN-K+1)
+#define C1 8
+#define L1 (L0-K+1)
+#define D_IN (L1*C1)
+#define D0 64
+#define CLASSES CLASSIFIER_CLASSES
+#define MIXED CLASSES
+
+//classifier.c only reads it in Classifier_Window, which runs on the target
+uint32_t SystemCoreClock = 80000000;
+
+static const char *classNames[CLASSES] = {"stationary", "walking", "running"};
+static uint8_t blob[AI_NETWORK_DATA_WEIGHTS_SIZE] __attribute__((aligned(4)));
+static const float *w0, *b0, *w1, *b1, *w2, *b2, *w3, *b3;
+//the last FEATURES_WINDOW samples and their classes
+static int16_t recent[FEATURES_WINDOW][3];
+static int recentLabel[FEATURES_WINDOW];
+static int recentHead = 0;
+//[model][true class, MIXED for a window across a change][predicted]
+static uint32_t confusion[2][CLASSES+1][CLASSES];
+
+static int parseLabel(const char *s)
+{
+	for(int c=0;c<CLASSES;c++) if(strcmp(s, classNames[c]) == 0) return c;
+	char *end;
+	long c = strtol(s, &end, 10);
+	return end != s && c >= 0 && c < CLASSES ? (int)c : -1;
+}
+//the golden model of prune_dense.c: channels last, weights [out][tap][in], relu fused
+static void conv1d(const float *x, int len, int cin, const float *w, const float *b, int cout, float *y)
+{
+	for(int t=0;t<len-K+1;t++)
+	{
+		for(int o=0;o<cout;o++)
+		{
+			const float *wo = w + o*K*cin;
+			float acc = b[o];
+			for(int k=0;k<K;k++)
+				for(int c=0;c<cin;c++)
+					acc += x[(t+k)*cin+c]*wo[k*cin+c];
+			y[t*cout+o] = acc > 0 ? acc : 0;
+		}
+	}
+}
+static void dense(const float *x, int nin, const float *w, const float *b, int nout, float *y)
+{
+	for(int o=0;o<nout;o++)
+	{
+		const float *wo = w + o*nin;
+		float acc = b[o];
+		for(int i=0;i<nin;i++) acc += x[i]*wo[i];
+		y[o] = acc;
+	}
+}
+static int cnnClass(void)
+{
+	float in[IN_LEN*IN_CH], a0[L0*C0], a1[D_IN], y[D0], out[CLASSES];
+	//oldest first, scaled as the channel table in Core/Src/pipeline.c has it
+	for(int t=0;t<IN_LEN;t++)
+	{
+		const int16_t *s = recent[(recentHead + FEATURES_WINDOW - IN_LEN + t) % FEATURES_WINDOW];
+		for(int a=0;a<IN_CH;a++) in[t*IN_CH+a] = s[a]/4000.0f;
+	}
+	conv1d(in, IN_LEN, IN_CH, w0, b0, C0, a0);
+	conv1d(a0, L0, C0, w1, b1, C1, a1);
+	dense(a1, D_IN, w2, b2, D0, y);
+	for(int i=0;i<D0;i++) if(y[i] < 0) y[i] = 0;
+	dense(y, D0, w3, b3, CLASSES, out);
+	int best = 0;
+	for(int c=1;c<CLASSES;c++) if(out[c] > out[best]) best = c;
+	return best;
+}
+static void addSample(const int16_t xyz[3], int label)
+{
+	Features_Add(xyz);
+	memcpy(recent[recentHead], xyz, sizeof(recent[0]));
+	recentLabel[recentHead] = label;
+	recentHead = (recentHead+1) % FEATURES_WINDOW;
+}
+static void classify(float rate)
+{
+	float features[FEATURES], scores[CLASSES];
+	int label = recentLabel[(recentHead + FEATURES_WINDOW - 1) % FEATURES_WINDOW];
+	for(int i=0;i<FEATURES_WINDOW;i++) if(recentLabel[i] != label) label = MIXED;
+	Features_Get(features, rate);
+	confusion[0][label][Classifier_Run(features, scores)]++;
+	confusion[1][label][cnnClass()]++;
+}
+static int runTrace(FILE *f, int stride, float rate)
+{
+	char line[256], name[32];
+	int x, y, z, fill = 0;
+	uint32_t lineNo = 0;
+	while(fgets(line, sizeof(line), f))
+	{
+		lineNo++;
+		if(line[0] == '#') continue;
+		int n = sscanf(line, "%d %d %d %31s", &x, &y, &z, name);
+		if(n < 3) continue;
+		int label = n == 4 ? parseLabel(name) : -1;
+		if(label < 0)
+		{
+			fprintf(stderr, "line %u: needs a class after x y z\n", lineNo);
+			return -1;
+		}
+		int16_t xyz[3] = {x, y, z};
+		addSample(xyz, label);
+		if(++fill < stride) continue;
+		fill = 0;
+		if(Features_Ready()) classify(rate);
+	}
+	return 0;
+}
+static float uniform(float lo, float hi)
+{
+	return lo + (hi-lo)*rand()/(float)RAND_MAX;
+}
+static int noise(int mg)
+{
+	return rand()%(2*mg+1) - mg;
+}
+//20 s segments, each class six times, with a fresh step rate, swing, phase and tilt per
+//segment: gait as a fundamental and its second harmonic, in the x-y plane at a random
+//heading with gravity on z. Swings and axes are where the network puts the classes (its
+//running needs 2 g and more, walking is around 1 g, gait along z it mostly calls
+//stationary), so its accuracy here checks the generator before the feature models are
+//judged on it
+static void synthetic(int stride, float rate, unsigned seed, FILE *out)
+{
+	int fill = 0;
+	srand(seed);
+	for(int seg=0;seg<18;seg++)
+	{
+		int cls = seg%3;
+		float hz = cls == 1 ? uniform(1.6f, 2.2f) : uniform(2.5f, 3.2f);
+		float amp = cls == 1 ? uniform(800, 1300) : uniform(2000, 3000);
+		float phase = uniform(0, 6.2832f), tilt = uniform(-0.3f, 0.3f), heading = uniform(0, 1.5708f);
+		int jitter = cls == 0 ? 4 : cls == 1 ? 20 : 40;
+		for(int t=0;t<20*(int)rate;t++)
+		{
+			float w = phase + 6.2832f*hz*t/rate;
+			float step = cls ? amp*(sinf(w) + 0.3f*sinf(2*w + 1.0f)) : 0;
+			int16_t xyz[3] = {
+				(int16_t)(1000*sinf(tilt) + cosf(heading)*step + noise(jitter)),
+				(int16_t)(sinf(heading)*step + noise(jitter)),
+				(int16_t)(1000*cosf(tilt) + 0.1f*step + noise(jitter))};
+			if(out)
+			{
+				fprintf(out, "%d %d %d %s\n", xyz[0], xyz[1], xyz[2], classNames[cls]);
+				continue;
+			}
+			addSample(xyz, cls);
+			if(++fill < stride) continue;
+			fill = 0;
+			if(Features_Ready()) classify(rate);
+		}
+	}
+}
+static void report(const char *model, uint32_t m[CLASSES+1][CLASSES])
+{
+	uint32_t right = 0, total = 0, mixed = 0;
+	printf("%s\n  true \\ predicted  ", model);
+	for(int p=0;p<CLASSES;p++) printf("%11s", classNames[p]);
+	printf("   accuracy\n");
+	for(int c=0;c<CLASSES;c++)
+	{
+		uint32_t n = 0;
+		printf("  %-17s ", classNames[c]);
+		for(int p=0;p<CLASSES;p++)
+		{
+			printf("%11u", m[c][p]);
+			n += m[c][p];
+		}
+		right += m[c][c];
+		total += n;
+		if(n) printf("   %7.1f%%\n", 100.0*m[c][c]/n);
+		else printf("         -\n");
+	}
+	for(int p=0;p<CLASSES;p++) mixed += m[MIXED][p];
+	printf("  overall %.1f%% of %u windows, %u across a change not counted\n\n", total ? 100.0*right/total : 0, total, mixed);
+}
+int main(int argc, char **argv)
+{
+	int stride = IN_LEN, opt, generate = 0;
+	unsigned seed = 7;
+	float rate = 104;
+	const char *weightsFile = NULL;
+	while((opt = getopt(argc, argv, "s:r:w:g:")) != -1)
+	{
+		if(opt == 's') stride = atoi(optarg);
+		else if(opt == 'r') rate = atof(optarg);
+		else if(opt == 'w') weightsFile = optarg;
+		else if(opt == 'g')
+		{
+			generate = 1;
+			seed = strtoul(optarg, NULL, 0);
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-s stride] [-r rate Hz] [-w weights.bin] [-g seed] [trace.txt]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(stride < 1 || stride > IN_LEN || rate <= 0)
+	{
+		fprintf(stderr, "stride 1..%d, rate > 0\n", IN_LEN);
+		return 2;
+	}
+	if(weightsFile)
+	{
+		FILE *f = fopen(weightsFile, "rb");
+		if(f == NULL || fread(blob, 1, sizeof(blob), f) != sizeof(blob))
+		{
+			fprintf(stderr, "%s: need %u bytes of weights\n", weightsFile, (unsigned)sizeof(blob));
+			return 1;
+		}
+		fclose(f);
+	}
+	else memcpy(blob, s_network_weights_array_u64, sizeof(blob));
+	if(generate)
+	{
+		synthetic(stride, rate, seed, stdout);
+		return 0;
+	}
+	w0 = (const float*)(blob + OFF_CONV0_W);
+	b0 = (const float*)(blob + OFF_CONV0_B);
+	w1 = (const float*)(blob + OFF_CONV1_W);
+	b1 = (const float*)(blob + OFF_CONV1_B);
+	w2 = (const float*)(blob + OFF_DENSE0_W);
+	b2 = (const float*)(blob + OFF_DENSE0_B);
+	w3 = (const float*)(blob + OFF_DENSE1_W);
+	b3 = (const float*)(blob + OFF_DENSE1_B);
+	Features_Init();
+	if(optind < argc)
+	{
+		FILE *f = fopen(argv[optind], "r");
+		if(f == NULL)
+		{
+			perror(argv[optind]);
+			return 1;
+		}
+		int status = runTrace(f, stride, rate);
+		fclose(f);
+		if(status) return 1;
+	}
+	else synthetic(stride, rate, seed, NULL);
+	printf("%s, stride %d at %.0f Hz\n\n", optind < argc ? argv[optind] : "synthetic segments", stride, rate);
+	report(CLASSIFIER == CLASSIFIER_TREES ? "feature model: trees" : "feature model: linear", confusion[0]);
+	report("CNN (host golden model)", confusion[1]);
+	return 0;
+}
@@ -0,0 +1,352 @@
+/*
+ * classifier_fit.c
+ *
+ *  Fits the tables of Core/Src/classifier.c to labelled windows and prints
+ *  them as C, to paste over the shipped ones. Input lines, in any mix:
+ *    F <11 features> <class>  CLASSIFIER_LOG_FEATURES output from the uart with
+ *                             the true class appended, e.g. per recording
+ *                             grep '^F ' walk.log | sed 's/\r*$/ walking/'
+ *    x y z <class>            a labelled accelerometer trace as classifier_eval
+ *                             and gate_replay read it (classifier_eval -g writes
+ *                             one); features through Core/Src/feature_ext.c every
+ *                             stride samples, windows across a change left out
+ *  The class is a number or a name from activities[] in main.c, # starts a
+ *  comment.
+ *
+ *  Linear: softmax regression on standardized features with a little L2, full
+ *  batch gradient descent; the standardization is folded into the weights and
+ *  the bias. Trees: -t trees of depth -d at most, gini splits at midpoints
+ *  between neighbouring values; the first tree sees every window and every
+ *  feature, the others a bootstrap resample and a random half of the features
+ *  per split. A leaf votes its purity. The training accuracy of both goes to
+ *  stderr; judge the tables with classifier_eval on a trace not fitted on.
+ *
+ *  build: cc -O2 -DUSE_HAL_DRIVER -DSTM32L475xx -IDrivers/CMSIS/Include \
+ *            -IDrivers/CMSIS/Device/ST/STM32L4xx/Include \
+ *            -IDrivers/STM32L4xx_HAL_Driver/Inc -ICore/Inc -o classifier_fit \
+ *            Tools/classifier_fit.c Core/Src/feature_ext.c -lm
+ *  run:   ./classifier_fit [-s stride] [-r rate Hz] [-t trees] [-d depth] file...
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "classifier.h"
+
+#define CLASSES CLASSIFIER_CLASSES
+#define MAX_WINDOWS 65536
+#define MAX_NODES 255 //uint8_t node indices
+#define MIN_LEAF 4 //windows
+#define STEPS 4000
+#define RATE 0.5f
+#define L2 0.001f
+
+static const char *classNames[CLASSES] = {"stationary", "walking", "running"};
+static const char *enumNames[CLASSES] = {"STATIONARY", "WALKING", "RUNNING"};
+static const char *featureNames[FEATURES] = {"FEAT_MEAN_X", "FEAT_MEAN_Y", "FEAT_MEAN_Z",
+	"FEAT_VAR_X", "FEAT_VAR_Y", "FEAT_VAR_Z", "FEAT_ZC_X", "FEAT_ZC_Y", "FEAT_ZC_Z",
+	"FEAT_ENERGY", "FEAT_PEAK_HZ"};
+static float x[MAX_WINDOWS][FEATURES];
+static int y[MAX_WINDOWS];
+static int n = 0;
+//the raw trace's window: the class of each of the last FEATURES_WINDOW samples
+static int recentLabel[FEATURES_WINDOW];
+static int recentHead = 0;
+static float w[CLASSES][FEATURES], b[CLASSES];
+static Classifier_Node nodes[MAX_NODES];
+static int nNodes = 0;
+static uint8_t roots[MAX_NODES];
+static int nRoots = 0;
+
+static int parseLabel(const char *s)
+{
+	for(int c=0;c<CLASSES;c++) if(strcmp(s, classNames[c]) == 0) return c;
+	char *end;
+	long c = strtol(s, &end, 10);
+	return end != s && c >= 0 && c < CLASSES ? (int)c : -1;
+}
+static int addWindow(const float *f, int label)
+{
+	if(n == MAX_WINDOWS)
+	{
+		fprintf(stderr, "more than %d windows\n", MAX_WINDOWS);
+		return -1;
+	}
+	memcpy(x[n], f, sizeof(x[0]));
+	y[n++] = label;
+	return 0;
+}
+static int readFile(FILE *f, const char *name, int stride, float rate)
+{
+	char line[512], label[32];
+	float f11[FEATURES];
+	int xs, ys, zs, fill = 0;
+	uint32_t lineNo = 0;
+	Features_Init();
+	while(fgets(line, sizeof(line), f))
+	{
+		lineNo++;
+		if(line[0] == '#') continue;
+		if(line[0] == 'F' && line[1] == ' ')
+		{
+			char *p = line+2, *end;
+			int k;
+			for(k=0;k<FEATURES;k++,p=end)
+			{
+				f11[k] = strtof(p, &end);
+				if(end == p) break;
+			}
+			if(k < FEATURES || sscanf(p, "%31s", label) != 1 || parseLabel(label) < 0)
+			{
+				fprintf(stderr, "%s:%u: needs %d features and a class\n", name, lineNo, FEATURES);
+				return -1;
+			}
+			if(addWindow(f11, parseLabel(label))) return -1;
+			continue;
+		}
+		int fields = sscanf(line, "%d %d %d %31s", &xs, &ys, &zs, label);
+		if(fields < 3) continue;
+		if(fields < 4 || parseLabel(label) < 0)
+		{
+			fprintf(stderr, "%s:%u: needs a class after x y z\n", name, lineNo);
+			return -1;
+		}
+		int16_t xyz[3] = {xs, ys, zs};
+		Features_Add(xyz);
+		recentLabel[recentHead] = parseLabel(label);
+		recentHead = (recentHead+1) % FEATURES_WINDOW;
+		if(++fill < stride || !Features_Ready()) continue;
+		fill = 0;
+		int mixed = 0;
+		for(int i=1;i<FEATURES_WINDOW;i++) mixed |= recentLabel[i] != recentLabel[0];
+		if(mixed) continue;
+		Features_Get(f11, rate);
+		if(addWindow(f11, recentLabel[0])) return -1;
+	}
+	return 0;
+}
+static int linearClass(const float *f)
+{
+	int best = 0;
+	float s[CLASSES];
+	for(int c=0;c<CLASSES;c++)
+	{
+		s[c] = b[c];
+		for(int k=0;k<FEATURES;k++) s[c] += w[c][k]*f[k];
+		if(s[c] > s[best]) best = c;
+	}
+	return best;
+}
+static void fitLinear(void)
+{
+	float mean[FEATURES] = {0}, sd[FEATURES] = {0};
+	float ws[CLASSES][FEATURES] = {{0}}, bs[CLASSES] = {0};
+	static float z[MAX_WINDOWS][FEATURES];
+	for(int i=0;i<n;i++) for(int k=0;k<FEATURES;k++) mean[k] += x[i][k]/n;
+	for(int i=0;i<n;i++) for(int k=0;k<FEATURES;k++) sd[k] += (x[i][k]-mean[k])*(x[i][k]-mean[k])/n;
+	for(int k=0;k<FEATURES;k++) sd[k] = sd[k] > 1e-12f ? sqrtf(sd[k]) : 1;
+	for(int i=0;i<n;i++) for(int k=0;k<FEATURES;k++) z[i][k] = (x[i][k]-mean[k])/sd[k];
+	for(int step=0;step<STEPS;step++)
+	{
+		float gw[CLASSES][FEATURES] = {{0}}, gb[CLASSES] = {0};
+		for(int i=0;i<n;i++)
+		{
+			float s[CLASSES], top = -INFINITY, total = 0;
+			for(int c=0;c<CLASSES;c++)
+			{
+				s[c] = bs[c];
+				for(int k=0;k<FEATURES;k++) s[c] += ws[c][k]*z[i][k];
+				if(s[c] > top) top = s[c];
+			}
+			for(int c=0;c<CLASSES;c++) total += s[c] = expf(s[c]-top);
+			for(int c=0;c<CLASSES;c++)
+			{
+				float err = s[c]/total - (y[i] == c);
+				gb[c] += err/n;
+				for(int k=0;k<FEATURES;k++) gw[c][k] += err*z[i][k]/n;
+			}
+		}
+		for(int c=0;c<CLASSES;c++)
+		{
+			bs[c] -= RATE*gb[c];
+			for(int k=0;k<FEATURES;k++) ws[c][k] -= RATE*(gw[c][k] + L2*ws[c][k]);
+		}
+	}
+	//back to raw features: w.(f-mean)/sd + b
+	for(int c=0;c<CLASSES;c++)
+	{
+		b[c] = bs[c];
+		for(int k=0;k<FEATURES;k++)
+		{
+			w[c][k] = ws[c][k]/sd[k];
+			b[c] -= w[c][k]*mean[k];
+		}
+	}
+}
+static float gini(const int *count, int total)
+{
+	float g = 1;
+	for(int c=0;c<CLASSES;c++) g -= (float)count[c]*count[c]/((float)total*total);
+	return g;
+}
+static int sortFeature;
+static int byFeature(const void *a, const void *b)
+{
+	float fa = x[*(const int*)a][sortFeature], fb = x[*(const int*)b][sortFeature];
+	return fa < fb ? -1 : fa > fb;
+}
+//grows the subtree over windows idx[0..m), returns its node index
+static int grow(int *idx, int m, int depth, int maxDepth, int subset)
+{
+	int count[CLASSES] = {0}, major = 0;
+	for(int i=0;i<m;i++) count[y[idx[i]]]++;
+	for(int c=1;c<CLASSES;c++) if(count[c] > count[major]) major = c;
+	int node = nNodes++;
+	nodes[node] = (Classifier_Node){CLASSIFIER_LEAF, major, 0, (float)count[major]/m};
+	if(depth == maxDepth || count[major] == m || m < 2*MIN_LEAF || nNodes+2 > MAX_NODES) return node;
+	float bestGain = 0, bestThreshold = 0;
+	int bestFeature = -1;
+	for(int k=0;k<FEATURES;k++)
+	{
+		if(subset && rand()%2) continue;
+		sortFeature = k;
+		qsort(idx, m, sizeof(int), byFeature);
+		int left[CLASSES] = {0}, right[CLASSES];
+		memcpy(right, count, sizeof(right));
+		for(int i=0;i<m-1;i++)
+		{
+			left[y[idx[i]]]++;
+			right[y[idx[i]]]--;
+			float a = x[idx[i]][k], c = x[idx[i+1]][k];
+			if(a == c || i+1 < MIN_LEAF || m-i-1 < MIN_LEAF) continue;
+			float gain = gini(count, m) - (i+1)*gini(left, i+1)/m - (m-i-1)*gini(right, m-i-1)/m;
+			if(gain > bestGain)
+			{
+				bestGain = gain;
+				bestFeature = k;
+				bestThreshold = (a+c)/2;
+			}
+		}
+	}
+	if(bestFeature < 0) return node;
+	//partition: <= threshold first
+	int split = 0;
+	for(int i=0;i<m;i++)
+	{
+		if(x[idx[i]][bestFeature] <= bestThreshold)
+		{
+			int t = idx[i];
+			idx[i] = idx[split];
+			idx[split++] = t;
+		}
+	}
+	nodes[node].feature = bestFeature;
+	nodes[node].threshold = bestThreshold;
+	nodes[node].yes = grow(idx, split, depth+1, maxDepth, subset);
+	nodes[node].no = grow(idx+split, m-split, depth+1, maxDepth, subset);
+	return node;
+}
+static int treesClass(const float *f)
+{
+	float votes[CLASSES] = {0};
+	int best = 0;
+	for(int t=0;t<nRoots;t++)
+	{
+		const Classifier_Node *node = &nodes[roots[t]];
+		while(node->feature != CLASSIFIER_LEAF) node = &nodes[f[node->feature] <= node->threshold ? node->yes : node->no];
+		votes[node->yes] += node->threshold;
+	}
+	for(int c=1;c<CLASSES;c++) if(votes[c] > votes[best]) best = c;
+	return best;
+}
+static void fitTrees(int trees, int maxDepth)
+{
+	static int idx[MAX_WINDOWS];
+	srand(1);
+	for(int t=0;t<trees && nNodes < MAX_NODES;t++)
+	{
+		for(int i=0;i<n;i++) idx[i] = t == 0 ? i : rand()%n;
+		roots[nRoots++] = grow(idx, n, 0, maxDepth, t > 0);
+	}
+}
+static void accuracy(const char *model, int (*classify)(const float*))
+{
+	int right[CLASSES] = {0}, total[CLASSES] = {0};
+	for(int i=0;i<n;i++)
+	{
+		total[y[i]]++;
+		right[y[i]] += classify(x[i]) == y[i];
+	}
+	fprintf(stderr, "%s, training windows:", model);
+	for(int c=0;c<CLASSES;c++) fprintf(stderr, " %s %.1f%% of %d", classNames[c], total[c] ? 100.0*right[c]/total[c] : 0, total[c]);
+	fprintf(stderr, "\n");
+}
+static void printTables(void)
+{
+	printf("//trees: %d nodes\n#define LEAF(cls,vote) {CLASSIFIER_LEAF, cls, 0, vote}\nstatic const Classifier_Node nodes[] = {\n", nNodes);
+	for(int i=0,t=0;i<nNodes;i++)
+	{
+		if(t < nRoots && roots[t] == i) printf("\t//%d: tree %d\n", i, t++);
+		if(nodes[i].feature == CLASSIFIER_LEAF) printf("\tLEAF(%s, %.3ff),\n", enumNames[nodes[i].yes], nodes[i].threshold);
+		else printf("\t{%s, %d, %d, %.6gf},\n", featureNames[nodes[i].feature], nodes[i].yes, nodes[i].no, nodes[i].threshold);
+	}
+	printf("};\nstatic const uint8_t roots[] = {");
+	for(int t=0;t<nRoots;t++) printf(t ? ", %d" : "%d", roots[t]);
+	printf("};\n\n//linear\nstatic const float weights[CLASSIFIER_CLASSES][FEATURES] = {\n");
+	for(int c=0;c<CLASSES;c++)
+	{
+		printf("\t[%s] = {", enumNames[c]);
+		for(int k=0;k<FEATURES;k++) printf(k ? ", %.6gf" : "%.6gf", w[c][k]);
+		printf("},\n");
+	}
+	printf("};\nstatic const float bias[CLASSIFIER_CLASSES] = {%.6gf, %.6gf, %.6gf};\n", b[0], b[1], b[2]);
+}
+int main(int argc, char **argv)
+{
+	int stride = 26, trees = 3, depth = 3, opt;
+	float rate = 104;
+	while((opt = getopt(argc, argv, "s:r:t:d:")) != -1)
+	{
+		if(opt == 's') stride = atoi(optarg);
+		else if(opt == 'r') rate = atof(optarg);
+		else if(opt == 't') trees = atoi(optarg);
+		else if(opt == 'd') depth = atoi(optarg);
+		else optind = argc;
+	}
+	if(optind >= argc || stride < 1 || rate <= 0 || trees < 1 || depth < 1 || depth > 6)
+	{
+		fprintf(stderr, "usage: %s [-s stride] [-r rate Hz] [-t trees] [-d depth 1..6] file...\n", argv[0]);
+		return 2;
+	}
+	for(int i=optind;i<argc;i++)
+	{
+		FILE *f = fopen(argv[i], "r");
+		if(f == NULL)
+		{
+			perror(argv[i]);
+			return 1;
+		}
+		int status = readFile(f, argv[i], stride, rate);
+		fclose(f);
+		if(status) return 1;
+	}
+	int count[CLASSES] = {0};
+	for(int i=0;i<n;i++) count[y[i]]++;
+	for(int c=0;c<CLASSES;c++)
+	{
+		if(count[c] == 0)
+		{
+			fprintf(stderr, "no %s windows\n", classNames[c]);
+			return 1;
+		}
+	}
+	fitLinear();
+	fitTrees(trees, depth);
+	accuracy("linear", linearClass);
+	accuracy("trees", treesClass);
+	printTables();
+	return 0;
+}
@@ -0,0 +1,288 @@
+/*
+ * emu_bench.c
+ *
+ *  Runs the firmware's uplink code (Core/Src/wifi.c, mqtt.c, imu_stream.c)
+ *  against the ISM43362 emulator and a local sink/echo server, and reports
+ *  the board-side time per operation and payload throughput.
+ *
+ *  build (from the repository root):
+ *    cc -O1 -std=gnu11 -DUSE_HAL_DRIVER -DSTM32L475xx -DDEBUG \
+ *       -IDrivers/CMSIS/Include -IDrivers/CMSIS/Device/ST/STM32L4xx/Include \
+ *       -IDrivers/STM32L4xx_HAL_Driver/Inc -ICore/Inc -ITools/emu \
+ *       -o emu_bench Tools/emu/emu_bench.c Tools/emu/ism43362_emu.c \
+ *       Core/Src/wifi.c Core/Src/mqtt.c Core/Src/imu_stream.c -lpthread
+ *
+ *  run:  ./emu_bench -m str|raw|udp|echo|mqtt|fuzz [options]
+ *    -n N      iterations (default 100)
+ *    -l MS     module latency per command     -j MS   latency jitter
+ *    -e P      ERROR answer probability       -c P    response corruption probability
+ *    -d P      payload drop probability       -k KHZ  SPI clock (default 5000)
+ *              (-e, -c and -d default to 0, in fuzz mode to 0.05 each)
+ *    -s SEED   random seed                    -r      sleep the delays in real time
+ *    -h IP -p PORT   use an external server instead of the built-in sink
+ *                    (mqtt mode needs one, e.g. mosquitto on 127.0.0.1 1883)
+ *    -v        print the AT traffic
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "wifi.h"
+#include "mqtt.h"
+#include "imu_stream.h"
+#include "ism43362_emu.h"
+
+WIFI_HandleTypeDef hwifi;
+extern SPI_HandleTypeDef hspi3;
+
+static volatile uint64_t sinkBytes;
+static volatile uint64_t sinkDatagrams;
+
+//built-in server: counts what arrives and echoes it back
+static void* tcpSink(void *arg)
+{
+	int lfd = *(int*)arg;
+	uint8_t buf[4096];
+	for(;;)
+	{
+		int fd = accept(lfd, NULL, NULL);
+		if(fd < 0) continue;
+		ssize_t n;
+		while((n = recv(fd, buf, sizeof(buf), 0)) > 0)
+		{
+			sinkBytes += n;
+			send(fd, buf, n, MSG_NOSIGNAL);
+		}
+		close(fd);
+	}
+	return NULL;
+}
+static void* udpSink(void *arg)
+{
+	int fd = *(int*)arg;
+	uint8_t buf[4096];
+	struct sockaddr_in from;
+	socklen_t fromLen = sizeof(from);
+	ssize_t n;
+	while((n = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr*)&from, &fromLen)) >= 0)
+	{
+		sinkBytes += n;
+		sinkDatagrams++;
+		sendto(fd, buf, n, 0, (struct sockaddr*)&from, fromLen);
+		fromLen = sizeof(from);
+	}
+	return NULL;
+}
+static int startSink(int udp, int *port)
+{
+	static int fd;
+	static pthread_t thread;
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	fd = socket(AF_INET, udp ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if(fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) return -1;
+	if(!udp && listen(fd, 1) < 0) return -1;
+	getsockname(fd, (struct sockaddr*)&addr, &len);
+	*port = ntohs(addr.sin_port);
+	return pthread_create(&thread, NULL, udp ? udpSink : tcpSink, &fd);
+}
+static void bringUp(WIFI_TransportProtocolTypeDef proto, char *host, char *port)
+{
+	hwifi.handle = &hspi3;
+	hwifi.ssid = "emulated";
+	hwifi.passphrase = "emulated";
+	hwifi.securityType = WPA_MIXED;
+	hwifi.DHCP = SET;
+	hwifi.ipStatus = IP_V4;
+	hwifi.transportProtocol = proto;
+	WIFI_Init(&hwifi);
+	WIFI_JoinNetwork(&hwifi);
+	if(proto != WIFI_MQTT_PROTOCOL) WIFI_ConnectServer(&hwifi, host, port);
+}
+//counters are reported per line, since the previous report
+static void report(const char *what, int n, double ms, uint64_t payload)
+{
+	static EMU_StatsTypeDef last;
+	const EMU_StatsTypeDef *st = EMU_Stats();
+	printf("%-28s %6d ops  %9.2f ms/op  %8.2f kB/s payload  %6.1f AT cmds/op  %8.1f SPI bytes/op\n",
+		what, n, n ? ms/n : 0, ms > 0 ? payload/ms : 0,
+		n ? (double)(st->commands-last.commands)/n : 0, n ? (double)(st->spiBytes-last.spiBytes)/n : 0);
+	last = *st;
+}
+int main(int argc, char **argv)
+{
+	EMU_ConfigTypeDef cfg = {0};
+	//negative until given, so fuzz mode can tell "not set" from an explicit 0
+	cfg.errorRate = cfg.corruptRate = cfg.dropRate = -1;
+	const char *mode = "str";
+	char *host = "127.0.0.1";
+	char port[8] = "";
+	int n = 100;
+	int opt;
+	while((opt = getopt(argc, argv, "m:n:l:j:e:c:d:k:s:h:p:rv")) != -1)
+	{
+		switch(opt)
+		{
+		case 'm': mode = optarg; break;
+		case 'n': n = atoi(optarg); break;
+		case 'l': cfg.latencyMs = atoi(optarg); break;
+		case 'j': cfg.jitterMs = atoi(optarg); break;
+		case 'e': cfg.errorRate = atof(optarg); break;
+		case 'c': cfg.corruptRate = atof(optarg); break;
+		case 'd': cfg.dropRate = atof(optarg); break;
+		case 'k': cfg.spiKHz = atoi(optarg); break;
+		case 's': cfg.seed = atoi(optarg); break;
+		case 'h': host = optarg; break;
+		case 'p': snprintf(port, sizeof(port), "%s", optarg); break;
+		case 'r': cfg.realTime = 1; break;
+		case 'v': cfg.verbose = 1; break;
+		default: fprintf(stderr, "see the header of Tools/emu/emu_bench.c for usage\n"); return 2;
+		}
+	}
+	int udp = strcmp(mode, "udp") == 0;
+	//fuzz without faults would only run the happy path
+	double faultRate = strcmp(mode, "fuzz") == 0 ? 0.05 : 0;
+	if(cfg.errorRate < 0) cfg.errorRate = faultRate;
+	if(cfg.corruptRate < 0) cfg.corruptRate = faultRate;
+	if(cfg.dropRate < 0) cfg.dropRate = faultRate;
+	if(port[0] == '\0')
+	{
+		int p;
+		if(strcmp(mode, "mqtt") == 0)
+		{
+			fprintf(stderr, "mqtt mode needs a broker, pass -h and -p\n");
+			return 2;
+		}
+		if(startSink(udp, &p) != 0)
+		{
+			perror("sink");
+			return 1;
+		}
+		snprintf(port, sizeof(port), "%d", p);
+	}
+	EMU_Init(&cfg);
+	uint8_t payload[WIFI_MAX_SEND_SIZE];
+	for(unsigned i=0;i<sizeof(payload);i++) payload[i] = i*7;
+
+	if(strcmp(mode, "str") == 0)
+	{
+		//what taskSendMessage does every second
+		bringUp(WIFI_TCP_PROTOCOL, host, port);
+		double t0 = EMU_Now();
+		for(int i=0;i<n;i++)
+		{
+			WIFI_SendStr(&hwifi, "walking");
+			WIFI_SendStr(&hwifi, "00024.3100");
+			WIFI_SendStr(&hwifi, "00055.1200");
+		}
+		report("SendStr x3 (taskSendMessage)", n, EMU_Now()-t0, (uint64_t)n*(7+10+10+12));
+	}
+	else if(strcmp(mode, "raw") == 0)
+	{
+		bringUp(WIFI_TCP_PROTOCOL, host, port);
+		report("bring-up", 1, EMU_Now(), 0);
+		const int sizes[] = {16, 64, 256, 512, 1024, WIFI_MAX_SEND_SIZE};
+		for(unsigned s=0;s<sizeof(sizes)/sizeof(sizes[0]);s++)
+		{
+			char what[32];
+			double t0 = EMU_Now();
+			for(int i=0;i<n;i++) WIFI_SendRaw(&hwifi, payload, sizes[s]);
+			snprintf(what, sizeof(what), "SendRaw %d B", sizes[s]);
+			report(what, n, EMU_Now()-t0, (uint64_t)n*sizes[s]);
+		}
+	}
+	else if(udp)
+	{
+		bringUp(WIFI_UDP_PROTOCOL, host, port);
+		IMU_Stream_Init(&hwifi);
+		double t0 = EMU_Now();
+		int16_t xyz[3] = {12, -980, 40};
+		for(int i=0;i<n*IMU_STREAM_BATCH;i++) IMU_Stream_Push(xyz, i*9);
+		IMU_Stream_Flush();
+		report("IMU datagram", n, EMU_Now()-t0, (uint64_t)n*IMU_STREAM_BATCH*6);
+		usleep(100000);
+		printf("sink: %llu datagrams, %llu bytes\n", (unsigned long long)sinkDatagrams, (unsigned long long)sinkBytes);
+	}
+	else if(strcmp(mode, "echo") == 0)
+	{
+		bringUp(WIFI_TCP_PROTOCOL, host, port);
+		uint8_t back[WIFI_MAX_RECV_SIZE];
+		int bad = 0;
+		double t0 = EMU_Now();
+		for(int i=0;i<n;i++)
+		{
+			uint16_t len = 0, got = 0;
+			WIFI_SendRaw(&hwifi, payload, 256);
+			while(got < 256 && WIFI_ReceiveRaw(&hwifi, back+got, 256-got, &len, 200) == WIFI_OK && len > 0) got += len;
+			if(got != 256 || memcmp(back, payload, 256) != 0) bad++;
+		}
+		report("SendRaw+ReceiveRaw 256 B", n, EMU_Now()-t0, (uint64_t)n*512);
+		printf("round trips with wrong data: %d\n", bad);
+	}
+	else if(strcmp(mode, "mqtt") == 0)
+	{
+		bringUp(WIFI_MQTT_PROTOCOL, host, port);
+		strcpy(hwifi.mqtt.publishTopic, "emu/node0");
+		strcpy(hwifi.mqtt.clientId, "emu-node0");
+		hwifi.mqtt.keepAlive = 60;
+		hwifi.mqtt.qos = 1;
+		if(MQTT_Connect(&hwifi, host, port) != WIFI_OK)
+		{
+			fprintf(stderr, "CONNECT failed\n");
+			return 1;
+		}
+		int failed = 0;
+		double t0 = EMU_Now();
+		for(int i=0;i<n;i++)
+		{
+			if(MQTT_PublishSensors(&hwifi, "walking", 24.31f, 55.12f) != WIFI_OK) failed++;
+		}
+		report("MQTT_PublishSensors qos1", n, EMU_Now()-t0, (uint64_t)n*56);
+		//the last report's acks are only read by the next one
+		MQTT_Poll(&hwifi);
+		printf("failed publishes: %d, given up without PUBACK: %u, unacked at the end: %d\n", failed, (unsigned)mqttLost, MQTT_InFlight());
+	}
+	else if(strcmp(mode, "fuzz") == 0)
+	{
+		//every iteration is a full bring-up plus traffic; Error_Handler ends
+		//the iteration instead of the process
+		static jmp_buf jb;
+		static int halted, iteration;
+		uint8_t back[WIFI_MAX_RECV_SIZE];
+		EMU_ArmErrorJump(&jb);
+		for(iteration=0;iteration<n;iteration++)
+		{
+			if(setjmp(jb))
+			{
+				halted++;
+				continue;
+			}
+			uint16_t len;
+			bringUp(WIFI_TCP_PROTOCOL, host, port);
+			WIFI_SendStr(&hwifi, "walking");
+			WIFI_SendRaw(&hwifi, payload, 1 + rand() % WIFI_MAX_SEND_SIZE);
+			WIFI_ReceiveRaw(&hwifi, back, sizeof(back), &len, 20);
+			WIFI_DisconnectServer(&hwifi);
+		}
+		const EMU_StatsTypeDef *st = EMU_Stats();
+		printf("fuzz: %d iterations, %d ended in Error_Handler, %llu commands, %llu errors, %llu corrupted, %llu dropped\n",
+			n, halted, (unsigned long long)st->commands, (unsigned long long)st->errors,
+			(unsigned long long)st->corrupted, (unsigned long long)st->dropped);
+	}
+	else
+	{
+		fprintf(stderr, "unknown mode %s\n", mode);
+		return 2;
+	}
+	return 0;
+}
@@ -0,0 +1,462 @@
+/*
+ * ism43362_emu.c
+ *
+ *  SPI side: the host clocks a command in while NSS is low, the command runs
+ *  when NSS goes high, and CMD/DATA READY stays high until the whole response
+ *  ("\r\n" body "\r\nOK\r\n> ", 0x15 after its end) has been clocked out.
+ *  CMD/DATA READY is also high while the module waits for a command.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "ism43362_emu.h"
+
+#define EMU_SOCKETS 4
+#define EMU_CMD_SIZE 4096
+#define EMU_RESP_SIZE 4096
+#define EMU_PAD 0x15
+
+typedef struct{
+	int proto; //P1: 0 tcp, 1 udp, 3 tcp ssl (carried as plain tcp)
+	char remoteIp[32];
+	int remotePort;
+	int localPort;
+	int fd; //client socket or accepted connection
+	int listenFd; //P5 server socket
+	int readSize; //R1
+	int readTimeout; //R2
+	int sendSize; //S1
+} EmuSocket;
+
+UART_HandleTypeDef huart1;
+SPI_HandleTypeDef hspi3;
+
+static EMU_ConfigTypeDef cfg;
+static EMU_StatsTypeDef stats;
+static double nowMs;
+static jmp_buf *errorJump;
+
+static enum {EMU_CMD, EMU_RESP} phase;
+static uint8_t cmd[EMU_CMD_SIZE];
+static int cmdLen;
+static uint8_t resp[EMU_RESP_SIZE];
+static int respLen;
+static int respPos;
+static int selected;
+static EmuSocket sockets[EMU_SOCKETS];
+static char ssid[64];
+
+static double uniform(void)
+{
+	return rand() / (RAND_MAX + 1.0);
+}
+static void advance(double ms)
+{
+	nowMs += ms;
+	if(cfg.realTime && ms >= 0.001)
+	{
+		struct timespec ts = {(time_t)(ms/1000), (long)((ms - (time_t)(ms/1000)*1000)*1e6)};
+		nanosleep(&ts, NULL);
+	}
+}
+static double wallMs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e3 + ts.tv_nsec*1e-6;
+}
+static void closeSocket(EmuSocket *s)
+{
+	if(s->fd >= 0) close(s->fd);
+	if(s->listenFd >= 0) close(s->listenFd);
+	s->fd = -1;
+	s->listenFd = -1;
+}
+static void resetModule(void)
+{
+	for(int i=0;i<EMU_SOCKETS;i++)
+	{
+		if(sockets[i].fd >= 0 || sockets[i].listenFd >= 0) closeSocket(&sockets[i]);
+		memset(&sockets[i], 0, sizeof(sockets[i]));
+		sockets[i].fd = -1;
+		sockets[i].listenFd = -1;
+		sockets[i].readSize = 1000;
+		sockets[i].readTimeout = 1000;
+	}
+	selected = 0;
+	cmdLen = 0;
+	//after reset the module greets with the prompt
+	memcpy(resp, "\r\n> ", 4);
+	respLen = 4;
+	respPos = 0;
+	phase = EMU_RESP;
+}
+static void reply(const char *body, int len, int ok)
+{
+	int n = 0;
+	resp[n++] = '\r';
+	resp[n++] = '\n';
+	if(len > EMU_RESP_SIZE - 16) len = EMU_RESP_SIZE - 16;
+	memcpy(resp+n, body, len);
+	n += len;
+	const char *tail = ok ? "\r\nOK\r\n> " : "\r\n> ";
+	memcpy(resp+n, tail, strlen(tail));
+	n += strlen(tail);
+	respLen = n;
+	respPos = 0;
+}
+static void replyOk(void)
+{
+	reply("", 0, 1);
+}
+static void replyError(const char *why)
+{
+	char body[96];
+	int n = snprintf(body, sizeof(body), "ERROR: %s", why);
+	reply(body, n, 0);
+}
+static int openClient(EmuSocket *s)
+{
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(s->remotePort);
+	if(inet_pton(AF_INET, s->remoteIp, &addr.sin_addr) != 1) return -1;
+	s->fd = socket(AF_INET, s->proto == 1 ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if(s->fd < 0) return -1;
+	if(connect(s->fd, (struct sockaddr*)&addr, sizeof(addr)) < 0)
+	{
+		close(s->fd);
+		s->fd = -1;
+		return -1;
+	}
+	return 0;
+}
+static int openServer(EmuSocket *s)
+{
+	struct sockaddr_in addr;
+	int one = 1;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(s->localPort);
+	int fd = socket(AF_INET, s->proto == 1 ? SOCK_DGRAM : SOCK_STREAM, 0);
+	if(fd < 0) return -1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || (s->proto != 1 && listen(fd, 1) < 0))
+	{
+		close(fd);
+		return -1;
+	}
+	if(s->proto == 1) s->fd = fd;
+	else s->listenFd = fd;
+	return 0;
+}
+//a server socket serves one client at a time, like the module's P5 mode
+static void acceptPending(EmuSocket *s)
+{
+	if(s->fd >= 0 || s->listenFd < 0) return;
+	struct pollfd p = {s->listenFd, POLLIN, 0};
+	if(poll(&p, 1, 0) > 0) s->fd = accept(s->listenFd, NULL, NULL);
+}
+static void sendPayload(const uint8_t *data, int len)
+{
+	EmuSocket *s = &sockets[selected];
+	acceptPending(s);
+	if(s->fd < 0)
+	{
+		replyError("No connection");
+		return;
+	}
+	if(cfg.dropRate > 0 && uniform() < cfg.dropRate)
+	{
+		stats.dropped++;
+	}
+	else if(send(s->fd, data, len, MSG_NOSIGNAL) != len)
+	{
+		//the module reports a failed send as -1
+		reply("-1", 2, 1);
+		return;
+	}
+	else
+	{
+		stats.sentBytes += len;
+	}
+	char body[16];
+	reply(body, snprintf(body, sizeof(body), "%d", len), 1);
+}
+static void readPayload(void)
+{
+	static uint8_t data[EMU_RESP_SIZE];
+	EmuSocket *s = &sockets[selected];
+	int n = 0;
+	double start = wallMs();
+	int timeout = s->readTimeout;
+	while(s->fd < 0 && s->listenFd >= 0)
+	{
+		acceptPending(s);
+		if(s->fd >= 0 || wallMs() - start >= timeout) break;
+		usleep(1000);
+	}
+	if(s->fd >= 0)
+	{
+		int left = timeout - (int)(wallMs() - start);
+		struct pollfd p = {s->fd, POLLIN, 0};
+		if(poll(&p, 1, left > 0 ? left : 0) > 0)
+		{
+			int size = s->readSize < EMU_RESP_SIZE - 16 ? s->readSize : EMU_RESP_SIZE - 16;
+			n = recv(s->fd, data, size, 0);
+			if(n == 0 && s->proto != 1)
+			{
+				//peer closed, a server socket goes back to waiting for the next client
+				close(s->fd);
+				s->fd = -1;
+			}
+			if(n < 0) n = 0;
+		}
+	}
+	//the board waited for the module as long as the host did
+	nowMs += wallMs() - start;
+	stats.recvBytes += n;
+	reply((char*)data, n, 1);
+}
+static void execute(void)
+{
+	char line[128];
+	int end = 0;
+	while(end < cmdLen && cmd[end] != '\r') end++;
+	if(end >= cmdLen)
+	{
+		replyError("Missing CR");
+		return;
+	}
+	int len = end < (int)sizeof(line)-1 ? end : (int)sizeof(line)-1;
+	memcpy(line, cmd, len);
+	line[len] = '\0';
+	const uint8_t *data = cmd + end + 1;
+	int dataLen = cmdLen - end - 1;
+	char *arg = strchr(line, '=');
+	if(arg) *arg++ = '\0';
+	EmuSocket *s = &sockets[selected];
+	stats.commands++;
+
+	if(cfg.verbose) fprintf(stderr, "[emu %10.1f] %s%s%s\n", nowMs, line, arg ? "=" : "", arg ? arg : "");
+	if(cfg.errorRate > 0 && uniform() < cfg.errorRate)
+	{
+		stats.errors++;
+		replyError("Injected");
+		return;
+	}
+	if(line[0] == 'Z' || line[0] == 'I')
+	{
+		replyOk();
+	}
+	else if(line[0] == 'C')
+	{
+		if(line[1] == '1' && arg) snprintf(ssid, sizeof(ssid), "%s", arg);
+		if(line[1] == '0')
+		{
+			char body[128];
+			int n = snprintf(body, sizeof(body), "[JOIN   ] %s,127.0.0.1,0,0", ssid);
+			reply(body, n, 1);
+		}
+		else replyOk();
+	}
+	else if(strcmp(line, "P0") == 0 && arg)
+	{
+		int n = atoi(arg);
+		if(n < 0 || n >= EMU_SOCKETS) replyError("Invalid socket");
+		else
+		{
+			selected = n;
+			replyOk();
+		}
+	}
+	else if(strcmp(line, "P1") == 0 && arg) { s->proto = atoi(arg); replyOk(); }
+	else if(strcmp(line, "P2") == 0 && arg) { s->localPort = atoi(arg); replyOk(); }
+	else if(strcmp(line, "P3") == 0 && arg) { snprintf(s->remoteIp, sizeof(s->remoteIp), "%s", arg); replyOk(); }
+	else if(strcmp(line, "P4") == 0 && arg) { s->remotePort = atoi(arg); replyOk(); }
+	else if((strcmp(line, "P5") == 0 || strcmp(line, "P6") == 0) && arg)
+	{
+		closeSocket(s);
+		int r = 0;
+		if(atoi(arg) == 1) r = line[1] == '5' ? openServer(s) : openClient(s);
+		if(r < 0) replyError(strerror(errno));
+		else replyOk();
+	}
+	else if(strcmp(line, "P7") == 0 && arg)
+	{
+		//2 closes the served client, 1 and 3 (take the next client) need no action,
+		//clients are accepted when the socket is used
+		if(atoi(arg) == 2 && s->fd >= 0 && s->listenFd >= 0)
+		{
+			close(s->fd);
+			s->fd = -1;
+		}
+		replyOk();
+	}
+	else if(strcmp(line, "P8") == 0 && arg) { replyOk(); }
+	else if(strcmp(line, "MR") == 0)
+	{
+		reply("[SOMA][EOMA]", 12, 1);
+	}
+	else if(strcmp(line, "S1") == 0 && arg) { s->sendSize = atoi(arg); replyOk(); }
+	else if(strcmp(line, "S0") == 0)
+	{
+		if(dataLen < s->sendSize) replyError("Short payload");
+		else sendPayload(data, s->sendSize);
+	}
+	else if(strcmp(line, "S3") == 0 && arg)
+	{
+		int n = atoi(arg);
+		if(n > 1200 || dataLen < n) replyError("Invalid length");
+		else sendPayload(data, n);
+	}
+	else if(strcmp(line, "R1") == 0 && arg) { s->readSize = atoi(arg); replyOk(); }
+	else if(strcmp(line, "R2") == 0 && arg) { s->readTimeout = atoi(arg); replyOk(); }
+	else if(strcmp(line, "R0") == 0)
+	{
+		readPayload();
+	}
+	else
+	{
+		replyError("Unknown command");
+	}
+}
+static void finishCommand(void)
+{
+	execute();
+	advance(cfg.latencyMs + (cfg.jitterMs ? uniform()*cfg.jitterMs : 0));
+	if(cfg.corruptRate > 0 && uniform() < cfg.corruptRate)
+	{
+		resp[rand() % respLen] ^= 1 << (rand() % 8);
+		stats.corrupted++;
+	}
+	cmdLen = 0;
+	phase = EMU_RESP;
+}
+
+void EMU_Init(const EMU_ConfigTypeDef *config)
+{
+	cfg = *config;
+	if(cfg.spiKHz == 0) cfg.spiKHz = 5000;
+	srand(cfg.seed);
+	memset(&stats, 0, sizeof(stats));
+	nowMs = 0;
+	for(int i=0;i<EMU_SOCKETS;i++)
+	{
+		sockets[i].fd = -1;
+		sockets[i].listenFd = -1;
+	}
+	resetModule();
+}
+const EMU_StatsTypeDef* EMU_Stats(void)
+{
+	return &stats;
+}
+double EMU_Now(void)
+{
+	return nowMs;
+}
+void EMU_ArmErrorJump(jmp_buf *jb)
+{
+	errorJump = jb;
+}
+
+/* HAL stubs -----------------------------------------------------------------*/
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)hspi;
+	(void)Timeout;
+	int n = Size*2;
+	if(phase != EMU_CMD || cmdLen + n > EMU_CMD_SIZE) return HAL_ERROR;
+	memcpy(cmd+cmdLen, pData, n);
+	cmdLen += n;
+	stats.spiBytes += n;
+	advance(n*8.0/cfg.spiKHz);
+	return HAL_OK;
+}
+HAL_StatusTypeDef HAL_SPI_Receive(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)hspi;
+	(void)Timeout;
+	for(int i=0;i<Size*2;i++)
+	{
+		pData[i] = respPos < respLen ? resp[respPos] : EMU_PAD;
+		respPos++;
+	}
+	stats.spiBytes += Size*2;
+	advance(Size*16.0/cfg.spiKHz);
+	return HAL_OK;
+}
+void HAL_GPIO_WritePin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+	if(GPIOx == WIFI_RESET_GPIO_Port && GPIO_Pin == WIFI_RESET_Pin)
+	{
+		if(PinState == GPIO_PIN_SET) resetModule();
+	}
+	else if(GPIOx == WIFI_NSS_GPIO_Port && GPIO_Pin == WIFI_NSS_Pin)
+	{
+		if(PinState == GPIO_PIN_RESET)
+		{
+			if(phase == EMU_CMD) cmdLen = 0;
+		}
+		else if(phase == EMU_CMD && cmdLen > 0)
+		{
+			finishCommand();
+		}
+		else if(phase == EMU_RESP && respPos >= respLen)
+		{
+			phase = EMU_CMD;
+		}
+	}
+}
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef* GPIOx, uint16_t GPIO_Pin)
+{
+	if(GPIOx == WIFI_CMD_DATA_READY_GPIO_Port && GPIO_Pin == WIFI_CMD_DATA_READY_Pin)
+	{
+		if(phase == EMU_CMD) return GPIO_PIN_SET;
+		return respPos < respLen ? GPIO_PIN_SET : GPIO_PIN_RESET;
+	}
+	return GPIO_PIN_RESET;
+}
+void HAL_Delay(uint32_t Delay)
+{
+	advance(Delay);
+}
+uint32_t HAL_GetTick(void)
+{
+	return (uint32_t)nowMs;
+}
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef *huart, uint8_t *pData, uint16_t Size, uint32_t Timeout)
+{
+	(void)huart;
+	(void)Timeout;
+	if(cfg.verbose) fwrite(pData, 1, Size, stderr);
+	return HAL_OK;
+}
+void Error_Handler(void)
+{
+	stats.errorHandler++;
+	if(errorJump) longjmp(*errorJump, 1);
+	fprintf(stderr, "Error_Handler at %.1f ms\n", nowMs);
+	exit(1);
+}
+//wifi.c traces its AT exchanges, there is no recorder on the host
+void Trace_Event(uint8_t event, uint8_t id, uint16_t arg)
+{
+	(void)event;
+	(void)id;
+	(void)arg;
+}
@@ -0,0 +1,47 @@
+/*
+ * ism43362_emu.h
+ *
+ *  Host emulator of the Inventek ISM43362 SPI AT interface, together with the
+ *  HAL stubs Core/Src/wifi.c calls (SPI, GPIO, delay, tick, uart). The driver is
+ *  linked unchanged against it; sockets opened with P1..P6 become real
+ *  localhost TCP/UDP sockets.
+ *
+ *  Time is virtual: HAL_Delay, SPI clocking and the injected latency advance
+ *  HAL_GetTick instead of sleeping, so benchmarks report what the board would
+ *  spend on the link. Set realTime to sleep as well.
+ */
+
+#ifndef TOOLS_EMU_ISM43362_EMU_H_
+#define TOOLS_EMU_ISM43362_EMU_H_
+#include <setjmp.h>
+#include <stdint.h>
+
+typedef struct{
+	uint32_t spiKHz; //SPI3 clock, 80MHz/16 on the board
+	uint32_t latencyMs; //module processing time per command
+	uint32_t jitterMs; //uniform extra latency 0..jitterMs
+	int realTime; //sleep the delays as well
+	double errorRate; //answer ERROR without executing the command
+	double corruptRate; //flip one byte of the response
+	double dropRate; //report a payload as sent but never put it on the socket
+	unsigned seed;
+	int verbose; //print every command and response to stderr
+} EMU_ConfigTypeDef;
+
+typedef struct{
+	uint64_t commands;
+	uint64_t errors; //injected ERROR answers
+	uint64_t corrupted;
+	uint64_t dropped;
+	uint64_t sentBytes; //payload bytes put on sockets
+	uint64_t recvBytes; //payload bytes returned by R0
+	uint64_t spiBytes; //bytes clocked over SPI, padding included
+	uint64_t errorHandler; //Error_Handler calls
+} EMU_StatsTypeDef;
+
+void EMU_Init(const EMU_ConfigTypeDef *cfg);
+const EMU_StatsTypeDef* EMU_Stats(void);
+double EMU_Now(void);
+//when armed, Error_Handler longjmps here instead of exiting the process
+void EMU_ArmErrorJump(jmp_buf *jb);
+#endif /* TOOLS_EMU_ISM43362_EMU_H_ */
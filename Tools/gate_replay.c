@@ -0,0 +1,152 @@
+/*
+ * gate_replay.c
+ *
+ *  Runs a recorded accelerometer trace through Core/Src/gate.c the way
+ *  taskAcc does (a window of 26 samples moving by the stride) and reports how
+ *  often the network would have run and what the gate got wrong. A trace has
+ *  one sample per line, "x y z" in mg as BSP_ACCELERO_AccGetXYZ returns them
+ *  (udp_receiver writes such a file), optionally followed by the true class,
+ *  as a number or a name from activities[] in main.c. Lines starting with #
+ *  are skipped. classifier_eval -g seed writes a labelled synthetic one.
+ *
+ *  With labels, a window's class is its last sample's; the network is taken
+ *  to be right, so audits get the true class. Reported per window: gated
+ *  while not stationary (the misclassification cost, also in seconds of
+ *  activity reported as stationary), and per start of motion the windows
+ *  until the gate opened.
+ *
+ *  build: cc -O2 -DSTM32L475xx -IDrivers/CMSIS/Include \
+ *            -IDrivers/CMSIS/Device/ST/STM32L4xx/Include -ICore/Inc \
+ *            -o gate_replay Tools/gate_replay.c Core/Src/gate.c -lm
+ *  run:   ./gate_replay [-s stride] [-r rate Hz] trace.txt
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gate.h"
+
+#define WINDOW 26 //AI_NETWORK_IN_1_SIZE/3
+#define CLASSES 3
+
+static const char *classNames[CLASSES] = {"stationary", "walking", "running"};
+
+static int parseLabel(const char *s)
+{
+	for(int c=0;c<CLASSES;c++) if(strcmp(s, classNames[c]) == 0) return c;
+	char *end;
+	long c = strtol(s, &end, 10);
+	return end != s && c >= 0 && c < CLASSES ? (int)c : -1;
+}
+int main(int argc, char **argv)
+{
+	int stride = WINDOW, opt;
+	double rate = 104;
+	while((opt = getopt(argc, argv, "s:r:")) != -1)
+	{
+		if(opt == 's') stride = atoi(optarg);
+		else if(opt == 'r') rate = atof(optarg);
+		else break;
+	}
+	if(optind >= argc || stride < 1 || stride > WINDOW || rate <= 0)
+	{
+		fprintf(stderr, "usage: %s [-s stride 1..%d] [-r rate Hz] trace.txt\n", argv[0], WINDOW);
+		return 2;
+	}
+	FILE *f = fopen(argv[optind], "r");
+	if(f == NULL)
+	{
+		perror(argv[optind]);
+		return 1;
+	}
+	Gate_Init();
+	char line[256];
+	int fill = 0, label = -1, labelled = 1, prevLabel = GATE_STATIONARY;
+	uint32_t samples = 0, windows = 0, skipped = 0, audits = 0;
+	uint32_t wrong[CLASSES] = {0}, perClass[CLASSES] = {0};
+	uint32_t onsets = 0, onsetWindows = 0, onsetMax = 0, sinceOnset = 0;
+	int waiting = 0;
+	while(fgets(line, sizeof(line), f))
+	{
+		int x, y, z;
+		char name[32];
+		if(line[0] == '#') continue;
+		int n = sscanf(line, "%d %d %d %31s", &x, &y, &z, name);
+		if(n < 3) continue;
+		if(n == 4 && (label = parseLabel(name)) < 0)
+		{
+			fprintf(stderr, "line %u: unknown class %s\n", samples+1, name);
+			return 1;
+		}
+		if(n == 3) labelled = 0;
+		int16_t xyz[3] = {x, y, z};
+		Gate_Add(xyz);
+		samples++;
+		if(++fill < WINDOW) continue;
+		fill = WINDOW - stride;
+		windows++;
+		Gate_DecisionTypeDef d = Gate_Window();
+		if(d == GATE_AUDIT)
+		{
+			audits++;
+			Gate_Result(labelled ? (uint32_t)label : GATE_STATIONARY);
+		}
+		if(d == GATE_SKIP) skipped++;
+		if(!labelled) continue;
+		perClass[label]++;
+		if(d == GATE_SKIP && label != GATE_STATIONARY) wrong[label]++;
+		//motion starting: count the windows until one reaches the network
+		if(label != GATE_STATIONARY && prevLabel == GATE_STATIONARY)
+		{
+			waiting = 1;
+			sinceOnset = 0;
+			onsets++;
+		}
+		if(waiting && label == GATE_STATIONARY) waiting = 0;
+		if(waiting)
+		{
+			if(d != GATE_SKIP)
+			{
+				onsetWindows += sinceOnset;
+				if(sinceOnset > onsetMax) onsetMax = sinceOnset;
+				waiting = 0;
+			}
+			else sinceOnset++;
+		}
+		prevLabel = label;
+	}
+	fclose(f);
+	if(windows == 0)
+	{
+		fprintf(stderr, "fewer than %d samples\n", WINDOW);
+		return 1;
+	}
+	printf("samples %u, windows %u (stride %d, %.1f s)\n", samples, windows, stride, samples/rate);
+	printf("network %u windows, gated %u, audits %u: inference duty cycle %.1f%%\n",
+			windows-skipped, skipped, audits, 100.0*(windows-skipped)/windows);
+	printf("gate openings %u, audit misses %u\n", (unsigned)gateOpenings, (unsigned)gateMisses);
+	if(!labelled)
+	{
+		printf("no labels on every line, misclassification not computed\n");
+		return 0;
+	}
+	uint32_t moving = 0, wrongTotal = 0;
+	for(int c=0;c<CLASSES;c++)
+	{
+		if(c != GATE_STATIONARY)
+		{
+			moving += perClass[c];
+			wrongTotal += wrong[c];
+		}
+		printf("%-10s %6u windows", classNames[c], perClass[c]);
+		if(c != GATE_STATIONARY) printf(", %u gated as stationary", wrong[c]);
+		printf("\n");
+	}
+	printf("misclassified by the gate: %u of %u moving windows (%.2f%%), %.1f s of activity\n",
+			wrongTotal, moving, moving ? 100.0*wrongTotal/moving : 0.0, wrongTotal*stride/rate);
+	if(onsets) printf("motion onsets %u: %.2f windows to open on average, %u at most\n",
+			onsets, (double)onsetWindows/onsets, onsetMax);
+	return 0;
+}
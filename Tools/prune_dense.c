@@ -0,0 +1,416 @@
+/*
+ * prune_dense.c
+ *
+ *  Structured pruning of dense_dense for Core/Inc/sparse_dense.h. Blocks of
+ *  SPARSE_BLOCK outputs by one input are ranked by their L2 norm and the
+ *  smallest are dropped until the given sparsity; the rest is written as
+ *  Core/Src/sparse_dense_table.c. The weights are the ones built into the
+ *  image (X-CUBE-AI/App/network_data_params.c) or a raw weights file, as
+ *  remote_ctl downloads them.
+ *
+ *  Every table is checked against the host golden model: the network's six
+ *  layers in plain C on the real weights (layouts from network.c, channels
+ *  last). Sparse_Dense must give what the dense layer gives with the pruned
+ *  matrix, and the class of the whole network with the pruned layer is
+ *  compared with the unpruned one on test windows: synthetic stationary,
+ *  walking and running, or a trace from udp_receiver ("x y z" in mg). -r
+ *  prints that with the host cost at 50, 75 and 90% instead of writing a
+ *  table, and what the table does to the image: "image" with the dense
+ *  matrix still in the weights, "stripped" with the weights from -p, which
+ *  leaves the matrix out (SPARSE_DENSE_STRIP). The kernel's code isn't
+ *  counted, the host can't build it for the target.
+ *
+ *  build: cc -O2 -DUSE_HAL_DRIVER -DSTM32L475xx -IDrivers/CMSIS/Include \
+ *            -IDrivers/CMSIS/Device/ST/STM32L4xx/Include \
+ *            -IDrivers/STM32L4xx_HAL_Driver/Inc -ICore/Inc \
+ *            -IMiddlewares/ST/AI/Inc -IX-CUBE-AI/App -o prune_dense \
+ *            Tools/prune_dense.c Core/Src/sparse_dense.c \
+ *            X-CUBE-AI/App/network_data_params.c -lm
+ *  run:   ./prune_dense [-s sparsity %] [-o table.c] [-p stripped_weights.c]
+ *                       [-w weights.bin] [-t trace.txt] [-r]
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sparse_dense.h"
+#include "network_data.h"
+
+//byte offsets in the weights, from network_configure_weights in network.c
+#define OFF_CONV0_W 12
+#define OFF_CONV0_B 588
+#define OFF_CONV1_W 652
+#define OFF_CONV1_B 2188
+#define OFF_DENSE0_W 2220
+#define OFF_DENSE0_B 47276
+#define OFF_DENSE1_W 47532
+#define OFF_DENSE1_B 0
+#define IN_LEN 26
+#define IN_CH 3
+#define K 3
+#define C0 16
+#define L0 (IN_LEN-K+1)
+#define C1 8
+#define L1 (L0-K+1)
+#define D_IN (L1*C1)
+#define D0 64
+#define D1 3
+#define GROUPS (D0/SPARSE_BLOCK)
+#define MAX_BLOCKS (GROUPS*D_IN)
+#define MAX_WINDOWS 4096
+#define DENSE_BYTES (D0*D_IN*sizeof(float))
+
+typedef struct{
+	const float *w0, *b0, *w1, *b1, *w2, *b2, *w3, *b3;
+} Model;
+
+static uint8_t blob[AI_NETWORK_DATA_WEIGHTS_SIZE] __attribute__((aligned(4)));
+static float windows[MAX_WINDOWS][IN_LEN*IN_CH];
+static float hidden[MAX_WINDOWS][D_IN]; //dense_dense inputs of the windows
+static int classes[MAX_WINDOWS]; //unpruned network
+static int numWindows = 0;
+static volatile float sink;
+static float pruned[D0*D_IN];
+static uint16_t rowStart[GROUPS+1];
+static uint8_t col[MAX_BLOCKS];
+static float values[MAX_BLOCKS*SPARSE_BLOCK];
+
+//channels last, weights [out channel][tap][in channel], valid padding, relu fused as in the runtime
+static void conv1d(const float *x, int len, int cin, const float *w, const float *b, int cout, float *y)
+{
+	for(int t=0;t<len-K+1;t++)
+	{
+		for(int o=0;o<cout;o++)
+		{
+			const float *wo = w + o*K*cin;
+			float acc = b[o];
+			for(int k=0;k<K;k++)
+				for(int c=0;c<cin;c++)
+					acc += x[(t+k)*cin+c]*wo[k*cin+c];
+			y[t*cout+o] = acc > 0 ? acc : 0;
+		}
+	}
+}
+//weights [out][in]
+static void dense(const float *x, int nin, const float *w, const float *b, int nout, float *y)
+{
+	for(int o=0;o<nout;o++)
+	{
+		const float *wo = w + o*nin;
+		float acc = b[o];
+		for(int i=0;i<nin;i++) acc += x[i]*wo[i];
+		y[o] = acc;
+	}
+}
+//the layers after dense_dense: relu, dense_1, softmax; the class is the argmax either way
+static int tail(const Model *m, float *y)
+{
+	float out[D1];
+	for(int i=0;i<D0;i++) if(y[i] < 0) y[i] = 0;
+	dense(y, D0, m->w3, m->b3, D1, out);
+	int best = 0;
+	for(int c=1;c<D1;c++) if(out[c] > out[best]) best = c;
+	return best;
+}
+static void addWindow(const int16_t xyz[IN_LEN][3])
+{
+	if(numWindows >= MAX_WINDOWS) return;
+	//scaled as the channel table in Core/Src/pipeline.c has it
+	for(int t=0;t<IN_LEN;t++)
+		for(int a=0;a<IN_CH;a++) windows[numWindows][t*IN_CH+a] = xyz[t][a]/4000.0f;
+	numWindows++;
+}
+static void synthWindows(void)
+{
+	int16_t xyz[IN_LEN][3];
+	srand(7);
+	for(int n=0;n<1500;n++)
+	{
+		int cls = n%3;
+		float hz = cls == 1 ? 2.0f : 3.0f, amp = cls == 1 ? 300 : 700;
+		float phase = rand()/(float)RAND_MAX*6.2832f;
+		for(int t=0;t<IN_LEN;t++)
+		{
+			float step = cls ? amp*sinf(phase + 6.2832f*hz*t/104.0f) : 0;
+			int noise = cls ? 20 : 3;
+			xyz[t][0] = (int16_t)(0.3f*step + rand()%(2*noise+1) - noise);
+			xyz[t][1] = (int16_t)(rand()%(2*noise+1) - noise);
+			xyz[t][2] = (int16_t)(1000 + step + rand()%(2*noise+1) - noise);
+		}
+		addWindow(xyz);
+	}
+}
+static int traceWindows(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+	{
+		perror(path);
+		return 0;
+	}
+	int16_t xyz[IN_LEN][3];
+	int fill = 0, x, y, z;
+	char line[256];
+	while(fgets(line, sizeof(line), f))
+	{
+		if(line[0] == '#' || sscanf(line, "%d %d %d", &x, &y, &z) != 3) continue;
+		xyz[fill][0] = x;
+		xyz[fill][1] = y;
+		xyz[fill][2] = z;
+		if(++fill == IN_LEN)
+		{
+			addWindow(xyz);
+			fill = 0;
+		}
+	}
+	fclose(f);
+	return numWindows > 0;
+}
+//the golden model up to dense_dense, and its class with the unpruned layer
+static void runGolden(const Model *m)
+{
+	float a0[L0*C0], y[D0];
+	for(int n=0;n<numWindows;n++)
+	{
+		conv1d(windows[n], IN_LEN, IN_CH, m->w0, m->b0, C0, a0);
+		conv1d(a0, L0, C0, m->w1, m->b1, C1, hidden[n]);
+		dense(hidden[n], D_IN, m->w2, m->b2, D0, y);
+		classes[n] = tail(m, y);
+	}
+}
+static const float *weightsAt(uint32_t offset)
+{
+	return (const float*)(blob + offset);
+}
+static float *norms;
+static int byNorm(const void *a, const void *b)
+{
+	float na = norms[*(const int*)a], nb = norms[*(const int*)b];
+	return na < nb ? -1 : na > nb;
+}
+//keeps the largest blocks, fills the table and the pruned dense matrix
+static Sparse_TableTypeDef prune(const Model *m, int sparsity)
+{
+	static float blockNorm[MAX_BLOCKS];
+	static int order[MAX_BLOCKS];
+	static uint8_t keep[MAX_BLOCKS];
+	for(int g=0;g<GROUPS;g++)
+	{
+		for(int i=0;i<D_IN;i++)
+		{
+			float s = 0;
+			for(int r=0;r<SPARSE_BLOCK;r++)
+			{
+				float w = m->w2[(g*SPARSE_BLOCK+r)*D_IN + i];
+				s += w*w;
+			}
+			blockNorm[g*D_IN+i] = sqrtf(s);
+			order[g*D_IN+i] = g*D_IN+i;
+		}
+	}
+	norms = blockNorm;
+	qsort(order, MAX_BLOCKS, sizeof(int), byNorm);
+	int drop = (int)((long)MAX_BLOCKS*sparsity/100);
+	for(int b=0;b<MAX_BLOCKS;b++) keep[order[b]] = b >= drop;
+	Sparse_TableTypeDef t = {D0, D_IN, 0, Sparse_Hash(m->w2, D0*D_IN), rowStart, col, values};
+	memcpy(pruned, m->w2, sizeof(pruned));
+	for(int g=0;g<GROUPS;g++)
+	{
+		rowStart[g] = t.blocks;
+		for(int i=0;i<D_IN;i++)
+		{
+			for(int r=0;r<SPARSE_BLOCK;r++)
+			{
+				float *w = &pruned[(g*SPARSE_BLOCK+r)*D_IN + i];
+				if(keep[g*D_IN+i]) values[t.blocks*SPARSE_BLOCK+r] = *w;
+				else *w = 0;
+			}
+			if(keep[g*D_IN+i]) col[t.blocks++] = i;
+		}
+	}
+	rowStart[GROUPS] = t.blocks;
+	return t;
+}
+static uint32_t tableBytes(const Sparse_TableTypeDef *t)
+{
+	return t->blocks*(SPARSE_BLOCK*sizeof(float) + 1) + (GROUPS+1)*sizeof(uint16_t) + sizeof(*t);
+}
+//the weights without dense_dense's matrix, padded to ai_u64 as the array is
+static uint32_t strippedBytes(void)
+{
+	return (AI_NETWORK_DATA_WEIGHTS_SIZE - DENSE_BYTES + 7)/8*8;
+}
+static double nowNs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+//Sparse_Dense against the pruned dense layer, the pruned network against the unpruned one
+static int validate(const Model *m, const Sparse_TableTypeDef *t, float *maxErr, float *agree)
+{
+	float golden[D0], sparse[D0];
+	int same = 0, ok = 1;
+	*maxErr = 0;
+	for(int n=0;n<numWindows;n++)
+	{
+		dense(hidden[n], D_IN, pruned, m->b2, D0, golden);
+		Sparse_Dense(t, hidden[n], m->b2, sparse);
+		for(int o=0;o<D0;o++)
+		{
+			float e = fabsf(golden[o] - sparse[o]);
+			if(e > *maxErr) *maxErr = e;
+			//the sums run in another order, only rounding may differ
+			if(e > 1e-4f*(1.0f + fabsf(golden[o]))) ok = 0;
+		}
+		same += tail(m, sparse) == classes[n];
+	}
+	*agree = 100.0f*same/numWindows;
+	return ok;
+}
+static double timeNs(const Model *m, const Sparse_TableTypeDef *t)
+{
+	float y[D0];
+	const int loops = 20000;
+	double t0 = nowNs();
+	for(int i=0;i<loops;i++)
+	{
+		if(t) Sparse_Dense(t, hidden[i%numWindows], m->b2, y);
+		else dense(hidden[i%numWindows], D_IN, m->w2, m->b2, D0, y);
+		sink = y[i%D0];
+	}
+	return (nowNs() - t0)/loops;
+}
+static int writeTable(const char *path, const Sparse_TableTypeDef *t, int sparsity, const char *source)
+{
+	FILE *f = fopen(path, "w");
+	if(f == NULL)
+	{
+		perror(path);
+		return 0;
+	}
+	fprintf(f, "//generated by Tools/prune_dense.c from %s, %d%% of the blocks dropped\n", source, sparsity);
+	fprintf(f, "#include \"sparse_dense.h\"\n#ifdef SPARSE_DENSE_EN\n\n");
+	fprintf(f, "static const uint16_t rowStart[%d] = {", GROUPS+1);
+	for(int g=0;g<=GROUPS;g++) fprintf(f, "%s%u", g ? ", " : "", rowStart[g]);
+	fprintf(f, "};\nstatic const uint8_t col[%u] = {", t->blocks);
+	for(int b=0;b<t->blocks;b++) fprintf(f, "%s%s%u", b ? "," : "", b%24 ? " " : "\n\t", col[b]);
+	fprintf(f, "\n};\nstatic const float values[%u] = {", t->blocks*SPARSE_BLOCK);
+	for(int v=0;v<t->blocks*SPARSE_BLOCK;v++) fprintf(f, "%s%s%.9gf", v ? "," : "", v%SPARSE_BLOCK ? " " : "\n\t", values[v]);
+	fprintf(f, "\n};\nconst Sparse_TableTypeDef sparseDenseTable = {%u, %u, %u, 0x%08Xu, rowStart, col, values};\n#endif\n",
+			t->rows, t->cols, t->blocks, (unsigned)t->hash);
+	fclose(f);
+	return 1;
+}
+//the weights as they are in the image, with the bytes of dense_dense's matrix cut out
+static int writeStripped(const char *path, const Sparse_TableTypeDef *t, const char *source)
+{
+	static uint8_t stripped[AI_NETWORK_DATA_WEIGHTS_SIZE];
+	FILE *f = fopen(path, "w");
+	if(f == NULL)
+	{
+		perror(path);
+		return 0;
+	}
+	memset(stripped, 0, sizeof(stripped));
+	memcpy(stripped, blob, OFF_DENSE0_W);
+	memcpy(stripped + OFF_DENSE0_W, blob + OFF_DENSE0_W + DENSE_BYTES, AI_NETWORK_DATA_WEIGHTS_SIZE - OFF_DENSE0_W - DENSE_BYTES);
+	fprintf(f, "//generated by Tools/prune_dense.c from %s, without the %u bytes of dense_dense's matrix\n",
+			source, (unsigned)DENSE_BYTES);
+	fprintf(f, "#include \"sparse_dense.h\"\n#ifdef SPARSE_DENSE_STRIP\n\n");
+	fprintf(f, "AI_ALIGNED(32)\nconst ai_u64 sparseDenseWeights[%u] = {", strippedBytes()/8);
+	for(uint32_t i=0;i<strippedBytes()/8;i++)
+	{
+		uint64_t v;
+		memcpy(&v, stripped + i*8, sizeof(v));
+		fprintf(f, "%s%s0x%016llxU", i ? "," : "", i%4 ? " " : "\n\t", (unsigned long long)v);
+	}
+	fprintf(f, "\n};\nconst uint32_t sparseDenseWeightsHash = 0x%08Xu;\n#endif\n", (unsigned)t->hash);
+	fclose(f);
+	return 1;
+}
+int main(int argc, char **argv)
+{
+	int sparsity = 75, report = 0, opt;
+	const char *out = "Core/Src/sparse_dense_table.c", *weightsFile = NULL, *trace = NULL, *strip = NULL;
+	while((opt = getopt(argc, argv, "s:o:w:t:p:r")) != -1)
+	{
+		if(opt == 's') sparsity = atoi(optarg);
+		else if(opt == 'o') out = optarg;
+		else if(opt == 'w') weightsFile = optarg;
+		else if(opt == 't') trace = optarg;
+		else if(opt == 'p') strip = optarg;
+		else if(opt == 'r') report = 1;
+		else
+		{
+			fprintf(stderr, "usage: %s [-s sparsity %%] [-o table.c] [-p stripped_weights.c] [-w weights.bin] [-t trace.txt] [-r]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(sparsity < 0 || sparsity > 99)
+	{
+		fprintf(stderr, "sparsity 0..99\n");
+		return 2;
+	}
+	if(weightsFile)
+	{
+		FILE *f = fopen(weightsFile, "rb");
+		if(f == NULL || fread(blob, 1, sizeof(blob), f) != sizeof(blob))
+		{
+			fprintf(stderr, "%s: need %u bytes of weights\n", weightsFile, (unsigned)sizeof(blob));
+			return 1;
+		}
+		fclose(f);
+	}
+	else memcpy(blob, s_network_weights_array_u64, sizeof(blob));
+	Model m = {weightsAt(OFF_CONV0_W), weightsAt(OFF_CONV0_B), weightsAt(OFF_CONV1_W), weightsAt(OFF_CONV1_B),
+			weightsAt(OFF_DENSE0_W), weightsAt(OFF_DENSE0_B), weightsAt(OFF_DENSE1_W), weightsAt(OFF_DENSE1_B)};
+	if(trace ? !traceWindows(trace) : (synthWindows(), 0)) return 1;
+	runGolden(&m);
+	printf("%d test windows from %s\n", numWindows, trace ? trace : "synthetic traces");
+	if(report)
+	{
+		static const int levels[] = {50, 75, 90};
+		double denseNs = timeNs(&m, NULL);
+		//the dense matrix stays in the image unless it is stripped (-p)
+		printf("sparsity  blocks  table B  image +B  stripped +B  host ns  speedup  max err   class agree\n");
+		printf("%7d%%  %6d  %7s  %8d  %11s  %7.0f  %6.2fx  %-8s  %s\n", 0, MAX_BLOCKS, "-", 0, "-",
+				denseNs, 1.0, "-", "reference");
+		for(unsigned i=0;i<sizeof(levels)/sizeof(levels[0]);i++)
+		{
+			float err, agree;
+			Sparse_TableTypeDef t = prune(&m, levels[i]);
+			int ok = validate(&m, &t, &err, &agree);
+			double ns = timeNs(&m, &t);
+			long kept = tableBytes(&t);
+			long stripped = kept + strippedBytes() + sizeof(uint32_t) - (long)sizeof(s_network_weights_array_u64);
+			printf("%7d%%  %6u  %7ld  %+8ld  %+11ld  %7.0f  %6.2fx  %.2e  %6.2f%%%s\n", levels[i], t.blocks, kept,
+					kept, stripped, ns, denseNs/ns, err, agree, ok ? "" : "  KERNEL MISMATCH");
+			if(!ok) return 1;
+		}
+		return 0;
+	}
+	float err, agree;
+	Sparse_TableTypeDef t = prune(&m, sparsity);
+	if(!validate(&m, &t, &err, &agree))
+	{
+		fprintf(stderr, "Sparse_Dense differs from the pruned dense layer by %g\n", err);
+		return 1;
+	}
+	const char *source = weightsFile ? weightsFile : "network_data_params.c";
+	if(!writeTable(out, &t, sparsity, source)) return 1;
+	printf("%s: %u blocks, %u bytes on top of the image, classes agree on %.2f%% of the windows\n",
+			out, t.blocks, tableBytes(&t), agree);
+	if(strip)
+	{
+		if(!writeStripped(strip, &t, source)) return 1;
+		printf("%s: %u bytes of weights instead of %u, the image %+ld bytes with the table\n", strip, strippedBytes(),
+				(unsigned)sizeof(s_network_weights_array_u64),
+				(long)tableBytes(&t) + strippedBytes() + (long)sizeof(uint32_t) - (long)sizeof(s_network_weights_array_u64));
+	}
+	return 0;
+}
@@ -0,0 +1,330 @@
+/*
+ * remote_ctl.c
+ *
+ *  Stand-in for the uplink server that also drives the command channel
+ *  (Core/Inc/remote.h). Accepts the node's TCP connection, prints the
+ *  length-prefixed frames it sends and turns stdin lines into commands:
+ *
+ *    period <task> <ms>     task codes as in enum Sensor_Index (0 accel .. 8 pressure,
+ *                           9 the command poll itself, 10 the metrics server); the
+ *                           ack shows the period
+ *                           running now and the requested one
+ *    odr <sensor> <hz>      sensor 0 accel, 1 temperature, 2 humidity
+ *    report <n>             send every n-th message
+ *    stride <samples>       inference window step
+ *    config                 read back running and requested periods, report
+ *                           divider, stride
+ *    trace [uart|wifi]      dump the scheduler trace; over wifi the TC/TN/TA/TR
+ *                           lines come back here, feed the output to trace2json
+ *    weights                active weights slot and version
+ *    weights <file> <ver>   download new weights into the free slot and switch
+ *                           the network over; file is X-CUBE-AI/App/network_data_params.c
+ *                           (the s_network_weights_array_u64 initializer) or a
+ *                           raw weights .bin, ver above the active version
+ *
+ *  build: cc -O2 -o remote_ctl Tools/remote_ctl.c
+ *  run:   ./remote_ctl [port]        (default 6666)
+ */
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SYNC_CMD 0xA5
+#define SYNC_ACK 0x5A
+#define CHUNK 128 //REMOTE_WEIGHTS_CHUNK
+#define IN_FLIGHT 3 //chunks, REMOTE_RX_SIZE on the node
+#define TASKS 16 //TASKS_MAX on the node
+
+static const char *cmdName[] = {"?", "period", "odr", "report", "stride", "config", "trace",
+	"weights begin", "weights data", "weights commit", "weights"};
+static const char *statusName[] = {"ok", "unknown command", "bad argument", "checksum", "busy", "flash error"};
+
+//the weights download in progress, size 0 when there is none
+static struct{
+	uint8_t data[65536];
+	uint32_t size;
+	uint32_t next;
+	uint32_t acked;
+	uint32_t version;
+	int inFlight;
+} xfer;
+
+//CRC-32/MPEG-2 over little-endian words, what the node's CRC peripheral computes
+static uint32_t crc32(const uint8_t *p, uint32_t len)
+{
+	uint32_t crc = 0xFFFFFFFF;
+	for(uint32_t i=0;i+4<=len;i+=4)
+	{
+		crc ^= (uint32_t)p[i] | (uint32_t)p[i+1]<<8 | (uint32_t)p[i+2]<<16 | (uint32_t)p[i+3]<<24;
+		for(int b=0;b<32;b++) crc = crc & 0x80000000u ? crc<<1 ^ 0x04C11DB7 : crc<<1;
+	}
+	return crc;
+}
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v>>24; p[1] = v>>16; p[2] = v>>8; p[3] = v;
+}
+//the generated C array, or raw bytes when the file has no s_network_weights_array_u64
+static int loadWeights(const char *path)
+{
+	FILE *f = fopen(path, "rb");
+	if(f == NULL)
+	{
+		perror(path);
+		return -1;
+	}
+	static char text[sizeof(xfer.data)*4];
+	size_t n = fread(text, 1, sizeof(text)-1, f);
+	fclose(f);
+	text[n] = 0;
+	xfer.size = 0;
+	char *p = strstr(text, "s_network_weights_array_u64");
+	if(p == NULL)
+	{
+		if(n > sizeof(xfer.data))
+		{
+			fprintf(stderr, "%s: %zu bytes, more than a slot\n", path, n);
+			return -1;
+		}
+		memcpy(xfer.data, text, n);
+		xfer.size = n;
+	}
+	else
+	{
+		p = strchr(p, '{');
+		char *end = p ? strchr(p, '}') : NULL;
+		while(p && (p = strstr(p, "0x")) != NULL && p < end && xfer.size+8 <= sizeof(xfer.data))
+		{
+			uint64_t v = strtoull(p, &p, 16);
+			for(int i=0;i<8;i++) xfer.data[xfer.size++] = v>>(8*i);
+		}
+	}
+	//the node takes whole doublewords
+	while(xfer.size % 8) xfer.data[xfer.size++] = 0;
+	if(xfer.size == 0)
+	{
+		fprintf(stderr, "%s: no weights\n", path);
+		return -1;
+	}
+	return 0;
+}
+
+static int sendCommand(int fd, uint8_t cmd, const uint8_t *p, uint8_t len)
+{
+	static uint8_t seq = 0;
+	uint8_t frame[5+4+CHUNK];
+	frame[0] = SYNC_CMD;
+	frame[1] = cmd;
+	frame[2] = ++seq;
+	frame[3] = len;
+	memcpy(frame+4, p, len);
+	uint8_t check = 0;
+	for(int i=1;i<4+len;i++) check ^= frame[i];
+	frame[4+len] = check;
+	return send(fd, frame, 5+len, MSG_NOSIGNAL) == 5+len ? 0 : -1;
+}
+static void command(int fd, char *line)
+{
+	char name[16];
+	int a = 0;
+	double v = 0;
+	uint8_t p[3];
+	int n = sscanf(line, "%15s %d %lf", name, &a, &v);
+	int b = (int)v;
+	if(n < 1) return;
+	if(strcmp(name, "period") == 0 && n == 3)
+	{
+		p[0] = a; p[1] = b>>8; p[2] = b;
+		sendCommand(fd, 0x01, p, 3);
+	}
+	else if(strcmp(name, "odr") == 0 && n == 3)
+	{
+		int odr = (int)(v*10 + 0.5);
+		p[0] = a; p[1] = odr>>8; p[2] = odr;
+		sendCommand(fd, 0x02, p, 3);
+	}
+	else if(strcmp(name, "report") == 0 && n == 2) { p[0] = a; sendCommand(fd, 0x03, p, 1); }
+	else if(strcmp(name, "stride") == 0 && n == 2) { p[0] = a; sendCommand(fd, 0x04, p, 1); }
+	else if(strcmp(name, "config") == 0) sendCommand(fd, 0x05, p, 0);
+	else if(strcmp(name, "weights") == 0)
+	{
+		char path[256];
+		unsigned version;
+		if(sscanf(line, "%*s %255s %u", path, &version) != 2) sendCommand(fd, 0x0A, p, 0);
+		else if(version == 0) fprintf(stderr, "version 0 is the firmware's own weights\n");
+		else if(loadWeights(path) == 0)
+		{
+			uint8_t begin[12];
+			put32(begin, xfer.size);
+			put32(begin+4, crc32(xfer.data, xfer.size));
+			put32(begin+8, version);
+			xfer.next = xfer.acked = 0;
+			xfer.inFlight = 0;
+			xfer.version = version;
+			printf("weights: %u bytes, crc %08x\n", xfer.size, crc32(xfer.data, xfer.size));
+			sendCommand(fd, 0x07, begin, 12);
+		}
+	}
+	else if(strcmp(name, "trace") == 0)
+	{
+		char where[8] = "wifi";
+		sscanf(line, "%*s %7s", where);
+		p[0] = strcmp(where, "uart") != 0;
+		sendCommand(fd, 0x06, p, 1);
+	}
+	else fprintf(stderr, "?? %s", line);
+}
+static void sendChunks(int fd)
+{
+	while(xfer.inFlight < IN_FLIGHT && xfer.next < xfer.size)
+	{
+		uint8_t p[4+CHUNK];
+		uint32_t len = xfer.size - xfer.next < CHUNK ? xfer.size - xfer.next : CHUNK;
+		put32(p, xfer.next);
+		memcpy(p+4, xfer.data+xfer.next, len);
+		if(sendCommand(fd, 0x08, p, 4+len) < 0) return;
+		xfer.next += len;
+		xfer.inFlight++;
+	}
+}
+//moves the download along on its acks, returns 1 for an ack not worth printing
+static int transfer(int fd, const uint8_t *f, uint32_t size)
+{
+	if(xfer.size == 0 || size < 6 || f[0] != SYNC_ACK || f[1] < 0x07 || f[1] > 0x09) return 0;
+	uint8_t cmd = f[1], status = f[3];
+	if(status != 0)
+	{
+		//the node keeps the download open, a new weights command starts over
+		xfer.size = 0;
+		return 0;
+	}
+	if(cmd == 0x07) sendChunks(fd);
+	else if(cmd == 0x08)
+	{
+		xfer.inFlight--;
+		xfer.acked += xfer.size - xfer.acked < CHUNK ? xfer.size - xfer.acked : CHUNK;
+		if(xfer.acked % 8192 < CHUNK) printf("weights: %u/%u\n", xfer.acked, xfer.size);
+		if(xfer.acked == xfer.size) sendCommand(fd, 0x09, xfer.data, 0);
+		else sendChunks(fd);
+		return 1;
+	}
+	else if(cmd == 0x09) xfer.size = 0;
+	return 0;
+}
+static void printFrame(const uint8_t *f, uint32_t size)
+{
+	if(size >= 6 && f[0] == SYNC_ACK && size == 6u + f[4])
+	{
+		uint8_t cmd = f[1], status = f[3], len = f[4];
+		printf("ack %s seq %u: %s", cmd < 11 ? cmdName[cmd] : "?", f[2], status < 6 ? statusName[status] : "?");
+		if(status == 0 && cmd == 0x01 && len == 4)
+		{
+			//0 running: basic mode, which doesn't follow periods
+			printf(", running %u ms, requested %u ms", (f[5]<<8) | f[6], (f[7]<<8) | f[8]);
+		}
+		if(status == 0 && cmd == 0x02 && len == 2) printf(", rate %.1f Hz", ((f[5]<<8) | f[6])/10.0);
+		if(status == 0 && cmd == 0x05 && len == 4*TASKS+2)
+		{
+			const uint8_t *running = f+5, *requested = f+5+2*TASKS;
+			printf(", periods (code:running/requested ms)");
+			//the registered tasks, free codes read 0 in both
+			for(int i=0;i<TASKS;i++)
+			{
+				int want = (requested[2*i]<<8) | requested[2*i+1];
+				if(want) printf(" %d:%d/%d", i, (running[2*i]<<8) | running[2*i+1], want);
+			}
+			printf(", report 1/%u, stride %u", f[5+len-2], f[5+len-1]);
+		}
+		if(status == 0 && cmd == 0x07 && len == 1) printf(", slot %c", 'A'+f[5]);
+		if(status == 0 && (cmd == 0x09 || cmd == 0x0A) && len >= 5)
+		{
+			uint32_t version = (uint32_t)f[6]<<24 | (uint32_t)f[7]<<16 | (uint32_t)f[8]<<8 | f[9];
+			if(f[5] == 0xFF) printf(", built in weights");
+			else printf(", slot %c version %u", 'A'+f[5], version);
+			if(cmd == 0x0A && len == 6 && f[10]) printf(", download open");
+		}
+		printf("\n");
+		return;
+	}
+	for(uint32_t i=0;i<size;i++)
+	{
+		//trace frames are several lines
+		if(!isprint(f[i]) && f[i] != '\r' && f[i] != '\n')
+		{
+			printf("<%u byte binary frame>\n", size);
+			return;
+		}
+	}
+	printf("%.*s\n", (int)size, (const char*)f);
+}
+int main(int argc, char **argv)
+{
+	int port = argc > 1 ? atoi(argv[1]) : 6666;
+	int one = 1;
+	int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if(bind(lfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0)
+	{
+		perror("listen");
+		return 1;
+	}
+	printf("waiting for the node on tcp port %d\n", port);
+	int fd = accept(lfd, NULL, NULL);
+	if(fd < 0)
+	{
+		perror("accept");
+		return 1;
+	}
+	printf("node connected\n");
+	fflush(stdout);
+
+	static uint8_t buf[70000];
+	size_t have = 0;
+	for(;;)
+	{
+		struct pollfd p[2] = {{0, POLLIN, 0}, {fd, POLLIN, 0}};
+		if(poll(p, 2, -1) < 0) break;
+		if(p[0].revents & POLLIN)
+		{
+			char line[128];
+			if(!fgets(line, sizeof(line), stdin)) break;
+			command(fd, line);
+		}
+		if(p[1].revents & (POLLIN|POLLHUP))
+		{
+			ssize_t n = recv(fd, buf+have, sizeof(buf)-have, 0);
+			if(n <= 0) break;
+			have += n;
+			for(;;)
+			{
+				if(have < 4) break;
+				uint32_t size = (uint32_t)buf[0]<<24 | (uint32_t)buf[1]<<16 | (uint32_t)buf[2]<<8 | buf[3];
+				if(size > sizeof(buf)-4)
+				{
+					fprintf(stderr, "frame of %u bytes, stream out of sync\n", size);
+					return 1;
+				}
+				if(have < 4+size) break;
+				if(!transfer(fd, buf+4, size)) printFrame(buf+4, size);
+				memmove(buf, buf+4+size, have-4-size);
+				have -= 4+size;
+			}
+			fflush(stdout);
+		}
+	}
+	printf("node disconnected\n");
+	return 0;
+}
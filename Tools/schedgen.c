@@ -0,0 +1,538 @@
+/*
+ * schedgen.c
+ *
+ *  Offline cyclic schedule synthesis. Reads a task set, picks a frame size
+ *  that satisfies the classic cyclic executive conditions, places every job
+ *  of the hyperperiod in a frame (branch and bound, minimising the most
+ *  loaded frame so the idle tasks keep the most slack), checks the result
+ *  job by job and writes a const Schedule_Table for flash.
+ *
+ *  task file, one task per line, '#' starts a comment, times in ms:
+ *
+ *    # name   code      period  wcet  deadline  [after]
+ *    accel    ACCELERO  80      1.2   80
+ *    temp     TEMP      80      1.5   80
+ *    humi     HUMI      80      1.5   80        temp
+ *    send     WIFI      1000    60    1000
+ *    time     TIME      3000    2.0   -
+ *
+ *  code is the enum Sensor_Index entry the task was registered with,
+ *  deadline '-' means the period. wcet is the worst case, ca3_task_exec_us
+ *  {stat="max"} from the metrics endpoint after a long run in basic mode is
+ *  a good start. after names a task with the same period whose job must
+ *  finish first.
+ *
+ *  A job is only placed in frames that start at or after its release, so
+ *  no task ever runs ahead of its period point, and its completion (frame
+ *  start plus everything before it in the frame) must meet the deadline.
+ *  Jobs are not split, a wcet longer than the frame has no schedule.
+ *  Inside a frame tasks run in one fixed priority order, deadline monotonic
+ *  on the deadlines tightened by the precedence (a predecessor has to finish
+ *  by its successor's deadline less the successor's wcet, so it always comes
+ *  first), which is what the table's order list encodes. In the example the
+ *  order is temp, accel, humi, send, time.
+ *
+ *  build: cc -O2 -o schedgen Tools/schedgen.c
+ *  run:   ./schedgen [-f frame] [-m max frame] [-n max frames] [-o Core/Src/schedule_table.c] tasks.txt
+ *         then enable CONST_SCHEDULE in main.c
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_TASKS 16
+#define MAX_JOBS 4096
+#define MAX_FRAMES 4096
+#define NODE_LIMIT 5000000L
+#define TIM1_MAX_FRAME 655 //ms, 16 bit ARR at the 100kHz TIM1 clock
+
+typedef struct{
+	char name[24];
+	char code[24];
+	long period;    //ms
+	long wcet;      //us
+	long deadline;  //ms, relative
+	int after;      //predecessor or -1
+	int prio;       //position in the execution order, 0 runs first
+	long effDeadline; //us, tightened by successors, only orders the search
+} Task;
+
+typedef struct{
+	int task;
+	int k;          //job index in the hyperperiod
+	long release;   //us
+	long deadline;  //us, absolute
+	int lo, hi;     //frames it may go in
+	int frame;
+} Job;
+
+static Task tasks[MAX_TASKS];
+static int nTasks = 0;
+static Job jobs[MAX_JOBS];
+static int nJobs = 0;
+static int order[MAX_JOBS];
+static long load[MAX_FRAMES];
+static int best[MAX_JOBS];
+static long bestPeak;
+static long nodes;
+static long frameUs;
+static int nFrames;
+
+static long gcdl(long a, long b)
+{
+	while(b)
+	{
+		long r = a%b;
+		a = b;
+		b = r;
+	}
+	return a;
+}
+static int findTask(const char *name)
+{
+	for(int i=0;i<nTasks;i++)
+	{
+		if(strcmp(tasks[i].name,name) == 0) return i;
+	}
+	return -1;
+}
+static int readTasks(const char *path)
+{
+	FILE *f = fopen(path,"r");
+	if(!f)
+	{
+		perror(path);
+		return -1;
+	}
+	char line[256];
+	char after[MAX_TASKS][24];
+	int lineNo = 0;
+	while(fgets(line,sizeof(line),f))
+	{
+		lineNo++;
+		char *hash = strchr(line,'#');
+		if(hash) *hash = 0;
+		Task *t = &tasks[nTasks];
+		char dl[16];
+		double wcet;
+		after[nTasks][0] = 0;
+		int n = sscanf(line,"%23s %23s %ld %lf %15s %23s",t->name,t->code,&t->period,&wcet,dl,after[nTasks]);
+		if(n <= 0) continue;
+		if(n < 5 || t->period <= 0 || wcet <= 0)
+		{
+			fprintf(stderr,"%s:%d: expected name code period wcet deadline [after]\n",path,lineNo);
+			fclose(f);
+			return -1;
+		}
+		if(nTasks == MAX_TASKS)
+		{
+			fprintf(stderr,"%s:%d: more than %d tasks\n",path,lineNo,MAX_TASKS);
+			fclose(f);
+			return -1;
+		}
+		t->wcet = (long)(wcet*1000 + 0.5);
+		t->deadline = strcmp(dl,"-") == 0 ? t->period : atol(dl);
+		if(t->deadline <= 0 || t->deadline > t->period)
+		{
+			//a deadline past the period would put two jobs of a task in one frame
+			fprintf(stderr,"%s:%d: deadline must be in 1..period\n",path,lineNo);
+			fclose(f);
+			return -1;
+		}
+		nTasks++;
+	}
+	fclose(f);
+	for(int i=0;i<nTasks;i++)
+	{
+		tasks[i].after = -1;
+		if(after[i][0] == 0) continue;
+		tasks[i].after = findTask(after[i]);
+		if(tasks[i].after < 0 || tasks[tasks[i].after].period != tasks[i].period)
+		{
+			fprintf(stderr,"%s: %s runs after %s, which must exist and have the same period\n",path,tasks[i].name,after[i]);
+			return -1;
+		}
+	}
+	//a predecessor chain longer than the task set goes round in a cycle
+	for(int i=0;i<nTasks;i++)
+	{
+		int r = 0;
+		for(int p=tasks[i].after;p>=0;p=tasks[p].after)
+		{
+			if(++r > nTasks)
+			{
+				fprintf(stderr,"%s: precedence cycle through %s\n",path,tasks[i].name);
+				return -1;
+			}
+		}
+	}
+	//a predecessor has to be done in time for its successor to finish
+	for(int i=0;i<nTasks;i++) tasks[i].effDeadline = tasks[i].deadline*1000;
+	for(int pass=0;pass<nTasks;pass++)
+	{
+		for(int i=0;i<nTasks;i++)
+		{
+			int p = tasks[i].after;
+			if(p >= 0 && tasks[i].effDeadline - tasks[i].wcet < tasks[p].effDeadline)
+			{
+				tasks[p].effDeadline = tasks[i].effDeadline - tasks[i].wcet;
+			}
+		}
+	}
+	//fixed priority: deadline monotonic on the tightened deadlines, with wcet > 0 every
+	//predecessor's is below its successor's, then rate monotonic
+	for(int i=0;i<nTasks;i++)
+	{
+		tasks[i].prio = 0;
+		for(int o=0;o<nTasks;o++)
+		{
+			Task *a = &tasks[o], *b = &tasks[i];
+			int before = a->effDeadline != b->effDeadline ? a->effDeadline < b->effDeadline
+				: a->period != b->period ? a->period < b->period
+				: o < i;
+			tasks[i].prio += before;
+		}
+	}
+	return nTasks > 0 ? 0 : -1;
+}
+//why a frame size can't be used, or NULL
+static const char *frameReject(long f, long hyper, long maxFrame, long maxFrames)
+{
+	static char why[96];
+	if(hyper % f) return "does not divide the hyperperiod";
+	if(f > maxFrame) return "longer than the timer allows";
+	if(maxFrames > 0 && hyper/f > maxFrames) return "too many frames";
+	for(int i=0;i<nTasks;i++)
+	{
+		if(tasks[i].wcet > f*1000)
+		{
+			snprintf(why,sizeof(why),"shorter than the wcet of %s",tasks[i].name);
+			return why;
+		}
+		//a full frame has to fit between any release and its deadline
+		if(2*f - gcdl(f,tasks[i].period) > tasks[i].deadline)
+		{
+			snprintf(why,sizeof(why),"2f-gcd(f,T) exceeds the deadline of %s",tasks[i].name);
+			return why;
+		}
+	}
+	return NULL;
+}
+static int jobCompare(const void *a, const void *b)
+{
+	const Job *x = &jobs[*(const int*)a], *y = &jobs[*(const int*)b];
+	long dx = x->release + tasks[x->task].effDeadline, dy = y->release + tasks[y->task].effDeadline;
+	if(dx != dy) return dx < dy ? -1 : 1;
+	if(x->release != y->release) return x->release < y->release ? -1 : 1;
+	return x->task - y->task;
+}
+static int buildJobs(long hyper)
+{
+	nJobs = 0;
+	for(int i=0;i<nTasks;i++)
+	{
+		for(int k=0;k<hyper/tasks[i].period;k++)
+		{
+			if(nJobs == MAX_JOBS) return -1;
+			Job *j = &jobs[nJobs];
+			j->task = i;
+			j->k = k;
+			j->release = k*tasks[i].period*1000;
+			j->deadline = j->release + tasks[i].deadline*1000;
+			//first frame starting at or after the release, last frame ending by the deadline
+			j->lo = (j->release + frameUs - 1)/frameUs;
+			j->hi = j->deadline/frameUs - 1;
+			j->frame = -1;
+			order[nJobs] = nJobs;
+			nJobs++;
+		}
+	}
+	qsort(order,nJobs,sizeof(int),jobCompare);
+	return 0;
+}
+static int predecessorFrame(const Job *j)
+{
+	int p = tasks[j->task].after;
+	if(p < 0) return -1;
+	for(int i=0;i<nJobs;i++)
+	{
+		if(jobs[i].task == p && jobs[i].k == j->k) return jobs[i].frame;
+	}
+	return -1;
+}
+static void search(int depth, long peak)
+{
+	if(++nodes > NODE_LIMIT || peak >= bestPeak) return;
+	if(depth == nJobs)
+	{
+		bestPeak = peak;
+		for(int i=0;i<nJobs;i++) best[i] = jobs[i].frame;
+		return;
+	}
+	Job *j = &jobs[order[depth]];
+	long e = tasks[j->task].wcet;
+	int lo = j->lo;
+	int pf = predecessorFrame(j);
+	if(pf > lo) lo = pf;
+	//least loaded frame first, the first leaf is then a balanced greedy schedule
+	int tried[j->hi - lo + 2];
+	int nTried = 0;
+	for(int n=lo;n<=j->hi;n++)
+	{
+		if(load[n] + e <= frameUs) tried[nTried++] = n;
+	}
+	for(int a=1;a<nTried;a++)
+	{
+		int v = tried[a], b = a;
+		while(b > 0 && load[tried[b-1]] > load[v])
+		{
+			tried[b] = tried[b-1];
+			b--;
+		}
+		tried[b] = v;
+	}
+	for(int a=0;a<nTried;a++)
+	{
+		int n = tried[a];
+		load[n] += e;
+		j->frame = n;
+		search(depth+1, load[n] > peak ? load[n] : peak);
+		load[n] -= e;
+		j->frame = -1;
+	}
+}
+//jobs of a frame in the order they run
+static int frameJobs(int n, int *list)
+{
+	int count = 0;
+	for(int i=0;i<nJobs;i++)
+	{
+		if(jobs[i].frame != n) continue;
+		int b = count;
+		while(b > 0 && tasks[jobs[list[b-1]].task].prio > tasks[jobs[i].task].prio)
+		{
+			list[b] = list[b-1];
+			b--;
+		}
+		list[b] = i;
+		count++;
+	}
+	return count;
+}
+//independent check of the placed schedule, returns the number of violations
+static int verify(int quiet)
+{
+	int bad = 0;
+	int list[MAX_TASKS];
+	for(int i=0;i<nJobs;i++)
+	{
+		if(jobs[i].frame < 0 || jobs[i].frame >= nFrames)
+		{
+			fprintf(stderr,"  %s job %d is not placed\n",tasks[jobs[i].task].name,jobs[i].k);
+			bad++;
+		}
+	}
+	for(int n=0;n<nFrames;n++)
+	{
+		long start = n*frameUs;
+		long t = start;
+		int count = frameJobs(n,list);
+		int seen[MAX_TASKS] = {0};
+		for(int c=0;c<count;c++)
+		{
+			Job *j = &jobs[list[c]];
+			Task *task = &tasks[j->task];
+			t += task->wcet;
+			if(seen[j->task]++)
+			{
+				fprintf(stderr,"  frame %d: %s twice\n",n,task->name);
+				bad++;
+			}
+			if(j->release > start)
+			{
+				fprintf(stderr,"  frame %d: %s job %d released at %ldus, before its period point\n",n,task->name,j->k,j->release);
+				bad++;
+			}
+			if(t > j->release + task->deadline*1000)
+			{
+				fprintf(stderr,"  frame %d: %s job %d finishes at %ldus, deadline %ldus\n",n,task->name,j->k,t,j->release + task->deadline*1000);
+				bad++;
+			}
+			if(task->after >= 0)
+			{
+				int pf = predecessorFrame(j);
+				int ok = pf >= 0 && pf <= n;
+				for(int c2=c+1;ok && c2<count;c2++)
+				{
+					if(jobs[list[c2]].task == task->after) ok = 0;
+				}
+				if(!ok)
+				{
+					fprintf(stderr,"  frame %d: %s job %d runs before %s\n",n,task->name,j->k,tasks[task->after].name);
+					bad++;
+				}
+			}
+		}
+		if(t - start > frameUs)
+		{
+			fprintf(stderr,"  frame %d overflows by %ldus\n",n,t - start - frameUs);
+			bad++;
+		}
+	}
+	if(!quiet) fprintf(stderr,"verified %d jobs in %d frames: %d violations\n",nJobs,nFrames,bad);
+	return bad;
+}
+static void report(long hyper)
+{
+	double u = 0;
+	for(int i=0;i<nTasks;i++) u += (double)tasks[i].wcet/(tasks[i].period*1000);
+	fprintf(stderr,"frame %ldms, %d frames, hyperperiod %ldms, utilisation %.1f%%\n",frameUs/1000,nFrames,hyper,u*100);
+	int list[MAX_TASKS];
+	long minSlack = frameUs;
+	for(int n=0;n<nFrames;n++)
+	{
+		int count = frameJobs(n,list);
+		long busy = 0;
+		fprintf(stderr,"  frame %3d @%6ldms ",n,n*frameUs/1000);
+		for(int c=0;c<count;c++)
+		{
+			busy += tasks[jobs[list[c]].task].wcet;
+			fprintf(stderr," %s",tasks[jobs[list[c]].task].name);
+		}
+		fprintf(stderr,"%*s load %5.1f%% slack %ldus\n",count ? 1 : 3,"",100.0*busy/frameUs,frameUs - busy);
+		if(frameUs - busy < minSlack) minSlack = frameUs - busy;
+	}
+	fprintf(stderr,"minimum slack %ldus\n",minSlack);
+}
+static void emit(FILE *out, const char *src, long hyper)
+{
+	int list[MAX_TASKS];
+	fprintf(out,"/*\n * schedule_table.c\n *\n *  Generated by Tools/schedgen.c from %s, do not edit.\n",src);
+	fprintf(out," *  frame %ldms, %d frames, hyperperiod %ldms\n */\n\n",frameUs/1000,nFrames,hyper);
+	fprintf(out,"#include \"cyclic.h\"\n#include \"sensor_config.h\"\n\n");
+	fprintf(out,"#if %d > TASKS_MAX\n#error \"the table has more tasks than the scheduler\"\n#endif\n",nTasks);
+	fprintf(out,"static const Frame_Run schedule_runs[] =\n{\n");
+	int nRuns = 0;
+	unsigned mask = 0, repeat = 0;
+	for(int n=0;n<=nFrames;n++)
+	{
+		unsigned m = 0;
+		if(n < nFrames)
+		{
+			int count = frameJobs(n,list);
+			for(int c=0;c<count;c++) m |= 1u << tasks[jobs[list[c]].task].prio;
+		}
+		//identical neighbours share one run, up to MAX_RUN_REPEAT frames
+		if(n > 0 && (n == nFrames || m != mask || repeat == 255))
+		{
+			fprintf(out,"\t{0x%02x, %u},\n",mask,repeat);
+			nRuns++;
+			repeat = 0;
+		}
+		mask = m;
+		repeat++;
+	}
+	fprintf(out,"};\n");
+	fprintf(out,"const Schedule_Table schedule_table = {schedule_runs, %d, {",nRuns);
+	for(int p=0;p<nTasks;p++)
+	{
+		for(int i=0;i<nTasks;i++)
+		{
+			if(tasks[i].prio == p) fprintf(out,"%s%s",p ? ", " : "",tasks[i].code);
+		}
+	}
+	fprintf(out,"}, %ld, %ld, %d, 1};\n",hyper,frameUs/1000,nFrames);
+}
+int main(int argc, char **argv)
+{
+	long fixedFrame = 0, maxFrame = TIM1_MAX_FRAME, maxFrames = 0;
+	const char *outPath = NULL, *src = NULL;
+	for(int i=1;i<argc;i++)
+	{
+		if(strcmp(argv[i],"-f") == 0 && i+1 < argc) fixedFrame = atol(argv[++i]);
+		else if(strcmp(argv[i],"-m") == 0 && i+1 < argc) maxFrame = atol(argv[++i]);
+		else if(strcmp(argv[i],"-n") == 0 && i+1 < argc) maxFrames = atol(argv[++i]);
+		else if(strcmp(argv[i],"-o") == 0 && i+1 < argc) outPath = argv[++i];
+		else src = argv[i];
+	}
+	if(!src)
+	{
+		fprintf(stderr,"usage: %s [-f frame] [-m max frame] [-n max frames] [-o out.c] tasks.txt\n",argv[0]);
+		return 2;
+	}
+	if(readTasks(src) < 0) return 1;
+	long hyper = tasks[0].period;
+	for(int i=1;i<nTasks;i++) hyper = hyper/gcdl(hyper,tasks[i].period)*tasks[i].period;
+
+	long bestFrame = 0;
+	long bestSlack = 0;
+	int bestProven = 0;
+	int *bestFrames = malloc(sizeof(int)*MAX_JOBS);
+	//every divisor of the hyperperiod is a candidate, the largest feasible one wins a tie
+	for(long f=1;f<=hyper;f++)
+	{
+		if(hyper % f || (fixedFrame && f != fixedFrame)) continue;
+		const char *why = frameReject(f,hyper,maxFrame,maxFrames);
+		if(why)
+		{
+			if(f <= maxFrame || f == fixedFrame) fprintf(stderr,"frame %4ldms: %s\n",f,why);
+			continue;
+		}
+		if(hyper/f > MAX_FRAMES)
+		{
+			fprintf(stderr,"frame %4ldms: more than %d frames\n",f,MAX_FRAMES);
+			continue;
+		}
+		frameUs = f*1000;
+		nFrames = hyper/f;
+		if(buildJobs(hyper) < 0)
+		{
+			fprintf(stderr,"frame %4ldms: more than %d jobs\n",f,MAX_JOBS);
+			continue;
+		}
+		memset(load,0,sizeof(load));
+		bestPeak = frameUs + 1;
+		nodes = 0;
+		search(0,0);
+		if(bestPeak > frameUs)
+		{
+			fprintf(stderr,"frame %4ldms: no placement%s\n",f,nodes > NODE_LIMIT ? " found before the search limit" : " exists");
+			continue;
+		}
+		//compare frames by the slack left in the fullest one
+		long slack = frameUs - bestPeak;
+		fprintf(stderr,"frame %4ldms: feasible, peak load %.1f%%, min slack %ldus%s\n",f,100.0*bestPeak/frameUs,slack,nodes > NODE_LIMIT ? " (search limit hit)" : " (optimal)");
+		if(bestFrame == 0 || slack >= bestSlack)
+		{
+			bestFrame = f;
+			bestSlack = slack;
+			bestProven = nodes <= NODE_LIMIT;
+			memcpy(bestFrames,best,sizeof(int)*nJobs);
+		}
+	}
+	if(bestFrame == 0)
+	{
+		fprintf(stderr,"no cyclic schedule for this task set\n");
+		return 1;
+	}
+	frameUs = bestFrame*1000;
+	nFrames = hyper/bestFrame;
+	buildJobs(hyper);
+	for(int i=0;i<nJobs;i++) jobs[i].frame = bestFrames[i];
+	fprintf(stderr,"\nchosen: %s\n",bestProven ? "optimal for its frame size" : "feasible, not proven optimal");
+	report(hyper);
+	if(verify(0)) return 1;
+
+	FILE *out = outPath ? fopen(outPath,"w") : stdout;
+	if(!out)
+	{
+		perror(outPath);
+		return 1;
+	}
+	emit(out,src,hyper);
+	if(outPath) fclose(out);
+	free(bestFrames);
+	return 0;
+}
@@ -0,0 +1,456 @@
+/*
+ * stackcheck.c
+ *
+ *  Static worst case stack and RAM budget. Frames come from the -fstack-usage
+ *  .su files the build already writes, the call graph from the disassembly
+ *  CubeIDE puts next to the elf (project.list, or arm-none-eabi-objdump -h -d).
+ *  Functions without a .su entry (newlib, the AI runtime, assembly) get their
+ *  frame from the prologue (push/vpush/sub sp), marked '~'.
+ *
+ *  Roots: main, every *_Handler and *_IRQHandler nobody calls, and the tasks. Tasks are only
+ *  called through pointers, so the indirect calls of the dispatchers (-i,
+ *  default runTask, serveAperiodic, task_scheduler) count as calls to every
+ *  task root: functions named task*, *_Step, *_Poll, *_Drain and any -t name.
+ *  Other indirect calls, recursion and dynamic frames (VLAs, alloca) are
+ *  listed; give a dynamic frame its bound with -d name=bytes.
+ *
+ *  The budget follows the layout of Core/Src/stackmon.c: thread mode (main and
+ *  the tasks) on the stack under _estack, the handlers on their own
+ *  STACK_ISR_SIZE stack in RAM2 (-H, default 2048). An exception pushes its
+ *  104 byte FPU frame on the stack that was in use, so the first one lands on
+ *  the thread stack and only nested ones on the handler stack.
+ *
+ *  build: cc -O2 -o stackcheck Tools/stackcheck.c
+ *  run:   ./stackcheck [-l STM32L475VGTX_FLASH.ld] [-H isr stack] [-d fn=bytes]
+ *                      [-t task] [-i dispatcher] [-v] Debug/project.list $(find Debug -name '*.su')
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define NAME_SIZE 96
+#define MAX_LIST 32
+#define EXCEPTION_FRAME 104 //8 core + 18 fpu words, lazy stacking reserves it anyway
+
+typedef struct{
+	char name[NAME_SIZE];
+	long frame;
+	int known; //frame from a .su file
+	int dynamic;
+	int indirect; //calls through a register
+	int called; //somebody calls it directly
+	int *callees;
+	int n_callees;
+	int cap_callees;
+	//search state
+	int state; //0 new, 1 on the path, 2 done
+	int recursive;
+	long depth;
+	int next; //callee on the deepest path, -1 at a leaf
+} Function;
+
+static Function *funcs;
+static int n_funcs = 0, cap_funcs = 0;
+static const char *taskNames[MAX_LIST];
+static int n_taskNames = 0;
+static const char *dispatchers[MAX_LIST] = {"runTask", "serveAperiodic", "task_scheduler"};
+static int n_dispatchers = 3;
+static int verbose = 0;
+
+static int find(const char *name)
+{
+	for(int i=0;i<n_funcs;i++) if(strcmp(funcs[i].name, name) == 0) return i;
+	return -1;
+}
+static int intern(const char *name)
+{
+	int i = find(name);
+	if(i >= 0) return i;
+	if(n_funcs == cap_funcs)
+	{
+		cap_funcs = cap_funcs ? cap_funcs*2 : 1024;
+		funcs = realloc(funcs, cap_funcs*sizeof(Function));
+	}
+	Function *f = &funcs[n_funcs];
+	memset(f, 0, sizeof(*f));
+	snprintf(f->name, NAME_SIZE, "%s", name);
+	f->next = -1;
+	return n_funcs++;
+}
+static void addCall(int from, int to)
+{
+	Function *f = &funcs[from];
+	for(int i=0;i<f->n_callees;i++) if(f->callees[i] == to) return;
+	if(f->n_callees == f->cap_callees)
+	{
+		f->cap_callees = f->cap_callees ? f->cap_callees*2 : 8;
+		f->callees = realloc(f->callees, f->cap_callees*sizeof(int));
+	}
+	f->callees[f->n_callees++] = to;
+	funcs[to].called = 1;
+}
+static int endsWith(const char *s, const char *suffix)
+{
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s+n-m, suffix) == 0;
+}
+static int isTask(const char *name)
+{
+	for(int i=0;i<n_taskNames;i++) if(strcmp(name, taskNames[i]) == 0) return 1;
+	return strncmp(name, "task", 4) == 0 || endsWith(name, "_Step") || endsWith(name, "_Poll") || endsWith(name, "_Drain");
+}
+static int isHandler(const char *name)
+{
+	return endsWith(name, "_Handler") || endsWith(name, "_IRQHandler");
+}
+static int isDispatcher(const char *name)
+{
+	for(int i=0;i<n_dispatchers;i++) if(strcmp(name, dispatchers[i]) == 0) return 1;
+	return 0;
+}
+
+//../Core/Src/wifi.c:16:6:WIFI_DEBUG	3088	static
+static void readSu(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	char line[512];
+	while(fgets(line, sizeof(line), f))
+	{
+		char *tab = strchr(line, '\t');
+		if(tab == NULL) continue;
+		*tab = '\0';
+		char *name = strrchr(line, ':');
+		name = name ? name+1 : line;
+		long bytes = 0;
+		char kind[32] = "";
+		if(sscanf(tab+1, "%ld %31s", &bytes, kind) < 1) continue;
+		int k = intern(name);
+		Function *fn = &funcs[k];
+		//static functions of the same name in two files: keep the larger
+		if(!fn->known || bytes > fn->frame) fn->frame = bytes;
+		fn->known = 1;
+		if(strncmp(kind, "dynamic", 7) == 0 && strcmp(kind, "dynamic,bounded") != 0) fn->dynamic = 1;
+	}
+	fclose(f);
+}
+//register count of "{r4, r5, r6, lr}" or "{d8-d11}"
+static int regCount(const char *list)
+{
+	int n = 0;
+	const char *p = strchr(list, '{');
+	if(p == NULL) return 0;
+	for(p++;*p && *p != '}';)
+	{
+		while(*p == ' ' || *p == ',') p++;
+		if(!isalpha((unsigned char)*p)) break;
+		int a = 0, b = -1;
+		if(isdigit((unsigned char)p[1])) a = atoi(p+1);
+		while(*p && *p != ',' && *p != '-' && *p != '}') p++;
+		if(*p == '-')
+		{
+			p++;
+			if(isalpha((unsigned char)*p)) p++;
+			b = atoi(p);
+			while(*p && *p != ',' && *p != '}') p++;
+		}
+		n += b >= a ? b-a+1 : 1;
+	}
+	return n;
+}
+static void readList(const char *path, long *sections, char sectionNames[][32], int *n_sections)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	char line[512];
+	int cur = -1;
+	int prologue = 0; //still in the first instructions of cur
+	long guess = 0;
+	while(fgets(line, sizeof(line), f))
+	{
+		char name[NAME_SIZE];
+		unsigned long addr, size, vma;
+		int idx;
+		//section table: " 8 .data 000001dc 20000000 ..."
+		if(sscanf(line, " %d %31s %lx %lx", &idx, sectionNames[*n_sections], &size, &vma) == 4 && sectionNames[*n_sections][0] == '.')
+		{
+			sections[2*(*n_sections)] = size;
+			sections[2*(*n_sections)+1] = vma;
+			(*n_sections)++;
+			continue;
+		}
+		if(sscanf(line, "%lx <%95[^>]>:", &addr, name) == 2 && strchr(line, '\t') == NULL)
+		{
+			if(cur >= 0 && !funcs[cur].known) funcs[cur].frame = guess;
+			cur = intern(name);
+			prologue = 1;
+			guess = 0;
+			continue;
+		}
+		if(cur < 0) continue;
+		//" 80047ba:	47c0      	blx	r8"
+		char *t1 = strchr(line, '\t');
+		if(t1 == NULL || strchr(line, ':') == NULL || strchr(line, ':') > t1) continue;
+		char *t2 = strchr(t1+1, '\t');
+		if(t2 == NULL) continue;
+		char op[16] = "";
+		sscanf(t2+1, "%15s", op);
+		char *args = t2+1+strlen(op);
+		char *target = strchr(args, '<');
+		if(prologue)
+		{
+			if(strcmp(op, "push") == 0 || strcmp(op, "push.w") == 0 || strncmp(op, "stmdb", 5) == 0) guess += 4*regCount(args);
+			else if(strcmp(op, "vpush") == 0) guess += 8*regCount(args);
+			else if(strncmp(op, "sub", 3) == 0 && strstr(args, "sp") == args+strspn(args, " \t") && strchr(args, '#')) guess += strtol(strchr(args, '#')+1, NULL, 0);
+			else if(op[0] == 'b') prologue = 0;
+		}
+		int call = strcmp(op, "bl") == 0 || strcmp(op, "blx") == 0;
+		int tail = strcmp(op, "b.w") == 0 || strcmp(op, "b") == 0 || strcmp(op, "b.n") == 0;
+		if(strcmp(op, "blx") == 0 && target == NULL)
+		{
+			funcs[cur].indirect = 1;
+			continue;
+		}
+		if((call || tail) && target != NULL)
+		{
+			char callee[NAME_SIZE];
+			if(sscanf(target, "<%95[^>]>", callee) != 1) continue;
+			//<fn+0x1c> is a branch inside a function
+			if(strchr(callee, '+') != NULL) continue;
+			if(tail && strcmp(callee, funcs[cur].name) == 0) continue;
+			addCall(cur, intern(callee));
+		}
+	}
+	if(cur >= 0 && !funcs[cur].known) funcs[cur].frame = guess;
+	fclose(f);
+}
+static long depth(int i)
+{
+	Function *f = &funcs[i];
+	if(f->state == 2) return f->depth;
+	if(f->state == 1)
+	{
+		f->recursive = 1;
+		return 0;
+	}
+	f->state = 1;
+	long best = 0;
+	f->next = -1;
+	for(int k=0;k<f->n_callees;k++)
+	{
+		long d = depth(f->callees[k]);
+		if(d > best || f->next < 0)
+		{
+			best = d;
+			f->next = f->callees[k];
+		}
+	}
+	if(f->indirect && isDispatcher(f->name))
+	{
+		for(int k=0;k<n_funcs;k++)
+		{
+			if(!isTask(funcs[k].name) || k == i) continue;
+			long d = depth(k);
+			if(d > best)
+			{
+				best = d;
+				f->next = k;
+			}
+		}
+	}
+	f->state = 2;
+	f->depth = f->frame + best;
+	return f->depth;
+}
+static void printPath(int i)
+{
+	int n = 0;
+	for(;i>=0 && n<40;i=funcs[i].next,n++)
+	{
+		printf("%s%s(%s%ld)", n ? " > " : "", funcs[i].name, funcs[i].known ? "" : "~", funcs[i].frame);
+	}
+	printf("\n");
+}
+static long parseSize(const char *s)
+{
+	char *end;
+	long v = strtol(s, &end, 0);
+	while(*end == ' ') end++;
+	if(*end == 'K' || *end == 'k') v *= 1024;
+	if(*end == 'M' || *end == 'm') v *= 1024*1024;
+	return v;
+}
+//MEMORY lines and the _Min_*_Size symbols of the linker script
+static void readLd(const char *path, char names[][16], long *origin, long *length, int *n, long *minHeap, long *minStack)
+{
+	FILE *f = fopen(path, "r");
+	if(f == NULL)
+	{
+		perror(path);
+		exit(1);
+	}
+	char line[256];
+	while(fgets(line, sizeof(line), f))
+	{
+		char *o = strstr(line, "ORIGIN ="), *l = strstr(line, "LENGTH =");
+		if(o != NULL && l != NULL && *n < 8)
+		{
+			sscanf(line, " %15s", names[*n]);
+			origin[*n] = strtol(o+8, NULL, 0);
+			char len[32];
+			sscanf(l+8, " %31[0-9xXa-fA-FKkMm]", len);
+			length[*n] = parseSize(len);
+			(*n)++;
+		}
+		char *h = strstr(line, "_Min_Heap_Size =");
+		if(h) *minHeap = strtol(h+16, NULL, 0);
+		char *s = strstr(line, "_Min_Stack_Size =");
+		if(s) *minStack = strtol(s+17, NULL, 0);
+	}
+	fclose(f);
+}
+int main(int argc, char **argv)
+{
+	const char *ld = "STM32L475VGTX_FLASH.ld";
+	long isrStack = 2048;
+	const char *bounds[MAX_LIST];
+	int n_bounds = 0;
+	int opt;
+	int customDispatchers = 0;
+	while((opt = getopt(argc, argv, "l:H:d:t:i:v")) != -1)
+	{
+		switch(opt)
+		{
+		case 'l': ld = optarg; break;
+		case 'H': isrStack = strtol(optarg, NULL, 0); break;
+		case 'd': if(n_bounds < MAX_LIST) bounds[n_bounds++] = optarg; break;
+		case 't': if(n_taskNames < MAX_LIST) taskNames[n_taskNames++] = optarg; break;
+		case 'i':
+			if(!customDispatchers) n_dispatchers = 0;
+			customDispatchers = 1;
+			if(n_dispatchers < MAX_LIST) dispatchers[n_dispatchers++] = optarg;
+			break;
+		case 'v': verbose = 1; break;
+		default:
+			fprintf(stderr, "usage: %s [-l ld] [-H isr stack] [-d fn=bytes] [-t task] [-i dispatcher] [-v] project.list file.su...\n", argv[0]);
+			return 2;
+		}
+	}
+	if(optind >= argc)
+	{
+		fprintf(stderr, "no listing given\n");
+		return 2;
+	}
+	const char *list = argv[optind++];
+	int n_su = argc - optind;
+	for(;optind<argc;optind++) readSu(argv[optind]);
+	static long sections[2*64];
+	static char sectionNames[64][32];
+	int n_sections = 0;
+	readList(list, sections, sectionNames, &n_sections);
+	for(int i=0;i<n_bounds;i++)
+	{
+		char name[NAME_SIZE];
+		long bytes;
+		if(sscanf(bounds[i], "%95[^=]=%ld", name, &bytes) != 2 || find(name) < 0)
+		{
+			fprintf(stderr, "-d %s: no such function\n", bounds[i]);
+			continue;
+		}
+		Function *f = &funcs[find(name)];
+		f->frame += bytes;
+		f->dynamic = 0;
+	}
+
+	printf("worst case stack, %s and %d .su files ('~': frame from the prologue)\n\n", list, n_su);
+	int main_ = find("main");
+	long mainDepth = main_ >= 0 ? depth(main_) : 0;
+	if(main_ >= 0)
+	{
+		printf("main %ld B\n  ", mainDepth);
+		printPath(main_);
+	}
+	printf("\ntasks\n");
+	for(int i=0;i<n_funcs;i++)
+	{
+		if(!isTask(funcs[i].name) || funcs[i].n_callees+funcs[i].known == 0) continue;
+		printf("  %-28s %6ld B  ", funcs[i].name, depth(i));
+		if(verbose) printPath(i);
+		else printf("\n");
+	}
+	printf("\nhandlers\n");
+	long isrMax = 0, isrSum = 0;
+	for(int i=0;i<n_funcs;i++)
+	{
+		//vector entries only: the HAL_*_IRQHandler run inside them, Reset_Handler is thread mode
+		if(!isHandler(funcs[i].name) || funcs[i].called || strncmp(funcs[i].name, "HAL_", 4) == 0 || strcmp(funcs[i].name, "Reset_Handler") == 0) continue;
+		long d = depth(i);
+		printf("  %-28s %6ld B  ", funcs[i].name, d);
+		if(verbose) printPath(i);
+		else printf("\n");
+		if(d > isrMax) isrMax = d;
+		isrSum += d + EXCEPTION_FRAME;
+	}
+	printf("\nnot covered\n");
+	for(int i=0;i<n_funcs;i++)
+	{
+		Function *f = &funcs[i];
+		if(f->state != 2) continue; //unreachable from the roots
+		if(f->dynamic) printf("  %-28s dynamic frame, %ld B counted (bound it with -d)\n", f->name, f->frame);
+		if(f->recursive) printf("  %-28s recursive, one level counted\n", f->name);
+		if(f->indirect && !isDispatcher(f->name)) printf("  %-28s calls through a pointer\n", f->name);
+	}
+
+	char memNames[8][16];
+	long origin[8], length[8], minHeap = 0, minStack = 0;
+	int n_mem = 0;
+	readLd(ld, memNames, origin, length, &n_mem, &minHeap, &minStack);
+	printf("\nRAM budget, %s\n", ld);
+	int bad = 0;
+	for(int m=0;m<n_mem;m++)
+	{
+		if((origin[m] & 0xFF000000) == 0x08000000) continue; //flash
+		long used = 0;
+		printf("  %s %ldK at 0x%08lx\n", memNames[m], length[m]/1024, origin[m]);
+		for(int s=0;s<n_sections;s++)
+		{
+			long size = sections[2*s], vma = sections[2*s+1];
+			if(size == 0 || vma < origin[m] || vma >= origin[m]+length[m]) continue;
+			//the linker's heap+stack reservation is replaced by the figures below
+			if(strcmp(sectionNames[s], "._user_heap_stack") == 0) continue;
+			printf("    %-24s %7ld B\n", sectionNames[s], size);
+			used += size;
+		}
+		if(origin[m] == 0x20000000)
+		{
+			long thread = mainDepth + EXCEPTION_FRAME;
+			long free = length[m] - used - minHeap - thread;
+			//the first exception's frame is on the thread stack
+			long nested = isrSum - EXCEPTION_FRAME;
+			printf("    %-24s %7ld B  (_Min_Heap_Size)\n", "heap", minHeap);
+			printf("    %-24s %7ld B  (main + exception frame, _Min_Stack_Size %ld%s)\n", "thread stack", thread,
+					minStack, thread > minStack ? ", raise it" : "");
+			printf("    %-24s %7ld B  %s\n", "left", free, free < 0 ? "OVERFLOW" : "");
+			printf("    handler stack %ld B in RAM2: deepest handler %ld B, all nested %ld B%s\n", isrStack, isrMax, nested,
+					isrMax > isrStack ? " OVERFLOW" : nested > isrStack ? " (only if every handler preempts the next)" : "");
+			bad |= free < 0 || isrMax > isrStack;
+		}
+		else
+		{
+			printf("    %-24s %7ld B\n", "left", length[m] - used);
+			bad |= length[m] - used < 0;
+		}
+	}
+	return bad;
+}
@@ -0,0 +1,194 @@
+/*
+ * trace2json.c
+ *
+ *  Turns a scheduler trace dump (Core/Inc/trace.h) into Chrome trace JSON,
+ *  for chrome://tracing or ui.perfetto.dev. The input is a uart capture or
+ *  the output of remote_ctl after "trace wifi"; lines that aren't TC/TN/TA/TR
+ *  are skipped, so the rest of the log can stay in. Every TC line starts a
+ *  new dump, shown as a process of its own.
+ *
+ *  Tracks: tasks, slack (idle tasks and aperiodic jobs), isr, wifi (one span
+ *  per AT command, named by its first two characters), inference (one span
+ *  per layer). Ticks and overruns are instant events on the tasks track.
+ *  The 32 bit cycle counter is unwrapped, so a dump may span any time as
+ *  long as no gap between two records is longer than one wrap (53s at 80MHz).
+ *  A span whose start was overwritten in the ring is dropped.
+ *
+ *  build: cc -O2 -o trace2json Tools/trace2json.c
+ *  run:   ./trace2json [capture.txt] > trace.json
+ */
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//enum Trace_Event in trace.h
+enum { TICK, TASK_START, TASK_STOP, ISR_ENTER, ISR_EXIT, WIFI_START, WIFI_END,
+	INFER_START, INFER_END, SLACK_START, SLACK_END, OVERRUN };
+#define APERIODIC 0x80
+
+enum { TRACK_TASKS = 1, TRACK_SLACK, TRACK_ISR, TRACK_WIFI, TRACK_INFER, TRACKS };
+static const char *trackName[TRACKS] = {"", "tasks", "slack", "isr", "wifi", "inference"};
+
+static char taskName[256][32];
+static char aperiodicName[128][32];
+static double hz = 80e6;
+static int dump = 0;
+static int first = 1;
+static uint32_t lastCycles;
+static int fresh;
+static uint64_t now;
+//open span start per track and id, -1 when none
+static double openTs[TRACKS][256];
+
+static void emit(const char *fmt, ...)
+{
+	va_list args;
+	printf(first ? "\n" : ",\n");
+	first = 0;
+	va_start(args, fmt);
+	vprintf(fmt, args);
+	va_end(args);
+}
+static const char *irqName(int irq)
+{
+	switch(irq)
+	{
+	case 7: return "EXTI1";
+	case 23: return "EXTI9_5";
+	case 25: return "TIM1_UP_TIM16";
+	case 28: return "TIM2";
+	case 40: return "EXTI15_10";
+	}
+	return NULL;
+}
+static void spanName(int track, int id, int arg, char *out, size_t size)
+{
+	switch(track)
+	{
+	case TRACK_TASKS:
+		if(taskName[id][0]) snprintf(out, size, "%s", taskName[id]);
+		else snprintf(out, size, "task %d", id);
+		break;
+	case TRACK_SLACK:
+		if(id & APERIODIC)
+		{
+			if(aperiodicName[id & 0x7f][0]) snprintf(out, size, "%s", aperiodicName[id & 0x7f]);
+			else snprintf(out, size, "aperiodic %d", id & 0x7f);
+		}
+		else snprintf(out, size, "idle %d", id);
+		break;
+	case TRACK_ISR:
+		if(irqName(id)) snprintf(out, size, "%s", irqName(id));
+		else snprintf(out, size, "irq %d", id);
+		break;
+	case TRACK_WIFI:
+		snprintf(out, size, "AT %c%c", arg>>8 >= ' ' ? arg>>8 : '?', (arg&0xff) >= ' ' ? arg&0xff : '?');
+		break;
+	default:
+		snprintf(out, size, "layer %d", id);
+		break;
+	}
+}
+static void newDump(double clock)
+{
+	hz = clock;
+	dump++;
+	now = 0;
+	fresh = 1;
+	for(int t=0;t<TRACKS;t++)
+		for(int i=0;i<256;i++)
+			openTs[t][i] = -1;
+	emit("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"dump %d\"}}", dump, dump);
+	for(int t=1;t<TRACKS;t++)
+	{
+		emit("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", dump, t, trackName[t]);
+		emit("{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"sort_index\":%d}}", dump, t, t);
+	}
+}
+static void record(uint32_t cycles, int event, int id, int arg)
+{
+	if(dump == 0) newDump(hz);
+	//first record of a dump is time 0
+	if(fresh) lastCycles = cycles;
+	fresh = 0;
+	now += (uint32_t)(cycles - lastCycles);
+	lastCycles = cycles;
+	double ts = now * 1e6 / hz;
+	int track = 0, start = 0;
+	switch(event)
+	{
+	case TICK:
+		emit("{\"name\":\"tick\",\"ph\":\"i\",\"s\":\"p\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"minor\":%d}}", dump, TRACK_TASKS, ts, arg);
+		return;
+	case OVERRUN:
+		emit("{\"name\":\"overrun\",\"ph\":\"i\",\"s\":\"p\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"late_us\":%d}}", dump, TRACK_TASKS, ts, arg);
+		return;
+	case TASK_START: start = 1; /* fall through */
+	case TASK_STOP: track = TRACK_TASKS; break;
+	case SLACK_START: start = 1; /* fall through */
+	case SLACK_END: track = TRACK_SLACK; break;
+	case ISR_ENTER: start = 1; /* fall through */
+	case ISR_EXIT: track = TRACK_ISR; break;
+	case WIFI_START: start = 1; /* fall through */
+	case WIFI_END: track = TRACK_WIFI; break;
+	case INFER_START: start = 1; /* fall through */
+	case INFER_END: track = TRACK_INFER; break;
+	default:
+		fprintf(stderr, "unknown event %d\n", event);
+		return;
+	}
+	if(start)
+	{
+		openTs[track][id] = ts;
+		return;
+	}
+	if(openTs[track][id] < 0) return;
+	char name[48];
+	spanName(track, id, arg, name, sizeof(name));
+	emit("{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+			name, trackName[track], dump, track, openTs[track][id], ts - openTs[track][id]);
+	openTs[track][id] = -1;
+}
+int main(int argc, char **argv)
+{
+	FILE *in = argc > 1 ? fopen(argv[1], "r") : stdin;
+	if(in == NULL)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	char line[256];
+	unsigned long clock, cycles;
+	unsigned int event, id, arg;
+	int code, n, records = 0;
+	printf("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	while(fgets(line, sizeof(line), in))
+	{
+		char *p = line;
+		//a tag starts the line, leading blanks are tolerated
+		while(*p == ' ' || *p == '\t') p++;
+		if(sscanf(p, "TR %lx %x %x %x", &cycles, &event, &id, &arg) == 4)
+		{
+			record(cycles, event, id & 0xff, arg & 0xffff);
+			records++;
+		}
+		else if(sscanf(p, "TC %lu", &clock) == 1 && clock > 0)
+		{
+			newDump(clock);
+		}
+		else if(sscanf(p, "TN %d %n", &code, &n) == 1 && code >= 0 && code < 256)
+		{
+			snprintf(taskName[code], sizeof(taskName[code]), "%.*s", (int)strcspn(p+n, "\r\n\""), p+n);
+		}
+		else if(sscanf(p, "TA %d %n", &code, &n) == 1 && code >= 0 && code < 128)
+		{
+			snprintf(aperiodicName[code], sizeof(aperiodicName[code]), "%.*s", (int)strcspn(p+n, "\r\n\""), p+n);
+		}
+	}
+	printf("\n]}\n");
+	fprintf(stderr, "%d records in %d dump(s)\n", records, dump);
+	return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * ts_bench.c
+ *
+ *  Host benchmark for Core/Src/tscompress.c: encodes synthetic series shaped
+ *  like the node's readings in TSC_BLOCK_SIZE blocks, decodes them back,
+ *  checks the round trip and prints bytes/sample and ns/sample for both
+ *  directions. The ASCII baseline is the old uplink: 4 byte length + "%010.4f".
+ *
+ *  build: cc -O2 -ICore/Inc -o ts_bench Tools/ts_bench.c Core/Src/tscompress.c -lm
+ *  run:   ./ts_bench [samples]        (default 200000 per series)
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "tscompress.h"
+
+#define TSC_BLOCK_SIZE 512
+
+typedef struct{
+	const char *name;
+	uint32_t periodMs;
+	float quantum;
+} Series;
+
+static uint32_t rng = 12345;
+static float uniform(void)
+{
+	rng = rng*1664525u + 1013904223u;
+	return (rng >> 8) / 16777216.0f;
+}
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+//readings as the tasks produce them: temperature/humidity are slow random walks
+//read through the sensor's resolution, accel is whole mg from the BSP
+static void generate(int kind, uint32_t period, uint32_t *t, float *v, int n)
+{
+	float level = kind == 0 ? 24.0f : 55.0f;
+	uint32_t tick = 1000;
+	for(int i=0;i<n;i++)
+	{
+		//the scheduler runs on a 1ms tick, now and then a task slips by one
+		tick += period + (uniform() < 0.05f ? 1 : 0);
+		t[i] = tick;
+		if(kind == 2)
+		{
+			float walk = 350.0f*sinf(i*2.0f*3.14159f*1.8f*period/1000.0f);
+			v[i] = (float)(int)(walk + 30.0f*(uniform()-0.5f) + 1000.0f);
+		}
+		else
+		{
+			level += 0.02f*(uniform()-0.5f);
+			v[i] = level + 0.01f*(uniform()-0.5f);
+		}
+	}
+}
+static void run(const Series *s, int kind, int n)
+{
+	uint32_t *t = malloc(n*sizeof(*t));
+	float *v = malloc(n*sizeof(*v));
+	uint32_t *t2 = malloc(n*sizeof(*t2));
+	float *v2 = malloc(n*sizeof(*v2));
+	//blocks are at least 8 samples, so n/8 blocks bounds the storage
+	uint8_t *blocks = malloc((size_t)(n/8+1)*TSC_BLOCK_SIZE);
+	uint16_t *sizes = malloc((n/8+1)*sizeof(*sizes));
+	generate(kind, s->periodMs, t, v, n);
+
+	TSC_EncoderTypeDef enc;
+	int nBlocks = 0;
+	size_t bytes = 0;
+	double start = now();
+	TSC_EncoderInit(&enc, blocks, TSC_BLOCK_SIZE, s->quantum);
+	for(int i=0;i<n;i++)
+	{
+		if(TSC_Append(&enc, t[i], v[i]) != 0)
+		{
+			sizes[nBlocks] = TSC_Finish(&enc);
+			bytes += sizes[nBlocks++];
+			TSC_EncoderInit(&enc, blocks + (size_t)nBlocks*TSC_BLOCK_SIZE, TSC_BLOCK_SIZE, s->quantum);
+			TSC_Append(&enc, t[i], v[i]);
+		}
+	}
+	sizes[nBlocks] = TSC_Finish(&enc);
+	bytes += sizes[nBlocks++];
+	double encTime = now() - start;
+
+	int m = 0;
+	start = now();
+	for(int b=0;b<nBlocks;b++)
+	{
+		TSC_DecoderTypeDef dec;
+		TSC_DecoderInit(&dec, blocks + (size_t)b*TSC_BLOCK_SIZE, sizes[b]);
+		while(m < n && TSC_Next(&dec, &t2[m], &v2[m]) == 1) m++;
+	}
+	double decTime = now() - start;
+
+	int bad = m != n;
+	float maxErr = 0;
+	for(int i=0;i<m && !bad;i++)
+	{
+		float err = fabsf(v2[i]-v[i]);
+		if(err > maxErr) maxErr = err;
+		if(t2[i] != t[i]) bad = 1;
+		if(s->quantum == 0 && memcmp(&v2[i],&v[i],4) != 0) bad = 1;
+		if(s->quantum > 0 && err > s->quantum*0.5f + fabsf(v[i])*1e-6f) bad = 1;
+	}
+	printf("%-22s %8.3f B/sample  %5.1fx ascii  %5.1fx raw  enc %6.1f ns  dec %6.1f ns  max err %g  %s\n",
+		s->name, (double)bytes/n, 14.0*n/bytes, 8.0*n/bytes,
+		encTime*1e9/n, decTime*1e9/n, maxErr, bad ? "MISMATCH" : "ok");
+	free(t); free(v); free(t2); free(v2); free(blocks); free(sizes);
+}
+int main(int argc, char **argv)
+{
+	int n = argc > 1 ? atoi(argv[1]) : 200000;
+	const Series series[] = {
+		{"temperature lossless", 80, 0},
+		{"temperature 0.01", 80, 0.01f},
+		{"humidity lossless", 80, 0},
+		{"humidity 0.01", 80, 0.01f},
+		{"accel axis (mg)", 9, 0},
+	};
+	const int kinds[] = {0, 0, 1, 1, 2};
+	printf("%d samples per series, %d byte blocks\n", n, TSC_BLOCK_SIZE);
+	for(unsigned i=0;i<sizeof(series)/sizeof(series[0]);i++)
+	{
+		rng = 12345 + kinds[i];
+		run(&series[i], kinds[i], n);
+	}
+	return 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * tsc_dump.c
+ *
+ *  Decoder for the compressed TCP uplink (UPLINK_TSC in main.c). Reads the
+ *  length-prefixed frames from stdin and prints one CSV line per sample,
+ *  plain string frames (node info, activity state) are printed as comments.
+ *
+ *  build: cc -O2 -ICore/Inc -o tsc_dump Tools/tsc_dump.c Core/Src/tscompress.c
+ *  run:   nc -l 6666 | ./tsc_dump > samples.csv
+ */
+
+#include <stdio.h>
+#include "tscompress.h"
+
+static const char *seriesName[] = {"temperature", "humidity", "acc_x", "acc_y", "acc_z"};
+
+int main(void)
+{
+	static uint8_t frame[65536];
+	uint8_t len[4];
+	printf("series,tick_ms,value\n");
+	while(fread(len,1,4,stdin) == 4)
+	{
+		uint32_t size = (uint32_t)len[0]<<24 | (uint32_t)len[1]<<16 | (uint32_t)len[2]<<8 | len[3];
+		if(size > sizeof(frame))
+		{
+			fprintf(stderr,"frame of %u bytes, stream out of sync\n",size);
+			return 1;
+		}
+		if(fread(frame,1,size,stdin) != size) break;
+		if(size < 3 || frame[0] != 'T' || frame[1] != 'S')
+		{
+			printf("# %.*s\n",(int)size,(char*)frame);
+			continue;
+		}
+		uint8_t id = frame[2];
+		const char *name = id < sizeof(seriesName)/sizeof(seriesName[0]) ? seriesName[id] : "unknown";
+		TSC_DecoderTypeDef dec;
+		if(TSC_DecoderInit(&dec,frame+3,size-3) < 0) continue;
+		uint32_t t;
+		float v;
+		int r;
+		while((r = TSC_Next(&dec,&t,&v)) == 1) printf("%s,%u,%.4f\n",name,t,v);
+		if(r < 0) fprintf(stderr,"truncated %s block\n",name);
+	}
+	return 0;
+}
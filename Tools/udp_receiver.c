@@ -0,0 +1,187 @@
+/*
+ * udp_receiver.c
+ *
+ *  Host side of the UDP uplink (UPLINK_UDP in main.c, datagram layout in
+ *  Core/Inc/imu_stream.h). Prints once per second: datagrams, samples/s,
+ *  lost, reordered and duplicated datagrams, plus totals on Ctrl-C. Given a
+ *  trace file, the samples also go there as "x y z" lines in arrival order,
+ *  the input of Tools/gate_replay.c.
+ *
+ *  build: cc -O2 -o udp_receiver Tools/udp_receiver.c
+ *  run:   ./udp_receiver [port [trace.txt]]        (default 6667)
+ */
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HEADER_SIZE 16
+#define WINDOW 1024 //sequence numbers remembered for reorder/duplicate detection
+
+typedef struct{
+	uint64_t datagrams;
+	uint64_t samples;
+	uint64_t lost; //gaps in the sequence, reduced again when a late datagram fills one
+	uint64_t reordered;
+	uint64_t duplicates;
+	uint64_t malformed;
+} Counters;
+
+static volatile sig_atomic_t running = 1;
+static uint8_t seen[WINDOW];
+
+static void onSignal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+static uint16_t getU16(const uint8_t *p)
+{
+	return (uint16_t)(p[0]<<8 | p[1]);
+}
+static uint32_t getU32(const uint8_t *p)
+{
+	return (uint32_t)p[0]<<24 | (uint32_t)p[1]<<16 | (uint32_t)p[2]<<8 | p[3];
+}
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+static void report(const char *tag, const Counters *c, double seconds)
+{
+	uint64_t expected = c->datagrams - c->duplicates + c->lost;
+	printf("%s %7.1fs | datagrams %8llu | samples/s %8.1f | lost %6llu (%5.2f%%) | reordered %6llu | dup %4llu | bad %4llu\n",
+		tag, seconds, (unsigned long long)c->datagrams,
+		seconds > 0 ? c->samples/seconds : 0.0,
+		(unsigned long long)c->lost, expected ? 100.0*c->lost/expected : 0.0,
+		(unsigned long long)c->reordered, (unsigned long long)c->duplicates,
+		(unsigned long long)c->malformed);
+	fflush(stdout);
+}
+int main(int argc, char **argv)
+{
+	int port = argc > 1 ? atoi(argv[1]) : 6667;
+	FILE *trace = NULL;
+	if(argc > 2 && (trace = fopen(argv[2],"w")) == NULL)
+	{
+		perror(argv[2]);
+		return 1;
+	}
+	int fd = socket(AF_INET,SOCK_DGRAM,0);
+	if(fd < 0)
+	{
+		perror("socket");
+		return 1;
+	}
+	struct sockaddr_in addr;
+	memset(&addr,0,sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if(bind(fd,(struct sockaddr*)&addr,sizeof(addr)) < 0)
+	{
+		perror("bind");
+		return 1;
+	}
+	//wake up at least every 200ms so the report keeps ticking without traffic
+	struct timeval tv = {0, 200000};
+	setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof(tv));
+	signal(SIGINT,onSignal);
+	printf("listening on udp port %d\n",port);
+
+	Counters total = {0}, window = {0};
+	int started = 0;
+	uint32_t highest = 0; //highest sequence number seen so far
+	double start = 0, windowStart = 0;
+	uint8_t buf[2048];
+
+	while(running)
+	{
+		ssize_t n = recv(fd,buf,sizeof(buf),0);
+		double t = now();
+		if(n >= 0)
+		{
+			if(n < HEADER_SIZE || buf[0] != 'I' || buf[1] != 'M')
+			{
+				total.malformed++;
+				window.malformed++;
+				continue;
+			}
+			uint8_t channels = buf[3];
+			uint32_t seq = getU32(buf+4);
+			uint16_t count = getU16(buf+14);
+			if(channels == 0 || n != HEADER_SIZE + count*channels*2)
+			{
+				total.malformed++;
+				window.malformed++;
+				continue;
+			}
+			if(!started)
+			{
+				//the node may have been running before us, start counting at its first datagram
+				started = 1;
+				highest = seq;
+				start = windowStart = t;
+				memset(seen,0,sizeof(seen));
+				seen[seq%WINDOW] = 1;
+			}
+			else if((int32_t)(seq-highest) > 0)
+			{
+				uint32_t gap = seq-highest-1;
+				total.lost += gap;
+				window.lost += gap;
+				//clear the slots the window moved over
+				for(uint32_t s=highest+1;s!=seq+1 && s-highest<=WINDOW;s++) seen[s%WINDOW] = 0;
+				seen[seq%WINDOW] = 1;
+				highest = seq;
+			}
+			else if(highest-seq < WINDOW && !seen[seq%WINDOW])
+			{
+				//late arrival: it was counted as lost when the gap opened
+				seen[seq%WINDOW] = 1;
+				total.reordered++;
+				window.reordered++;
+				if(total.lost) total.lost--;
+				if(window.lost) window.lost--;
+			}
+			else
+			{
+				total.duplicates++;
+				window.duplicates++;
+				total.datagrams++;
+				window.datagrams++;
+				continue;
+			}
+			total.datagrams++;
+			window.datagrams++;
+			total.samples += count;
+			window.samples += count;
+			for(uint16_t i=0;trace && i<count;i++)
+			{
+				const uint8_t *p = buf + HEADER_SIZE + i*channels*2;
+				for(uint8_t c=0;c<channels;c++) fprintf(trace,c ? " %d" : "%d",(int16_t)getU16(p+2*c));
+				fputc('\n',trace);
+			}
+		}
+		if(started && t-windowStart >= 1.0)
+		{
+			report("1s   ",&window,t-windowStart);
+			memset(&window,0,sizeof(window));
+			windowStart = t;
+		}
+	}
+	if(started) report("total",&total,now()-start);
+	if(trace) fclose(trace);
+	close(fd);
+	return 0;
+}